@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+
+#
+#  This file is part of MADNESS.
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+#
+
+"""Merge the per-rank JSON traces of the task profiler into one trace.
+
+Run a program built with ENABLE_TASK_PROFILER=ON with
+
+    MAD_TASKPROFILER_NAME=prof MAD_TASKPROFILER_FORMAT=json
+
+which writes one file prof_<rank>x<threads>.json per process, then
+
+    taskprofile_merge.py -o trace.json prof_*.json
+
+and open trace.json with chrome://tracing or https://ui.perfetto.dev.
+Each process is shown as "rank N". Timestamps of each rank are shifted by
+the time of day recorded in its process_name record, so that events on
+different ranks line up (to within the skew of the node clocks).
+"""
+
+import argparse
+import json
+import sys
+
+
+def read_events(file_name):
+    """Read the events of one per-rank trace.
+
+    The profiler appends records from several threads, so each record ends
+    with a comma and the closing bracket is missing.
+    """
+    with open(file_name, 'r') as f:
+        text = f.read().strip()
+    if text.endswith(']'):
+        text = text[:-1].rstrip()
+    text = text.rstrip(',')
+    if not text.startswith('['):
+        raise ValueError(file_name + " is not a task profiler JSON trace")
+    return json.loads(text + ']')
+
+
+def epoch_of(events):
+    """Time of day (in microseconds) of time zero of a trace, or None."""
+    for e in events:
+        if e.get('ph') == 'M' and e.get('name') == 'process_name':
+            return e.get('args', {}).get('epoch')
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('files', nargs='+', help='per-rank JSON traces')
+    parser.add_argument('-o', '--output', default='-',
+                        help='merged trace (default: standard output)')
+    parser.add_argument('--no-align', action='store_true',
+                        help='do not shift the timestamps of the ranks')
+    args = parser.parse_args()
+
+    traces = [read_events(f) for f in args.files]
+    epochs = [epoch_of(t) for t in traces]
+    known = [e for e in epochs if e is not None]
+    origin = min(known) if known else 0.0
+
+    merged = []
+    ndropped = 0
+    for events, epoch in zip(traces, epochs):
+        shift = 0.0 if (args.no_align or epoch is None) else epoch - origin
+        for e in events:
+            if 'ts' in e:
+                e['ts'] = round(e['ts'] + shift, 3)
+            if e.get('name') == 'thread_name':
+                ndropped += e.get('args', {}).get('dropped', 0)
+            merged.append(e)
+
+    # Metadata first, then events in time order
+    merged.sort(key=lambda e: (e.get('ph') != 'M', e.get('ts', 0.0)))
+
+    out = sys.stdout if args.output == '-' else open(args.output, 'w')
+    json.dump({'traceEvents': merged, 'displayTimeUnit': 'ms'}, out)
+    if out is not sys.stdout:
+        out.close()
+
+    if ndropped:
+        print("warning: %d events were overwritten in the ring buffers "
+              "(increase MAD_TASKPROFILER_NEVENT)" % ndropped, file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
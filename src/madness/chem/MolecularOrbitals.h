@@ -273,7 +273,8 @@ public:
         std::string xc, localize_method;
 
 
-		archive::ParallelInputArchive<archive::BinaryFstreamInputArchive> ar(world, filename.c_str());
+		archive::AsyncFstreamOutputArchive::wait(); // SCF::save_mos writes in the background
+		archive::ParallelInputArchive<archive::MmapInputArchive> ar(world, filename.c_str());
         ar & version;
 		ar & current_energy & spinrestricted;
         ar & L& k1& molecule& xc & localize_method & converged_to_thresh;
@@ -309,7 +310,8 @@ public:
 	}
 
 	/// legacy code
-    void load_mos(archive::ParallelInputArchive<>& ar, const Molecule& molecule, const std::size_t nmo_from_input) {
+    template <typename localarchiveT>
+    void load_mos(archive::ParallelInputArchive<localarchiveT>& ar, const Molecule& molecule, const std::size_t nmo_from_input) {
 
 		unsigned int nmo = 0;
 
@@ -281,7 +281,10 @@ void SCF::copy_data(World& world, const SCF& other) {
 void SCF::save_mos(World& world) {
     PROFILE_MEMBER_FUNC(SCF);
     auto archivename=param.prefix()+".restartdata";
-    archive::ParallelOutputArchive<archive::BinaryFstreamOutputArchive> ar(world, archivename.c_str(), param.get<int>("nio"));
+    // the previous checkpoint may still be written in the background; keep at most one in flight
+    archive::AsyncFstreamOutputArchive::wait();
+    // one writer per process, so that each stages only its own part of the orbitals
+    archive::ParallelOutputArchive<archive::AsyncFstreamOutputArchive> ar(world, archivename.c_str(), world.size());
     // IF YOU CHANGE ANYTHING HERE MAKE SURE TO UPDATE THIS VERSION NUMBER
     /*
      * After spin restricted
@@ -330,7 +333,8 @@ void SCF::load_mos(World& world) {
     amo.clear();
     bmo.clear();
 
-    archive::ParallelInputArchive<archive::BinaryFstreamInputArchive> ar(world, param.prefix()+".restartdata");
+    archive::AsyncFstreamOutputArchive::wait(); // save_mos writes in the background
+    archive::ParallelInputArchive<archive::MmapInputArchive> ar(world, param.prefix()+".restartdata");
 
     /*
       File format:
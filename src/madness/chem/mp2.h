@@ -277,7 +277,7 @@ public:
         bool exists = archive::ParallelInputArchive<archive::BinaryFstreamInputArchive>::exists(world, name.c_str());
         if (exists) {
             if (world.rank() == 0) printf("loading matrix elements %s", name.c_str());
-            archive::ParallelInputArchive<archive::BinaryFstreamInputArchive> ar(world, name.c_str(), 1);
+            archive::ParallelInputArchive<archive::MmapInputArchive> ar(world, name.c_str(), 1);
             ar & *this;
             if (world.rank() == 0) printf(" %s\n", (converged) ? " converged" : " not converged");
             if (function.is_initialized()) function.set_thresh(FunctionDefaults<6>::get_thresh());
@@ -114,6 +114,7 @@ namespace madness {
         static bool truncate_on_project; ///< If true initial projection inserts at n-1 not n
         static bool apply_randomize;   ///< If true use randomization for load balancing in apply integral operator
         static bool project_randomize; ///< If true use randomization for load balancing in project/refine
+        static int reduction_priority; ///< Task priority of the upward reductions in tree traversals (compress, norm_tree, truncate)
         static std::optional<BoundaryConditions<NDIM>> bc; ///< Default boundary conditions, not initialized by default and must be set explicitly before use
         static Tensor<double> cell ;   ///< cell[NDIM][2] Simulation cell, cell(0,0)=xlo, cell(0,1)=xhi, ...
         static Tensor<double> cell_width;///< Width of simulation cell in each dimension
@@ -307,6 +308,23 @@ namespace madness {
         	project_randomize=value;
         }
 
+        /// Gets the task priority of the upward reductions in tree traversals
+        static int get_reduction_priority() {
+        	return reduction_priority;
+        }
+
+        /// Sets the task priority of the upward reductions in tree traversals
+
+        /// Reductions are on the critical path of compress, norm_tree and
+        /// truncate, and a level above 0 runs them ahead of bulk work.  The
+        /// default, 0, gives them normal priority: the first task of a
+        /// higher level switches the pool to its priority queues for the
+        /// rest of the run, so only ask for it where it pays off.
+        static void set_reduction_priority(int value) {
+        	MADNESS_ASSERT(value >= 0 && value < TaskAttributes::NPRIORITY);
+        	reduction_priority=value;
+        }
+
         /// Returns the default boundary conditions
         static const BoundaryConditions<NDIM>& get_bc() {
           if (!bc.has_value()) {
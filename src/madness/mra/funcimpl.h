@@ -926,6 +926,99 @@ template<size_t NDIM>
         return s;
     }
 
+    /// Screening of FunctionImpl::apply recorded for replay in later iterations
+
+    /// FunctionImpl::apply spawns one task per source node, and each task
+    /// walks the shells of operator displacements until they stop
+    /// contributing.  In SCF and response iterations the same operator is
+    /// applied over and over to functions with an unchanged tree, so the
+    /// walk finds the same displacements every time.  The first application
+    /// with a plan records, for each source node, the displacements whose
+    /// estimated contribution is within a factor \c margin of the screening
+    /// threshold.  Later applications of the same operator to a function with
+    /// the same tree skip the walk and process the local source nodes in
+    /// batches, only screening the recorded displacements against the current
+    /// coefficients.  A contribution that grew by more than 1/margin since the
+    /// capture is missed, so call clear() after large changes of the function.
+    ///
+    /// The plan is recorded again if the operator generation (see
+    /// SeparatedConvolution::generation()), the threshold, the wavelet order
+    /// or the tree structure on any process differ from the capture, so a new
+    /// operator constructed at the address of the recorded one is not
+    /// mistaken for it.  Plans are process-local and must not be shared by
+    /// applications that run concurrently.
+    template <std::size_t NDIM>
+    class ApplyPlan {
+    public:
+        typedef Key<NDIM> keyT;
+
+        /// Displacements estimated below margin times the threshold are not recorded
+        static constexpr double margin = 0.1;
+
+    private:
+        ConcurrentHashMap<keyT, std::vector<keyT> > disp; ///< Recorded displacements of each local source node
+        bool recorded = false;      ///< True once a recording was started
+        unsigned long generation = 0; ///< Generation of the operator that was recorded
+        double thresh = 0.0;        ///< Threshold of the recorded application
+        int k = 0;                  ///< Wavelet order of the recorded application
+        std::size_t nsource = 0;    ///< Number of local source nodes
+        hashT signature = 0;        ///< Sum of the hashes of the local source keys
+        std::size_t ncaptured = 0;  ///< Number of applications that recorded the plan
+        std::size_t nreplayed = 0;  ///< Number of applications that replayed the plan
+
+    public:
+        ApplyPlan() = default;
+        ApplyPlan(const ApplyPlan&) = delete;
+        ApplyPlan& operator=(const ApplyPlan&) = delete;
+
+        /// True if the plan was recorded for this operator and tree (local check only)
+        bool matches(unsigned long generation, double thresh, int k, std::size_t nsource, hashT signature) const {
+            return recorded && this->generation == generation && this->thresh == thresh && this->k == k
+                && this->nsource == nsource && this->signature == signature;
+        }
+
+        /// Forgets any previous recording and starts a new one
+        void begin_capture(unsigned long generation, double thresh, int k, std::size_t nsource, hashT signature) {
+            disp.clear();
+            this->generation = generation;
+            this->thresh = thresh;
+            this->k = k;
+            this->nsource = nsource;
+            this->signature = signature;
+            recorded = true;
+            ++ncaptured;
+        }
+
+        /// Records the displacements of a source node (called from tasks)
+        void record(const keyT& key, std::vector<keyT>&& d) {
+            typename ConcurrentHashMap<keyT, std::vector<keyT> >::accessor acc;
+            [[maybe_unused]] auto inserted = disp.insert(acc, key);
+            acc->second = std::move(d);
+        }
+
+        /// Counts an application that replays the plan
+        void begin_replay() { ++nreplayed; }
+
+        /// Recorded displacements of a source node, or null if there are none
+        const std::vector<keyT>* find(const keyT& key) const {
+            typename ConcurrentHashMap<keyT, std::vector<keyT> >::const_iterator it = disp.find(key);
+            return (it == disp.end()) ? nullptr : &it->second;
+        }
+
+        /// Discards the recording, so that the next application records again
+        void clear() {
+            disp.clear();
+            recorded = false;
+            generation = 0;
+        }
+
+        /// Number of applications that recorded the plan
+        std::size_t get_ncaptured() const { return ncaptured; }
+
+        /// Number of applications that replayed the plan
+        std::size_t get_nreplayed() const { return nreplayed; }
+    };
+
     /// FunctionImpl holds all Function state to facilitate shallow copy semantics
 
     /// Since Function assignment and copy constructors are shallow it
@@ -1328,6 +1421,10 @@ template<size_t NDIM>
             ar & k & thresh & initial_level & max_refine_level & truncate_mode
                 & autorefine & truncate_on_project & tree_state;//nonstandard & compressed ; //& bc;
 
+            // lossy compression is relative to the truncation tolerance of each node
+            std::vector<double> tol(MAXLEVEL+1);
+            for (int n=0; n<=MAXLEVEL; ++n) tol[n] = truncate_tol(thresh, keyT(n));
+            TensorCompression::ScopedThreshold compression_thresh(std::move(tol));
             ar & coeffs;
             world.gop.fence();
         }
@@ -4673,6 +4770,30 @@ template<size_t NDIM>
         void remove_leaf_coefficients(const bool fence);
 
 
+        /// Task attributes of the upward (children to parent) reductions of tree traversals
+
+        /// \sa FunctionDefaults::set_reduction_priority
+        static TaskAttributes reduction_attributes() {
+            return TaskAttributes::priority(FunctionDefaults<NDIM>::get_reduction_priority());
+        }
+
+        /// Task attributes of the work on node \c key in tree traversals (apply, compress)
+
+        /// The nodes below one box of level 2 prefer the same NUMA domain, so
+        /// that the tensors their tasks create are used by threads near the
+        /// memory they were first touched in. Only a hint: it takes effect
+        /// with NUMA-aware task placement (\c MAD_TASK_NUMA=on) and is ignored
+        /// by prioritized tasks.
+        /// \sa TaskAttributes::set_numa_domain
+        static TaskAttributes node_attributes(const keyT& key, TaskAttributes attr = TaskAttributes()) {
+            const int ndomain = numa_topology.get_ndomain();
+            if (ndomain > 1) {
+                const Level n = key.level();
+                attr.set_numa_domain(int(key.parent(n > 2 ? n-2 : 0).hash() % ndomain));
+            }
+            return attr;
+        }
+
         /// compute for each FunctionNode the norm of the function inside that node
         void norm_tree(bool fence);
 
@@ -4876,8 +4997,9 @@ template<size_t NDIM>
         /// @param[in] op	the operator to act on the source function
         /// @param[in] key	key of the source FunctionNode of f which is processed
         /// @param[in] c	coeffs of the FunctionNode of f which is processed
+        /// @param[in] plan	if not null, the displacements that may contribute are recorded here
         template <typename opT, typename R>
-        void do_apply(const opT* op, const keyT& key, const Tensor<R>& c) {
+        void do_apply(const opT* op, const keyT& key, const Tensor<R>& c, ApplyPlan<NDIM>* plan) {
             PROFILE_MEMBER_FUNC(FunctionImpl);
 
           // working assumption here WAS that the operator is
@@ -4915,6 +5037,7 @@ template<size_t NDIM>
           // previously fac=10.0 selected empirically constrained by qmprop
 
           double cnorm = c.normf();
+          std::vector<keyT> recorded; // displacements kept in the plan
 
           // BC handling:
           // - if operator is lattice-summed then treat this as nonperiodic (i.e. tell neighbor() to stay in simulation cell)
@@ -5001,6 +5124,10 @@ template<size_t NDIM>
               if (dest.is_valid()) {
                 nvalid++;
                 const double opnorm = op->norm(key.level(), displacement, source);
+                if constexpr (opdim == NDIM) {
+                  if (plan && cnorm * opnorm > ApplyPlan<NDIM>::margin * tol / fac)
+                    recorded.push_back(displacement);
+                }
 
                 if (cnorm * opnorm > tol / fac) {
                   tensorT result =
@@ -5062,14 +5189,115 @@ template<size_t NDIM>
                 [](const auto &displacement) -> std::uint64_t { return 0; },
                 default_skip_predicate);
           }
+
+          if (plan) plan->record(key, std::move(recorded));
         }
 
 
+        /// apply the recorded displacements of a plan to a batch of local source nodes
+
+        /// the result is accumulated inplace to this's tree, screening as in do_apply
+        /// @param[in] op	the operator to act on the source function
+        /// @param[in] f	the source function
+        /// @param[in] plan	the plan recorded by an earlier application
+        /// @param[in] keys	keys of the local source nodes of f to process
+        template <typename opT, typename R>
+        void do_apply_planned(const opT* op, const FunctionImpl<R,NDIM>* f, const ApplyPlan<NDIM>* plan,
+                              const std::vector<keyT>& keys) {
+            PROFILE_MEMBER_FUNC(FunctionImpl);
+            static_assert(opT::opdim == NDIM, "apply plans need an operator acting on all dimensions");
+
+            // same screening parameters as do_apply
+            const double radius = 1.5 + 0.33 * std::max(0.0, 2 - std::log10(thresh) - k);
+            const double fac = vol_nsphere(NDIM, radius);
+            const array_of_bools<NDIM> func_is_treated_by_op_as_periodic =
+                array_of_bools<NDIM>{false}.or_front(op->func_domain_is_periodic());
+
+            for (const keyT& key : keys) {
+                const std::vector<keyT>* disp = plan->find(key);
+                const Tensor<R> c = f->coeffs.find(key).get()->second.coeff().reconstruct_tensor();
+                if (!disp) {
+                    // not seen during the capture, so screen it the usual way
+                    do_apply(op, key, c, static_cast<ApplyPlan<NDIM>*>(nullptr));
+                    continue;
+                }
+
+                const keyT source = op->get_source_key(key);
+                const double cnorm = c.normf();
+                const double tol = truncate_tol(thresh, key) / fac;
+                for (const keyT& displacement : *disp) {
+                    const keyT dest = neighbor(key, displacement, func_is_treated_by_op_as_periodic);
+                    const double opnorm = op->norm(key.level(), displacement, source);
+                    if (cnorm * opnorm > tol) {
+                        tensorT result = op->apply(source, displacement, c, tol / cnorm);
+                        if (result.normf() > 0.3 * tol) {
+                            if (coeffs.is_local(dest))
+                                coeffs.send(dest, &nodeT::accumulate2, result, coeffs, dest);
+                            else
+                                coeffs.task(dest, &nodeT::accumulate2, result, coeffs, dest);
+                        }
+                    }
+                }
+            }
+        }
+
+        /// replay a plan for the application of op to f, if it was recorded for both
+
+        /// collective; if the plan does not match on every process it is reset
+        /// to record the coming application and false is returned
+        template <typename opT, typename R>
+        bool replay_apply_plan(const opT& op, const FunctionImpl<R,NDIM>& f, ApplyPlan<NDIM>& plan) {
+            std::vector<keyT> keys;
+            hashT signature = 0;
+            typename FunctionImpl<R,NDIM>::dcT::const_iterator end = f.coeffs.end();
+            for (typename FunctionImpl<R,NDIM>::dcT::const_iterator it=f.coeffs.begin(); it!=end; ++it) {
+                const FunctionNode<R,NDIM>& node = it->second;
+                if (node.has_coeff() && (node.coeff().dim(0) != k || op.doleaves)) {
+                    keys.push_back(it->first);
+                    signature += it->first.hash();
+                }
+            }
+
+            int same = plan.matches(op.generation(), thresh, k, keys.size(), signature);
+            world.gop.min(same);
+            if (!same) {
+                plan.begin_capture(op.generation(), thresh, k, keys.size(), signature);
+                return false;
+            }
+
+            // several nodes per task; small enough batches to keep all threads busy
+            plan.begin_replay();
+            const std::size_t nbatch = std::max<std::size_t>(1,
+                    std::min<std::size_t>(32, keys.size() / (8 * (ThreadPool::size() + 1))));
+            for (std::size_t i = 0; i < keys.size(); i += nbatch) {
+                std::vector<keyT> batch(keys.begin() + i, keys.begin() + std::min(keys.size(), i + nbatch));
+                woT::task(world.rank(), &implT:: template do_apply_planned<opT,R>, &op, &f, &plan, batch);
+            }
+            return true;
+        }
+
         /// apply an operator on f to return this
+
+        /// @param[in] op	the operator to act on the source function
+        /// @param[in] f	the source function
+        /// @param[in] fence	fence after the application
+        /// @param[in] plan	if not null, record the screening in this plan or replay it (see ApplyPlan)
         template <typename opT, typename R>
-        void apply(opT& op, const FunctionImpl<R,NDIM>& f, bool fence) {
+        void apply(opT& op, const FunctionImpl<R,NDIM>& f, bool fence, ApplyPlan<NDIM>* plan = nullptr) {
             PROFILE_MEMBER_FUNC(FunctionImpl);
             MADNESS_ASSERT(!op.modified());
+
+            // plans are kept where the source node lives, and only for operators on all dimensions
+            if (opT::opdim != NDIM || FunctionDefaults<NDIM>::get_apply_randomize()) plan = nullptr;
+            if constexpr (opT::opdim == NDIM) {
+                if (plan && replay_apply_plan(op, f, *plan)) {
+                    if (fence)
+                        world.gop.fence();
+                    set_tree_state(nonstandard_after_apply);
+                    return;
+                }
+            }
+
             typename dcT::const_iterator end = f.coeffs.end();
             for (typename dcT::const_iterator it=f.coeffs.begin(); it!=end; ++it) {
                 // looping through all the coefficients in the source
@@ -5079,7 +5307,8 @@ template<size_t NDIM>
                     if (node.coeff().dim(0) != k /* i.e. not a leaf */ || op.doleaves) {
                         ProcessID p = FunctionDefaults<NDIM>::get_apply_randomize() ? world.random_proc() : coeffs.owner(key);
 //                        woT::task(p, &implT:: template do_apply<opT,R>, &op, key, node.coeff()); //.full_tensor_copy() ????? why copy ????
-                        woT::task(p, &implT:: template do_apply<opT,R>, &op, key, node.coeff().reconstruct_tensor());
+                        woT::task(p, &implT:: template do_apply<opT,R>, &op, key, node.coeff().reconstruct_tensor(),
+                                  (p == world.rank()) ? plan : nullptr, node_attributes(key));
                     }
                 }
             }
@@ -7391,6 +7620,35 @@ template<size_t NDIM>
                 ArchiveStoreImpl<Archive, FunctionImpl<T,NDIM>*>::store(ar, ptr.get());
             }
         };
+
+        /// ApplyPlans are process-local, tasks sent elsewhere run without one
+        template <class Archive, std::size_t NDIM>
+        struct ArchiveLoadImpl<Archive, ApplyPlan<NDIM>*> {
+            static void load(const Archive& ar, ApplyPlan<NDIM>*& ptr) {
+                ptr = nullptr;
+            }
+        };
+
+        template <class Archive, std::size_t NDIM>
+        struct ArchiveStoreImpl<Archive, ApplyPlan<NDIM>*> {
+            static void store(const Archive& ar, ApplyPlan<NDIM>*const& ptr) {
+                MADNESS_ASSERT(!ptr);
+            }
+        };
+
+        template <class Archive, std::size_t NDIM>
+        struct ArchiveLoadImpl<Archive, const ApplyPlan<NDIM>*> {
+            static void load(const Archive& ar, const ApplyPlan<NDIM>*& ptr) {
+                ptr = nullptr;
+            }
+        };
+
+        template <class Archive, std::size_t NDIM>
+        struct ArchiveStoreImpl<Archive, const ApplyPlan<NDIM>*> {
+            static void store(const Archive& ar, const ApplyPlan<NDIM>*const& ptr) {
+                MADNESS_ASSERT(!ptr);
+            }
+        };
     }
 
 }
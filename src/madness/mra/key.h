@@ -37,6 +37,7 @@
 
 #include <madness/mra/bc.h>
 #include <madness/mra/power.h>
+#include <madness/tensor/tensor_compression.h>
 #include <madness/world/vector.h>
 #include <madness/world/binary_fstream_archive.h>
 #include <madness/world/worldhash.h>
@@ -563,6 +564,8 @@ namespace madness {
         template <class Archive, std::size_t NDIM>
         struct ArchiveStoreImpl< Archive, Key<NDIM> > {
             static void store(const Archive& ar, const Key<NDIM>& t) {
+                // the node stored next is compressed relative to its level
+                if constexpr (is_file_output_archive<Archive>::value) TensorCompression::set_level(t.level());
                 ar & archive::wrap((unsigned char*) &t, sizeof(t));
             }
         };
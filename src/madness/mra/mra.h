@@ -88,6 +88,7 @@ namespace madness {
 #include <madness/mra/funcdefaults.h>
 #include <madness/mra/function_factory.h>
 #include <madness/mra/lbdeux.h>
+#include <madness/mra/sfcpmap.h>
 #include <madness/mra/funcimpl.h>
 
 // some forward declarations
@@ -2226,9 +2227,13 @@ namespace madness {
 
 
     /// Apply operator ONLY in non-standard form - required other steps missing !!
+
+    /// If a plan is given the screening of the source nodes is recorded in it,
+    /// or replayed from it when op and the tree of f did not change (see
+    /// ApplyPlan); plans are only used in up to 3 dimensions.
     template <typename opT, typename R, std::size_t NDIM>
     Function<TENSOR_RESULT_TYPE(typename opT::opT,R), NDIM>
-    apply_only(const opT& op, const Function<R,NDIM>& f, bool fence=true) {
+    apply_only(const opT& op, const Function<R,NDIM>& f, bool fence=true, ApplyPlan<NDIM>* plan=nullptr) {
         Function<TENSOR_RESULT_TYPE(typename opT::opT,R), NDIM> result;
 
         constexpr std::size_t OPDIM=opT::opdim;
@@ -2237,7 +2242,7 @@ namespace madness {
         // specialized version for 3D
         if (NDIM <= 3 and (not low_dim)) {
             result.set_impl(f, false);
-            result.get_impl()->apply(op, *f.get_impl(), fence);
+            result.get_impl()->apply(op, *f.get_impl(), fence, plan);
 
         } else {        // general version for higher dimension
 	  //bool print_timings=false;
@@ -2272,9 +2277,13 @@ namespace madness {
     /// g.particle=2                          g(f) = result(x,y)
     ///                 inner(g(y,y'),f(x,y'),1,1) = result(y,x)
     /// also note the confusion with the counting of the particles/integration variables
+    ///
+    /// In iterations that apply the same operator to functions with the same
+    /// tree, pass the same ApplyPlan every time to skip the screening of the
+    /// source nodes after the first application.
     template <typename opT, typename R, std::size_t NDIM>
     Function<TENSOR_RESULT_TYPE(typename opT::opT,R), NDIM>
-    apply(const opT& op, const Function<R,NDIM>& f, bool fence=true) {
+    apply(const opT& op, const Function<R,NDIM>& f, bool fence=true, ApplyPlan<NDIM>* plan=nullptr) {
 
     	typedef TENSOR_RESULT_TYPE(typename opT::opT,R) resultT;
     	Function<R,NDIM>& ff = const_cast< Function<R,NDIM>& >(f);
@@ -2306,7 +2315,7 @@ namespace madness {
                 fff.get_impl()->timer_filter.print("filter");
                 fff.get_impl()->timer_compress_svd.print("compress_svd");
             }
-            result = apply_only(op, fff, fence);
+            result = apply_only(op, fff, fence, plan);
             result.get_impl()->set_tree_state(nonstandard_after_apply);
         	ff.world().gop.fence();
             if (print_timings) result.print_size("result after apply_only");
@@ -2890,7 +2899,7 @@ namespace madness {
 
     template <class T, std::size_t NDIM>
     void load(Function<T,NDIM>& f, const std::string name) {
-        archive::ParallelInputArchive<archive::BinaryFstreamInputArchive> ar2(f.world(), name.c_str(), 1);
+        archive::ParallelInputArchive<archive::MmapInputArchive> ar2(f.world(), name.c_str(), 1);
         ar2 & f;
     }
 
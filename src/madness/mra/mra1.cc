@@ -42,11 +42,11 @@ namespace madness {
 
     template <>
     ConcurrentHashMap< hashT, std::shared_ptr< GaussianConvolution1D<double> > >
-    GaussianConvolution1DCache<double>::map = {};
+    GaussianConvolution1DCache<double>::map = {1021, Hash<hashT>(), true};
 
     template <>
     ConcurrentHashMap< hashT, std::shared_ptr< GaussianConvolution1D<double_complex> > >
-    GaussianConvolution1DCache<double_complex>::map = {};
+    GaussianConvolution1DCache<double_complex>::map = {1021, Hash<hashT>(), true};
 
 #ifdef FUNCTION_INSTANTIATE_1
 
@@ -1575,7 +1575,14 @@ namespace madness {
             for (KeyChildIterator<NDIM> kit(key); kit; ++kit,++i) {
                 v[i] = woT::task(coeffs.owner(kit.key()), &implT::norm_tree_spawn, kit.key());
             }
-            return woT::task(world.rank(),&implT::norm_tree_op, key, v);
+            // Combining the child norms is cheap so it runs inline on the thread
+            // that sets the last child norm, unless that is the communication
+            // thread (a remote child): then it is queued like the other reductions
+            return when_all(v, [this, key](const std::vector< Future<double> >& v) {
+                if (RMI::get_this_thread_is_server())
+                    return woT::task(world.rank(), &implT::norm_tree_op, key, v, reduction_attributes());
+                return Future<double>(norm_tree_op(key, v));
+            });
         }
         else {
             //                return Future<double>(node.coeff().normf());
@@ -2622,7 +2629,9 @@ namespace madness {
             for (KeyChildIterator<NDIM> kit(key); kit; ++kit,++i) {
                 v[i] = woT::task(coeffs.owner(kit.key()), &implT::truncate_spawn, kit.key(), tol, TaskAttributes::generator());
             }
-            return woT::task(world.rank(),&implT::truncate_op, key, tol, v);
+            // Not an inline continuation as in norm_tree: truncate_op computes
+            // a norm and erases children, too much for the communication thread
+            return woT::task(world.rank(),&implT::truncate_op, key, tol, v, reduction_attributes());
         }
         else {
             // In compressed form leaves should not have coeffs ... however the
@@ -3283,8 +3292,10 @@ template <typename T, std::size_t NDIM>
                 v[i] = woT::task(coeffs.owner(kit.key()), &implT::compress_spawn, kit.key(),
                                  nonstandard1, keepleaves, redundant1, TaskAttributes::hipri());
             }
-            if (redundant1) return woT::task(world.rank(),&implT::make_redundant_op, key, v);
-            return woT::task(world.rank(),&implT::compress_op, key, v, nonstandard1);
+            if (redundant1) return woT::task(world.rank(),&implT::make_redundant_op, key, v,
+                                             node_attributes(key, reduction_attributes()));
+            return woT::task(world.rank(),&implT::compress_op, key, v, nonstandard1,
+                             node_attributes(key, reduction_attributes()));
         }
 
         // leaf node -> remove coefficients here and pass them back to parent for filtering
@@ -3550,6 +3561,7 @@ template <typename T, std::size_t NDIM>
         truncate_on_project = true;
         apply_randomize = false;
         project_randomize = false;
+        reduction_priority = 0;
         if (!bc.has_value()) bc = BoundaryConditions<NDIM>(BC_FREE);
         tt = TT_FULL;
         cell = make_default_cell();
@@ -3559,6 +3571,10 @@ template <typename T, std::size_t NDIM>
 
     template <std::size_t NDIM>
     std::shared_ptr< WorldDCPmapInterface< Key<NDIM> > > FunctionDefaults<NDIM>::make_default_pmap(World& world) {
+        // MAD_PMAP=sfc keeps subtrees together in Morton order; balance it with LoadBalanceSFC
+        const char* env = std::getenv("MAD_PMAP");
+        if (env && std::string(env) == "sfc")
+            return std::make_shared<SFCPmap<NDIM>>(world, SFCPmap<NDIM>::default_level(world));
         // return std::make_shared<WorldDCDefaultPmap< Key<NDIM> >>(world);
         return std::make_shared<LevelPmap< Key<NDIM> >>(world);
         // return std::make_shared<SimplePmap< Key<NDIM> >>(world);
@@ -3587,6 +3603,7 @@ template <typename T, std::size_t NDIM>
     		std::cout << "             truncate_on_project" <<  ": " << truncate_on_project << std::endl;
     		std::cout << "                 apply_randomize" <<  ": " << apply_randomize << std::endl;
     		std::cout << "               project_randomize" <<  ": " << project_randomize << std::endl;
+    		std::cout << "              reduction_priority" <<  ": " << reduction_priority << std::endl;
     		std::cout << "                              bc" <<  ": " << get_bc() << std::endl;
     		std::cout << "                              tt" <<  ": " << tt << std::endl;
     		std::cout << "                            cell" <<  ": " << cell << std::endl;
@@ -3608,6 +3625,7 @@ template <typename T, std::size_t NDIM>
     template <std::size_t NDIM> bool FunctionDefaults<NDIM>::truncate_on_project = true;
     template <std::size_t NDIM> bool FunctionDefaults<NDIM>::apply_randomize = false;
     template <std::size_t NDIM> bool FunctionDefaults<NDIM>::project_randomize = false;
+    template <std::size_t NDIM> int FunctionDefaults<NDIM>::reduction_priority = 0;
     template <std::size_t NDIM> std::optional<BoundaryConditions<NDIM>> FunctionDefaults<NDIM>::bc;
     template <std::size_t NDIM> TensorType FunctionDefaults<NDIM>::tt = TT_FULL;
     template <std::size_t NDIM> Tensor<double> FunctionDefaults<NDIM>::cell = FunctionDefaults<NDIM>::make_default_cell();
@@ -37,6 +37,7 @@
 
 /// \ingroup function
 
+#include <atomic>
 #include <type_traits>
 #include <limits.h>
 #include <madness/mra/adquad.h>
@@ -78,6 +79,14 @@ namespace madness {
     template<typename T, std::size_t NDIM>
     CCPairFunction<T,NDIM> apply(const SeparatedConvolution<T,NDIM/2>& op, const CCPairFunction<T,NDIM>& argument);
 
+    namespace detail {
+        /// Returns a generation number for SeparatedConvolution, never returned before in this process
+        inline unsigned long next_operator_generation() {
+            static std::atomic<unsigned long> counter{0};
+            return ++counter;
+        }
+    }
+
     /// SeparatedConvolutionInternal keeps data for 1 term and all dimensions and 1 displacement
     /// Why is this here?? Why don't you just use ConvolutionND in SeparatedConvolutionData??
     template <typename Q, std::size_t NDIM>
@@ -181,6 +190,8 @@ namespace madness {
         mutable SimpleCache< SeparatedConvolutionData<Q,NDIM>, NDIM > data; ///< cache for all terms, dims and displacements
         mutable SimpleCache< SeparatedConvolutionData<Q,NDIM>, 2*NDIM > mod_data; ///< cache for all terms, dims and displacements
 
+        unsigned long generation_ = detail::next_operator_generation(); ///< Renewed whenever the kernel or boundary treatment changes
+
     public:
 
         bool& modified() {return modified_;}
@@ -205,6 +216,14 @@ namespace madness {
         const std::array<KernelRange, NDIM>& get_range() const { return range; }
         bool range_restricted() const { return std::any_of(range.begin(), range.end(), [](const auto& v) { return v.finite(); }); }
 
+        /// Identifies the kernel and boundary treatment of this operator
+
+        /// Distinct operators, or one operator before and after initialize() or
+        /// set_domain_periodicity(), never share a generation in a process,
+        /// even if one is constructed at the address of another.  Used to
+        /// match an ApplyPlan to the operator it was recorded for.
+        unsigned long generation() const { return generation_; }
+
     private:
 
         /// laziness for calling lists: which terms to apply
@@ -1083,6 +1102,7 @@ namespace madness {
         }
 
         void initialize(const Tensor<Q>& coeff, const Tensor<double>& expnt, std::array<LatticeRange, NDIM> lattice_range, std::array<KernelRange, NDIM> range = {}, const Vector<double, NDIM>& bloch_k = Vector<double, NDIM>(0.0)) {
+            generation_ = detail::next_operator_generation();
             const Tensor<double>& width = FunctionDefaults<NDIM>::get_cell_width();
             const double pi = constants::pi;
 
@@ -1129,7 +1149,10 @@ namespace madness {
         const array_of_bools<NDIM>& func_domain_is_periodic() const { return func_domain_is_periodic_; }
         /// changes domain periodicity
         /// \param domain_is_periodic
-        void set_domain_periodicity(const array_of_bools<NDIM>& domain_is_periodic) { func_domain_is_periodic_ = domain_is_periodic;}
+        void set_domain_periodicity(const array_of_bools<NDIM>& domain_is_periodic) {
+            func_domain_is_periodic_ = domain_is_periodic;
+            generation_ = detail::next_operator_generation();
+        }
 
         /// return the operator norm for all terms, all dimensions and 1 displacement
         double norm(Level n, const Key<NDIM>& d, const Key<NDIM>& source_key) const {
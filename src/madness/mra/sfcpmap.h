@@ -0,0 +1,274 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+
+  $Id$
+*/
+#ifndef MADNESS_MRA_SFCPMAP_H__INCLUDED
+#define MADNESS_MRA_SFCPMAP_H__INCLUDED
+
+#include <madness/madness_config.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <madness/world/worlddc.h>
+#include <madness/world/worldhashmap.h>
+
+#include <madness/mra/key.h>
+
+/// \file mra/sfcpmap.h
+/// \brief Implements a process map along a space-filling curve, and load balancing for it
+/// \ingroup function
+
+namespace madness {
+
+	template<typename T, std::size_t NDIM>
+	class FunctionNode;
+
+	template<typename T, std::size_t NDIM>
+	class Function;
+
+    /// Maps whole subtrees to processes in Morton (Z) order
+
+    /// The boxes at level \c level are the roots of the subtrees. They are
+    /// numbered along the Morton curve, which is cut into one contiguous
+    /// range of boxes per process. A key below \c level belongs to the
+    /// process of its ancestor at \c level, so a subtree lives on a single
+    /// process and compress, reconstruct and the traversals of apply only
+    /// cross the network above \c level. A key above \c level belongs to
+    /// the process of its first descendant at \c level (process zero for
+    /// the root), so it shares that process with at least one child.
+    ///
+    /// Neighbouring subtrees go to the same process, and moving a cut only
+    /// moves the subtrees between the old and the new position, so that
+    /// rebalancing after a small change of the costs, or of the number of
+    /// processes, moves little data. Use \c LoadBalanceSFC to place the
+    /// cuts by the cost of the subtrees.
+    template <std::size_t NDIM>
+    class SFCPmap : public WorldDCPmapInterface< Key<NDIM> > {
+        typedef Key<NDIM> keyT;
+        Level level;                  ///< Level of the roots of the subtrees
+        std::vector<std::uint64_t> cuts; ///< First box of processes 1, 2, ...
+
+    public:
+        /// Deepest level of the subtree roots; their Morton index must fit in 64 bits
+
+        /// NDIM=0 is only instantiated (never used) by the dimension-reducing
+        /// operations of Function<T,1>.
+        static constexpr Level max_level = 62/(NDIM ? NDIM : 1);
+
+        /// Returns a level giving at least 64 subtrees per process
+        static Level default_level(World& world) {
+            Level n = 1;
+            while (n < max_level && (std::uint64_t(1) << (NDIM*n)) < 64*std::uint64_t(world.size())) ++n;
+            return n;
+        }
+
+        /// Cuts the curve into equal numbers of boxes
+        SFCPmap(World& world, Level level) : level(std::min(level, max_level)), cuts(world.size()-1) {
+            const std::uint64_t nbox = std::uint64_t(1) << (NDIM*this->level);
+            for (std::size_t p=0; p<cuts.size(); ++p)
+                cuts[p] = std::uint64_t((p+1)*(double(nbox)/world.size()));
+        }
+
+        /// Cuts the curve at the given boxes
+
+        /// \param[in] level Level of the roots of the subtrees.
+        /// \param[in] cuts Morton index of the first box of processes 1, 2, ... nproc-1, ascending.
+        SFCPmap(World& world, Level level, const std::vector<std::uint64_t>& cuts) : level(level), cuts(cuts) {
+            MADNESS_CHECK(level <= max_level);
+            MADNESS_CHECK(cuts.size() == std::size_t(world.size()-1));
+            MADNESS_CHECK(std::is_sorted(cuts.begin(), cuts.end()));
+        }
+
+        /// Returns the Morton index of the box at \c level holding the key (or its first descendant there)
+        std::uint64_t box(const keyT& key) const {
+            const Level n = key.level();
+            const Level m = std::min(n, level);
+            const Vector<Translation,NDIM>& l = key.translation();
+            std::uint64_t index = 0;
+            for (Level b=n-1; b>=n-m; --b) {
+                for (std::size_t d=0; d<NDIM; ++d) index = (index << 1) | ((l[d] >> b) & 0x1);
+            }
+            return index << (NDIM*(level-m));
+        }
+
+        ProcessID owner(const keyT& key) const {
+            return std::upper_bound(cuts.begin(), cuts.end(), box(key)) - cuts.begin();
+        }
+
+        Level get_level() const {
+            return level;
+        }
+
+        const std::vector<std::uint64_t>& get_cuts() const {
+            return cuts;
+        }
+
+        void print() const {
+            madness::print("SFCPmap at level", level, "cuts", cuts);
+        }
+    };
+
+
+    /// Load balancing by cutting the Morton curve of subtrees into equal costs
+
+    /// Used like \c LoadBalanceDeux
+    /// \code
+    ///   LoadBalanceSFC<3> lb(world);
+    ///   auto cost = [](const Key<3>& key, const FunctionNode<double,3>& node) {
+    ///       return node.has_children() ? 8.0 : 1.0;
+    ///   };
+    ///   lb.add_tree(rho, cost);
+    ///   FunctionDefaults<3>::redistribute(world, lb.load_balance());
+    /// \endcode
+    /// The cost of every node is added to the box of its subtree on the
+    /// process holding it, without messages; the boxes are then gathered on
+    /// process zero, which places the cuts.
+    template <std::size_t NDIM>
+    class LoadBalanceSFC {
+        typedef Key<NDIM> keyT;
+        typedef ConcurrentHashMap<std::uint64_t,double> costmapT;
+        World& world;
+        SFCPmap<NDIM> boxes; ///< Only used to number the boxes
+        costmapT costs;      ///< Local cost of each box
+
+        template <typename T, typename costT>
+        struct add_op {
+            LoadBalanceSFC* lb;
+            const costT& costfn;
+            add_op(LoadBalanceSFC* lb, const costT& costfn) : lb(lb), costfn(costfn) {}
+            void operator()(const keyT& key, const FunctionNode<T,NDIM>& node) const {
+                typename costmapT::accessor acc;
+                [[maybe_unused]] auto inserted = lb->costs.insert(acc, lb->boxes.box(key));
+                acc->second += costfn(key,node);
+            }
+        };
+
+        /// Every node costs one
+        struct count_nodes {
+            template <typename T>
+            double operator()(const keyT& key, const FunctionNode<T,NDIM>& node) const {
+                return 1.0;
+            }
+        };
+
+        /// Returns the largest cost of a process for the given cuts
+        static double max_cost(const std::vector< std::pair<std::uint64_t,double> >& v,
+                               const std::vector<std::uint64_t>& cuts) {
+            double cmax = 0.0, c = 0.0;
+            std::size_t p = 0;
+            for (const auto& box : v) {
+                for (; p<cuts.size() && box.first >= cuts[p]; ++p) {
+                    cmax = std::max(cmax, c);
+                    c = 0.0;
+                }
+                c += box.second;
+            }
+            return std::max(cmax, c);
+        }
+
+    public:
+        /// \param[in] level Level of the roots of the subtrees, by default \c SFCPmap::default_level().
+        LoadBalanceSFC(World& world, Level level = -1)
+                : world(world)
+                , boxes(world, level < 0 ? SFCPmap<NDIM>::default_level(world) : level) {
+        }
+
+        /// Accumulates cost from a function
+
+        /// \param[in] costfn Returns the cost of a node given its key and the node.
+        template <typename T, typename costT>
+        void add_tree(const Function<T,NDIM>& f, const costT& costfn, bool fence=false) {
+            const_cast<Function<T,NDIM>&>(f).unaryop_node(add_op<T,costT>(this,costfn), fence);
+        }
+
+        /// Accumulates the number of nodes of a function
+        template <typename T>
+        void add_tree(const Function<T,NDIM>& f, bool fence=false) {
+            add_tree(f, count_nodes(), fence);
+        }
+
+        /// Places the cuts so that all processes get about the same cost
+
+        /// If \c current is given (and has the same level and number of
+        /// processes) and none of its processes is above the average cost by
+        /// more than a fraction \c tolerance, it is returned unchanged so that
+        /// redistributing moves nothing.
+        /// \param[in] tolerance Allowed imbalance of \c current.
+        /// \param[in] current The process map in use.
+        /// \return The new process map.
+        std::shared_ptr< WorldDCPmapInterface<keyT> >
+        load_balance(double tolerance = 0.0, std::shared_ptr< WorldDCPmapInterface<keyT> > current = nullptr) {
+            world.gop.fence();
+            std::vector< std::pair<std::uint64_t,double> > v;
+            v.reserve(costs.size());
+            for (auto it=costs.begin(); it!=costs.end(); ++it) v.push_back(*it);
+            v = world.gop.concat0(v, 128*1024*1024);
+
+            const std::size_t nproc = world.size();
+            std::vector<std::uint64_t> cuts(nproc-1);
+            auto sfc = std::dynamic_pointer_cast< SFCPmap<NDIM> >(current);
+            bool keep = sfc && sfc->get_level() == boxes.get_level() && sfc->get_cuts().size() == cuts.size();
+            if (world.rank() == 0) {
+                // Merge the costs of each box over processes
+                std::sort(v.begin(), v.end());
+                std::size_t n = 0;
+                for (std::size_t i=0; i<v.size(); ++i) {
+                    if (n && v[n-1].first == v[i].first) v[n-1].second += v[i].second;
+                    else v[n++] = v[i];
+                }
+                v.resize(n);
+                double total = 0.0;
+                for (const auto& box : v) total += box.second;
+
+                if (keep) keep = (max_cost(v, sfc->get_cuts()) <= (1.0 + tolerance)*total/nproc);
+                if (!keep) {
+                    // Process p starts at the first box beyond p/nproc of the total cost
+                    double sum = 0.0;
+                    std::size_t p = 0;
+                    for (const auto& box : v) {
+                        for (; p<cuts.size() && sum >= (p+1)*total/nproc; ++p) cuts[p] = box.first;
+                        sum += box.second;
+                    }
+                    const std::uint64_t end = std::uint64_t(1) << (NDIM*boxes.get_level());
+                    for (; p<cuts.size(); ++p) cuts[p] = end;
+                }
+            }
+            world.gop.broadcast(keep, 0);
+            world.gop.fence();
+            if (keep) return current;
+
+            world.gop.broadcast_serializable(cuts, 0);
+            return std::make_shared< SFCPmap<NDIM> >(world, boxes.get_level(), cuts);
+        }
+    };
+}
+
+#endif // MADNESS_MRA_SFCPMAP_H__INCLUDED
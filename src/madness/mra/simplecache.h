@@ -41,7 +41,8 @@ namespace madness {
 
     /// This is a write once cache --- subsequent writes of elements
     /// have no effect (so that pointers/references to cached data
-    /// cannot be invalidated)
+    /// cannot be invalidated). Since nothing is ever erased the underlying
+    /// map is insert-only and getptr() takes no lock.
     template <typename Q, std::size_t NDIM>
     class SimpleCache {
     private:
@@ -50,7 +51,7 @@ namespace madness {
         mapT cache;
 
     public:
-        SimpleCache() : cache() {};
+        SimpleCache() : cache(1021, Hash< Key<NDIM> >(), true) {};
 
         SimpleCache(const SimpleCache& c) : cache(c.cache) {};
 
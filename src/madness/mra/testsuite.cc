@@ -39,6 +39,8 @@
 #include <madness/mra/mra.h>
 #include <unistd.h>
 #include <cstdio>
+#include <numeric>
+#include <optional>
 #include <madness/constants.h>
 #include <madness/mra/qmprop.h>
 
@@ -785,6 +787,40 @@ int test_op(World& world) {
     }
     CHECK(re, 30*thresh, "err in test_op");
 
+    // record the screening of the source nodes, then replay it
+    ApplyPlan<NDIM> plan;
+    START_TIMER;
+    Function<T,NDIM> rcap = madness::apply(op,f,true,&plan);
+    END_TIMER("apply and record");
+    START_TIMER;
+    Function<T,NDIM> rplan = madness::apply(op,f,true,&plan);
+    END_TIMER("apply replayed");
+    double ecap = (rcap-r).norm2();
+    double eplan = (rplan-r).norm2();
+    CHECK(ecap, thresh, "err in test_op recording plan");
+    CHECK(eplan, thresh, "err in test_op replaying plan");
+    CHECK(plan.get_nreplayed()-1.0, 0.5, "apply plan replayed");
+
+    // a different operator constructed at the address of the recorded one
+    // must record again instead of replaying
+    Tensor<double> exponents2(1);
+    exponents2(0L) = 3.0;
+    SeparatedConvolution<T,NDIM> op2(world, coeffs, exponents2, lo, thresh1);
+    Function<T,NDIM> r2 = madness::apply(op2,f);
+    ApplyPlan<NDIM> plan2;
+    std::optional< SeparatedConvolution<T,NDIM> > slot;
+    slot.emplace(world, coeffs, exponents, lo, thresh1);
+    const void* address = &*slot;
+    madness::apply(*slot,f,true,&plan2);
+    slot.reset();
+    slot.emplace(world, coeffs, exponents2, lo, thresh1);
+    MADNESS_CHECK(&*slot == address);
+    Function<T,NDIM> rslot = madness::apply(*slot,f,true,&plan2);
+    slot.reset();
+    double eslot = (rslot-r2).norm2();
+    CHECK(eslot, thresh, "err in test_op with a new operator at the same address");
+    CHECK(double(plan2.get_nreplayed()), 0.5, "apply plan not replayed for a new operator");
+
 //     for (int i=0; i<=100; ++i) {
 //         coordT c(-10.0+20.0*i/100.0);
 //         print("           ",i,c[0],r(c),r(c)-(*fexact)(c));
@@ -1241,6 +1277,27 @@ int test_io(World& world) {
     if (world.rank() == 0) print("err = ", err);
     CHECK(err,1e-12,"test_io");
 
+    // lossy compression bounds the error of each node by factor*tol/2
+    const double factor = 0.01;
+    TensorCompression::set_mode(TensorCompressionMode::lossy, factor);
+    TensorCompression::reset_stats();
+    archive::ParallelOutputArchive<archive::BinaryFstreamOutputArchive> lout(world, "mary", nio);
+    lout & f;
+    lout.close();
+    TensorCompression::set_mode(TensorCompressionMode::none);
+
+    Function<T,NDIM> h;
+    archive::ParallelInputArchive<archive::BinaryFstreamInputArchive> lin(world, "mary", nio);
+    lin & h;
+    lin.close();
+    lin.remove();
+
+    double errlossy = (h-f).norm2();
+    if (world.rank() == 0) print("err lossy = ", errlossy, "compression ratio", TensorCompression::stats().ratio());
+    CHECK(errlossy, 0.5*factor*f.thresh()*std::sqrt(double(f.tree_size())), "test_io lossy compression");
+    if (std::is_same<T,double>::value && NDIM > 1)
+        CHECK(1.0/TensorCompression::stats().ratio(), 1.0, "test_io lossy compression ratio");
+
     //    MADNESS_CHECK(err == 0.0);
 
     if (world.rank() == 0) print("test_io OK");
@@ -1300,6 +1357,96 @@ int test_apply_push_1d(World& world) {
     return 1;
 }
 
+template <typename T, std::size_t NDIM>
+int test_sfcpmap(World& world) {
+    typedef Vector<double,NDIM> coordT;
+    typedef Key<NDIM> keyT;
+    typedef std::shared_ptr< FunctionFunctorInterface<T,NDIM> > functorT;
+    typedef std::shared_ptr< WorldDCPmapInterface<keyT> > pmapT;
+
+    bool ok=true;
+    if (world.rank() == 0)
+        print("\nTest SFCPmap - type =",archive::get_type_name<T>(),", ndim =",NDIM,"\n");
+
+    FunctionDefaults<NDIM>::set_cubic_cell(-10,10);
+    FunctionDefaults<NDIM>::set_k(6);
+    FunctionDefaults<NDIM>::set_thresh(1e-6);
+    FunctionDefaults<NDIM>::set_truncate_mode(0);
+    FunctionDefaults<NDIM>::set_refine(true);
+    FunctionDefaults<NDIM>::set_initial_level(2);
+
+    // off-center, so that the tree and the costs are uneven along the curve
+    const coordT center(1.5);
+    const double expnt = 10.0;
+    const double coeff = pow(2.0*expnt/PI,0.25*NDIM);
+    functorT functor(new Gaussian<T,NDIM>(center, expnt, coeff));
+    Function<T,NDIM> f = FunctionFactory<T,NDIM>(world).functor(functor);
+    const double norm = f.norm2();
+    const T value = f(center);
+
+    // a subtree is owned by the process of its root, a key above the roots by that of its first descendant
+    const Level level = 2;
+    SFCPmap<NDIM> sfc(world, level);
+    long nbad = 0;
+    for (auto it=f.get_impl()->get_coeffs().begin(); it!=f.get_impl()->get_coeffs().end(); ++it) {
+        const keyT& key = it->first;
+        const Level n = key.level();
+        Vector<Translation,NDIM> l = key.translation();
+        for (std::size_t d=0; d<NDIM; ++d) l[d] <<= std::max(0, level-n);
+        const keyT root = (n >= level) ? key.parent(n-level) : keyT(level, l);
+        if (sfc.owner(key) != sfc.owner(root)) ++nbad;
+    }
+    world.gop.sum(nbad);
+    CHECK(double(nbad), 0.5, "SFCPmap keeps subtrees together");
+
+    // the cuts split the node count, each process gets at most one box above the average
+    LoadBalanceSFC<NDIM> lb(world, level);
+    lb.add_tree(f);
+    pmapT balanced = lb.load_balance();
+    std::shared_ptr< SFCPmap<NDIM> > bsfc = std::dynamic_pointer_cast< SFCPmap<NDIM> >(balanced);
+    MADNESS_CHECK(bsfc && bsfc->get_level() == level);
+    std::vector<double> boxcost(std::size_t(1) << (NDIM*level), 0.0);
+    std::vector<double> proccost(world.size(), 0.0);
+    for (auto it=f.get_impl()->get_coeffs().begin(); it!=f.get_impl()->get_coeffs().end(); ++it) {
+        boxcost[bsfc->box(it->first)] += 1.0;
+        proccost[bsfc->owner(it->first)] += 1.0;
+    }
+    world.gop.sum(boxcost.data(), boxcost.size());
+    world.gop.sum(proccost.data(), proccost.size());
+    const double total = std::accumulate(proccost.begin(), proccost.end(), 0.0);
+    const double maxbox = *std::max_element(boxcost.begin(), boxcost.end());
+    const double maxproc = *std::max_element(proccost.begin(), proccost.end());
+    if (world.rank() == 0) print("nodes", total, "largest box", maxbox, "largest process", maxproc);
+    CHECK(std::max(0.0, maxproc - total/world.size() - maxbox), 0.5, "LoadBalanceSFC cut placement");
+
+    // a balanced map within the tolerance is kept, an unbalanced one is replaced
+    LoadBalanceSFC<NDIM> lb2(world, level);
+    lb2.add_tree(f);
+    CHECK(double(lb2.load_balance(1.0, balanced) != balanced), 0.5, "LoadBalanceSFC keeps a balanced map");
+    pmapT skewed(new SFCPmap<NDIM>(world, level, std::vector<std::uint64_t>(world.size()-1, 0)));
+    CHECK(double((lb2.load_balance(0.0, skewed) != skewed) != (world.size() > 1)), 0.5,
+          "LoadBalanceSFC replaces an unbalanced map");
+
+    // redistribute to the balanced map and back
+    pmapT old = FunctionDefaults<NDIM>::get_pmap();
+    for (const pmapT& pmap : {balanced, old}) {
+        FunctionDefaults<NDIM>::redistribute(world, pmap);
+        long nremote = 0;
+        for (auto it=f.get_impl()->get_coeffs().begin(); it!=f.get_impl()->get_coeffs().end(); ++it)
+            if (pmap->owner(it->first) != world.rank()) ++nremote;
+        world.gop.sum(nremote);
+        CHECK(double(nremote), 0.5, "redistribute places nodes on their owner");
+        f.verify_tree();
+        CHECK(f.norm2() - norm, 1e-12, "norm after redistribute");
+        CHECK(std::abs(f(center) - value), 1e-12, "value after redistribute");
+    }
+
+    world.gop.fence();
+    if (world.rank() == 0) print("test_sfcpmap OK");
+    if (ok) return 0;
+    return 1;
+}
+
 
 #define TO_STRING(s) TO_STRING2(s)
 #define TO_STRING2(s) #s
@@ -1391,6 +1538,7 @@ int main(int argc, char**argv) {
         nfail+=test_op<double,2>(world);
         nfail+=test_plot<double,2>(world);
         nfail+=test_io<double,2>(world);
+        nfail+=test_sfcpmap<double,2>(world);
 
         if (!smalltest) {
             nfail+=test_basic<double,3>(world);
@@ -2308,7 +2308,7 @@ namespace madness {
     void load_function(World& world, std::vector<Function<T,NDIM> >& f,
             const std::string name) {
         if (world.rank()==0) print("loading vector of functions",name);
-        archive::ParallelInputArchive<archive::BinaryFstreamInputArchive> ar(world, name.c_str(), 1);
+        archive::ParallelInputArchive<archive::MmapInputArchive> ar(world, name.c_str(), 1);
         std::size_t fsize=0;
         ar & fsize;
         f.resize(fsize);
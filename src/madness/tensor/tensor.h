@@ -35,6 +35,7 @@
 #include <madness/madness_config.h>
 #include <madness/misc/ran.h>
 #include <madness/world/posixmem.h>
+#include <madness/world/memory_accounting.h>
 
 #include <memory>
 #include <complex>
@@ -60,6 +61,7 @@
 #include <madness/tensor/mxm.h>
 #include <madness/tensor/tensorexcept.h>
 #include <madness/tensor/tensoriter.h>
+#include <madness/tensor/tensor_compression.h>
 
 #ifdef ENABLE_GENTENSOR
 #define HAVE_GENTENSOR 1
@@ -359,11 +361,21 @@ namespace madness {
 #ifdef TENSOR_USE_SHARED_ALIGNED_ARRAY
                     _p = _shptr.allocate(_size, TENSOR_ALIGNMENT);
 #elif defined WORLD_GATHER_MEM_STATS
+                    const std::size_t nbyte = sizeof(T)*_size;
                     _p = new T[_size];
-                    _shptr = std::shared_ptr<T>(_p);
+                    MemoryAccounting::add(MemoryCategory::tensor, nbyte);
+                    _shptr = std::shared_ptr<T>(_p, [nbyte](T* p) {
+                        delete [] p;
+                        MemoryAccounting::sub(MemoryCategory::tensor, nbyte);
+                    });
 #else
-                    if (posix_memalign((void **) &_p, TENSOR_ALIGNMENT, sizeof(T)*_size)) throw 1;
-                    _shptr.reset(_p, &free);
+                    const std::size_t nbyte = sizeof(T)*_size;
+                    if (posix_memalign((void **) &_p, TENSOR_ALIGNMENT, nbyte)) throw 1;
+                    MemoryAccounting::add(MemoryCategory::tensor, nbyte);
+                    _shptr.reset(_p, [nbyte](T* p) {
+                        free(p);
+                        MemoryAccounting::sub(MemoryCategory::tensor, nbyte);
+                    });
 #endif
                 }
                 catch (...) {
@@ -386,6 +398,9 @@ MADNESS_PRAGMA_GCC(diagnostic pop)
                     aligned_zero(_size, _p);
 #endif
                 }
+                else {
+                    numa_first_touch(_p, _size*sizeof(T));
+                }
             }
             else {
                 _p = 0;
@@ -1912,6 +1927,19 @@ MADNESS_PRAGMA_GCC(diagnostic pop)
         template <class Archive, typename T>
         struct ArchiveStoreImpl< Archive, Tensor<T> > {
             static void store(const Archive& s, const Tensor<T>& t) {
+                if constexpr (std::is_same<T,double>::value && is_file_output_archive<Archive>::value) {
+                    // Files may hold compressed data, see TensorCompression
+                    std::vector<unsigned char> buf;
+                    int codec = 0;
+                    double quantum = 0.0;
+                    if (t.iscontiguous() && TensorCompression::compress(t.ptr(), t.size(), codec, quantum, buf)) {
+                        const long id = t.id() + TensorCompression::compressed_id;
+                        const std::size_t nbyte = buf.size();
+                        s & t.size() & id & t.ndim() & wrap(t.dims(),TENSOR_MAXDIM);
+                        s & codec & quantum & nbyte & wrap(buf.data(),nbyte);
+                        return;
+                    }
+                }
                 if (t.iscontiguous()) {
                     s & t.size() & t.id();
                     if (t.size()) s & t.ndim() & wrap(t.dims(),TENSOR_MAXDIM) & wrap(t.ptr(),t.size());
@@ -1929,13 +1957,31 @@ MADNESS_PRAGMA_GCC(diagnostic pop)
             static void load(const Archive& s, Tensor<T>& t) {
                 long sz = 0l, id = 0l;
                 s & sz & id;
+                const bool compressed = (id >= TensorCompression::compressed_id);
+                if (compressed) id -= TensorCompression::compressed_id;
                 if (id != t.id()) throw "type mismatch deserializing a tensor";
                 if (sz) {
                     long _ndim = 0l, _dim[TENSOR_MAXDIM];
                     s & _ndim & wrap(_dim,TENSOR_MAXDIM);
                     t = Tensor<T>(_ndim, _dim, false);
                     if (sz != t.size()) throw "size mismatch deserializing a tensor";
-                    s & wrap(t.ptr(), t.size());
+                    if (compressed) {
+                        if constexpr (std::is_same<T,double>::value) {
+                            int codec = 0;
+                            double quantum = 0.0;
+                            std::size_t nbyte = 0;
+                            s & codec & quantum & nbyte;
+                            std::vector<unsigned char> buf(nbyte);
+                            s & wrap(buf.data(),nbyte);
+                            TensorCompression::decompress(codec, quantum, buf.data(), nbyte, t.ptr(), t.size());
+                        }
+                        else {
+                            MADNESS_EXCEPTION("compressed tensor data is only supported for Tensor<double>", 0);
+                        }
+                    }
+                    else {
+                        s & wrap(t.ptr(), t.size());
+                    }
                 }
                 else {
                     t = Tensor<T>();
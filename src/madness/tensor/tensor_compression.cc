@@ -0,0 +1,251 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+
+
+  $Id$
+*/
+
+/// \file tensor_compression.cc
+/// \brief Implements the compression of tensors stored in files
+
+#include <madness/tensor/tensor_compression.h>
+#include <madness/tensor/tensorexcept.h>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace madness {
+
+    namespace {
+
+        std::atomic<int> compression_mode{int(TensorCompressionMode::none)};
+        std::atomic<double> lossy_factor{0.01};
+        thread_local const TensorCompression::ScopedThreshold* current_scope = nullptr;
+        thread_local int current_level = -1;
+        std::atomic<std::uint64_t> raw_bytes{0}, stored_bytes{0}, ntensor{0};
+
+        /// Reads MAD_TENSOR_COMPRESSION once
+        void init_from_environment() {
+            static std::once_flag flag;
+            std::call_once(flag, []() {
+                const char* env = std::getenv("MAD_TENSOR_COMPRESSION");
+                if (!env) return;
+                const std::string s(env);
+                if (s == "lossless") {
+                    compression_mode = int(TensorCompressionMode::lossless);
+                }
+                else if (s.compare(0, 5, "lossy") == 0) {
+                    compression_mode = int(TensorCompressionMode::lossy);
+                    if (s.size() > 6 && s[5] == ':') lossy_factor = std::atof(s.c_str() + 6);
+                }
+                else if (s != "none") {
+                    std::fprintf(stderr, "MAD_TENSOR_COMPRESSION=%s not understood, tensors are not compressed\n", env);
+                }
+            });
+        }
+
+        /// Encodes the bytes of u, most significant first, one byte plane
+        /// after the other; a zero byte is followed by the length of its run
+        void shuffle_encode(const std::uint64_t* u, long n, std::vector<unsigned char>& out) {
+            out.clear();
+            out.reserve(n);
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                long i = 0;
+                while (i < n) {
+                    const unsigned char byte = (u[i] >> shift) & 0xff;
+                    if (byte) {
+                        out.push_back(byte);
+                        ++i;
+                        continue;
+                    }
+                    std::uint64_t run = 0;
+                    while (i < n && ((u[i] >> shift) & 0xff) == 0) {
+                        ++run;
+                        ++i;
+                    }
+                    out.push_back(0);
+                    for (--run; run >= 0x80; run >>= 7) out.push_back((run & 0x7f) | 0x80);
+                    out.push_back(run);
+                }
+            }
+        }
+
+        void shuffle_decode(const unsigned char* in, std::size_t nbyte, std::uint64_t* u, long n) {
+            std::memset(u, 0, n*sizeof(std::uint64_t));
+            std::size_t pos = 0;
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                long i = 0;
+                while (i < n) {
+                    if (pos >= nbyte) TENSOR_EXCEPTION("compressed tensor: data too short", pos, 0);
+                    const unsigned char byte = in[pos++];
+                    if (byte) {
+                        u[i++] |= std::uint64_t(byte) << shift;
+                        continue;
+                    }
+                    std::uint64_t run = 0;
+                    for (int bits = 0; ; bits += 7) {
+                        if (pos >= nbyte || bits > 63) TENSOR_EXCEPTION("compressed tensor: bad run length", pos, 0);
+                        const unsigned char c = in[pos++];
+                        run |= std::uint64_t(c & 0x7f) << bits;
+                        if (!(c & 0x80)) break;
+                    }
+                    if (run >= std::uint64_t(n - i)) TENSOR_EXCEPTION("compressed tensor: run too long", run, 0);
+                    i += run + 1;
+                }
+            }
+            if (pos != nbyte) TENSOR_EXCEPTION("compressed tensor: data too long", pos, 0);
+        }
+
+        /// Rounds to multiples of quantum; false if a value does not fit
+        bool quantize(const double* x, long n, double quantum, std::uint64_t* u) {
+            const double qmax = 4.0e18;
+            for (long i = 0; i < n; ++i) {
+                const double q = std::nearbyint(x[i]/quantum);
+                if (!(std::abs(q) < qmax)) return false; // also catches NaN
+                const std::int64_t k = std::int64_t(q);
+                u[i] = (std::uint64_t(k) << 1) ^ std::uint64_t(k >> 63); // zigzag, small values have zero high bytes
+            }
+            return true;
+        }
+
+    } // namespace
+
+    TensorCompressionMode TensorCompression::mode() {
+        init_from_environment();
+        return TensorCompressionMode(compression_mode.load());
+    }
+
+    void TensorCompression::set_mode(TensorCompressionMode m, double factor) {
+        init_from_environment();
+        compression_mode = int(m);
+        lossy_factor = factor;
+    }
+
+    TensorCompression::ScopedThreshold::ScopedThreshold(double thresh)
+            : saved(current_scope), tol(1, thresh), by_level(false) {
+        current_scope = this;
+    }
+
+    TensorCompression::ScopedThreshold::ScopedThreshold(std::vector<double> tol)
+            : saved(current_scope), tol(std::move(tol)), by_level(true) {
+        current_scope = this;
+        current_level = -1;
+    }
+
+    TensorCompression::ScopedThreshold::~ScopedThreshold() {
+        current_scope = saved;
+        current_level = -1;
+    }
+
+    void TensorCompression::set_level(int n) {
+        current_level = n;
+    }
+
+    bool TensorCompression::compress(const double* x, long n, int& codec, double& quantum,
+                                     std::vector<unsigned char>& out) {
+        const TensorCompressionMode m = mode();
+        if (m == TensorCompressionMode::none || n < min_size) return false;
+
+        std::vector<std::uint64_t> u(n);
+        codec = xor_shuffle;
+        quantum = 0.0;
+        if (m == TensorCompressionMode::lossy && current_scope) {
+            // Each element is off by at most quantum/2, the tensor by quantum/2*sqrt(n) in norm
+            const std::vector<double>& tol = current_scope->tol;
+            if (!current_scope->by_level) quantum = tol[0];
+            else if (current_level >= 0 && std::size_t(current_level) < tol.size()) quantum = tol[current_level];
+            quantum *= lossy_factor/std::sqrt(double(n));
+            if (quantum > 0.0 && quantize(x, n, quantum, u.data())) codec = quantized;
+            else quantum = 0.0;
+        }
+        if (codec == xor_shuffle) {
+            // Neighbours share sign, exponent and leading mantissa bits
+            std::uint64_t prev = 0;
+            for (long i = 0; i < n; ++i) {
+                std::uint64_t bits;
+                std::memcpy(&bits, x + i, sizeof(bits));
+                u[i] = bits ^ prev;
+                prev = bits;
+            }
+        }
+        shuffle_encode(u.data(), n, out);
+
+        const std::uint64_t raw = n*sizeof(double);
+        const bool smaller = out.size() < raw;
+        raw_bytes += raw;
+        stored_bytes += smaller ? out.size() : raw;
+        ++ntensor;
+        return smaller;
+    }
+
+    void TensorCompression::decompress(int codec, double quantum, const unsigned char* in, std::size_t nbyte,
+                                       double* x, long n) {
+        std::vector<std::uint64_t> u(n);
+        shuffle_decode(in, nbyte, u.data(), n);
+        if (codec == xor_shuffle) {
+            std::uint64_t prev = 0;
+            for (long i = 0; i < n; ++i) {
+                prev ^= u[i];
+                std::memcpy(x + i, &prev, sizeof(prev));
+            }
+        }
+        else if (codec == quantized) {
+            for (long i = 0; i < n; ++i) {
+                const std::int64_t k = std::int64_t(u[i] >> 1) ^ -std::int64_t(u[i] & 1);
+                x[i] = k*quantum;
+            }
+        }
+        else {
+            TENSOR_EXCEPTION("compressed tensor: unknown codec", codec, 0);
+        }
+    }
+
+    TensorCompressionStats TensorCompression::stats() {
+        return TensorCompressionStats{raw_bytes, stored_bytes, ntensor};
+    }
+
+    void TensorCompression::reset_stats() {
+        raw_bytes = 0;
+        stored_bytes = 0;
+        ntensor = 0;
+    }
+
+    void TensorCompression::print() {
+        const TensorCompressionStats s = stats();
+        std::printf("tensor compression: %lu tensors %.3f MB -> %.3f MB ratio %.2f\n",
+                    (unsigned long) s.ntensor, s.raw*1e-6, s.stored*1e-6, s.ratio());
+    }
+
+}
@@ -0,0 +1,173 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+
+
+  $Id$
+*/
+
+#ifndef MADNESS_TENSOR_TENSOR_COMPRESSION_H__INCLUDED
+#define MADNESS_TENSOR_TENSOR_COMPRESSION_H__INCLUDED
+
+/// \file tensor_compression.h
+/// \brief Declares the compression of tensors stored in files
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace madness {
+
+    /// How tensors of doubles stored in file archives are compressed
+    enum class TensorCompressionMode {
+        none,     ///< Stored as they are (default)
+        lossless, ///< XOR with the previous value, byte shuffle and zero-run encoding
+        lossy     ///< Rounded to a multiple of a quantum proportional to the truncation threshold, then encoded
+    };
+
+    /// Bytes of tensors passed through the compression, before and after
+    struct TensorCompressionStats {
+        std::uint64_t raw;    ///< Bytes of the tensor data
+        std::uint64_t stored; ///< Bytes written for them
+        std::uint64_t ntensor; ///< Number of tensors
+
+        /// Returns raw/stored, or 1 if nothing was stored
+        double ratio() const {
+            return stored ? double(raw)/double(stored) : 1.0;
+        }
+    };
+
+    /// Compression of the data of \c Tensor<double> in file archives
+
+    /// The data of a \c Tensor<double> stored in an archive for which
+    /// \c is_file_output_archive holds (\c BinaryFstreamOutputArchive, and
+    /// the local archives of the parallel archives) are compressed if the
+    /// mode is not \c none and this makes them smaller. The stored tensor
+    /// records the codec and its parameters, so any archive reads it back
+    /// whatever the mode is then. Data sent between processes are never
+    /// compressed.
+    ///
+    /// The mode is set with \c set_mode() or with the environment variable
+    /// \c MAD_TENSOR_COMPRESSION, one of \c none, \c lossless, \c lossy or
+    /// \c lossy:factor. In the lossy mode, the coefficients of a node of a
+    /// function are rounded to multiples of factor*tol/sqrt(n) (default factor
+    /// 0.01), where tol is the truncation tolerance of the node and n the
+    /// number of coefficients, so the norm of the error of a node is at most
+    /// factor*tol/2. Tensors stored outside of a \c ScopedThreshold are
+    /// compressed losslessly, and so are nodes whose level is unknown (see
+    /// \c set_level()), as in a \c SharedFileOutputArchive, which stores the
+    /// keys apart from the nodes.
+    class TensorCompression {
+    public:
+        /// The encoding of compressed data, recorded with them
+        enum codec_type {
+            xor_shuffle = 1, ///< Lossless
+            quantized = 2    ///< Lossy
+        };
+
+        /// Offset added to the type id of a stored tensor to mark compressed data
+        static const long compressed_id = 1024;
+
+        /// Tensors with fewer elements are never compressed
+        static const long min_size = 16;
+
+        /// Returns the compression mode
+        static TensorCompressionMode mode();
+
+        /// Sets the compression mode
+
+        /// \param[in] m The mode.
+        /// \param[in] factor In the lossy mode, the quantum relative to the truncation threshold.
+        static void set_mode(TensorCompressionMode m, double factor = 0.01);
+
+        /// Sets the truncation tolerance of the tensors this thread stores while in scope
+        class ScopedThreshold {
+            friend class TensorCompression;
+            const ScopedThreshold* saved;
+            std::vector<double> tol;
+            bool by_level;
+        public:
+            /// Every tensor stored has the same tolerance
+
+            /// \param[in] thresh The tolerance.
+            explicit ScopedThreshold(double thresh);
+
+            /// The tolerance depends on the level of the node stored
+
+            /// \param[in] tol The tolerance of a node at level n is tol[n]. The
+            ///     level is set by \c set_level() before the node is stored.
+            explicit ScopedThreshold(std::vector<double> tol);
+            ~ScopedThreshold();
+            ScopedThreshold(const ScopedThreshold&) = delete;
+            ScopedThreshold& operator=(const ScopedThreshold&) = delete;
+        };
+
+        /// Sets the level of the node whose coefficients this thread stores next
+
+        /// Called when the key of a node is stored to a file archive, which
+        /// precedes its coefficients.
+        /// \param[in] n The level.
+        static void set_level(int n);
+
+        /// Compresses data, if this makes them smaller
+
+        /// \param[in] x The data.
+        /// \param[in] n The number of elements.
+        /// \param[out] codec The encoding used.
+        /// \param[out] quantum The quantum of the lossy encoding.
+        /// \param[out] out The compressed data.
+        /// \return False if the data should be stored as they are.
+        static bool compress(const double* x, long n, int& codec, double& quantum,
+                             std::vector<unsigned char>& out);
+
+        /// Decompresses data
+
+        /// \param[in] codec The encoding used.
+        /// \param[in] quantum The quantum of the lossy encoding.
+        /// \param[in] in The compressed data.
+        /// \param[in] nbyte The size of the compressed data.
+        /// \param[out] x Where to put the data.
+        /// \param[in] n The number of elements.
+        /// \throw TensorException If the compressed data are not valid.
+        static void decompress(int codec, double quantum, const unsigned char* in, std::size_t nbyte,
+                               double* x, long n);
+
+        /// Returns the bytes compressed by this process
+        static TensorCompressionStats stats();
+
+        /// Clears the statistics
+        static void reset_stats();
+
+        /// Prints the statistics of this process
+        static void print();
+    };
+
+}
+
+#endif // MADNESS_TENSOR_TENSOR_COMPRESSION_H__INCLUDED
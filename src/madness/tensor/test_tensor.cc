@@ -34,6 +34,8 @@
 
 #include <madness/tensor/tensor.h>
 #include <madness/world/print.h>
+#include <madness/world/binary_fstream_archive.h>
+#include <cstdio>
 
 #ifdef MADNESS_HAS_GOOGLE_TEST
 
@@ -415,6 +417,48 @@ namespace {
         ITERATOR3(b,ASSERT_EQ(b(_i,_j,_k), a(_j,_i,_k)));
     }
 
+    TEST(TensorCompressionTest, RoundTrip) {
+        using madness::TensorCompression;
+        using madness::TensorCompressionMode;
+        const char* filename = "test_tensor_compression.ar";
+
+        madness::Tensor<double> a(20,30), tiny(3);
+        for (long i=0; i<20; ++i)
+            for (long j=0; j<30; ++j)
+                a(i,j) = std::exp(-0.1*(i+j))*(1.0 + 1e-3*i); // smooth, decaying like coefficients
+        tiny.fillrandom();
+
+        for (auto mode : {TensorCompressionMode::none, TensorCompressionMode::lossless, TensorCompressionMode::lossy}) {
+            TensorCompression::set_mode(mode, 0.01);
+            TensorCompression::reset_stats();
+            {
+                TensorCompression::ScopedThreshold thresh(1e-4);
+                madness::archive::BinaryFstreamOutputArchive ar(filename);
+                ar & a & tiny;
+            }
+            TensorCompression::set_mode(TensorCompressionMode::none); // reading does not depend on the mode
+            madness::Tensor<double> b, c;
+            {
+                madness::archive::BinaryFstreamInputArchive ar(filename);
+                ar & b & c;
+            }
+            std::remove(filename);
+
+            ASSERT_EQ(b.ndim(), 2);
+            ASSERT_EQ(b.dim(1), 30);
+            EXPECT_EQ((c - tiny).normf(), 0.0);
+            if (mode == TensorCompressionMode::lossy) {
+                EXPECT_LE((b - a).normf(), 0.5e-6*(1.0 + 1e-12)); // factor*thresh/2 for the whole tensor
+                EXPECT_GT(TensorCompression::stats().ratio(), 2.0);
+            }
+            else {
+                EXPECT_EQ((b - a).normf(), 0.0);
+            }
+            if (mode == TensorCompressionMode::lossless) EXPECT_GT(TensorCompression::stats().ratio(), 1.0);
+            if (mode == TensorCompressionMode::none) EXPECT_EQ(TensorCompression::stats().ntensor, 0u);
+        }
+    }
+
 //     TYPED_TEST(TensorTest, Container) {
 //         typedef madness::ConcurrentHashMap< int, Tensor<TypeParam> > containerT;
 //         static const int N = 100;
@@ -0,0 +1,178 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+/**
+ \file async_fstream_archive.cc
+ \brief Implements an output archive whose file is written by a background thread.
+ \ingroup serialization
+*/
+
+#include <madness/world/async_fstream_archive.h>
+#include <madness/world/madness_exception.h>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace madness {
+    namespace archive {
+
+        namespace {
+
+            /// One buffer to write
+            struct AsyncWrite {
+                std::string filename;
+                std::ios_base::openmode mode;
+                std::shared_ptr< std::vector<unsigned char> > buf;
+                Future<bool> done;
+            };
+
+            /// The background thread writing the buffers in the order they were queued
+            class AsyncWriter {
+                std::mutex mutex;
+                std::condition_variable cv_queue; ///< Signalled when a write is queued
+                std::condition_variable cv_done;  ///< Signalled when a write is done
+                std::deque<AsyncWrite> queue;
+                std::size_t npending = 0;         ///< Queued or being written
+                std::size_t nfailed = 0;          ///< Failed since the last wait()
+                bool stopping = false;
+                std::thread thread;
+
+                void run() {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while (true) {
+                        cv_queue.wait(lock, [this]{return stopping || !queue.empty();});
+                        if (queue.empty()) return;
+                        AsyncWrite w = std::move(queue.front());
+                        queue.pop_front();
+                        lock.unlock();
+
+                        // A new file is written beside the old one, which it
+                        // replaces only once complete, so that a crash while
+                        // writing a checkpoint leaves the previous one intact
+                        const bool replace = !(w.mode & std::ios_base::app);
+                        const std::string name = replace ? w.filename + ".tmp" : w.filename;
+                        std::ofstream os(name.c_str(), w.mode);
+                        os.write(reinterpret_cast<const char*>(w.buf->data()), w.buf->size());
+                        os.close();
+                        bool ok = !os.fail();
+                        if (replace) {
+                            if (ok) ok = (std::rename(name.c_str(), w.filename.c_str()) == 0);
+                            if (!ok) std::remove(name.c_str());
+                        }
+                        w.buf.reset();
+                        w.done.set(ok); // runs the callbacks of done on this thread
+
+                        lock.lock();
+                        if (!ok) ++nfailed;
+                        --npending;
+                        cv_done.notify_all();
+                    }
+                }
+
+            public:
+                AsyncWriter() : thread([this]{run();}) {}
+
+                /// Writes everything still queued
+                ~AsyncWriter() {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        stopping = true;
+                    }
+                    cv_queue.notify_one();
+                    thread.join();
+                }
+
+                void push(AsyncWrite&& w) {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        queue.push_back(std::move(w));
+                        ++npending;
+                    }
+                    cv_queue.notify_one();
+                }
+
+                /// Returns the number of writes that failed
+                std::size_t wait() {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv_done.wait(lock, [this]{return npending == 0;});
+                    const std::size_t n = nfailed;
+                    nfailed = 0;
+                    return n;
+                }
+
+                std::size_t pending() {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    return npending;
+                }
+            };
+
+            AsyncWriter& writer() {
+                static AsyncWriter w;
+                return w;
+            }
+
+        } // namespace
+
+        AsyncFstreamOutputArchive::AsyncFstreamOutputArchive(const char* filename, std::ios_base::openmode mode)
+                : buf(), filename(), mode(mode), done()
+        {
+            if (filename) open(filename, mode);
+        }
+
+        void AsyncFstreamOutputArchive::open(const char* filename, std::ios_base::openmode mode) {
+            this->filename = filename;
+            this->mode = mode;
+            buf.reset(new std::vector<unsigned char>());
+            done = Future<bool>();
+            store(ARCHIVE_COOKIE, strlen(ARCHIVE_COOKIE)+1);
+        }
+
+        void AsyncFstreamOutputArchive::close() {
+            if (buf) {
+                writer().push(AsyncWrite{filename, mode, buf, done});
+                buf.reset();
+            }
+        }
+
+        void AsyncFstreamOutputArchive::wait() {
+            if (const std::size_t nfailed = writer().wait())
+                MADNESS_EXCEPTION("AsyncFstreamOutputArchive: writing failed", nfailed);
+        }
+
+        std::size_t AsyncFstreamOutputArchive::pending() {
+            return writer().pending();
+        }
+
+    } // namespace archive
+} // namespace madness
@@ -0,0 +1,157 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_WORLD_ASYNC_FSTREAM_ARCHIVE_H__INCLUDED
+#define MADNESS_WORLD_ASYNC_FSTREAM_ARCHIVE_H__INCLUDED
+
+/**
+ \file async_fstream_archive.h
+ \brief Implements an output archive whose file is written by a background thread.
+ \ingroup serialization
+*/
+
+#include <algorithm>
+#include <type_traits>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <madness/world/archive.h>
+#include <madness/world/future.h>
+
+namespace madness {
+    namespace archive {
+
+        /// \addtogroup serialization
+        /// @{
+
+        /// Wraps an archive around a binary file that is written in the background.
+
+        /// Data stored in the archive are copied into a staging buffer in
+        /// memory. \c close() hands the buffer to a background I/O thread and
+        /// returns at once; the thread writes the buffer to the file in the
+        /// format of \c BinaryFstreamOutputArchive, so the file is read with
+        /// \c BinaryFstreamInputArchive or \c MmapInputArchive. Unless the
+        /// mode includes \c std::ios_base::app, it writes to \c filename.tmp
+        /// and renames that to \c filename once it is complete, so that a
+        /// crash during the write leaves the previous file intact.
+        ///
+        /// As the local archive of a \c ParallelOutputArchive with one writer
+        /// per process, storing a \c WorldContainer only copies the local
+        /// entries of each process into its buffer, e.g. to checkpoint every
+        /// iteration
+        /// \code
+        ///   archive::ParallelOutputArchive<archive::AsyncFstreamOutputArchive> ar(world, "restart", world.size());
+        ///   ar & f;
+        ///   ar.close();   // returns before the data are on disk
+        ///   ...
+        ///   archive::AsyncFstreamOutputArchive::wait(); // e.g. before the next checkpoint
+        /// \endcode
+        /// The staging buffer holds a copy, so the stored objects can be
+        /// modified as soon as the store returns.
+        class AsyncFstreamOutputArchive : public BaseOutputArchive {
+            std::shared_ptr< std::vector<unsigned char> > buf; ///< Staging buffer, null if not open.
+            std::string filename;       ///< The file to write.
+            std::ios_base::openmode mode; ///< I/O attributes for opening the file.
+            Future<bool> done;          ///< Assigned once the last buffer closed was written.
+
+        public:
+            /// Default constructor.
+
+            /// The filename and open modes are optional here; they can be
+            /// specified later by calling \c open().
+            /// \param[in] filename Name of the file to write to.
+            /// \param[in] mode I/O attributes for opening the file.
+            AsyncFstreamOutputArchive(const char* filename = nullptr,
+                                      std::ios_base::openmode mode = std::ios_base::binary | \
+                                                                     std::ios_base::out | std::ios_base::trunc);
+
+            AsyncFstreamOutputArchive(const std::string name,
+                                      std::ios_base::openmode mode = std::ios_base::binary | \
+                                                                     std::ios_base::out | std::ios_base::trunc)
+                    : AsyncFstreamOutputArchive(name.c_str(),mode) {}
+
+            /// Copy into the staging buffer.
+
+            /// The function only appears (due to \c enable_if) if \c T is
+            /// serializable.
+            /// \tparam T The type of data to be written.
+            /// \param[in] t Location of the data to be written.
+            /// \param[in] n The number of data items to be written.
+            template <class T>
+            inline
+            typename std::enable_if< is_trivially_serializable<T>::value, void >::type
+            store(const T* t, long n) const {
+                const unsigned char* ptr = (const unsigned char*) t;
+                const std::size_t nbyte = n*sizeof(T);
+                if (buf->capacity() - buf->size() < nbyte)
+                    buf->reserve(std::max(buf->size() + nbyte, 2*buf->capacity()));
+                buf->insert(buf->end(), ptr, ptr+nbyte);
+            }
+
+            /// Start a new staging buffer for the file.
+
+            /// \param[in] filename The name of the file.
+            /// \param[in] mode I/O attributes for opening the file.
+            void open(const char* filename,
+                      std::ios_base::openmode mode = std::ios_base::binary | \
+                                                     std::ios_base::out | std::ios_base::trunc);
+
+            /// Queue the staging buffer for writing and return at once.
+            void close();
+
+            /// Does nothing; the data are written by \c close().
+            void flush() {}
+
+            /// Returns the completion of the last write queued by \c close().
+
+            /// The future is assigned by the I/O thread, true if the file was
+            /// written and false if writing failed. The I/O thread is not a
+            /// thread of the pool, and callbacks registered directly on the
+            /// future (e.g. by a \c RemoteReference) run on it; tasks that
+            /// depend on the future are queued to the pool as usual.
+            Future<bool> completion() const {
+                return done;
+            }
+
+            /// Waits until all writes queued by this process are done.
+
+            /// \throw MadnessException if any of them failed.
+            static void wait();
+
+            /// Returns the number of queued writes that are not done yet.
+            static std::size_t pending();
+        };
+
+        /// @}
+    }
+}
+#endif // MADNESS_WORLD_ASYNC_FSTREAM_ARCHIVE_H__INCLUDED
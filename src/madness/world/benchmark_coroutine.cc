@@ -0,0 +1,82 @@
+#include <madness/world/MADworld.h>
+
+// This program compares a recursive traversal written as a chain of tasks
+// and futures with the same traversal written as coroutine tasks.
+//
+//   tasks     : each node is a task that spawns its children and then a
+//               second task to combine their results (as in norm_tree)
+//   coroutine : each node is a coroutine that spawns its children and
+//               co_awaits their results
+//
+// Reported per node of the tree are the tasks submitted to the queue, the
+// allocations from the runtime pools and the time.
+//
+// Usage: benchmark_coroutine [depth]
+
+using namespace madness;
+
+#ifdef MADNESS_HAS_COROUTINES
+
+AtomicInt ntask;
+
+long add3(long a, long b, long c) {
+    return a + b + c;
+}
+
+Future<long> tree_task(World* world, int depth) {
+    if (depth == 0) return Future<long>(1);
+    ntask += 3;
+    Future<long> left = world->taskq.add(tree_task, world, depth-1);
+    Future<long> right = world->taskq.add(tree_task, world, depth-1);
+    return world->taskq.add(add3, 1l, left, right);
+}
+
+CoTask<long> tree_coroutine(World& world, int depth) {
+    if (depth == 0) co_return 1;
+    ntask += 2;
+    Future<long> left = world.taskq.add(tree_coroutine(world, depth-1));
+    Future<long> right = world.taskq.add(tree_coroutine(world, depth-1));
+    co_return 1 + co_await left + co_await right;
+}
+
+template <typename opT>
+void time_tree(World& world, const char* name, int depth, opT op) {
+    const long nnode = (2l << depth) - 1;
+    ntask = 0;
+    const PoolAllocatorStats before = PoolAllocator::get_stats();
+    const double start = wall_time();
+    MADNESS_CHECK(op().get() == nnode);
+    world.taskq.fence();
+    const double used = wall_time() - start;
+    const PoolAllocatorStats after = PoolAllocator::get_stats();
+    printf("%10s  tasks/node %5.2f   allocations/node %6.2f   time/node %10.3e s\n", name,
+           double(int(ntask))/nnode, double(after.nalloc - before.nalloc)/nnode, used/nnode);
+}
+
+int main(int argc, char** argv) {
+    World& world = initialize(argc, argv);
+
+    const int depth = (argc > 1) ? std::atoi(argv[1]) : 16;
+
+    if (world.rank() == 0) {
+        print("benchmark_coroutine:", ThreadPool::size(), "threads, binary tree of depth", depth);
+
+        time_tree(world, "tasks", depth, [&]{ return tree_task(&world, depth); });
+        time_tree(world, "coroutine", depth, [&]{ return world.taskq.add(tree_coroutine(world, depth)); });
+    }
+    world.gop.fence();
+
+    finalize();
+    return 0;
+}
+
+#else
+
+int main(int argc, char** argv) {
+    World& world = initialize(argc, argv);
+    if (world.rank() == 0) print("benchmark_coroutine: coroutines need C++20");
+    finalize();
+    return 0;
+}
+
+#endif // MADNESS_HAS_COROUTINES
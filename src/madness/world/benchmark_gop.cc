@@ -0,0 +1,70 @@
+#include <madness/world/MADworld.h>
+
+// This program measures the latency of the global operations and how much
+// is gained by overlapping the split-phase versions.
+//
+//   fence       : blocking fence() vs fence_async().get()
+//   sum         : blocking sum() of a scalar vs sum_async().get()
+//   sum xN      : N blocking sums in turn vs N sum_async() in flight at once
+//
+// Usage: benchmark_gop [nrep] [nconcurrent]
+
+using namespace madness;
+
+template <typename opT>
+double time_op(World& world, int nrep, opT op) {
+    world.gop.fence();
+    const double start = wall_time();
+    for (int i=0; i<nrep; ++i) op();
+    const double used = wall_time() - start;
+    world.gop.fence();
+    return used/nrep;
+}
+
+int main(int argc, char** argv) {
+    World& world = initialize(argc, argv);
+
+    const int nrep = (argc > 1) ? std::atoi(argv[1]) : 1000;
+    const int nconc = (argc > 2) ? std::atoi(argv[2]) : 8;
+    const long expected = long(world.size())*(world.size()-1)/2;
+
+    if (world.rank() == 0)
+        print("benchmark_gop:", world.size(), "processes,", ThreadPool::size(),
+              "threads,", nrep, "repetitions,", nconc, "concurrent sums");
+
+    const double tfence = time_op(world, nrep, [&]{ world.gop.fence(); });
+    const double tfence_async = time_op(world, nrep, [&]{ world.gop.fence_async().get(); });
+
+    const double tsum = time_op(world, nrep, [&]{
+        long value = world.rank();
+        world.gop.sum(value);
+        MADNESS_CHECK(value == expected);
+    });
+    const double tsum_async = time_op(world, nrep, [&]{
+        MADNESS_CHECK(world.gop.sum_async(long(world.rank())).get() == expected);
+    });
+
+    const double tsumn = time_op(world, nrep, [&]{
+        for (int i=0; i<nconc; ++i) {
+            long value = world.rank();
+            world.gop.sum(value);
+            MADNESS_CHECK(value == expected);
+        }
+    });
+    const double tsumn_async = time_op(world, nrep, [&]{
+        std::vector< Future<long> > sums;
+        for (int i=0; i<nconc; ++i)
+            sums.push_back(world.gop.sum_async(long(world.rank())));
+        for (auto& s : sums)
+            MADNESS_CHECK(s.get() == expected);
+    });
+
+    if (world.rank() == 0) {
+        printf("%8s  blocking %10.3e s   async %10.3e s\n", "fence", tfence, tfence_async);
+        printf("%8s  blocking %10.3e s   async %10.3e s\n", "sum", tsum, tsum_async);
+        printf("%8s  blocking %10.3e s   async %10.3e s\n", ("sum x" + std::to_string(nconc)).c_str(), tsumn, tsumn_async);
+    }
+
+    finalize();
+    return 0;
+}
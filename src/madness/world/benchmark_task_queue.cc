@@ -0,0 +1,91 @@
+#include <madness/world/MADworld.h>
+
+// This program measures the task throughput of the thread pool with the
+// shared-queue and the work-stealing schedulers.
+//
+//   flat : the main thread submits all tasks (they go through the shared queue)
+//   tree : every task spawns two children (pool threads submit most tasks,
+//          as in the FunctionImpl traversals)
+//
+// Usage: benchmark_task_queue [ntask] [depth]
+
+using namespace madness;
+
+AtomicInt total_count;
+
+class FlatTask : public TaskInterface {
+public:
+    void run(World& world) {
+        total_count++;
+    }
+};
+
+class TreeTask : public TaskInterface {
+    const int depth;
+public:
+    TreeTask(int depth) : depth(depth) {}
+
+    void run(World& world) {
+        total_count++;
+        if (depth > 0) {
+            world.taskq.add(new TreeTask(depth-1));
+            world.taskq.add(new TreeTask(depth-1));
+        }
+    }
+};
+
+double time_flat(World& world, int ntask) {
+    total_count = 0;
+    const double start = wall_time();
+    for (int i=0; i<ntask; ++i)
+        world.taskq.add(new FlatTask);
+    world.taskq.fence();
+    const double used = wall_time() - start;
+    MADNESS_CHECK(total_count == ntask);
+    return used;
+}
+
+double time_tree(World& world, int ntree, int depth) {
+    total_count = 0;
+    const double start = wall_time();
+    for (int i=0; i<ntree; ++i)
+        world.taskq.add(new TreeTask(depth));
+    world.taskq.fence();
+    const double used = wall_time() - start;
+    MADNESS_CHECK(total_count == ntree*((2<<depth) - 1));
+    return used;
+}
+
+int main(int argc, char** argv) {
+    World& world = initialize(argc, argv);
+
+    const int ntask = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+    const int depth = (argc > 2) ? std::atoi(argv[2]) : 14;
+    const int ntree = std::max(1, ntask/((2<<depth) - 1));
+    const int ntree_task = ntree*((2<<depth) - 1);
+
+    if (world.rank() == 0)
+        print("benchmark_task_queue:", ThreadPool::size(), "threads,", ntask,
+              "flat tasks,", ntree, "trees of depth", depth);
+
+    const TaskScheduler oldpolicy = ThreadPool::get_scheduler();
+    const std::pair<TaskScheduler, const char*> policies[] = {
+        {TaskScheduler::SharedQueue, "queue"}, {TaskScheduler::WorkStealing, "steal"}};
+
+    for (const auto& policy : policies) {
+        ThreadPool::set_scheduler(policy.first);
+        time_tree(world, 1, 8); // warm up
+
+        const double tflat = time_flat(world, ntask);
+        const double ttree = time_tree(world, ntree, depth);
+        world.gop.fence();
+        if (world.rank() == 0) {
+            printf("%8s  flat %10.3e tasks/s   tree %10.3e tasks/s\n", policy.second,
+                   ntask/tflat, ntree_task/ttree);
+        }
+    }
+
+    ThreadPool::set_scheduler(oldpolicy);
+    finalize();
+    return 0;
+}
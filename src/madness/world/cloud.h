@@ -15,6 +15,7 @@
 
 
 #include <madness/world/parallel_dc_archive.h>
+#include <madness/world/memory_accounting.h>
 #include<any>
 #include<iomanip>
 
@@ -224,6 +225,7 @@ private:
 
     mutable madness::WorldContainer<keyT, valueT> container;
     cacheT cached_objects;
+    std::size_t cached_bytes = 0;               // shallow size of cached_objects, for MemoryAccounting
     recordlistT local_list_of_container_keys;   // a world-local list of keys occupied in container
 
 public:
@@ -250,6 +252,7 @@ public:
             std::string msg="deferred destruction of cloud with non-empty cache";
             std::cerr << msg << std::endl;
         }
+        MemoryAccounting::sub(MemoryCategory::cloud, cached_bytes);
     }
 
     void set_debug(bool value) {
@@ -469,6 +472,8 @@ public:
 
     void clear_cache(World &subworld) {
         cached_objects.clear();
+        MemoryAccounting::sub(MemoryCategory::cloud, cached_bytes);
+        cached_bytes = 0;
         local_list_of_container_keys.list.clear();
         subworld.gop.fence();
     }
@@ -733,7 +738,12 @@ private:
 
     template<typename T>
     void cache(madness::World &world, const T &obj, const keyT &record) const {
-        const_cast<cacheT &>(cached_objects).insert({record,std::make_any<T>(obj)});
+        // The objects are shallow copies: count the map node and the object itself
+        if (const_cast<cacheT &>(cached_objects).insert({record,std::make_any<T>(obj)}).second) {
+            const std::size_t nbyte = sizeof(typename cacheT::value_type) + sizeof(T) + 4*sizeof(void*);
+            const_cast<std::size_t &>(cached_bytes) += nbyte;
+            MemoryAccounting::add(MemoryCategory::cloud, nbyte);
+        }
     }
 
     /// load an object from the cache, record is unchanged
@@ -43,6 +43,7 @@
 #define MADNESS_DQ_STATS
 
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <iostream>
 #include <madness/config.h>
@@ -244,6 +245,14 @@ namespace madness {
         /// Insert element at back of queue (default is just one copy)
         void push_back(const T& value, int ncopy=1);
 
+        /// Insert element at back of queue bypassing the thread-local prebuffer
+
+        /// Used to wake a consumer blocked in \c pop_front as soon as possible.
+        void push_back_unbuffered(const T& value) {
+            madness::ScopedMutex<CONDITION_VARIABLE_TYPE> obolus(this);
+            push_back_with_lock(value);
+        }
+
         template <typename opT>
         void scan(opT& op) {
             madness::ScopedMutex<CONDITION_VARIABLE_TYPE> obolus(this);
@@ -404,6 +413,106 @@ namespace madness {
 #endif
     }
 
+
+    /// A per-thread double-ended queue used for work stealing.
+
+    /// The owning thread pushes and pops at the back (LIFO) while other
+    /// threads steal from the front (FIFO), so that the owner works on the
+    /// most recently generated (cache hot) tasks and thieves take the
+    /// oldest (usually largest) ones.  Each deque has its own spinlock,
+    /// so the only contention is between the owner and the occasional
+    /// thief rather than between all threads of the pool.
+    ///
+    /// Like \c DQueue this is a circular buffer that grows as needed.
+    template <typename T>
+    class WorkStealingDeque : private Spinlock {
+        char pad[64]; ///< To put the lock and the data in separate cache lines
+
+        /// Number of elements in the buffer; only changed with the lock held
+        /// but read without it as a hint
+        std::atomic<size_t> n __attribute__((aligned(64)));
+        size_t sz;    ///< Current capacity (always a power of 2)
+        T* buf;       ///< Actual buffer
+        size_t _front; ///< Index of element at front of buffer
+
+        void grow() {
+            // ASSUME WE ALREADY HAVE THE LOCK WHEN IN HERE
+            const size_t nn = n.load(std::memory_order_relaxed);
+            T* nbuf = new T[2*sz];
+            for (size_t i=0; i<nn; ++i) nbuf[i] = buf[(_front + i) & (sz - 1)];
+            delete [] buf;
+            buf = nbuf;
+            sz *= 2;
+            _front = 0;
+        }
+
+    public:
+        WorkStealingDeque(size_t hint=1024)
+            : n(0), sz(2), buf(nullptr), _front(0)
+        {
+            while (sz < hint) sz *= 2;
+            buf = new T[sz];
+        }
+
+        WorkStealingDeque(const WorkStealingDeque&) = delete;
+        WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+        virtual ~WorkStealingDeque() {
+            delete [] buf;
+        }
+
+        /// Insert value at the back of the deque (owner only)
+        void push_back(const T& value) {
+            madness::ScopedMutex<Spinlock> obolus(this);
+            const size_t nn = n.load(std::memory_order_relaxed);
+            if (nn == sz) grow();
+            buf[(_front + nn) & (sz - 1)] = value;
+            n.store(nn + 1, std::memory_order_relaxed);
+        }
+
+        /// Pop up to \c nmax values off the back of the deque (owner only)
+
+        /// As with \c DQueue::pop_front you are given no more than
+        /// max(size()/64,1) values so the rest remains available to thieves.
+        /// The most recently pushed value is placed in \c r[0].
+        /// \return The number of values popped ... might be zero
+        int pop_back(int nmax, T* r) {
+            if (empty()) return 0;
+            madness::ScopedMutex<Spinlock> obolus(this);
+            const size_t nn = n.load(std::memory_order_relaxed);
+            int ntake = std::min(nmax, std::max(int(nn>>6),1));
+            if (ntake > int(nn)) ntake = int(nn);
+            for (int i=0; i<ntake; ++i) r[i] = buf[(_front + nn - 1 - i) & (sz - 1)];
+            n.store(nn - ntake, std::memory_order_relaxed);
+            return ntake;
+        }
+
+        /// Steal up to \c nmax values from the front of the deque (any thread)
+
+        /// A thief takes at most half of the entries so the owner keeps
+        /// some work.  Does not wait for the lock if the deque is busy.
+        /// \return The number of values stolen ... might be zero
+        int steal(int nmax, T* r) {
+            if (empty() || !try_lock()) return 0;
+            const size_t nn = n.load(std::memory_order_relaxed);
+            int ntake = std::min(nmax, int((nn+1)>>1));
+            for (int i=0; i<ntake; ++i) r[i] = buf[(_front + i) & (sz - 1)];
+            _front = (_front + ntake) & (sz - 1);
+            n.store(nn - ntake, std::memory_order_relaxed);
+            unlock();
+            return ntake;
+        }
+
+        /// Number of values in the deque (only a hint unless quiescent)
+        size_t size() const {
+            return n.load(std::memory_order_relaxed);
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+    };
+
 }  // namespace madness
 
 #endif // MADNESS_WORLD_DQUEUE_H__INCLUDED
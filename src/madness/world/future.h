@@ -42,11 +42,14 @@
 #include <vector>
 #include <stack>
 #include <new>
+#include <type_traits>
 #include <madness/world/nodefaults.h>
 #include <madness/world/dependency_interface.h>
 #include <madness/world/stack.h>
 #include <madness/world/worldref.h>
 #include <madness/world/world.h>
+#include <madness/world/pool_allocator.h>
+#include <madness/world/type_traits.h>
 
 /// \addtogroup futures
 /// @{
@@ -57,6 +60,16 @@ namespace madness {
     // forward decl
     template <typename T> class Future;
 
+    namespace detail {
+        template <typename argT, typename fnT, typename resultT> class FutureContinuation;
+        template <typename T, typename fnT>
+        using continuation_result_t = remove_future_t<std::decay_t<std::invoke_result_t<fnT&, T&>>>;
+
+        template <typename T, typename fnT>
+        Future< continuation_result_t<T, fnT> >
+        continuation_task(World& world, const Future<T>& arg, fnT&& fn);
+    }  // namespace detail
+
     /// Human readable printing of a \c Future to a stream.
 
     /// \tparam T The type of future.
@@ -389,13 +402,21 @@ namespace madness {
         /// \param[in] blah Description needed.
         explicit Future(const dddd& blah) : f(), value(nullptr) { }
 
+        /// Makes a new implementation object, which shares one pooled block with its reference count
+
+        /// \param[in] args Arguments forwarded to the \c FutureImpl constructor.
+        template <typename... argsT>
+        static std::shared_ptr< FutureImpl<T> > make_impl(const argsT&... args) {
+            return std::allocate_shared< FutureImpl<T> >(PoolStdAllocator< FutureImpl<T> >(), args...);
+        }
+
     public:
         /// \todo Brief description needed.
         typedef RemoteReference< FutureImpl<T> > remote_refT;
 
         /// Makes an unassigned future.
         Future() :
-            f(new FutureImpl<T>()), value(nullptr)
+            f(make_impl()), value(nullptr)
         {
         }
 
@@ -415,7 +436,7 @@ namespace madness {
         explicit Future(const remote_refT& remote_ref) :
                 f(remote_ref.is_local() ?
                         remote_ref.get_shared() :
-                        std::make_shared<FutureImpl<T> >(remote_ref)),
+                        make_impl(remote_ref)),
                 //                        std::shared_ptr<FutureImpl<T> >(new FutureImpl<T>(remote_ref))),
                 value(nullptr)
         {
@@ -442,7 +463,7 @@ namespace madness {
                 nullptr)
         {
             if(other.is_default_initialized())
-                f.reset(new FutureImpl<T>()); // Other was default constructed so make a new f
+                f = make_impl(); // Other was default constructed so make a new f
         }
 
         /// Destructor.
@@ -709,6 +730,44 @@ namespace madness {
                 f->register_callback(callback);
             }
         }
+
+        /// Runs a continuation inline once this future is assigned.
+
+        /// \c fn(value) is invoked by the thread that assigns this future
+        /// (immediately by the caller if it is already assigned), so no task
+        /// is made. This suits cheap follow-up work such as scaling or
+        /// forwarding a value; anything heavy should use the \c World
+        /// overload instead, since the assigning thread may be the
+        /// communication thread and holds the lock of this future while
+        /// \c fn runs (so \c fn must not register callbacks on this future).
+        /// \tparam fnT A callable taking \c T&
+        /// \param[in] fn The continuation
+        /// \return A future to the result of \c fn (flattened if \c fn
+        ///     returns a future), or a \c Future<void> if it returns \c void.
+        /// \pre `this->is_local()`
+        template <typename fnT>
+        Future< detail::continuation_result_t<T, fnT> > then(fnT&& fn) const {
+            typedef detail::continuation_result_t<T, fnT> resultT;
+            MADNESS_ASSERT(is_local());
+            auto* c = new detail::FutureContinuation<Future<T>, std::decay_t<fnT>, resultT>(
+                    *this, std::forward<fnT>(fn), 1);
+            Future<resultT> result = c->result();
+            const_cast<Future<T>&>(*this).register_callback(c);
+            return result;
+        }
+
+        /// Runs a continuation as a task once this future is assigned.
+
+        /// The same as \c then(fn) except that \c fn is submitted to the
+        /// task queue of \c world, for continuations too heavy to run inline.
+        /// \tparam fnT A callable taking \c T&
+        /// \param[in,out] world The world whose task queue runs \c fn
+        /// \param[in] fn The continuation
+        /// \return A future to the result of \c fn
+        template <typename fnT>
+        Future< detail::continuation_result_t<T, fnT> > then(World& world, fnT&& fn) const {
+            return detail::continuation_task(world, *this, std::forward<fnT>(fn));
+        }
     }; // class Future
 
 
@@ -796,6 +855,96 @@ namespace madness {
     }; // class Future<void>
 
 
+    namespace detail {
+
+        /// Holds the result of a continuation, with nothing to hold for \c void.
+        template <typename resultT>
+        class ContinuationResult {
+            Future<resultT> result_;
+        public:
+            template <typename fnT, typename... argsT>
+            void run(fnT& fn, argsT&... args) { result_.set(fn(args...)); }
+
+            Future<resultT> future() const { return result_; }
+        };
+
+        template <>
+        class ContinuationResult<void> {
+        public:
+            template <typename fnT, typename... argsT>
+            void run(fnT& fn, argsT&... args) { fn(args...); }
+
+            Future<void> future() const { return Future<void>(); }
+        };
+
+        /// Callback that runs a function once all of its futures are assigned.
+
+        /// It is registered with each future and deletes itself after the
+        /// last one is assigned and the function has run.
+        /// \tparam argT Either a \c Future, whose value is passed to the
+        ///     continuation, or (for \c when_all) a vector of futures
+        /// \tparam fnT The continuation
+        /// \tparam resultT The result type of the continuation
+        template <typename argT, typename fnT, typename resultT>
+        class FutureContinuation : public CallbackInterface {
+            argT arg_;
+            fnT fn_;
+            ContinuationResult<resultT> result_;
+            std::atomic<int> ndepend_;
+
+            template <typename U>
+            void invoke(Future<U>& arg) { result_.run(fn_, arg.get()); }
+
+            template <typename U>
+            void invoke(std::vector< Future<U> >& arg) { result_.run(fn_, arg); }
+
+        public:
+            template <typename argsT, typename fT>
+            FutureContinuation(const argsT& arg, fT&& fn, int ndepend) :
+                arg_(arg), fn_(std::forward<fT>(fn)), ndepend_(ndepend)
+            { }
+
+            Future<resultT> result() const { return result_.future(); }
+
+            void notify() override {
+                if (--ndepend_ == 0) {
+                    invoke(arg_);
+                    delete this;
+                }
+            }
+        }; // class FutureContinuation
+
+    }  // namespace detail
+
+    /// Runs a continuation inline once all futures in a vector are assigned.
+
+    /// \c fn(v) is invoked by the thread that assigns the last of the
+    /// futures, without making a task. As with \c Future::then this is only
+    /// for cheap work, such as combining the results of the children of a
+    /// tree node.
+    /// \tparam T The type of the futures
+    /// \tparam fnT A callable taking \c std::vector<Future<T>>&
+    /// \param[in] v The futures, which must be local
+    /// \param[in] fn The continuation
+    /// \return A future to the result of \c fn (flattened if \c fn returns
+    ///     a future), or a \c Future<void> if it returns \c void.
+    template <typename T, typename fnT>
+    Future< remove_future_t<std::decay_t<std::invoke_result_t<fnT&, std::vector< Future<T> >&>>> >
+    when_all(const std::vector< Future<T> >& v, fnT&& fn) {
+        typedef std::vector< Future<T> > argT;
+        typedef remove_future_t<std::decay_t<std::invoke_result_t<fnT&, argT&>>> resultT;
+        // One extra count is held until every callback is registered
+        auto* c = new detail::FutureContinuation<argT, std::decay_t<fnT>, resultT>(
+                v, std::forward<fnT>(fn), v.size() + 1);
+        auto result = c->result();
+        for (const Future<T>& f : v) {
+            MADNESS_ASSERT(f.is_local());
+            const_cast<Future<T>&>(f).register_callback(c);
+        }
+        c->notify();
+        return result;
+    }
+
     /// Specialization of \c Future for a vector of `Future`s.
 
     /// Enables passing a vector of futures into a task and having the
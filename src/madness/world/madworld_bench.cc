@@ -0,0 +1,324 @@
+#include <madness/world/MADworld.h>
+#include <madness/world/worlddc.h>
+#include <madness/world/worldhashmap.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+// This program measures the runtime primitives of MADworld and writes the
+// results as one JSON object so that runs can be compared across MADNESS
+// versions, MAD_BUFFER_SIZE settings and thread counts.
+//
+//   tasks     : spawn and execute rate of empty tasks
+//   future    : set/get latency on one thread and through a task
+//   am        : active-message round-trip latency and bandwidth by size
+//               (rank 0 to rank 1, or to itself on one process)
+//   gop       : fence and sum latency (run at several process counts)
+//   container : WorldContainer local and remote insert/find rates
+//   hashmap   : ConcurrentHashMap update rate vs. number of threads, with
+//               all threads on a few keys (contended) or on their own keys
+//
+// Usage: madworld_bench [scale] [output.json]
+//
+// scale multiplies the repetition counts (default 1, e.g. 0.01 for a quick
+// check); the JSON is printed by rank 0 and also written to output.json.
+
+using namespace madness;
+
+namespace {
+
+    /// Collects the results of one rank as a JSON object of sections
+    class JsonReport {
+        std::ostringstream s;
+        const char* sep = "";
+    public:
+        JsonReport() {
+            s.precision(6);
+            s << "{";
+        }
+
+        /// Starts a nested object named \c name
+        void begin(const char* name) {
+            s << sep << "\n  \"" << name << "\": {";
+            sep = "";
+        }
+
+        void end() {
+            s << "}";
+            sep = ",";
+        }
+
+        template <typename T>
+        void add(const std::string& name, const T& value) {
+            s << sep << "\"" << name << "\": " << value;
+            sep = ", ";
+        }
+
+        std::string str() const {
+            return s.str() + "\n}\n";
+        }
+    };
+
+    /// Returns \c n scaled by \c scale, at least 1
+    long nrep(long n, double scale) {
+        return std::max(1L, long(n*scale));
+    }
+
+    /// Returns the wall time per repetition of \c op, between two fences
+    template <typename opT>
+    double time_op(World& world, long nrep, opT op) {
+        world.gop.fence();
+        const double start = wall_time();
+        for (long i=0; i<nrep; ++i) op();
+        const double used = wall_time() - start;
+        world.gop.fence();
+        return used/nrep;
+    }
+
+    /// Target of the active-message measurements
+    class Echo : public WorldObject<Echo> {
+    public:
+        Echo(World& world) : WorldObject<Echo>(world) {
+            process_pending();
+        }
+
+        std::size_t echo(const std::vector<unsigned char>& buf) const {
+            return buf.size();
+        }
+    };
+
+    void bench_tasks(World& world, JsonReport& report, double scale) {
+        const long ntask = nrep(200000, scale);
+        AtomicInt count;
+        count = 0;
+
+        world.gop.fence();
+        const double start = wall_time();
+        for (long i=0; i<ntask; ++i)
+            world.taskq.add([&count]() { count++; });
+        const double spawned = wall_time();
+        world.taskq.fence();
+        const double done = wall_time();
+        MADNESS_CHECK(count == ntask);
+
+        report.begin("tasks");
+        report.add("ntask", ntask);
+        report.add("spawn_per_s", ntask/(spawned - start));
+        report.add("execute_per_s", ntask/(done - start));
+        report.end();
+    }
+
+    void bench_future(World& world, JsonReport& report, double scale) {
+        const long nset = nrep(100000, scale);
+
+        const double tlocal = time_op(world, nset, [] {
+            Future<int> f;
+            f.set(1);
+            MADNESS_CHECK(f.get() == 1);
+        });
+
+        const long ntask = nrep(10000, scale);
+        const double ttask = time_op(world, ntask, [&world] {
+            MADNESS_CHECK(world.taskq.add([]() { return 1; }).get() == 1);
+        });
+
+        report.begin("future");
+        report.add("set_get_s", tlocal);
+        report.add("task_set_get_s", ttask);
+        report.end();
+    }
+
+    void bench_am(World& world, JsonReport& report, double scale) {
+        Echo echo(world);
+        const ProcessID dest = (world.size() > 1) ? 1 : 0;
+        const std::size_t maxsize = 4*1024*1024;
+        const long total = nrep(64*1024*1024, scale);
+
+        std::ostringstream results;
+        results.precision(6);
+
+        world.gop.fence();
+        for (std::size_t size=8; size<=maxsize; size*=4) {
+            const std::vector<unsigned char> buf(size, 1);
+            const long nmsg = std::max<long>(1, std::min<long>(nrep(1000, scale), total/size));
+
+            double latency = 0.0, bandwidth = 0.0;
+            if (world.rank() == 0) {
+                // Round trips one after another
+                const long nlat = nrep(100, scale);
+                double start = wall_time();
+                for (long i=0; i<nlat; ++i)
+                    MADNESS_CHECK(echo.task(dest, &Echo::echo, buf).get() == size);
+                latency = (wall_time() - start)/nlat;
+
+                // All messages in flight at once
+                std::vector< Future<std::size_t> > replies;
+                replies.reserve(nmsg);
+                start = wall_time();
+                for (long i=0; i<nmsg; ++i)
+                    replies.push_back(echo.task(dest, &Echo::echo, buf));
+                for (auto& r : replies)
+                    MADNESS_CHECK(r.get() == size);
+                bandwidth = nmsg*double(size)/(wall_time() - start);
+            }
+            world.gop.fence();
+
+            results << (size == 8 ? "" : ", ") << "{\"bytes\": " << size
+                    << ", \"round_trip_s\": " << latency
+                    << ", \"bytes_per_s\": " << bandwidth << "}";
+        }
+
+        report.begin("am");
+        report.add("dest", dest);
+        report.add("by_size", "[" + results.str() + "]");
+        report.end();
+    }
+
+    void bench_gop(World& world, JsonReport& report, double scale) {
+        const long ngop = nrep(1000, scale);
+        const long expected = long(world.size())*(world.size()-1)/2;
+
+        const double tfence = time_op(world, ngop, [&world] { world.gop.fence(); });
+        const double tsum = time_op(world, ngop, [&world, expected] {
+            long value = world.rank();
+            world.gop.sum(value);
+            MADNESS_CHECK(value == expected);
+        });
+
+        report.begin("gop");
+        report.add("nproc", world.size());
+        report.add("fence_s", tfence);
+        report.add("sum_s", tsum);
+        report.end();
+    }
+
+    void bench_container(World& world, JsonReport& report, double scale) {
+        typedef WorldContainer<long,double> dcT;
+        const long nkey = nrep(20000, scale);
+        const ProcessID me = world.rank();
+        const ProcessID other = (me + 1) % world.size();
+
+        dcT dc(world);
+
+        // Keys owned by this process and by the next one
+        std::vector<long> local, remote;
+        for (long key=0; long(local.size())<nkey || long(remote.size())<nkey; ++key) {
+            const ProcessID owner = dc.owner(key);
+            if (owner == me && long(local.size()) < nkey) local.push_back(key);
+            if (owner == other && long(remote.size()) < nkey) remote.push_back(key);
+        }
+
+        auto rates = [&](const std::vector<long>& keys, double& insert, double& find) {
+            world.gop.fence();
+            double start = wall_time();
+            for (long key : keys) dc.replace(key, double(key));
+            world.gop.fence();
+            insert = keys.size()/(wall_time() - start);
+
+            std::vector< Future<dcT::iterator> > found;
+            found.reserve(keys.size());
+            start = wall_time();
+            for (long key : keys) found.push_back(dc.find(key));
+            for (auto& f : found) MADNESS_CHECK(f.get() != dc.end());
+            find = keys.size()/(wall_time() - start);
+            found.clear();
+            world.gop.fence();
+        };
+
+        double local_insert, local_find, remote_insert, remote_find;
+        rates(local, local_insert, local_find);
+        rates(remote, remote_insert, remote_find);
+
+        report.begin("container");
+        report.add("nkey", nkey);
+        report.add("local_insert_per_s", local_insert);
+        report.add("local_find_per_s", local_find);
+        report.add("remote_insert_per_s", remote_insert);
+        report.add("remote_find_per_s", remote_find);
+        report.end();
+    }
+
+    /// Returns the updates per second of \c nthread threads incrementing keys
+    /// of one map; thread t uses keys t*stride .. t*stride+nkey-1
+    double hashmap_rate(int nthread, long nupdate, long nkey, long stride) {
+        typedef ConcurrentHashMap<long,long> mapT;
+        mapT map;
+        std::vector<std::thread> threads;
+
+        const double start = wall_time();
+        for (int t=0; t<nthread; ++t) {
+            threads.emplace_back([&map, t, nupdate, nkey, stride]() {
+                for (long i=0; i<nupdate; ++i) {
+                    mapT::accessor acc;
+                    [[maybe_unused]] auto inserted = map.insert(acc, t*stride + i%nkey);
+                    acc->second++;
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        const double used = wall_time() - start;
+
+        long sum = 0;
+        for (const auto& datum : map) sum += datum.second;
+        MADNESS_CHECK(sum == nthread*nupdate);
+        return nthread*nupdate/used;
+    }
+
+    void bench_hashmap(World& world, JsonReport& report, double scale) {
+        const long nupdate = nrep(200000, scale);
+        const int maxthread = std::max(1u, std::thread::hardware_concurrency());
+
+        std::ostringstream results;
+        results.precision(6);
+        for (int nthread=1; ; nthread=std::min(2*nthread, maxthread)) {
+            const double contended = hashmap_rate(nthread, nupdate, 16, 0);
+            const double disjoint = hashmap_rate(nthread, nupdate, 1024, 1024);
+            results << (nthread == 1 ? "" : ", ") << "{\"threads\": " << nthread
+                    << ", \"contended_per_s\": " << contended
+                    << ", \"disjoint_per_s\": " << disjoint << "}";
+            if (nthread == maxthread) break;
+        }
+        world.gop.fence();
+
+        report.begin("hashmap");
+        report.add("by_threads", "[" + results.str() + "]");
+        report.end();
+    }
+}
+
+int main(int argc, char** argv) {
+    World& world = initialize(argc, argv);
+
+    const double scale = (argc > 1) ? std::atof(argv[1]) : 1.0;
+    const char* filename = (argc > 2) ? argv[2] : nullptr;
+
+    JsonReport report;
+    report.begin("config");
+    report.add("nproc", world.size());
+    report.add("nthread", ThreadPool::size());
+    // RMI is only started with more than one process
+    report.add("max_msg_len", (world.size() > 1) ? RMI::max_msg_len() : 0);
+    report.add("scale", scale);
+    report.end();
+
+    bench_tasks(world, report, scale);
+    bench_future(world, report, scale);
+    bench_am(world, report, scale);
+    bench_gop(world, report, scale);
+    bench_container(world, report, scale);
+    bench_hashmap(world, report, scale);
+
+    if (world.rank() == 0) {
+        const std::string json = report.str();
+        std::cout << json;
+        if (filename) {
+            std::ofstream file(filename);
+            file << json;
+        }
+    }
+
+    finalize();
+    return 0;
+}
@@ -0,0 +1,255 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+
+
+  $Id$
+*/
+
+/**
+ \file memory_accounting.cc
+ \brief Counters, JSON timeline and summary of the per-subsystem memory accounting.
+ \ingroup world
+*/
+
+#include <madness/world/memory_accounting.h>
+#include <madness/world/MADworld.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace madness {
+
+    thread_local detail::MemoryThreadCounters* MemoryAccounting::local_ = nullptr;
+    std::atomic<std::int64_t> MemoryAccounting::high_water_[MemoryAccounting::ncategory+1] = {};
+
+    namespace {
+
+        /// The counters of all threads, ever
+        struct MemoryRegistry {
+            Mutex mutex;
+            std::vector< std::unique_ptr<detail::MemoryThreadCounters> > threads;
+        };
+
+        /// Never destroyed, since threads free memory until the program has exited
+        MemoryRegistry& registry() {
+            static MemoryRegistry* r = new MemoryRegistry;
+            return *r;
+        }
+
+        /// Samples the counters until stopped, and appends a record to the
+        /// timeline file (if one is open) every period seconds
+        class MemorySampler {
+            std::ofstream file;
+            const int rank;
+            const double period;
+            const double start;
+            double last_write = 0.0;
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool stopping = false;
+            std::thread thread;
+
+            void write() {
+                last_write = wall_time();
+                MemoryAccounting::write_json(file, rank, last_write - start);
+                file.flush();
+            }
+
+            void run() {
+                const double wait = file.is_open() ? std::min(period, MemoryAccounting::sample_period)
+                                                   : MemoryAccounting::sample_period;
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!cv.wait_for(lock, std::chrono::duration<double>(wait), [this]{return stopping;})) {
+                    if (file.is_open() && wall_time() - last_write >= period) write();
+                    else MemoryAccounting::sample();
+                }
+            }
+
+        public:
+            /// \param[in] filename The timeline file, or empty for no timeline.
+            MemorySampler(const std::string& filename, int rank, double period)
+                : rank(rank), period(period), start(wall_time())
+            {
+                if (!filename.empty()) {
+                    file.open(filename.c_str(), std::ios::out | std::ios::trunc);
+                    if (!file) MADNESS_EXCEPTION("MemoryAccounting: failed to open the timeline file", 0);
+                    write();
+                }
+                thread = std::thread([this]{run();});
+            }
+
+            /// Stops the thread and writes a last record
+            ~MemorySampler() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                cv.notify_one();
+                thread.join();
+                if (file.is_open()) write();
+            }
+
+            bool has_timeline() const {
+                return file.is_open();
+            }
+        };
+
+        std::unique_ptr<MemorySampler> sampler;
+
+        const char* category_names[] = {"tensor", "hashmap", "rmi", "task", "cloud"};
+
+    } // namespace
+
+    const char* MemoryAccounting::name(MemoryCategory c) {
+        return (c < MemoryCategory::ncategory) ? category_names[std::size_t(c)] : "total";
+    }
+
+    detail::MemoryThreadCounters* MemoryAccounting::register_thread() {
+        MemoryRegistry& r = registry();
+        ScopedMutex<Mutex> guard(r.mutex);
+        r.threads.emplace_back(new detail::MemoryThreadCounters);
+        return local_ = r.threads.back().get();
+    }
+
+    void MemoryAccounting::sum(std::int64_t (&current)[ncategory+1]) {
+        for (std::size_t i=0; i<=ncategory; ++i) current[i] = 0;
+        {
+            MemoryRegistry& r = registry();
+            ScopedMutex<Mutex> guard(r.mutex);
+            for (const auto& t : r.threads) {
+                for (std::size_t i=0; i<ncategory; ++i)
+                    current[i] += t->current[i].load(std::memory_order_relaxed);
+            }
+        }
+        for (std::size_t i=0; i<ncategory; ++i) current[ncategory] += current[i];
+
+        for (std::size_t i=0; i<=ncategory; ++i) {
+            std::int64_t hwm = high_water_[i].load(std::memory_order_relaxed);
+            while (current[i] > hwm &&
+                   !high_water_[i].compare_exchange_weak(hwm, current[i], std::memory_order_relaxed)) { }
+        }
+    }
+
+    MemoryAccountingStats MemoryAccounting::get_stats(MemoryCategory c) {
+        std::int64_t current[ncategory+1];
+        sum(current);
+        const std::size_t i = std::size_t(c);
+        return MemoryAccountingStats{current[i], high_water_[i].load(std::memory_order_relaxed)};
+    }
+
+    void MemoryAccounting::sample() {
+        std::int64_t current[ncategory+1];
+        sum(current);
+    }
+
+    void MemoryAccounting::reset_high_water() {
+        std::int64_t current[ncategory+1];
+        sum(current);
+        for (std::size_t i=0; i<=ncategory; ++i)
+            high_water_[i].store(current[i], std::memory_order_relaxed);
+    }
+
+    void MemoryAccounting::write_json(std::ostream& os, int rank, double time) {
+        // Build the line first so that it is written in one piece
+        std::ostringstream s;
+        s.precision(6);
+        std::int64_t current[ncategory+1];
+        sum(current);
+        s << std::fixed << "{\"rank\": " << rank << ", \"time\": " << time;
+        for (const char* field : {"current", "high_water"}) {
+            s << ", \"" << field << "\": {";
+            for (std::size_t i=0; i<=ncategory; ++i) {
+                s << (i ? ", " : "") << "\"" << name(MemoryCategory(i)) << "\": "
+                  << (field[0] == 'c' ? current[i] : high_water_[i].load(std::memory_order_relaxed));
+            }
+            s << "}";
+        }
+        s << "}\n";
+        os << s.str();
+    }
+
+    void MemoryAccounting::begin(int rank) {
+        if (sampler) return;
+        const char* value = std::getenv("MAD_MEMORY_TIMELINE");
+        const double period = value ? std::atof(value) : 0.0;
+        std::ostringstream filename;
+        if (period > 0.0) filename << "MEMORY_TIMELINE." << rank << ".json";
+        sampler.reset(new MemorySampler(filename.str(), rank, period));
+        if (period > 0.0 && rank == 0 && !madness::quiet())
+            std::cout << "MADNESS memory timeline on, writing every " << period
+                      << " s to MEMORY_TIMELINE.<rank>.json\n";
+    }
+
+    void MemoryAccounting::end(World& world) {
+        if (!sampler) return;
+        // All processes read the same environment so either all or none have a timeline
+        const bool timeline = sampler->has_timeline();
+        sampler.reset();
+        if (timeline) print(world);
+    }
+
+    void MemoryAccounting::print(World& world) {
+        const std::size_t n = ncategory + 1;
+        long hwm_max[n], hwm_sum[n], cur_sum[n];
+        std::int64_t current[n];
+        sum(current);
+        for (std::size_t i=0; i<n; ++i) {
+            hwm_max[i] = hwm_sum[i] = high_water_[i].load(std::memory_order_relaxed);
+            cur_sum[i] = current[i];
+        }
+        world.gop.max(hwm_max, n);
+        world.gop.sum(hwm_sum, n);
+        world.gop.sum(cur_sum, n);
+
+        if (world.rank() == 0) {
+            const double to_MiB = 1.0/(1024.0*1024.0);
+            std::printf("\n    MADNESS memory accounting (MiB)\n");
+            std::printf("    -------------------------------\n\n");
+            std::printf("    o  high-water max and avg are over processes, current is the sum\n");
+            std::printf("    o  the total high-water is that of the sum of the categories\n\n");
+            std::printf("    category    hwm-max    hwm-avg    current\n");
+            std::printf("   ---------- ---------- ---------- ----------\n");
+            for (std::size_t i=0; i<n; ++i)
+                std::printf("    %-10s %10.1f %10.1f %10.1f\n", name(MemoryCategory(i)),
+                            hwm_max[i]*to_MiB, hwm_sum[i]*to_MiB/world.size(), cur_sum[i]*to_MiB);
+            std::printf("\n");
+            std::fflush(stdout);
+        }
+    }
+
+} // namespace madness
@@ -0,0 +1,178 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+
+
+  $Id$
+*/
+
+#ifndef MADNESS_WORLD_MEMORY_ACCOUNTING_H__INCLUDED
+#define MADNESS_WORLD_MEMORY_ACCOUNTING_H__INCLUDED
+
+/**
+ \file memory_accounting.h
+ \brief Always-on accounting of the memory held by the main subsystems.
+ \ingroup world
+
+ Unlike \c WorldMemInfo, which needs \c WORLD_GATHER_MEM_STATS and sees only
+ the global \c new and \c delete, the subsystems that hold most of the memory
+ of a run tell \c MemoryAccounting directly how much they allocate and free.
+ Each category keeps the bytes currently held and the high-water mark of
+ this process. Recording only updates a counter of the calling thread, with
+ no atomic read-modify-write; the counters of all threads are summed when
+ they are read. The high-water marks are the largest sums seen, by the
+ reads and by a background thread that samples the counters every
+ \c MemoryAccounting::sample_period seconds, so a peak shorter than that may
+ be missed.
+
+ Setting \c MAD_MEMORY_TIMELINE to a number of seconds makes every process
+ append a JSON record of its counters to \c MEMORY_TIMELINE.<rank>.json at
+ that interval (one object per line, flushed as written, so the file
+ survives a run killed by running out of memory), and \c finalize() print
+ the high-water marks reduced over all processes.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+namespace madness {
+
+    class World;
+
+    /// Subsystems whose memory is accounted by \c MemoryAccounting
+    enum class MemoryCategory : unsigned char {
+        tensor,   ///< Data of \c Tensor (function coefficients and everything else)
+        hashmap,  ///< Bins and entries of \c ConcurrentHashMap (keys and nodes, not the tensors they hold)
+        rmi,      ///< RMI receive buffers and the pooled message buffers
+        task,     ///< Pooled task objects and futures
+        cloud,    ///< Objects cached by \c Cloud
+        ncategory ///< Number of categories
+    };
+
+    /// Counters of one category (or of the sum of all)
+    struct MemoryAccountingStats {
+        std::int64_t current;    ///< Bytes held now
+        std::int64_t high_water; ///< Most bytes held at any time since the last reset
+    };
+
+    namespace detail {
+
+        /// Bytes allocated minus bytes freed by one thread, per category
+
+        /// Only the owning thread writes them; memory freed by another thread
+        /// than the one that allocated it makes them negative.
+        struct MemoryThreadCounters {
+            std::atomic<std::int64_t> current[std::size_t(MemoryCategory::ncategory)] = {};
+        };
+
+    } // namespace detail
+
+    /// Per-subsystem memory accounting with high-water marks
+
+    /// All members are static. See \c memory_accounting.h for an overview.
+    class MemoryAccounting {
+        static constexpr std::size_t ncategory = std::size_t(MemoryCategory::ncategory);
+
+        static thread_local detail::MemoryThreadCounters* local_;  ///< Counters of this thread, null until used
+        static std::atomic<std::int64_t> high_water_[ncategory+1]; ///< Largest sums seen, last entry is the total
+
+        /// Creates the counters of this thread
+        static detail::MemoryThreadCounters* register_thread();
+
+        /// Sums the counters of all threads and raises the high-water marks
+
+        /// \param[out] current The sums, the last entry is the total.
+        static void sum(std::int64_t (&current)[ncategory+1]);
+
+        static void update(std::size_t i, std::int64_t nbyte) {
+            detail::MemoryThreadCounters* t = local_ ? local_ : register_thread();
+            t->current[i].store(t->current[i].load(std::memory_order_relaxed) + nbyte, std::memory_order_relaxed);
+        }
+
+    public:
+        /// Interval of the background sampling of the high-water marks, in seconds
+        static constexpr double sample_period = 0.01;
+
+        /// Records that \c nbyte bytes were allocated for category \c c
+        static void add(MemoryCategory c, std::size_t nbyte) {
+            update(std::size_t(c), std::int64_t(nbyte));
+        }
+
+        /// Records that \c nbyte bytes of category \c c were freed
+        static void sub(MemoryCategory c, std::size_t nbyte) {
+            update(std::size_t(c), -std::int64_t(nbyte));
+        }
+
+        /// Returns the counters of category \c c on this process
+
+        /// Sums the counters of all threads, which also samples the high-water marks.
+        static MemoryAccountingStats get_stats(MemoryCategory c);
+
+        /// Samples the counters, raising the high-water marks to the bytes held now
+        static void sample();
+
+        /// Returns the counters summed over all categories on this process
+
+        /// The high-water mark of the sum is at most the sum of the high-water marks.
+        static MemoryAccountingStats get_total_stats() {
+            return get_stats(MemoryCategory::ncategory);
+        }
+
+        /// Returns the name of category \c c as used in the JSON records
+        static const char* name(MemoryCategory c);
+
+        /// Resets the high-water marks to the bytes held now
+        static void reset_high_water();
+
+        /// Writes the counters of this process as one JSON object on one line
+
+        /// \param[in,out] os The stream.
+        /// \param[in] rank The rank of this process.
+        /// \param[in] time The time of the record (seconds since \c initialize()).
+        static void write_json(std::ostream& os, int rank, double time);
+
+        /// Starts the background sampling and, if \c MAD_MEMORY_TIMELINE is set, the timeline; called by \c initialize()
+        static void begin(int rank);
+
+        /// Stops the sampling and the timeline and, if it ran, prints the summary; called by \c finalize()
+
+        /// Collective over \c world.
+        static void end(World& world);
+
+        /// Prints the high-water marks reduced over all processes on process 0
+
+        /// Collective over \c world.
+        static void print(World& world);
+    }; // class MemoryAccounting
+
+} // namespace madness
+
+#endif // MADNESS_WORLD_MEMORY_ACCOUNTING_H__INCLUDED
@@ -0,0 +1,103 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+/**
+ \file mmap_archive.cc
+ \brief Implements an input archive reading a memory-mapped binary file.
+ \ingroup serialization
+*/
+
+#include <madness/world/mmap_archive.h>
+#include <madness/world/madness_exception.h>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace madness {
+    namespace archive {
+
+        MmapAdvice MmapInputArchive::default_advice = MmapAdvice::sequential;
+
+        MmapInputArchive::MmapInputArchive(const char* filename, MmapAdvice advice)
+                : map(), nbyte(0), pos(0), advice(advice) {
+            if (filename) open(filename);
+        }
+
+        void MmapInputArchive::open(const char* filename) {
+            close();
+            const int fd = ::open(filename, O_RDONLY);
+            if (fd < 0) MADNESS_EXCEPTION("MmapInputArchive: open: failed", 1);
+            struct stat st;
+            if (fstat(fd, &st) || st.st_size == 0) {
+                ::close(fd);
+                MADNESS_EXCEPTION("MmapInputArchive: open: not an archive?", 1);
+            }
+            const std::size_t size = st.st_size;
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd); // The mapping keeps the file open
+            if (p == MAP_FAILED) MADNESS_EXCEPTION("MmapInputArchive: open: mmap failed", 1);
+
+            // Hints only, so failures are ignored
+            switch (advice) {
+            case MmapAdvice::prefetch:
+                madvise(p, size, MADV_WILLNEED);
+                // fall through
+            case MmapAdvice::sequential:
+                madvise(p, size, MADV_SEQUENTIAL);
+                break;
+            case MmapAdvice::on_demand:
+                madvise(p, size, MADV_RANDOM);
+                break;
+            }
+
+            map.reset(static_cast<const char*>(p), [size](const char* q) {munmap((void*) q, size);});
+            nbyte = size;
+            pos = 0;
+
+            char cookie[255];
+            const std::size_t n = strlen(ARCHIVE_COOKIE)+1;
+            if (n > nbyte) MADNESS_EXCEPTION("MmapInputArchive: open: not an archive?", 1);
+            load(cookie, n);
+            if (strncmp(cookie,ARCHIVE_COOKIE,n) != 0)
+                MADNESS_EXCEPTION("MmapInputArchive: open: not an archive?", 1);
+        }
+
+        void MmapInputArchive::close() {
+            map.reset();
+            nbyte = 0;
+            pos = 0;
+        }
+
+    } // namespace archive
+} // namespace madness
@@ -0,0 +1,140 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_WORLD_MMAP_ARCHIVE_H__INCLUDED
+#define MADNESS_WORLD_MMAP_ARCHIVE_H__INCLUDED
+
+/**
+ \file mmap_archive.h
+ \brief Implements an input archive reading a memory-mapped binary file.
+ \ingroup serialization
+*/
+
+#include <type_traits>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <madness/world/archive.h>
+
+namespace madness {
+    namespace archive {
+
+        /// \addtogroup serialization
+        /// @{
+
+        /// How the pages of a memory-mapped archive are brought in (see \c MmapInputArchive)
+        enum class MmapAdvice {
+            sequential, ///< Aggressive read-ahead, pages are dropped behind the reader (default)
+            prefetch,   ///< As \c sequential, and start reading the whole file at once
+            on_demand   ///< No read-ahead, only the pages touched are read
+        };
+
+        /// Wraps an archive around a memory-mapped binary file for input.
+
+        /// Reads files written by \c BinaryFstreamOutputArchive. The file is
+        /// mapped read-only and data are copied straight from the mapping to
+        /// their destination (e.g. the data of a \c Tensor), instead of going
+        /// through the buffers of a \c std::ifstream. Copies of an open archive
+        /// share the mapping but not the read position.
+        ///
+        /// Use it as the local archive of a \c ParallelInputArchive, e.g.
+        /// \code
+        ///   archive::ParallelInputArchive<archive::MmapInputArchive> ar(world, "restartdata");
+        /// \endcode
+        class MmapInputArchive : public BaseInputArchive {
+            std::shared_ptr<const char> map; ///< The mapping, null if closed.
+            std::size_t nbyte;               ///< Size of the mapping.
+            mutable std::size_t pos;         ///< Read position.
+            MmapAdvice advice;               ///< Access pattern hint given to the OS.
+
+            static MmapAdvice default_advice; ///< Advice used by archives not given one.
+
+        public:
+            /// Default constructor.
+
+            /// The filename is optional here; it can be specified later by
+            /// calling \c open().
+            /// \param[in] filename Name of the file to read from.
+            /// \param[in] advice How the pages are brought in.
+            MmapInputArchive(const char* filename = nullptr, MmapAdvice advice = default_advice);
+
+            /// Opens the archive of the given name.
+
+            /// \param[in] filename Name of the file to read from.
+            /// \param[in] advice How the pages are brought in.
+            MmapInputArchive(const std::string name, MmapAdvice advice = default_advice)
+                    : MmapInputArchive(name.c_str(), advice) {}
+
+            /// Load from the mapping.
+
+            /// The function only appears (due to \c enable_if) if \c T is
+            /// serializable.
+            /// \tparam T The type of data to be read.
+            /// \param[out] t Where to put the loaded data.
+            /// \param[in] n The number of data items to be loaded.
+            template <class T>
+            inline
+            typename std::enable_if< is_trivially_serializable<T>::value, void >::type
+            load(T* t, long n) const {
+                const std::size_t size = n*sizeof(T);
+                if (size > nbyte - pos)
+                    MADNESS_EXCEPTION("MmapInputArchive: load: read past the end of the file", n);
+                std::memcpy((void*) t, map.get() + pos, size);
+                pos += size;
+            }
+
+            /// Map the file.
+
+            /// \param[in] filename Name of the file to read from.
+            void open(const char* filename);
+
+            /// Unmap the file (once no copy of this archive uses it).
+            void close();
+
+            /// Returns the number of bytes not yet read.
+            std::size_t remaining() const {
+                return nbyte - pos;
+            }
+
+            /// Sets the advice of archives subsequently constructed without one.
+
+            /// This is how to choose the advice of the archives opened by
+            /// \c ParallelInputArchive.
+            /// \param[in] advice How the pages are brought in.
+            static void set_default_advice(MmapAdvice advice) {
+                default_advice = advice;
+            }
+        };
+
+        /// @}
+    }
+}
+#endif // MADNESS_WORLD_MMAP_ARCHIVE_H__INCLUDED
@@ -41,6 +41,9 @@
 #include <type_traits>
 #include <madness/world/archive.h>
 #include <madness/world/binary_fstream_archive.h>
+#include <madness/world/mmap_archive.h>
+#include <madness/world/async_fstream_archive.h>
+#include <madness/world/shared_file_archive.h>
 #include <madness/world/world.h>
 #include <madness/world/worldgop.h>
 
@@ -60,7 +63,9 @@ namespace madness {
 
         /// Base class for input and output parallel archives.
 
-        /// \tparam Archive The local archive. Only tested for \c BinaryFstreamInputArchive and \c BinaryFstreamOutputArchive.
+        /// \tparam Archive The local archive. Only tested for \c BinaryFstreamInputArchive, \c BinaryFstreamOutputArchive,
+        ///     \c MmapInputArchive and \c AsyncFstreamOutputArchive, and for the single shared file of
+        ///     \c SharedFileOutputArchive and \c SharedFileInputArchive.
         /// \todo Should this class derive from \c BaseArchive?
         template <typename Archive>
         class BaseParallelArchive {
@@ -86,7 +91,7 @@ namespace madness {
 
             /// Default constructor.
             template <typename X=Archive>
-            BaseParallelArchive(typename std::enable_if_t<std::is_same<X,BinaryFstreamInputArchive>::value || std::is_same<X,BinaryFstreamOutputArchive>::value,int> nio=0)
+            BaseParallelArchive(typename std::enable_if_t<std::is_same<X,BinaryFstreamInputArchive>::value || std::is_same<X,BinaryFstreamOutputArchive>::value || std::is_same<X,MmapInputArchive>::value || std::is_same<X,AsyncFstreamOutputArchive>::value || std::is_same<X,SharedFileOutputArchive>::value || std::is_same<X,SharedFileInputArchive>::value,int> nio=0)
                 : world(nullptr), ar(), nio(nio), do_fence(true) {
             }
 
@@ -151,7 +156,7 @@ namespace madness {
             /// \param[in] nwriter The number of writers.
 
             template <typename X=Archive>
-            typename std::enable_if_t<std::is_same<X,BinaryFstreamInputArchive>::value || std::is_same<X,BinaryFstreamOutputArchive>::value,
+            typename std::enable_if_t<std::is_same<X,BinaryFstreamInputArchive>::value || std::is_same<X,BinaryFstreamOutputArchive>::value || std::is_same<X,MmapInputArchive>::value || std::is_same<X,AsyncFstreamOutputArchive>::value,
                                       void>
             open(World& world, const char* filename, int nwriter=1) {
                 this->world = &world;
@@ -197,6 +202,36 @@ namespace madness {
                 set_nclient(world);
             }
 
+            /// Opens the parallel archive of one file shared by all processes.
+
+            /// Every process opens the file, so all of them are I/O nodes and
+            /// the number of writers is ignored. Process zero stores the
+            /// serial data, and all processes write and read the data of a
+            /// \c WorldContainer. An archive can be read by any number of
+            /// processes.
+            /// \param[in] world The world.
+            /// \param[in] filename Name of the file.
+            /// \param[in] nwriter The number of writers. Ignored.
+            template <typename X=Archive>
+            typename std::enable_if_t<std::is_same<X,SharedFileInputArchive>::value || std::is_same<X,SharedFileOutputArchive>::value,
+                                      void>
+            open(World& world, const char* filename, int nwriter=1) {
+                this->world = &world;
+                nio = world.size();
+
+                MADNESS_CHECK(filename);
+                MADNESS_CHECK(strlen(filename)+1<=sizeof(fname));
+                strcpy(fname,filename); // Save the filename for later
+
+                if (ar.is_input_archive and (not exists(world,filename))) {
+                    std::string msg = "could not find file: " + std::string(filename);
+                    throw std::runtime_error(msg);
+                }
+                ar.open(world, filename);
+
+                set_nclient(world);
+            }
+
             // Count #client
             void set_nclient(World& world) {
 				ProcessID me = world.rank();
@@ -219,7 +254,7 @@ namespace madness {
             /// \return True if the named, unopened archive exists and is readable.
             template <typename X=Archive>
             static
-            typename std::enable_if_t<std::is_same<X,BinaryFstreamInputArchive>::value || std::is_same<X,BinaryFstreamOutputArchive>::value,
+            typename std::enable_if_t<std::is_same<X,BinaryFstreamInputArchive>::value || std::is_same<X,BinaryFstreamOutputArchive>::value || std::is_same<X,MmapInputArchive>::value || std::is_same<X,AsyncFstreamOutputArchive>::value,
                                       bool>
             exists(World& world, const char* filename) {
                 constexpr std::size_t bufsize=512;
@@ -261,6 +296,26 @@ namespace madness {
                 get_world()->gop.broadcast_serializable(obj, root);
             }
 
+            /// Returns true if the named, unopened shared file exists on disk with read access.
+
+            /// This is a collective operation.
+            /// \param[in] world The world.
+            /// \param[in] filename Name of the file.
+            /// \return True if the named, unopened archive exists and is readable.
+            template <typename X=Archive>
+            static
+            typename std::enable_if_t<std::is_same<X,SharedFileInputArchive>::value || std::is_same<X,SharedFileOutputArchive>::value,
+                                      bool>
+            exists(World& world, const char* filename) {
+                bool status;
+                if (world.rank() == 0)
+                    status = (access(filename, F_OK|R_OK) == 0);
+
+                world.gop.broadcast(status);
+
+                return status;
+            }
+
             /// Deletes the files associated with the archive of the given name.
 
             /// Presently assumes a shared file system since process zero does the
@@ -269,7 +324,7 @@ namespace madness {
             /// \param[in] filename Base name of the file.
             template <typename X=Archive>
             static
-            typename std::enable_if_t<std::is_same<X,BinaryFstreamInputArchive>::value || std::is_same<X,BinaryFstreamOutputArchive>::value,
+            typename std::enable_if_t<std::is_same<X,BinaryFstreamInputArchive>::value || std::is_same<X,BinaryFstreamOutputArchive>::value || std::is_same<X,MmapInputArchive>::value || std::is_same<X,AsyncFstreamOutputArchive>::value,
                                       void>
             remove(World& world, const char* filename) {
                 if (world.rank() == 0) {
@@ -283,6 +338,18 @@ namespace madness {
                 }
             }
 
+            /// Deletes the shared file of the given name.
+
+            /// \param[in] world The world.
+            /// \param[in] filename Name of the file.
+            template <typename X=Archive>
+            static
+            typename std::enable_if_t<std::is_same<X,SharedFileInputArchive>::value || std::is_same<X,SharedFileOutputArchive>::value,
+                                      void>
+            remove(World& world, const char* filename) {
+                if (world.rank() == 0) ::remove(filename);
+            }
+
             /// Removes the files associated with the current archive.
             void remove() {
                 MADNESS_CHECK(world);
@@ -362,6 +429,8 @@ namespace madness {
         /// forced to be the same as the original number of writers and,
         /// therefore, you cannot presently read an archive from a parallel job
         /// with fewer total processes than the number of writers.
+        /// The single file of \c SharedFileInputArchive is the exception: it is
+        /// read by any number of processes.
         template <class localarchiveT=BinaryFstreamInputArchive>
         class ParallelInputArchive : public BaseParallelArchive<localarchiveT>, public  BaseInputArchive {
         public:
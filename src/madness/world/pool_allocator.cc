@@ -0,0 +1,228 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+
+
+  $Id$
+*/
+
+/**
+ \file pool_allocator.cc
+ \brief Central free lists and thread caches of the pooled small-object allocator.
+ \ingroup world
+*/
+
+#include <madness/world/pool_allocator.h>
+#include <madness/world/memory_accounting.h>
+#include <cstdlib>
+#include <mutex>
+
+namespace madness {
+    namespace detail {
+
+        thread_local PoolThreadCache* pool_thread_cache = nullptr;
+
+        /// Set when the thread's cache has been destroyed at thread exit
+        static thread_local bool pool_thread_exited = false;
+
+        /// Per-class lists of batches shared by all threads, plus bookkeeping
+
+        /// Allocated once and never destroyed so that objects freed during
+        /// static destruction can still be returned.
+        struct PoolCentral {
+            std::mutex mutex;
+            PoolBlock* batches[PoolThreadCache::nclass] = {}; ///< Full batches ready for refill
+            PoolBlock* loose[PoolThreadCache::nclass] = {};   ///< Single blocks freed by exited threads
+            PoolThreadCache* caches = nullptr;                ///< Registry of live thread caches
+            PoolAllocatorStats totals = {0, 0, 0, 0, 0, 0};   ///< Counters of exited threads and of batches
+
+            /// Carves a new batch of class \c c from system memory (mutex must be held)
+            PoolBlock* new_batch(std::size_t c) {
+                const std::size_t size = PoolThreadCache::block_size(c);
+                const std::size_t n = PoolThreadCache::batch(c);
+                void* chunk = nullptr;
+                if (posix_memalign(&chunk, PoolThreadCache::granularity, n*size))
+                    throw std::bad_alloc();
+                totals.nbytes += n*size;
+                MemoryAccounting::add((c < PoolThreadCache::nsmall) ? MemoryCategory::task : MemoryCategory::rmi, n*size);
+
+                char* p = static_cast<char*>(chunk);
+                for (std::size_t i=0; i<n; ++i) {
+                    PoolBlock* b = reinterpret_cast<PoolBlock*>(p + i*size);
+                    b->next = (i+1 < n) ? reinterpret_cast<PoolBlock*>(p + (i+1)*size) : nullptr;
+                }
+                PoolBlock* b = static_cast<PoolBlock*>(chunk);
+                b->n = n;
+                return b;
+            }
+
+            /// Removes the first batch of class \c c, making a new one if needed (mutex must be held)
+            PoolBlock* get_batch(std::size_t c) {
+                PoolBlock* b = batches[c];
+                if (b)
+                    batches[c] = b->next_batch;
+                else
+                    b = new_batch(c);
+                return b;
+            }
+        };
+
+        static PoolCentral& pool_central() {
+            static PoolCentral* central = new PoolCentral;
+            return *central;
+        }
+
+        /// Makes the calling thread's cache on first use
+        static void pool_thread_cache_create() {
+            static thread_local PoolThreadCache cache;
+        }
+
+        PoolThreadCache::PoolThreadCache()
+            : head(), count(), nalloc(0), nfree(0), nlarge(0), prev(nullptr), next(nullptr)
+        {
+            PoolCentral& central = pool_central();
+            std::lock_guard<std::mutex> lock(central.mutex);
+            next = central.caches;
+            if (next) next->prev = this;
+            central.caches = this;
+            pool_thread_cache = this;
+        }
+
+        PoolThreadCache::~PoolThreadCache() {
+            pool_thread_cache = nullptr;
+            pool_thread_exited = true;
+
+            PoolCentral& central = pool_central();
+            std::lock_guard<std::mutex> lock(central.mutex);
+            for (std::size_t c=0; c<nclass; ++c) {
+                if (head[c]) {
+                    head[c]->n = count[c];
+                    head[c]->next_batch = central.batches[c];
+                    central.batches[c] = head[c];
+                }
+            }
+            if (prev) prev->next = next;
+            else central.caches = next;
+            if (next) next->prev = prev;
+
+            central.totals.nalloc += nalloc;
+            central.totals.nfree += nfree;
+            central.totals.nlarge += nlarge;
+        }
+
+        void* PoolThreadCache::refill(std::size_t c) {
+            PoolBlock* b;
+            {
+                PoolCentral& central = pool_central();
+                std::lock_guard<std::mutex> lock(central.mutex);
+                b = central.get_batch(c);
+                ++central.totals.nbatch_get;
+            }
+            head[c] = b->next;
+            count[c] = b->n - 1;
+            ++nalloc;
+            return b;
+        }
+
+        void PoolThreadCache::flush(std::size_t c) {
+            PoolBlock* b = head[c];
+            PoolBlock* last = b;
+            const std::size_t n = batch(c);
+            for (std::size_t i=1; i<n; ++i)
+                last = last->next;
+            head[c] = last->next;
+            count[c] -= n;
+            last->next = nullptr;
+            b->n = n;
+
+            PoolCentral& central = pool_central();
+            std::lock_guard<std::mutex> lock(central.mutex);
+            b->next_batch = central.batches[c];
+            central.batches[c] = b;
+            ++central.totals.nbatch_put;
+        }
+
+    } // namespace detail
+
+    void* PoolAllocator::allocate_slow(std::size_t size) {
+        const std::size_t c = detail::PoolThreadCache::size_class(size);
+        if (c == detail::PoolThreadCache::nclass) {
+            if (detail::pool_thread_cache) ++detail::pool_thread_cache->nlarge;
+            return ::operator new(size);
+        }
+
+        if (!detail::pool_thread_exited) {
+            detail::pool_thread_cache_create();
+            return allocate(size);
+        }
+
+        // The thread is exiting so bypass the (destroyed) cache
+        detail::PoolCentral& central = detail::pool_central();
+        std::lock_guard<std::mutex> lock(central.mutex);
+        detail::PoolBlock* b = central.loose[c];
+        if (!b) b = central.get_batch(c);
+        central.loose[c] = b->next;
+        ++central.totals.nalloc;
+        return b;
+    }
+
+    void PoolAllocator::deallocate_slow(void* p, std::size_t size) {
+        const std::size_t c = detail::PoolThreadCache::size_class(size);
+        if (c == detail::PoolThreadCache::nclass) {
+            ::operator delete(p);
+            return;
+        }
+
+        if (!detail::pool_thread_exited) {
+            detail::pool_thread_cache_create();
+            deallocate(p, size);
+            return;
+        }
+
+        detail::PoolCentral& central = detail::pool_central();
+        std::lock_guard<std::mutex> lock(central.mutex);
+        detail::PoolBlock* b = static_cast<detail::PoolBlock*>(p);
+        b->next = central.loose[c];
+        central.loose[c] = b;
+        ++central.totals.nfree;
+    }
+
+    PoolAllocatorStats PoolAllocator::get_stats() {
+        detail::PoolCentral& central = detail::pool_central();
+        std::lock_guard<std::mutex> lock(central.mutex);
+        PoolAllocatorStats stats = central.totals;
+        for (const detail::PoolThreadCache* cache = central.caches; cache; cache = cache->next) {
+            stats.nalloc += cache->nalloc;
+            stats.nfree += cache->nfree;
+            stats.nlarge += cache->nlarge;
+        }
+        return stats;
+    }
+
+} // namespace madness
@@ -0,0 +1,218 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+
+
+  $Id$
+*/
+
+#ifndef MADNESS_WORLD_POOL_ALLOCATOR_H__INCLUDED
+#define MADNESS_WORLD_POOL_ALLOCATOR_H__INCLUDED
+
+/**
+ \file pool_allocator.h
+ \brief Thread-local size-class pools for runtime objects (tasks, futures, message buffers).
+ \ingroup world
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace madness {
+
+    /// Statistics of the pooled small-object allocator (see \c PoolAllocator)
+
+    /// Counters are aggregated over all threads; while other threads are
+    /// running they are only approximate.
+    struct PoolAllocatorStats {
+        std::uint64_t nalloc;     ///< Number of allocations served from the pools
+        std::uint64_t nfree;      ///< Number of blocks returned to the pools
+        std::uint64_t nlarge;     ///< Number of requests too large for the pools (forwarded to \c ::operator \c new)
+        std::uint64_t nbatch_get; ///< Number of batches moved from the central lists to a thread
+        std::uint64_t nbatch_put; ///< Number of batches moved from a thread to the central lists
+        std::uint64_t nbytes;     ///< Bytes obtained from the system for the pools (never released)
+    };
+
+    namespace detail {
+
+        /// A free block; the batch fields are only meaningful for the first block of a batch
+        struct PoolBlock {
+            PoolBlock* next;       ///< Next block in this batch/free list
+            PoolBlock* next_batch; ///< Next batch in the central list
+            std::size_t n;         ///< Number of blocks in this batch
+        };
+
+        /// Free lists owned by one thread, one per size class
+
+        /// Classes below \c nsmall hold small objects in steps of
+        /// \c granularity bytes; the remaining slab classes double in size
+        /// up to \c max_block and hold active-message buffers.
+        class PoolThreadCache {
+        public:
+            static constexpr std::size_t nsmall = 16;       ///< Number of small-object classes
+            static constexpr std::size_t nclass = 23;       ///< Total number of size classes
+            static constexpr std::size_t granularity = 64;  ///< Small class c holds blocks of (c+1)*granularity bytes
+            static constexpr std::size_t max_small = nsmall*granularity;         ///< Largest small block (1 KiB)
+            static constexpr std::size_t max_block = max_small << (nclass-nsmall); ///< Largest slab block (128 KiB)
+
+            /// Returns the size class of a request of \c size bytes (\c nclass if not pooled)
+            static std::size_t size_class(std::size_t size) {
+                if (size == 0 || size > max_block) return nclass;
+                if (size <= max_small) return (size - 1) / granularity;
+                std::size_t c = nsmall;
+                for (std::size_t n = (size - 1) / max_small; n > 1; n >>= 1) ++c;
+                return c;
+            }
+
+            /// Returns the size of the blocks in class \c c
+            static constexpr std::size_t block_size(std::size_t c) {
+                return (c < nsmall) ? (c+1)*granularity : max_small << (c-nsmall+1);
+            }
+
+            /// Returns the number of blocks exchanged with the central lists at a time
+            static constexpr std::size_t batch(std::size_t c) {
+                return (c < nsmall) ? 32 :
+                    (block_size(c) >= 32768) ? 2 : 65536/block_size(c);
+            }
+
+            PoolBlock* head[nclass];    ///< Free list of each class
+            std::size_t count[nclass];  ///< Length of each free list
+            std::uint64_t nalloc;       ///< Blocks handed out by this thread
+            std::uint64_t nfree;        ///< Blocks returned by this thread
+            std::uint64_t nlarge;       ///< Large requests made by this thread
+            PoolThreadCache* prev;      ///< Links in the registry of live caches
+            PoolThreadCache* next;      ///< Links in the registry of live caches
+
+            PoolThreadCache();
+
+            /// Returns all cached blocks to the central lists
+            ~PoolThreadCache();
+
+            /// Takes a batch of class \c c from the central lists and returns one block of it
+            void* refill(std::size_t c);
+
+            /// Returns a batch of class \c c to the central lists
+            void flush(std::size_t c);
+        };
+
+        /// The calling thread's cache (null before first use and after thread exit)
+        extern thread_local PoolThreadCache* pool_thread_cache;
+
+    } // namespace detail
+
+    /// Allocator for short-lived runtime objects
+
+    /// Requests of up to 1 KiB are rounded up to a multiple of 64 bytes, and
+    /// requests of up to \c max_size bytes to a power of two (the slab classes
+    /// used for \c AmArg buffers). Each class is served from a free list
+    /// private to the calling thread, so the common allocate/free pair takes
+    /// no lock. Blocks freed by a thread other than the one that allocated
+    /// them simply join the freeing thread's list; when a list grows beyond
+    /// two batches one batch is handed back to a central per-class list from
+    /// which other threads refill. Memory held by the pools is never returned
+    /// to the system.
+    ///
+    /// Larger requests are forwarded to the global \c ::operator \c new.
+    class PoolAllocator {
+        static void* allocate_slow(std::size_t size);
+        static void deallocate_slow(void* p, std::size_t size);
+
+    public:
+        /// Largest request served from the pools
+        static constexpr std::size_t max_size = detail::PoolThreadCache::max_block;
+
+        /// Allocates \c size bytes aligned to at least 64 bytes for pooled sizes
+        static void* allocate(std::size_t size) {
+            const std::size_t c = detail::PoolThreadCache::size_class(size);
+            detail::PoolThreadCache* cache = detail::pool_thread_cache;
+            if (c < detail::PoolThreadCache::nclass && cache) {
+                detail::PoolBlock* b = cache->head[c];
+                if (!b) return cache->refill(c);
+                cache->head[c] = b->next;
+                --cache->count[c];
+                ++cache->nalloc;
+                return b;
+            }
+            return allocate_slow(size);
+        }
+
+        /// Frees a block obtained from \c allocate() with the same \c size
+        static void deallocate(void* p, std::size_t size) {
+            if (!p) return;
+            const std::size_t c = detail::PoolThreadCache::size_class(size);
+            detail::PoolThreadCache* cache = detail::pool_thread_cache;
+            if (c < detail::PoolThreadCache::nclass && cache) {
+                detail::PoolBlock* b = static_cast<detail::PoolBlock*>(p);
+                b->next = cache->head[c];
+                cache->head[c] = b;
+                ++cache->nfree;
+                if (++cache->count[c] > 2*detail::PoolThreadCache::batch(c))
+                    cache->flush(c);
+                return;
+            }
+            deallocate_slow(p, size);
+        }
+
+        /// Returns the statistics aggregated over all threads
+        static PoolAllocatorStats get_stats();
+    };
+
+    /// Standard-conforming allocator on top of \c PoolAllocator
+
+    /// Used with \c std::allocate_shared so that an object and its
+    /// reference count share one pooled block.
+    template <typename T>
+    class PoolStdAllocator {
+    public:
+        typedef T value_type;
+
+        PoolStdAllocator() = default;
+
+        template <typename U>
+        PoolStdAllocator(const PoolStdAllocator<U>&) { }
+
+        T* allocate(std::size_t n) {
+            return static_cast<T*>(PoolAllocator::allocate(n*sizeof(T)));
+        }
+
+        void deallocate(T* p, std::size_t n) {
+            PoolAllocator::deallocate(p, n*sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(const PoolStdAllocator<U>&) const { return true; }
+
+        template <typename U>
+        bool operator!=(const PoolStdAllocator<U>&) const { return false; }
+    };
+
+} // namespace madness
+
+#endif // MADNESS_WORLD_POOL_ALLOCATOR_H__INCLUDED
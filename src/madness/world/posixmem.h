@@ -35,9 +35,11 @@
 #define MADNESS_WORLD_POSIXMEM_H__INCLUDED
 
 /// \file world/posixmem.h
-/// \brief Implement dummy posix_memalign if it is missing on the system.
+/// \brief Implement dummy posix_memalign if it is missing on the system,
+/// and first-touch placement of new buffers.
 
 #include <madness/madness_config.h>
+#include <cstddef>
 
 #if !HAVE_POSIX_MEMALIGN
 #include <sys/errno.h>
@@ -50,4 +52,30 @@ inline int posix_memalign(void **memptr, std::size_t alignment, std::size_t size
 extern "C"  int posix_memalign(void **memptr, std::size_t alignment, std::size_t size);
 #endif
 
+namespace madness {
+
+    namespace detail {
+        /// True if NUMA-aware task placement is on (see `MAD_TASK_NUMA`)
+        extern bool numa_first_touch_enabled;
+    }
+
+    /// Touch each page of a new, uninitialized buffer from the calling thread
+
+    /// Under the first-touch policy of Linux this places the pages in the
+    /// NUMA domain of the thread that created the buffer (typically the
+    /// task that will work on it) rather than that of the thread that
+    /// later fills it in.  Does nothing unless NUMA-aware task placement
+    /// is on or the buffer is smaller than a page.
+    /// \param[in,out] p The buffer.
+    /// \param[in] nbyte The size of the buffer in bytes.
+    inline void numa_first_touch(void* p, std::size_t nbyte) {
+        const std::size_t pagesize = 4096;
+        if (detail::numa_first_touch_enabled && nbyte >= pagesize) {
+            volatile char* c = static_cast<char*>(p);
+            for (std::size_t i=0; i<nbyte; i+=pagesize) c[i] = 0;
+        }
+    }
+
+} // namespace madness
+
 #endif // MADNESS_WORLD_POSIXMEM_H__INCLUDED
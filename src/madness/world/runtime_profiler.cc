@@ -0,0 +1,371 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#include <madness/world/runtime_profiler.h>
+#include <madness/world/worldprofile.h>
+#include <madness/world/mpi_archive.h>
+#include <madness/world/MADworld.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if __has_include(<execinfo.h>)
+#include <execinfo.h> // for backtrace_symbols
+#define MADNESS_RUNTIME_PROFILER_HAS_EXECINFO 1
+#endif
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h> // for abi::__cxa_demangle
+#define MADNESS_RUNTIME_PROFILER_HAS_CXXABI 1
+#endif
+
+namespace madness {
+
+    std::atomic<bool> RuntimeProfiler::enabled_{false};
+    bool RuntimeProfiler::used_ = false;
+    unsigned RuntimeProfiler::period_ = 1;
+
+    namespace {
+
+        /// Calls and time of one entry on one thread
+        struct Counter {
+            const void* key = nullptr;
+            const char* name = nullptr;
+            RuntimeProfileKind kind = RuntimeProfileKind::task;
+            unsigned short type = 0;
+            bool used = false;
+            int depth = 0;              // Active calls of a region on this thread
+            unsigned long count = 0;    // No. of calls
+            unsigned long ntimed = 0;   // No. of calls that were timed
+            double time = 0.0;          // Time of the timed calls
+        };
+
+        /// The counters of one thread, an open-addressed hash table
+        struct ThreadCounters {
+            static const std::size_t nslot = 1024; // Power of 2
+            Counter slot[nslot];
+            std::size_t nused = 0;
+            Counter other; // Used once the table is 3/4 full
+
+            Counter& find(RuntimeProfileKind kind, const void* key, unsigned short type, const char* name) {
+                std::size_t h = (reinterpret_cast<std::size_t>(key) >> 3) ^
+                    (reinterpret_cast<std::size_t>(name) >> 5) ^ (std::size_t(kind) << 7);
+                for (h &= nslot-1; slot[h].used; h = (h+1) & (nslot-1)) {
+                    const Counter& c = slot[h];
+                    if (c.key == key && c.name == name && c.kind == kind) return slot[h];
+                }
+                if (4*nused >= 3*nslot) return other;
+                Counter& c = slot[h];
+                c.key = key;
+                c.name = name;
+                c.kind = kind;
+                c.type = type;
+                c.used = true;
+                ++nused;
+                return c;
+            }
+
+            void clear() {
+                for (Counter& c : slot) c = Counter();
+                other = Counter();
+                nused = 0;
+            }
+        };
+
+        Mutex registry_mutex; // Protects registry
+        std::vector<std::unique_ptr<ThreadCounters> > registry; // Counters of all threads, ever
+        thread_local ThreadCounters* local_counters = nullptr;
+        thread_local unsigned nsample = 0;
+
+        ThreadCounters& counters() {
+            if (!local_counters) {
+                ScopedMutex<Mutex> guard(registry_mutex);
+                registry.emplace_back(new ThreadCounters);
+                local_counters = registry.back().get();
+            }
+            return *local_counters;
+        }
+
+        std::string demangle(const char* symbol) {
+#ifdef MADNESS_RUNTIME_PROFILER_HAS_CXXABI
+            int status = 0;
+            char* name = abi::__cxa_demangle(symbol, 0, 0, &status);
+            if (status == 0 && name) {
+                std::string result(name);
+                std::free(name);
+                return result;
+            }
+#endif
+            return symbol;
+        }
+
+        /// Name of a function pointer, or its address if it has no symbol
+        std::string function_name(const void* f) {
+#ifdef MADNESS_RUNTIME_PROFILER_HAS_EXECINFO
+            void* addr = const_cast<void*>(f);
+            char** bt_sym = backtrace_symbols(&addr, 1);
+            if (bt_sym) {
+                // Format of bt_sym is <file>(<mangled name>+<offset>) [<address>]
+                std::string mangled;
+                const char* first = std::strchr(bt_sym[0],'(');
+                if (first) {
+                    ++first;
+                    const char* last = std::strrchr(first,'+');
+                    if (last && last > first) mangled.assign(first, last - first);
+                }
+                std::free(bt_sym);
+                if (!mangled.empty()) return demangle(mangled.c_str());
+            }
+#endif
+            std::ostringstream s;
+            s << f;
+            return s.str();
+        }
+
+        std::string entry_name(const Counter& c) {
+            switch (c.type) {
+            case 1: return function_name(c.key);
+            case 2: return demangle(static_cast<const char*>(c.key));
+            case 3:
+                if (c.name && *c.name) return std::string(c.name) + "::" + static_cast<const char*>(c.key);
+                return static_cast<const char*>(c.key);
+            default: return "(unnamed)";
+            }
+        }
+
+        /// Totals of one entry, reduced over threads and processes
+        struct RuntimeProfileEntry {
+            std::string name;
+            int kind;
+            ProfileStat<unsigned long> count; ///< No. of calls
+            ProfileStat<double> time;         ///< Estimated time
+            double thread_max;                ///< Largest time on any one thread
+            int nproc;                        ///< No. of processes with this entry
+
+            void par_reduce(const RuntimeProfileEntry& other) {
+                count.par_reduce(other.count);
+                time.par_reduce(other.time);
+                thread_max = std::max(thread_max, other.thread_max);
+                nproc += other.nproc;
+            }
+
+            template <class Archive>
+            void serialize(const Archive& ar) {
+                ar & name & kind & count & time & thread_max & nproc;
+            }
+        };
+
+        typedef std::map<std::pair<int,std::string>, RuntimeProfileEntry> entry_mapT;
+
+        void merge(entry_mapT& entries, const std::vector<RuntimeProfileEntry>& v) {
+            for (const RuntimeProfileEntry& e : v) {
+                auto it = entries.find(std::make_pair(e.kind, e.name));
+                if (it == entries.end()) entries[std::make_pair(e.kind, e.name)] = e;
+                else it->second.par_reduce(e);
+            }
+        }
+
+        void recv_entries(World& world, ProcessID p, entry_mapT& entries) {
+            if (p >= world.size()) return;
+            archive::MPIInputArchive ar(world, p);
+            std::vector<RuntimeProfileEntry> v;
+            ar & v;
+            merge(entries, v);
+        }
+
+        void print_kind(World& world, const char* title, int kind, const entry_mapT& entries) {
+            std::vector<const RuntimeProfileEntry*> v;
+            for (const auto& e : entries)
+                if (e.second.kind == kind) v.push_back(&e.second);
+            if (v.empty()) return;
+            std::sort(v.begin(), v.end(), [](const RuntimeProfileEntry* a, const RuntimeProfileEntry* b) {
+                return a->time.sum > b->time.sum;
+            });
+
+            const std::size_t nprint = std::min<std::size_t>(v.size(), 25);
+            std::printf("\n    %s\n\n", title);
+            std::printf("     time/s  time-min  time-avg  time-max  time-eff  thrd-max     calls  calls-max name\n");
+            std::printf("   -------- --------- --------- --------- --------- --------- --------- ---------- --------------------\n");
+            for (std::size_t i=0; i<nprint; ++i) {
+                const RuntimeProfileEntry& e = *v[i];
+                const double avg = e.time.sum/world.size();
+                const double tmin = (e.nproc < world.size()) ? 0.0 : e.time.min;
+                std::printf("%11.2e%10.2e%10.2e%10.2e%10.2f%10.2e%10.2e%11.2e %s\n",
+                            e.time.sum, tmin, avg, e.time.max, e.time.max ? avg/e.time.max : 1.0,
+                            e.thread_max, double(e.count.sum), double(e.count.max), e.name.c_str());
+            }
+            if (nprint < v.size())
+                std::printf("   ... %zu more\n", v.size() - nprint);
+        }
+
+    } // namespace
+
+    void RuntimeProfiler::enable(unsigned period) {
+        period_ = std::max(period, 1u);
+        used_ = true;
+        enabled_.store(true, std::memory_order_release);
+    }
+
+    void RuntimeProfiler::disable() {
+        enabled_.store(false, std::memory_order_release);
+    }
+
+    void RuntimeProfiler::begin() {
+        const char* value = std::getenv("MAD_RUNTIME_PROFILE");
+        if (!value) return;
+        const int period = std::atoi(value);
+        if (period > 0) {
+            enable(period);
+            if (SafeMPI::COMM_WORLD.Get_rank() == 0 && !madness::quiet())
+                std::cout << "MADNESS runtime profiler on, timing 1 in " << period
+                          << " tasks and messages.\n";
+        }
+    }
+
+    void RuntimeProfiler::clear() {
+        ScopedMutex<Mutex> guard(registry_mutex);
+        for (auto& t : registry) t->clear();
+        used_ = enabled();
+    }
+
+    bool RuntimeProfiler::sample() {
+        return period_ == 1 || (++nsample % period_) == 0;
+    }
+
+    void RuntimeProfiler::record(RuntimeProfileKind kind, const void* key, unsigned short type,
+                                 const char* name, double time) {
+        Counter& c = counters().find(kind, key, type, name);
+        ++c.count;
+        if (time >= 0.0) {
+            ++c.ntimed;
+            c.time += time;
+        }
+    }
+
+    bool RuntimeProfiler::enter(const char* classname, const char* function) {
+        Counter& c = counters().find(RuntimeProfileKind::region, function, 3, classname);
+        ++c.count;
+        return (c.depth++ == 0);
+    }
+
+    void RuntimeProfiler::leave(const char* classname, const char* function, double time) {
+        Counter& c = counters().find(RuntimeProfileKind::region, function, 3, classname);
+        if (c.depth > 0) --c.depth;
+        if (time >= 0.0) {
+            ++c.ntimed;
+            c.time += time;
+        }
+    }
+
+    unsigned long RuntimeProfiler::count(RuntimeProfileKind kind) {
+        ScopedMutex<Mutex> guard(registry_mutex);
+        unsigned long n = 0;
+        for (const auto& t : registry) {
+            for (const Counter& c : t->slot)
+                if (c.used && c.kind == kind) n += c.count;
+        }
+        return n;
+    }
+
+    void RuntimeProfiler::print(World& world) {
+        world.gop.fence();
+        const ProcessID me = world.rank();
+
+        // Sum the threads of this process
+        entry_mapT entries;
+        {
+            ScopedMutex<Mutex> guard(registry_mutex);
+            for (const auto& t : registry) {
+                std::vector<const Counter*> used;
+                for (const Counter& c : t->slot) if (c.used) used.push_back(&c);
+                if (t->other.count) used.push_back(&t->other);
+                for (const Counter* c : used) {
+                    // Regions are always timed, tasks and messages are sampled
+                    const double time = c->ntimed ? c->time*double(c->count)/double(c->ntimed) : 0.0;
+                    const auto key = std::make_pair(int(c->kind),
+                            c == &t->other ? std::string("(other)") : entry_name(*c));
+                    auto it = entries.find(key);
+                    if (it == entries.end()) {
+                        RuntimeProfileEntry& e = entries[key];
+                        e.name = key.second;
+                        e.kind = key.first;
+                        e.count.value = c->count;
+                        e.time.value = time;
+                        e.thread_max = time;
+                        e.nproc = 1;
+                    }
+                    else {
+                        it->second.count.value += c->count;
+                        it->second.time.value += time;
+                        it->second.thread_max = std::max(it->second.thread_max, time);
+                    }
+                }
+            }
+        }
+        for (auto& e : entries) {
+            e.second.count.init_par_stats(me);
+            e.second.time.init_par_stats(me);
+        }
+
+        // Reduce up a binary tree to process 0
+        recv_entries(world, 2*me+1, entries);
+        recv_entries(world, 2*me+2, entries);
+        if (me) {
+            std::vector<RuntimeProfileEntry> v;
+            for (const auto& e : entries) v.push_back(e.second);
+            archive::MPIOutputArchive ar(world, (me-1)/2);
+            ar & v;
+        }
+        else {
+            std::printf("\n    MADNESS runtime profile\n");
+            std::printf("    -----------------------\n\n");
+            std::printf("    o  times are inclusive and summed over threads; a task waiting on a\n");
+            std::printf("       future includes the tasks its thread runs meanwhile\n");
+            std::printf("    o  time of tasks and messages is estimated from 1 in %u timed calls\n", period_);
+            std::printf("    o  time-min/avg/max - per process; time-eff = avg/max\n");
+            std::printf("    o  thrd-max - largest time on any one thread\n");
+            std::printf("    o  calls-max - most calls on any one process\n");
+            print_kind(world, "Tasks", int(RuntimeProfileKind::task), entries);
+            print_kind(world, "RMI handlers", int(RuntimeProfileKind::rmi), entries);
+            print_kind(world, "Active messages", int(RuntimeProfileKind::am), entries);
+            print_kind(world, "Profiled functions and blocks", int(RuntimeProfileKind::region), entries);
+            std::printf("\n");
+            std::fflush(stdout);
+        }
+        world.gop.fence();
+    }
+
+} // namespace madness
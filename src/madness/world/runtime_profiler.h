@@ -0,0 +1,196 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_WORLD_RUNTIME_PROFILER_H__INCLUDED
+#define MADNESS_WORLD_RUNTIME_PROFILER_H__INCLUDED
+
+/**
+ \file runtime_profiler.h
+ \brief Profiler that is compiled into every build and switched on at run time.
+ \ingroup world
+
+ Unlike \c WorldProfile (\c ENABLE_WORLD_PROFILE) and the task profiler
+ (\c ENABLE_TASK_PROFILER) this profiler is always built, but does nothing
+ until it is enabled, either by setting the environment variable
+ \c MAD_RUNTIME_PROFILE or by calling \c RuntimeProfiler::enable(). While
+ disabled each instrumented point costs one load and branch.
+
+ When enabled it aggregates the number of calls and the time spent
+ - per task type (the function or functor run by the task),
+ - per RMI handler and per active message function, and
+ - per region marked by \c PROFILE_FUNC, \c PROFILE_MEMBER_FUNC or
+   \c PROFILE_BLOCK (e.g. the operations of \c Function and \c FunctionImpl)
+   when \c WorldProfile is not compiled in.
+
+ Times are inclusive: a task that waits on a future includes the tasks its
+ thread runs meanwhile, and a multi-threaded task is counted once per thread.
+
+ Counters are kept per thread, so recording takes no locks. Every task and
+ message is counted, but only one in \c period of them is timed (the value of
+ \c MAD_RUNTIME_PROFILE, e.g. 1 = all, 16 = one in 16) and the total time is
+ estimated from the sampled ones. Regions are always timed.
+ \c finalize() prints a summary reduced over all processes.
+*/
+
+#include <madness/madness_config.h>
+#include <madness/world/timers.h>
+#include <atomic>
+#include <utility>
+
+namespace madness {
+
+    class World;
+
+    /// Kinds of activity aggregated by \c RuntimeProfiler
+    enum class RuntimeProfileKind : unsigned char {
+        task,     ///< Tasks, by function or functor type
+        rmi,      ///< RMI handlers run by the server thread
+        am,       ///< Active message functions (run inside the RMI handler)
+        region    ///< Profiled functions and blocks
+    };
+
+    /// Runtime-switchable aggregating profiler
+
+    /// All members are static. See \c runtime_profiler.h for an overview.
+    class RuntimeProfiler {
+        static std::atomic<bool> enabled_; ///< True while recording
+        static bool used_;                 ///< True if ever enabled
+        static unsigned period_;           ///< Time one in period_ tasks and messages
+
+    public:
+        /// True if the profiler is recording
+        static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+        /// Start recording
+
+        /// \param[in] period Time one in \c period tasks and messages (all are counted)
+        static void enable(unsigned period = 1);
+
+        /// Stop recording (the data are kept)
+        static void disable();
+
+        /// Reads \c MAD_RUNTIME_PROFILE; called by \c initialize()
+        static void begin();
+
+        /// Discards all data recorded so far by all threads
+
+        /// Only call while no other thread is recording
+        static void clear();
+
+        /// Prints the summary, reduced over all processes, on process 0
+
+        /// Collective over \c world. \c finalize() calls this if the
+        /// profiler was ever enabled.
+        static void print(World& world);
+
+        /// True if the profiler was enabled since the last \c clear()
+        static bool used() { return used_; }
+
+        /// Number of calls of one kind recorded by all threads of this process
+        static unsigned long count(RuntimeProfileKind kind);
+
+        /// Decides whether the next task or message on this thread is timed
+        static bool sample();
+
+        /// Adds one call to an entry of this thread
+
+        /// \param[in] kind The kind of entry
+        /// \param[in] key Identifies the entry: a function pointer, type name or class name
+        /// \param[in] type How to name \c key: 1 = function pointer, 2 = mangled type name,
+        ///     3 = function name with \c name the class name
+        /// \param[in] name The class name of a region
+        /// \param[in] time The time taken, or negative if it was not timed
+        static void record(RuntimeProfileKind kind, const void* key, unsigned short type,
+                           const char* name, double time);
+
+        /// Enters a region on this thread, returns false if it is already active (recursion)
+        static bool enter(const char* classname, const char* function);
+
+        /// Leaves a region entered with \c enter
+        static void leave(const char* classname, const char* function, double time);
+    }; // class RuntimeProfiler
+
+    /// Times one task or active message if the profiler is enabled
+    class RuntimeProfileSample {
+        RuntimeProfileKind kind_;
+        const void* key_;
+        unsigned short type_;
+        bool active_;
+        double start_;
+
+    public:
+        /// \param[in] kind The kind of entry
+        /// \param[in] id The function pointer or type name and its type (as from \c PoolTaskInterface::get_id)
+        RuntimeProfileSample(RuntimeProfileKind kind, const std::pair<void*,unsigned short>& id)
+            : kind_(kind), key_(id.first), type_(id.second), active_(RuntimeProfiler::enabled())
+        {
+            if (active_) start_ = RuntimeProfiler::sample() ? wall_time() : -1.0;
+        }
+
+        ~RuntimeProfileSample() {
+            if (active_)
+                RuntimeProfiler::record(kind_, key_, type_, nullptr, start_ < 0.0 ? -1.0 : wall_time() - start_);
+        }
+
+        RuntimeProfileSample(const RuntimeProfileSample&) = delete;
+        RuntimeProfileSample& operator=(const RuntimeProfileSample&) = delete;
+    }; // class RuntimeProfileSample
+
+    /// Times a function or block if the profiler is enabled
+
+    /// Recursive calls are counted but their time is only included once.
+    class RuntimeProfileRegion {
+        const char* classname_;
+        const char* function_;
+        bool active_;
+        double start_;
+
+    public:
+        /// \param[in] classname The class (may be empty)
+        /// \param[in] function The function or block
+        RuntimeProfileRegion(const char* classname, const char* function)
+            : classname_(classname), function_(function), active_(RuntimeProfiler::enabled())
+        {
+            if (active_) start_ = RuntimeProfiler::enter(classname, function) ? wall_time() : -1.0;
+        }
+
+        ~RuntimeProfileRegion() {
+            if (active_)
+                RuntimeProfiler::leave(classname_, function_, start_ < 0.0 ? -1.0 : wall_time() - start_);
+        }
+
+        RuntimeProfileRegion(const RuntimeProfileRegion&) = delete;
+        RuntimeProfileRegion& operator=(const RuntimeProfileRegion&) = delete;
+    }; // class RuntimeProfileRegion
+
+} // namespace madness
+
+#endif // MADNESS_WORLD_RUNTIME_PROFILER_H__INCLUDED
@@ -254,12 +254,12 @@ namespace SafeMPI {
 
         operator MPI_Status() const { return status_; }
 
-//        bool Is_cancelled() const {
-//            int flag = 0;
-//            MADNESS_MPI_TEST(MPI_Test_cancelled(const_cast<MPI_Status*>(&status_), &flag));
-//            return flag != 0;
-//        }
-//
+        bool Is_cancelled() const {
+            int flag = 0;
+            MADNESS_MPI_TEST(MPI_Test_cancelled(const_cast<MPI_Status*>(&status_), &flag));
+            return flag != 0;
+        }
+
 //        int Get_elements(const MPI_Datatype datatype) const {
 //            int elements = 0;
 //            MADNESS_MPI_TEST(MPI_Get_elements(const_cast<MPI_Status*>(&status_), datatype, &elements));
@@ -407,6 +407,12 @@ namespace SafeMPI {
         }
 
 
+        /// Cancels the request, which must still be completed (e.g. by Test())
+        void Cancel() {
+            SAFE_MPI_GLOBAL_MUTEX;
+            MADNESS_MPI_TEST(MPI_Cancel(&request_));
+        }
+
         bool Test_got_lock_already(MPI_Status& status) {
             int flag;
             MADNESS_MPI_TEST(MPI_Test(&request_, &flag, &status));
@@ -0,0 +1,299 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+/**
+ \file shared_file_archive.cc
+ \brief Implements archives for a single file shared by all processes.
+ \ingroup serialization
+*/
+
+#include <madness/world/shared_file_archive.h>
+#include <madness/world/world.h>
+#include <madness/world/worldgop.h>
+#include <madness/world/madness_exception.h>
+#include <algorithm>
+#include <cstring>
+#ifdef STUBOUTMPI
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace madness {
+    namespace archive {
+        namespace detail {
+
+            /// A file opened by all processes of a world.
+
+            /// Uses MPI-IO, or POSIX I/O if MPI is stubbed out (there is then
+            /// only one process). Transfers are split in chunks since MPI counts
+            /// are \c int.
+            class SharedFile {
+                static constexpr std::size_t chunk = std::size_t(1) << 30;
+
+                World* world;
+#ifdef STUBOUTMPI
+                int fd;
+#else
+                MPI_File fh;
+#endif
+                bool is_open;
+
+            public:
+                std::vector<unsigned char> buf; ///< Data stored but not yet written.
+                std::uint64_t pos;              ///< File offset of \c buf, or the read position.
+
+                SharedFile(World& world, const char* filename, bool write)
+                        : world(&world), is_open(false), buf(), pos(0) {
+#ifdef STUBOUTMPI
+                    fd = write ? ::open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644) : ::open(filename, O_RDONLY);
+                    if (fd < 0) MADNESS_EXCEPTION("SharedFile: open: failed", 1);
+#else
+                    SAFE_MPI_GLOBAL_MUTEX;
+                    MADNESS_MPI_TEST(MPI_File_open(world.mpi.comm().Get_mpi_comm(), const_cast<char*>(filename),
+                                                   write ? (MPI_MODE_WRONLY|MPI_MODE_CREATE) : MPI_MODE_RDONLY,
+                                                   MPI_INFO_NULL, &fh));
+                    // Get rid of the tail of a longer file of the same name
+                    if (write) MADNESS_MPI_TEST(MPI_File_set_size(fh, 0));
+#endif
+                    is_open = true;
+                }
+
+                ~SharedFile() {
+                    close();
+                }
+
+                /// Writes \c buf and closes the file; collective
+                void close() {
+                    if (!is_open) return;
+                    flush();
+                    is_open = false;
+#ifdef STUBOUTMPI
+                    ::close(fd);
+#else
+                    SAFE_MPI_GLOBAL_MUTEX;
+                    MADNESS_MPI_TEST(MPI_File_close(&fh));
+#endif
+                }
+
+                /// Writes \c buf at \c pos
+                void flush() {
+                    if (buf.empty()) return;
+                    write_at(pos, buf.data(), buf.size());
+                    pos += buf.size();
+                    buf.clear();
+                }
+
+                void write_at(std::uint64_t offset, const void* p, std::size_t nbyte) {
+                    const char* q = static_cast<const char*>(p);
+                    while (nbyte) {
+                        const std::size_t n = std::min(nbyte, chunk);
+#ifdef STUBOUTMPI
+                        if (pwrite(fd, q, n, offset) != ssize_t(n))
+                            MADNESS_EXCEPTION("SharedFile: write failed", n);
+#else
+                        SAFE_MPI_GLOBAL_MUTEX;
+                        MADNESS_MPI_TEST(MPI_File_write_at(fh, offset, const_cast<char*>(q), int(n), MPI_BYTE, MPI_STATUS_IGNORE));
+#endif
+                        offset += n;
+                        q += n;
+                        nbyte -= n;
+                    }
+                }
+
+                void read_at(std::uint64_t offset, void* p, std::size_t nbyte) {
+                    char* q = static_cast<char*>(p);
+                    while (nbyte) {
+                        const std::size_t n = std::min(nbyte, chunk);
+#ifdef STUBOUTMPI
+                        if (pread(fd, q, n, offset) != ssize_t(n))
+                            MADNESS_EXCEPTION("SharedFile: read past the end of the file", n);
+#else
+                        MPI_Status status;
+                        int count = 0;
+                        {
+                            SAFE_MPI_GLOBAL_MUTEX;
+                            MADNESS_MPI_TEST(MPI_File_read_at(fh, offset, q, int(n), MPI_BYTE, &status));
+                            MADNESS_MPI_TEST(MPI_Get_count(&status, MPI_BYTE, &count));
+                        }
+                        if (count != int(n))
+                            MADNESS_EXCEPTION("SharedFile: read past the end of the file", n);
+#endif
+                        offset += n;
+                        q += n;
+                        nbyte -= n;
+                    }
+                }
+
+                /// Collective write; every process makes the same number of calls
+                void write_at_all(std::uint64_t offset, const void* p, std::size_t nbyte) {
+#ifdef STUBOUTMPI
+                    write_at(offset, p, nbyte);
+#else
+                    const char* q = static_cast<const char*>(p);
+                    for (long nchunk = max_chunks(nbyte); nchunk > 0; --nchunk) {
+                        const std::size_t n = std::min(nbyte, chunk);
+                        {
+                            SAFE_MPI_GLOBAL_MUTEX;
+                            MADNESS_MPI_TEST(MPI_File_write_at_all(fh, offset, const_cast<char*>(q), int(n), MPI_BYTE, MPI_STATUS_IGNORE));
+                        }
+                        offset += n;
+                        q += n;
+                        nbyte -= n;
+                    }
+#endif
+                }
+
+                /// Collective read; every process makes the same number of calls
+                void read_at_all(std::uint64_t offset, void* p, std::size_t nbyte) {
+#ifdef STUBOUTMPI
+                    read_at(offset, p, nbyte);
+#else
+                    char* q = static_cast<char*>(p);
+                    bool ok = true;
+                    for (long nchunk = max_chunks(nbyte); nchunk > 0; --nchunk) {
+                        const std::size_t n = std::min(nbyte, chunk);
+                        MPI_Status status;
+                        int count = 0;
+                        {
+                            SAFE_MPI_GLOBAL_MUTEX;
+                            MADNESS_MPI_TEST(MPI_File_read_at_all(fh, offset, q, int(n), MPI_BYTE, &status));
+                            MADNESS_MPI_TEST(MPI_Get_count(&status, MPI_BYTE, &count));
+                        }
+                        ok = ok && (count == int(n));
+                        offset += n;
+                        q += n;
+                        nbyte -= n;
+                    }
+                    if (!ok) MADNESS_EXCEPTION("SharedFile: read past the end of the file", 0);
+#endif
+                }
+
+            private:
+                /// Largest number of chunks over all processes
+                long max_chunks(std::size_t nbyte) {
+                    long nchunk = (nbyte + chunk - 1)/chunk;
+                    world->gop.max(nchunk);
+                    return nchunk;
+                }
+            };
+
+        } // namespace detail
+
+        SharedFileOutputArchive::SharedFileOutputArchive() : file() {}
+
+        void SharedFileOutputArchive::open(World& world, const char* filename) {
+            close();
+            file.reset(new detail::SharedFile(world, filename, true));
+            if (world.rank() == 0) store(ARCHIVE_COOKIE, strlen(ARCHIVE_COOKIE)+1);
+        }
+
+        void SharedFileOutputArchive::close() {
+            if (file) {
+                file->close();
+                file.reset();
+            }
+        }
+
+        void SharedFileOutputArchive::flush() {
+            if (file) file->flush();
+        }
+
+        std::uint64_t SharedFileOutputArchive::position() const {
+            MADNESS_CHECK(file);
+            return file->pos + file->buf.size();
+        }
+
+        void SharedFileOutputArchive::seek(std::uint64_t offset) {
+            MADNESS_CHECK(file);
+            file->flush();
+            file->pos = offset;
+        }
+
+        void SharedFileOutputArchive::write_at_all(std::uint64_t offset, const void* buf, std::size_t nbyte) const {
+            MADNESS_CHECK(file);
+            file->write_at_all(offset, buf, nbyte);
+        }
+
+        void SharedFileOutputArchive::store_bytes(const void* buf, std::size_t nbyte) const {
+            MADNESS_ASSERT(file);
+            const unsigned char* p = static_cast<const unsigned char*>(buf);
+            file->buf.insert(file->buf.end(), p, p+nbyte);
+        }
+
+        SharedFileInputArchive::SharedFileInputArchive() : file() {}
+
+        void SharedFileInputArchive::open(World& world, const char* filename) {
+            close();
+            file.reset(new detail::SharedFile(world, filename, false));
+            if (world.rank() == 0) {
+                char cookie[255];
+                const std::size_t n = strlen(ARCHIVE_COOKIE)+1;
+                load(cookie, n);
+                if (strncmp(cookie,ARCHIVE_COOKIE,n) != 0)
+                    MADNESS_EXCEPTION("SharedFileInputArchive: open: not an archive?", 1);
+            }
+        }
+
+        void SharedFileInputArchive::close() {
+            if (file) {
+                file->close();
+                file.reset();
+            }
+        }
+
+        std::uint64_t SharedFileInputArchive::position() const {
+            MADNESS_CHECK(file);
+            return file->pos;
+        }
+
+        void SharedFileInputArchive::seek(std::uint64_t offset) {
+            MADNESS_CHECK(file);
+            file->pos = offset;
+        }
+
+        void SharedFileInputArchive::read_at(std::uint64_t offset, void* buf, std::size_t nbyte) const {
+            MADNESS_CHECK(file);
+            file->read_at(offset, buf, nbyte);
+        }
+
+        void SharedFileInputArchive::read_at_all(std::uint64_t offset, void* buf, std::size_t nbyte) const {
+            MADNESS_CHECK(file);
+            file->read_at_all(offset, buf, nbyte);
+        }
+
+        void SharedFileInputArchive::load_bytes(void* buf, std::size_t nbyte) const {
+            MADNESS_ASSERT(file);
+            file->read_at(file->pos, buf, nbyte);
+            file->pos += nbyte;
+        }
+
+    } // namespace archive
+} // namespace madness
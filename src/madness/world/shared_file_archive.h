@@ -0,0 +1,223 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_WORLD_SHARED_FILE_ARCHIVE_H__INCLUDED
+#define MADNESS_WORLD_SHARED_FILE_ARCHIVE_H__INCLUDED
+
+/**
+ \file shared_file_archive.h
+ \brief Implements archives for a single file shared by all processes.
+ \ingroup serialization
+*/
+
+#include <type_traits>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <madness/world/archive.h>
+#include <madness/world/vector_archive.h>
+
+namespace madness {
+
+    class World;
+
+    namespace archive {
+
+        /// \addtogroup serialization
+        /// @{
+
+        namespace detail {
+            class SharedFile;
+        }
+
+        /// Wraps an archive around one binary file opened by all processes of a world.
+
+        /// This is the local archive of a \c ParallelOutputArchive writing a
+        /// single file, however many processes there are:
+        /// \code
+        ///   archive::ParallelOutputArchive<archive::SharedFileOutputArchive> ar(world, "restart");
+        /// \endcode
+        /// Process zero stores the serial data at the current position, as
+        /// \c BinaryFstreamOutputArchive would. A \c WorldContainer is written
+        /// by all processes at once with MPI-IO collective writes: each
+        /// process writes the values it owns, followed by an index giving the
+        /// file offset of the value of each key (see worlddc.h).
+        ///
+        /// Copies of an open archive share the file and the position.
+        class SharedFileOutputArchive : public BaseOutputArchive {
+            std::shared_ptr<detail::SharedFile> file; ///< The file, null if not open.
+
+        public:
+            /// Default constructor.
+            SharedFileOutputArchive();
+
+            /// Copy into the buffer of data not yet written.
+
+            /// The function only appears (due to \c enable_if) if \c T is
+            /// serializable.
+            /// \tparam T The type of data to be written.
+            /// \param[in] t Location of the data to be written.
+            /// \param[in] n The number of data items to be written.
+            template <class T>
+            inline
+            typename std::enable_if< is_trivially_serializable<T>::value, void >::type
+            store(const T* t, long n) const {
+                store_bytes(t, n*sizeof(T));
+            }
+
+            /// Opens (and truncates) the file on all processes.
+
+            /// This is a collective operation.
+            /// \param[in] world The world.
+            /// \param[in] filename The name of the file.
+            void open(World& world, const char* filename);
+
+            /// Writes the buffered data and closes the file.
+
+            /// This is a collective operation.
+            void close();
+
+            /// Writes the buffered data at the current position.
+            void flush();
+
+            /// Returns the file offset at which the next data are stored.
+            std::uint64_t position() const;
+
+            /// Moves the current position, after writing the buffered data.
+
+            /// \param[in] offset The new position.
+            void seek(std::uint64_t offset);
+
+            /// Writes a block of data at the given offset on every process.
+
+            /// This is a collective operation; each process writes its own
+            /// block, which may be empty.
+            /// \param[in] offset Where this process's block goes in the file.
+            /// \param[in] buf The data.
+            /// \param[in] nbyte The number of bytes.
+            void write_at_all(std::uint64_t offset, const void* buf, std::size_t nbyte) const;
+
+        private:
+            void store_bytes(const void* buf, std::size_t nbyte) const;
+        };
+
+        /// Wraps an archive around a file written by \c SharedFileOutputArchive.
+
+        /// Process zero loads the serial data from the current position. A
+        /// \c WorldContainer is read by all processes, each of them reading
+        /// only the values of the keys it owns under the process map of the
+        /// container being loaded, so the file can be read by any number of
+        /// processes.
+        class SharedFileInputArchive : public BaseInputArchive {
+            std::shared_ptr<detail::SharedFile> file; ///< The file, null if not open.
+
+        public:
+            /// Default constructor.
+            SharedFileInputArchive();
+
+            /// Read from the current position.
+
+            /// The function only appears (due to \c enable_if) if \c T is
+            /// serializable.
+            /// \tparam T The type of data to be read.
+            /// \param[out] t Where to put the loaded data.
+            /// \param[in] n The number of data items to be loaded.
+            template <class T>
+            inline
+            typename std::enable_if< is_trivially_serializable<T>::value, void >::type
+            load(T* t, long n) const {
+                load_bytes(t, n*sizeof(T));
+            }
+
+            /// Opens the file on all processes.
+
+            /// This is a collective operation.
+            /// \param[in] world The world.
+            /// \param[in] filename The name of the file.
+            void open(World& world, const char* filename);
+
+            /// Closes the file.
+
+            /// This is a collective operation.
+            void close();
+
+            /// Returns the file offset from which the next data are loaded.
+            std::uint64_t position() const;
+
+            /// Moves the current position.
+
+            /// \param[in] offset The new position.
+            void seek(std::uint64_t offset);
+
+            /// Reads a block of data at the given offset.
+
+            /// \param[in] offset Where the data are in the file.
+            /// \param[out] buf Where to put the data.
+            /// \param[in] nbyte The number of bytes.
+            void read_at(std::uint64_t offset, void* buf, std::size_t nbyte) const;
+
+            /// Reads a block of data at the given offset on every process.
+
+            /// This is a collective operation; each process reads its own
+            /// block, which may be empty.
+            /// \param[in] offset Where this process's block is in the file.
+            /// \param[out] buf Where to put the data.
+            /// \param[in] nbyte The number of bytes.
+            void read_at_all(std::uint64_t offset, void* buf, std::size_t nbyte) const;
+
+        private:
+            void load_bytes(void* buf, std::size_t nbyte) const;
+        };
+
+        /// Serializes the values of a \c WorldContainer into the block a process writes to a shared file.
+
+        /// The same as \c VectorOutputArchive, except that the data are
+        /// meant for a file (see \c is_file_output_archive).
+        class SharedFileBlockOutputArchive : public VectorOutputArchive {
+        public:
+            using VectorOutputArchive::VectorOutputArchive;
+        };
+
+        /// Disable type info for the blocks of a shared file.
+
+        /// \tparam T The data type.
+        template <class T>
+        struct ArchivePrePostImpl<SharedFileBlockOutputArchive,T> {
+            static void preamble_store(const SharedFileBlockOutputArchive& ar) {};
+
+            static inline void postamble_store(const SharedFileBlockOutputArchive& ar) {};
+        };
+
+        /// @}
+    }
+}
+#endif // MADNESS_WORLD_SHARED_FILE_ARCHIVE_H__INCLUDED
@@ -315,6 +315,31 @@ void test_florian(World& world) {
     if (world.rank() == 0) print("test_florian passed");
 }
 
+void test_many(World& world) {
+    std::shared_ptr< WorldDCPmapInterface<int> > pmap0(new TestPmap(world, 0));
+    WorldContainer<int,double> c(world,pmap0);
+
+    // every process inserts a slice of the keys, most of them remote
+    std::vector< std::pair<int,double> > data;
+    for (int i=world.rank(); i<1000; i+=world.size()) data.push_back(std::make_pair(i, i+0.5));
+    c.replace_many(data);
+    world.gop.fence();
+
+    std::vector<int> keys;
+    for (int i=0; i<1100; ++i) keys.push_back(i);
+    std::vector< Future<WorldContainer<int,double>::iterator> > v = c.find_many(keys);
+    MADNESS_CHECK(v.size() == keys.size());
+    for (int i=0; i<1000; ++i) MADNESS_CHECK(v[i].get()->second == i+0.5);
+    for (int i=1000; i<1100; ++i) MADNESS_CHECK(v[i].get() == c.end());
+
+    const WorldContainer<int,double>& cc = c;
+    std::vector< Future<WorldContainer<int,double>::const_iterator> > cv = cc.find_many(keys);
+    for (int i=0; i<1000; ++i) MADNESS_CHECK(cv[i].get()->second == i+0.5);
+
+    world.gop.fence();
+    if (world.rank() == 0) print("test_many passed");
+}
+
 int main(int argc, char** argv) {
 
     try {
@@ -325,6 +350,7 @@ int main(int argc, char** argv) {
         // test1(world);
         // test_local(world);
         test_florian(world);
+        test_many(world);
     }
     catch (const SafeMPI::Exception& e) {
         error("caught an MPI exception");
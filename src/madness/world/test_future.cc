@@ -66,6 +66,38 @@ int main(int argc, char** argv) {
 
     print(s.get(), ggg.get());
 
+    // Continuations run inline when the future is assigned
+    Future<int> x;
+    int nrun = 0;
+    Future<double> y = x.then([&nrun](int i) { ++nrun; return 0.5*i; });
+    y.then([&nrun](double d) { ++nrun; });
+    MADNESS_CHECK(!y.probe() && nrun == 0);
+    x.set(3);
+    MADNESS_CHECK(y.probe() && y.get() == 1.5 && nrun == 2);
+
+    // ... immediately if it is already assigned, and futures are flattened
+    Future<string> t = s.then([&](const string& in) {
+        return world.taskq.add(fred, &Fred::b, in, attr);
+    });
+    MADNESS_CHECK(t.get() == s.get() + "b");
+
+    // ... or as a task
+    Future<string> u = r.then(world, [](const string& in) { return in + "c"; });
+    MADNESS_CHECK(u.get() == r.get() + "c");
+
+    // Continuation of a vector of futures
+    std::vector< Future<int> > v = future_vector_factory<int>(4);
+    Future<int> vsum = when_all(v, [](std::vector< Future<int> >& v) {
+        int sum = 0;
+        for (auto& f : v) sum += f.get();
+        return sum;
+    });
+    for (int i=0; i<4; ++i)
+        world.taskq.add([](int i) { return i*i; }, i).then([&v,i](int j) { v[i].set(j); });
+    MADNESS_CHECK(vsum.get() == 14);
+    world.gop.fence();
+    print("continuations OK");
+
     madness::finalize();
     return 0;
 }
@@ -347,6 +347,149 @@ void test_thread() {
 }
 
 
+class Grower : public madness::ThreadBase {
+private:
+    ConcurrentHashMap<int,double>& a; // Better would be a shared pointer
+    const int first, n;
+
+public:
+    Grower(ConcurrentHashMap<int,double>& a, int first, int n)
+            : ThreadBase(), a(a), first(first), n(n) {
+        start();
+    }
+
+    void run() {
+        typedef ConcurrentHashMap<int,double>::datumT datumT;
+        for (int i=first; i<first+n; ++i) {
+            [[maybe_unused]] auto&& [it, inserted] = a.insert(datumT(i,i));
+            MADNESS_ASSERT(inserted);
+            // Everything inserted so far must be found while the table grows
+            ConcurrentHashMap<int,double>::const_accessor r;
+            if (!a.find(r, first + (i-first)/2)) MADNESS_EXCEPTION("lost an entry while growing", i);
+            r.release();
+            ConcurrentHashMap<int,double>::iterator it2 = a.find(first + (i-first)/3);
+            if (it2 == a.end() || it2->second != first + (i-first)/3) MADNESS_EXCEPTION("lost an entry while growing", i);
+        }
+
+        ndone++;
+    }
+};
+
+
+void test_growth() {
+    // Starts small and grows while two threads insert
+    ConcurrentHashMap<int,double> a(11);
+    typedef ConcurrentHashMap<int,double>::iterator iteratorT;
+    const int n = 100000;
+
+    ndone = 0;
+    Grower g1(a,0,n), g2(a,n,n);
+    while (ndone != 2) sched_yield();
+
+    ConcurrentHashMapStats stats = a.get_stats();
+    if (stats.nentries != size_t(2*n) || a.size() != size_t(2*n))
+        cout << "growth: expected size " << 2*n << " " << a.size() << endl;
+    if (stats.ngrow == 0 || stats.nbins <= 11)
+        cout << "growth: table did not grow " << stats.nbins << endl;
+
+    size_t count = 0;
+    for (iteratorT it=a.begin(); it!=a.end(); ++it) {
+        count++;
+        if (it->first != int(it->second)) cout << "growth: key/value mismatch " << it->first << endl;
+    }
+    if (count != size_t(2*n)) cout << "growth: iterated over " << count << endl;
+
+    // begin() completed any rehash in progress
+    stats = a.get_stats();
+    if (stats.rehashing) cout << "growth: still rehashing after begin()" << endl;
+    if (stats.load_factor > a.max_load_factor())
+        cout << "growth: load factor too large " << stats.load_factor << endl;
+
+    for (int i=0; i<2*n; ++i) {
+        [[maybe_unused]] auto erased = a.try_erase(i);
+        MADNESS_ASSERT(erased);
+    }
+    if (a.size() != 0) cout << "growth: expected to be empty " << a.size() << endl;
+
+    // With growth disabled the number of bins is fixed
+    ConcurrentHashMap<int,double> b(11);
+    b.max_load_factor(0.0);
+    for (int i=0; i<1000; ++i) b[i] = i;
+    if (b.bucket_count() != 11) cout << "growth: should not have grown " << b.bucket_count() << endl;
+}
+
+
+void test_iterator_growth() {
+    // An iterator from find() outlives the tables it was made from
+    typedef ConcurrentHashMap<int,double> hashT;
+    const int n = 10000;
+    const MemoryAccountingStats before = MemoryAccounting::get_stats(MemoryCategory::hashmap);
+    {
+        hashT a(11);
+        for (int i=0; i<5; ++i) a[i] = i;
+        hashT::iterator it = a.find(0);
+        for (int i=5; i<n; ++i) a[i] = i;
+        if (a.get_stats().ngrow < 3) cout << "iterator growth: table did not grow " << a.bucket_count() << endl;
+
+        // The old tables are gone, so the iteration resumes in the current one
+        size_t count = 0;
+        for (; it!=a.end() && count<=size_t(n); ++it) {
+            count++;
+            if (it->first != int(it->second)) cout << "iterator growth: key/value mismatch " << it->first << endl;
+        }
+        if (count == 0 || count > size_t(n)) cout << "iterator growth: iterated over " << count << endl;
+
+        // Only the current table and the entries remain
+        { hashT::iterator b = a.begin(); }
+        const std::int64_t nbyte = MemoryAccounting::get_stats(MemoryCategory::hashmap).current - before.current;
+        const std::int64_t expected = a.bucket_count()*sizeof(hashT::binT) + a.size()*sizeof(hashT::entryT);
+        if (nbyte != expected) cout << "iterator growth: old tables not freed " << nbyte << " " << expected << endl;
+
+        // Assignment copies the load factor
+        hashT b(11);
+        a.max_load_factor(0.0);
+        b = a;
+        if (b.max_load_factor() != 0.0f) cout << "iterator growth: max_load_factor not assigned" << endl;
+    }
+    if (MemoryAccounting::get_stats(MemoryCategory::hashmap).current != before.current)
+        cout << "iterator growth: memory not released" << endl;
+}
+
+
+void test_insert_only() {
+    // Lock-free lookups while two threads insert and the table grows
+    ConcurrentHashMap<int,double> a(11, Hash<int>(), true);
+    const int n = 100000;
+
+    ndone = 0;
+    Grower g1(a,0,n), g2(a,n,n);
+    while (ndone != 2) sched_yield();
+
+    if (!a.is_insert_only()) cout << "insert-only: flag lost" << endl;
+    if (a.size() != size_t(2*n)) cout << "insert-only: expected size " << 2*n << " " << a.size() << endl;
+    const ConcurrentHashMap<int,double>* ca = &a;
+    for (int i=0; i<2*n; ++i) {
+        ConcurrentHashMap<int,double>::const_iterator it = ca->find(i);
+        if (it == ca->end() || it->second != i) cout << "insert-only: expected to find " << i << endl;
+    }
+    if (ca->find(2*n) != ca->end()) cout << "insert-only: found what was not inserted" << endl;
+
+    bool caught = false;
+    try {
+        [[maybe_unused]] auto erased = a.try_erase(0);
+    }
+    catch (const madness::MadnessException&) {
+        caught = true;
+    }
+    if (!caught) cout << "insert-only: erase should have thrown" << endl;
+
+    ConcurrentHashMap<int,double> b(a);
+    if (!b.is_insert_only() || b.size() != size_t(2*n)) cout << "insert-only: copy failed" << endl;
+    a.clear();
+    if (a.size() != 0 || a.find(0) != a.end()) cout << "insert-only: expected to be empty" << endl;
+}
+
+
 class Peasant : public madness::ThreadBase {
 private:
     ConcurrentHashMap<int,double>& a; // Better would be a shared pointer
@@ -404,6 +547,9 @@ int main(int argc, char** argv) {
     
     try {
         test_coverage();
+        test_growth();
+        test_iterator_growth();
+        test_insert_only();
         if (!smalltest) {
             test_random();
             test_time();
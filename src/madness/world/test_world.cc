@@ -31,11 +31,16 @@
 
 #include <vector>
 #include <numeric>
+#include <cstring>
+#include <cstdint>
 #include <algorithm>
+#include <sstream>
+#include <fstream>
 
 #include <madness/world/MADworld.h>
 #include <madness/world/world_object.h>
 #include <madness/world/worlddc.h>
+#include <madness/world/worldmem.h>
 
 #if MADNESS_CATCH_SIGNALS
 # include <csignal>
@@ -1120,6 +1125,22 @@ void test12(World& world) {
 
     world.gop.fence();
 
+    // The same file read through a memory mapping
+    archive::MmapInputArchive min("testme.ar", archive::MmapAdvice::prefetch);
+    WorldContainer<int,double> e(world);
+    min & e;
+    MADNESS_CHECK(min.remaining() == 0);
+    min.close();
+
+    world.gop.fence();
+
+    for (int i=0; i<100; ++i) {
+        int key = me*100+i;
+        MADNESS_CHECK(e.find(key).get()->second == key);
+    }
+
+    world.gop.fence();
+
     if (world.rank() == 0) print("test12 (container archive I/O) OK");
 }
 
@@ -1172,8 +1193,64 @@ void test13(World& world) {
     }
 
     fin.close();
+
+    // The same archive read through memory mappings
+    archive::ParallelInputArchive<archive::MmapInputArchive> fmap(world, "fred");
+    WorldContainer<int,double> e(world);
+    fmap & e;
+    for (int i=0; i<100; ++i) {
+        int key = me*100+i;
+        MADNESS_CHECK(e.find(key).get()->second == key);
+    }
+    fmap.close();
+
+    // Checkpoint in the background with one writer per process
+    archive::ParallelOutputArchive<archive::AsyncFstreamOutputArchive> fasync(world, "fred", world.size());
+    fasync & d;
+    fasync.close();
+    for (int i=0; i<100; ++i) d.replace(me*100+i, -1.0); // the archive holds a copy
+    MADNESS_CHECK(fasync.local_archive().completion().get());
+    archive::AsyncFstreamOutputArchive::wait();
+    MADNESS_CHECK(archive::AsyncFstreamOutputArchive::pending() == 0);
+    {
+        // the file is written under a temporary name, then renamed
+        char tmpname[256];
+        snprintf(tmpname, sizeof(tmpname), "fred.%5.5d.tmp", me);
+        MADNESS_CHECK(!std::ifstream(tmpname).good());
+    }
+    world.gop.fence();
+
+    WorldContainer<int,double> g(world);
+    fin.open(world,"fred");
+    fin & g;
+    for (int i=0; i<100; ++i) {
+        int key = me*100+i;
+        MADNESS_CHECK(g.find(key).get()->second == key);
+    }
+    fin.close();
+
     archive::ParallelOutputArchive<>::remove(world, "fred");
 
+    // One shared file, read back with every process owning all keys
+    for (int i=0; i<100; ++i) d.replace(me*100+i, double(me*100+i));
+    world.gop.fence();
+    archive::ParallelOutputArchive<archive::SharedFileOutputArchive> fshared(world, "fred.shared");
+    fshared & 1.0 & d & "hello";
+    fshared.close();
+
+    v = 0.0;
+    s[0] = 0;
+    WorldContainer<int,double> h(world, std::make_shared<WorldDCLocalPmap<int>>(world));
+    archive::ParallelInputArchive<archive::SharedFileInputArchive> fsin(world, "fred.shared");
+    fsin & v & h & s;
+    fsin.close();
+    MADNESS_CHECK(v == 1.0 && strcmp(s, "hello") == 0);
+    MADNESS_CHECK(h.size() == std::size_t(100*world.size()));
+    for (int key=0; key<100*world.size(); ++key) {
+        MADNESS_CHECK(h.find(key).get()->second == key);
+    }
+    archive::ParallelOutputArchive<archive::SharedFileOutputArchive>::remove(world, "fred.shared");
+
     print("Test13 OK");
     world.gop.fence();
 }
@@ -1228,6 +1305,489 @@ void test15(World& world) {
   world.gop.fence();
 }
 
+class TreeTask : public TaskInterface {
+    const int depth;
+public:
+    static AtomicInt count;
+
+    TreeTask(int depth, const TaskAttributes& attr = TaskAttributes())
+        : TaskInterface(attr), depth(depth) {}
+
+    void run(World& world) {
+        count++;
+        if (depth > 0) {
+            // Children prefer the NUMA domain of their parent if it had a preference
+            const TaskAttributes attr = (get_numa_domain() >= 0) ?
+                TaskAttributes::numa_local() : TaskAttributes();
+            world.taskq.add(new TreeTask(depth-1, attr));
+            world.taskq.add(new TreeTask(depth-1, attr));
+        }
+    }
+};
+
+AtomicInt TreeTask::count;
+
+void test16(World& world) {
+    PROFILE_FUNC;
+    const TaskScheduler oldpolicy = ThreadPool::get_scheduler();
+    const int ntree = 100, depth = 10;
+
+    MADNESS_CHECK(TaskAttributes().get_numa_domain() == -1);
+    MADNESS_CHECK(TaskAttributes::numa(3).get_numa_domain() == 3);
+    MADNESS_CHECK(TaskAttributes::numa(3).set_numa_domain(-1).get_numa_domain() == -1);
+    MADNESS_CHECK(TaskAttributes::multi_threaded(2).set_numa_domain(1).get_nthread() == 2);
+    MADNESS_CHECK(TaskAttributes().get_priority() == 0);
+    MADNESS_CHECK(TaskAttributes::priority(3).get_priority() == 3);
+    MADNESS_CHECK(!TaskAttributes::priority(3).is_high_priority());
+    MADNESS_CHECK(TaskAttributes::hipri().get_priority() == TaskAttributes::NPRIORITY-1);
+    MADNESS_CHECK(TaskAttributes::priority(TaskAttributes::NPRIORITY-1).is_high_priority());
+    MADNESS_CHECK(TaskAttributes::hipri().set_highpriority(false).get_priority() == 0);
+
+    for (TaskScheduler policy : {TaskScheduler::WorkStealing, TaskScheduler::SharedQueue}) {
+        ThreadPool::set_scheduler(policy);
+        TreeTask::count = 0;
+        for (int i=0; i<ntree; ++i)
+            world.taskq.add(new TreeTask(depth));
+        world.taskq.fence();
+        MADNESS_CHECK(TreeTask::count == ntree*((2<<depth) - 1));
+
+        // Same with NUMA domain hints (only placed if MAD_TASK_NUMA=on)
+        TreeTask::count = 0;
+        const int ndomain = numa_topology.get_ndomain();
+        for (int i=0; i<ntree; ++i)
+            world.taskq.add(new TreeTask(depth, TaskAttributes::numa(i % ndomain)));
+        world.taskq.fence();
+        MADNESS_CHECK(TreeTask::count == ntree*((2<<depth) - 1));
+
+        // Same with every priority level
+        TreeTask::count = 0;
+        for (int i=0; i<ntree; ++i)
+            world.taskq.add(new TreeTask(depth, TaskAttributes::priority(i % TaskAttributes::NPRIORITY)));
+        world.taskq.fence();
+        MADNESS_CHECK(TreeTask::count == ntree*((2<<depth) - 1));
+
+        // Multi-threaded tasks must still work alongside the local deques
+        if (ThreadPool::size() > 1) {
+            world.taskq.add(new TestBarrier(TaskAttributes::multi_threaded(ThreadPool::size())));
+            world.taskq.fence();
+        }
+    }
+
+    ThreadPool::set_scheduler(oldpolicy);
+    world.gop.fence();
+    print("Test16 OK");
+}
+
+void test17(World& world) {
+    PROFILE_FUNC;
+    const int n = 10000;
+
+    // Blocks are aligned, distinct and reused within a thread
+    std::vector<void*> blocks;
+    for (int i=0; i<n; ++i) {
+        const std::size_t size = 1 + (i*37)%4096;
+        void* p = PoolAllocator::allocate(size);
+        MADNESS_CHECK((reinterpret_cast<std::uintptr_t>(p) % 64) == 0);
+        std::memset(p, 0xff, size);
+        blocks.push_back(p);
+    }
+    for (int i=0; i<n; ++i)
+        PoolAllocator::deallocate(blocks[i], 1 + (i*37)%4096);
+    void* p = PoolAllocator::allocate(100);
+    PoolAllocator::deallocate(p, 100);
+    MADNESS_CHECK(PoolAllocator::allocate(100) == p);
+    PoolAllocator::deallocate(p, 100);
+    p = PoolAllocator::allocate(2*PoolAllocator::max_size);
+    PoolAllocator::deallocate(p, 2*PoolAllocator::max_size);
+
+    // Active-message buffers are recycled from the slab classes
+    for (std::size_t nbyte : {std::size_t(0), std::size_t(100), std::size_t(5000), std::size_t(100000)}) {
+        AmArg* arg = new_am_arg(std::vector<char>(nbyte, 'x'));
+        std::vector<char> v;
+        *arg & v;
+        MADNESS_CHECK(v.size() == nbyte);
+        AmArg* copy = copy_am_arg(*arg);
+        free_am_arg(arg);
+        MADNESS_CHECK(alloc_am_arg(copy->size()) == arg);
+        free_am_arg(arg);
+        free_am_arg(copy);
+    }
+
+    // Tasks and futures come from the pools and return to them (mostly on other threads)
+    const PoolAllocatorStats before = world_mem_info()->pool_stats();
+    std::vector< Future<double> > results;
+    for (int i=0; i<n; ++i)
+        results.push_back(world.taskq.add(dumb, i, 1, 1, 1, 1, 1, 1));
+    world.taskq.fence();
+    for (int i=0; i<n; ++i)
+        MADNESS_CHECK(results[i].get() == dumb(i, 1, 1, 1, 1, 1, 1));
+    results.clear();
+    const PoolAllocatorStats after = world_mem_info()->pool_stats();
+    MADNESS_CHECK(after.nalloc - before.nalloc >= std::uint64_t(2*n));
+    MADNESS_CHECK(after.nfree - before.nfree >= std::uint64_t(2*n));
+
+    print("Test17 OK");
+}
+
+void test18(World& world) {
+    PROFILE_FUNC;
+    const bool oldaggregate = RMI::get_aggregation();
+    const uint64_t nbatch_before = RMI::get_stats().nbatch_sent;
+    const int nproc = world.size();
+    const ProcessID me = world.rank();
+
+    RMI::set_aggregation(true);
+    MADNESS_CHECK(RMI::get_aggregation() == (nproc > 1)); // No RMI server with one process
+
+    // Floods of small ordered messages (and a few large ones) to every process
+    WorldContainer<int,std::vector<double> > c(world);
+    for (int i=me; i<10000; i+=nproc)
+        c.replace(i, std::vector<double>((i%1000 == 0) ? 100000 : 1, double(i)));
+    world.gop.fence();
+    for (int i=9999; i>=0; --i) {
+        const std::vector<double> v = c.find(i).get()->second;
+        MADNESS_CHECK(v.size() == ((i%1000 == 0) ? 100000u : 1u) && v[0] == i);
+    }
+    world.gop.fence();
+    if (nproc > 1) {
+        MADNESS_CHECK(RMI::get_stats().nbatch_sent > nbatch_before);
+        MADNESS_CHECK(RMI::get_stats().nmsg_batched >= RMI::get_stats().nbatch_sent);
+    }
+
+    RMI::set_aggregation(oldaggregate);
+    world.gop.fence();
+
+    print("Test18 OK");
+}
+
+void test19(World& world) {
+    PROFILE_FUNC;
+    const uint64_t nrendezvous_before = RMI::get_stats().nrendezvous_sent;
+    const int nproc = world.size();
+    const ProcessID me = world.rank();
+
+    // Values larger than the rendezvous threshold, several in flight at once
+    const std::size_t n = (nproc > 1) ? RMI::rendezvous_threshold()/sizeof(double) + 1 : 1000;
+    WorldContainer<int,std::vector<double> > c(world);
+    for (int i=me; i<20; i+=nproc)
+        c.replace(i, std::vector<double>(n+i, double(i)));
+    world.gop.fence();
+    // One process reads at a time
+    for (ProcessID p=0; p<nproc; ++p) {
+        if (p == me) {
+            for (int i=0; i<20; ++i) {
+                const std::vector<double> v = c.find(i).get()->second;
+                MADNESS_CHECK(v.size() == n+i && v.front() == i && v.back() == i);
+            }
+        }
+        world.gop.fence();
+    }
+    if (nproc > 1)
+        MADNESS_CHECK(RMI::get_stats().nrendezvous_sent > nrendezvous_before);
+
+    // All processes read at once, so that the RMI server threads send huge
+    // replies to each other at the same time
+    std::vector< Future< WorldContainer<int,std::vector<double> >::iterator > > found;
+    for (int i=0; i<20; ++i) found.push_back(c.find((i + me) % 20));
+    for (int i=0; i<20; ++i) {
+        const int key = (i + me) % 20;
+        const std::vector<double>& v = found[i].get()->second;
+        MADNESS_CHECK(v.size() == n+key && v.front() == key && v.back() == key);
+    }
+    found.clear();
+    world.gop.fence();
+
+    // A small value sent after a huge one to the same key must not overtake it
+    for (int i=20; i<20+nproc; ++i) {
+        c.replace(i + nproc*me, std::vector<double>(n, -1.0));
+        c.replace(i + nproc*me, std::vector<double>(1, double(me)));
+    }
+    world.gop.fence();
+    for (int i=20; i<20+nproc; ++i) {
+        const std::vector<double> v = c.find(i + nproc*me).get()->second;
+        MADNESS_CHECK(v.size() == 1 && v.front() == me);
+    }
+
+    print("Test19 OK");
+}
+
+void test20(World& world) {
+    PROFILE_FUNC;
+    const int nproc = world.size();
+    const ProcessID me = world.rank();
+
+    // A burst of small messages from every process
+    WorldContainer<int,double> c(world);
+    for (int i=0; i<2000; ++i)
+        c.replace(i*nproc + me, double(i));
+    world.gop.fence();
+    std::size_t n = c.size();
+    world.gop.sum(n);
+    MADNESS_CHECK(n == 2000u*nproc);
+
+    if (nproc > 1) {
+        const RMIStats stats = RMI::get_stats();
+        MADNESS_CHECK(RMI::nrecv_min() <= RMI::nrecv() && RMI::nrecv() <= RMI::nrecv_max());
+        MADNESS_CHECK(stats.nrecv_posted >= RMI::nrecv_min() && stats.nrecv_posted <= RMI::nrecv_max());
+        MADNESS_CHECK(stats.max_nrecv_posted >= stats.nrecv_posted);
+        MADNESS_CHECK(stats.max_recv_in_use > 0);
+
+        // Once the traffic stops the pool shrinks and frees the surplus buffers
+        if (RMI::nrecv() > RMI::nrecv_min()) {
+            const std::size_t nrecv = RMI::nrecv();
+            const double start = wall_time();
+            while ((RMI::nrecv() == nrecv || RMI::get_stats().nrecv_posted != RMI::nrecv())
+                   && wall_time() - start < 10.0)
+                myusleep(10000);
+            MADNESS_CHECK(RMI::nrecv() < nrecv);
+            MADNESS_CHECK(RMI::get_stats().nrecv_posted == RMI::nrecv());
+        }
+        world.gop.fence();
+    }
+
+    print("Test20 OK");
+}
+
+void test21(World& world) {
+    PROFILE_FUNC;
+    const int nproc = world.size();
+    const ProcessID me = world.rank();
+
+    for (ProcessID root=0; root<nproc; ++root) {
+        // Every process but the root is the child of exactly one process
+        ProcessID parent;
+        std::vector<ProcessID> children;
+        world.mpi.node_tree_info(root, parent, children);
+        MADNESS_CHECK((parent == -1) == (me == root));
+        std::vector<long> nparent(nproc, 0);
+        for (ProcessID child : children) nparent[child] = 1;
+        world.gop.sum(nparent.data(), nproc);
+        for (ProcessID p=0; p<nproc; ++p) MADNESS_CHECK(nparent[p] == (p == root ? 0 : 1));
+
+        // Only node leaders talk to other nodes
+        const bool leader = (parent == -1) || (world.mpi.node_of(parent) != world.mpi.node_of(me));
+        for (ProcessID child : children)
+            MADNESS_CHECK(leader || world.mpi.node_of(child) == world.mpi.node_of(me));
+
+        double value = (me == root) ? root + 0.5 : -1.0;
+        world.gop.broadcast(value, root);
+        MADNESS_CHECK(value == root + 0.5);
+    }
+
+    long sum = me + 1;
+    world.gop.sum(sum);
+    MADNESS_CHECK(sum == long(nproc)*(nproc+1)/2);
+    world.gop.fence();
+
+    print("Test21 OK");
+}
+
+static AtomicInt test22_count;
+
+static long test22_incr(long i) {
+    test22_count++;
+    return i;
+}
+
+void test22(World& world) {
+    PROFILE_FUNC;
+    const int nproc = world.size();
+    const ProcessID me = world.rank();
+    test22_count = 0;
+    world.gop.fence();
+
+    // Several reductions in flight at once, completed in reverse order
+    const int nred = 8;
+    std::vector< Future<long> > sums, maxs;
+    std::vector<double> v = {1.0*me, -1.0*me, 1.0};
+    Future< std::vector<double> > vsum = world.gop.sum_async(v.data(), v.size());
+    for (int i=0; i<nred; ++i) {
+        sums.push_back(world.gop.sum_async(long(me + i)));
+        maxs.push_back(world.gop.max_async(long(i - me)));
+    }
+    Future<double> dmin = world.gop.min_async(-1.5*me);
+    for (int i=nred-1; i>=0; --i) {
+        MADNESS_CHECK(sums[i].get() == long(nproc)*(nproc-1)/2 + long(nproc)*i);
+        MADNESS_CHECK(maxs[i].get() == i);
+    }
+    MADNESS_CHECK(dmin.get() == -1.5*(nproc-1));
+    MADNESS_CHECK(vsum.get()[0] == 0.5*nproc*(nproc-1));
+    MADNESS_CHECK(vsum.get()[1] == -0.5*nproc*(nproc-1));
+    MADNESS_CHECK(vsum.get()[2] == nproc);
+
+    // The fence completes only once all remote tasks submitted before it
+    // have run everywhere, while more work may be added as it proceeds
+    const int ntask = 100;
+    for (int i=0; i<ntask; ++i)
+        world.taskq.add((me + i) % nproc, test22_incr, long(i));
+    Future<bool> fenced = world.gop.fence_async();
+    Future<long> overlap = world.gop.sum_async(long(1));
+    for (int i=0; i<ntask; ++i)
+        world.taskq.add((me + i + 1) % nproc, test22_incr, long(i));
+    MADNESS_CHECK(overlap.get() == nproc);
+    MADNESS_CHECK(fenced.get());
+    long count = test22_count;
+    world.gop.sum(count);
+    MADNESS_CHECK(count >= long(ntask)*nproc);
+    world.gop.fence();
+    count = test22_count;
+    world.gop.sum(count);
+    MADNESS_CHECK(count == 2l*ntask*nproc);
+
+    // Back to back with the blocking fence
+    world.gop.fence_async().get();
+    world.gop.fence();
+
+    print("Test22 OK");
+}
+
+#ifdef MADNESS_HAS_COROUTINES
+CoTask<long> test23_tree(World& world, int depth) {
+    if (depth == 0) co_return 1;
+    Future<long> left = world.taskq.add(test23_tree(world, depth-1));
+    Future<long> right = world.taskq.add(test23_tree(world, depth-1));
+    co_return 1 + co_await left + co_await right;
+}
+
+CoTask<double> test23_find(World& world, const WorldContainer<int,double>& c, int n) {
+    // Most items are remote so most lookups suspend
+    double sum = 0.0;
+    for (int i=0; i<n; ++i) {
+        auto it = co_await c.find(i);
+        sum += it->second;
+    }
+    co_return sum;
+}
+
+CoTask<void> test23_void(Future<int> f, AtomicInt* count) {
+    int i = co_await f;
+    (*count) += i;
+    co_return;
+}
+#endif // MADNESS_HAS_COROUTINES
+
+void test23(World& world) {
+    PROFILE_FUNC;
+#ifdef MADNESS_HAS_COROUTINES
+    const int depth = 10;
+    MADNESS_CHECK(world.taskq.add(test23_tree(world, depth)).get() == (2l << depth) - 1);
+
+    const int n = 100;
+    {
+        WorldContainer<int,double> c(world);
+        for (int i=world.rank(); i<n; i+=world.size()) c.replace(i, 0.5*i);
+        world.gop.fence();
+        MADNESS_CHECK(world.taskq.add(test23_find(world, c, n)).get() == 0.25*n*(n-1));
+        world.gop.fence();
+    }
+
+    // The fence waits for a coroutine that is suspended
+    Future<int> f;
+    AtomicInt count;
+    count = 0;
+    world.taskq.add(test23_void(f, &count));
+    world.taskq.add([f]() { Future<int> g = f; g.set(7); });
+    world.gop.fence();
+    MADNESS_CHECK(count == 7);
+
+    // Futures assigned by another task while the coroutine is suspending
+    const int nrace = 1000;
+    AtomicInt nset;
+    nset = 0;
+    for (int i=0; i<nrace; ++i) {
+        Future<int> g;
+        world.taskq.add(test23_void(g, &nset));
+        world.taskq.add([g]() { Future<int> h = g; h.set(1); });
+    }
+    world.gop.fence();
+    MADNESS_CHECK(nset == nrace);
+
+    // A coroutine that is never submitted never runs
+    { CoTask<void> unused = test23_void(Future<int>(1), &count); }
+    MADNESS_CHECK(count == 7);
+
+    print("Test23 OK");
+#else
+    print("Test23 skipped: coroutines need C++20");
+#endif // MADNESS_HAS_COROUTINES
+}
+
+int test24_task(int i) {
+    PROFILE_FUNC;
+    return i + 1;
+}
+
+void test24(World& world) {
+    PROFILE_FUNC;
+    const int ntask = 1000;
+
+    RuntimeProfiler::clear();
+    RuntimeProfiler::enable();
+    std::vector< Future<int> > v(ntask);
+    for (int i=0; i<ntask; ++i) v[i] = world.taskq.add(test24_task, i);
+    for (int i=0; i<ntask; ++i) MADNESS_CHECK(v[i].get() == i + 1);
+    // Tasks sent to another process arrive as active messages
+    const ProcessID next = (world.rank() + 1) % world.size();
+    for (int i=0; i<10; ++i) MADNESS_CHECK(world.taskq.add(next, test24_task, i).get() == i + 1);
+    world.gop.fence();
+    RuntimeProfiler::disable();
+
+    // Tasks run by the main thread while it waits are counted too
+    MADNESS_CHECK(RuntimeProfiler::count(RuntimeProfileKind::task) >= (unsigned long)(ntask));
+#ifndef WORLD_PROFILE_ENABLE
+    MADNESS_CHECK(RuntimeProfiler::count(RuntimeProfileKind::region) >= (unsigned long)(ntask));
+#endif
+    if (world.size() > 1) MADNESS_CHECK(RuntimeProfiler::count(RuntimeProfileKind::rmi) > 0);
+
+    // Nothing is recorded while disabled
+    const unsigned long n = RuntimeProfiler::count(RuntimeProfileKind::task);
+    world.taskq.add(test24_task, 0).get();
+    MADNESS_CHECK(RuntimeProfiler::count(RuntimeProfileKind::task) == n);
+
+    RuntimeProfiler::print(world);
+    RuntimeProfiler::clear();
+    MADNESS_CHECK(RuntimeProfiler::count(RuntimeProfileKind::task) == 0);
+    MADNESS_CHECK(!RuntimeProfiler::used());
+
+    print("Test24 OK");
+}
+
+void test25(World& world) {
+    PROFILE_FUNC;
+    const int n = 1000;
+    world.gop.fence();
+
+    const MemoryAccountingStats before = MemoryAccounting::get_stats(MemoryCategory::hashmap);
+    {
+        ConcurrentHashMap<int,double> h(1024);
+        for (int i=0; i<n; ++i) MADNESS_CHECK(h.insert(std::pair<int,double>(i, double(i))).second);
+        const MemoryAccountingStats during = MemoryAccounting::get_stats(MemoryCategory::hashmap);
+        const std::int64_t minbytes = n*sizeof(std::pair<const int,double>);
+        MADNESS_CHECK(during.current >= before.current + minbytes);
+        MADNESS_CHECK(during.high_water >= during.current);
+        for (int i=0; i<n; i+=2) MADNESS_CHECK(h.try_erase(i));
+        MADNESS_CHECK(MemoryAccounting::get_stats(MemoryCategory::hashmap).current < during.current);
+    }
+    const MemoryAccountingStats after = MemoryAccounting::get_stats(MemoryCategory::hashmap);
+    MADNESS_CHECK(after.current == before.current);
+    MADNESS_CHECK(after.high_water >= before.current + n*std::int64_t(sizeof(std::pair<const int,double>)));
+
+    // Earlier tests ran tasks from the pools
+    MADNESS_CHECK(MemoryAccounting::get_stats(MemoryCategory::task).current > 0);
+    MADNESS_CHECK(MemoryAccounting::get_total_stats().high_water >= MemoryAccounting::get_total_stats().current);
+
+    std::ostringstream s;
+    MemoryAccounting::write_json(s, world.rank(), 1.5);
+    const std::string json = s.str();
+    MADNESS_CHECK(json.front() == '{' && json.back() == '\n');
+    MADNESS_CHECK(json.find("\"high_water\": {\"tensor\": ") != std::string::npos);
+    MADNESS_CHECK(json.find("\"cloud\": ") != std::string::npos);
+
+    MemoryAccounting::print(world);
+
+    print("Test25 OK");
+}
+
 inline bool is_odd(int i) {
     return i & 0x1;
 }
@@ -1400,6 +1960,16 @@ int main(int argc, char** argv) {
         test13(world);
         test14(world);
         test15(world);
+        test16(world);
+        test17(world);
+        test18(world);
+        test19(world);
+        test20(world);
+        test21(world);
+        test22(world);
+        test23(world);
+        test24(world);
+        test25(world);
 
         for (int i=0; i<10; ++i) {
           print("REPETITION",i);
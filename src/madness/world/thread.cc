@@ -43,8 +43,12 @@
 #include <madness/world/worldpapi.h>
 #include <madness/world/safempi.h>
 #include <madness/world/atomicint.h>
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <string>
+#include <unordered_map>
 
 #if defined(HAVE_IBMBGQ) and defined(HPM)
 extern "C" unsigned int HPM_Prof_init_thread(void);
@@ -70,6 +74,10 @@ extern "C" void HPM_Prof_stop(unsigned int);
 namespace madness {
     ThreadBinder binder;
     thread_local bool ThreadBinder::bound = false;
+    NumaTopology numa_topology;
+    namespace detail {
+        bool numa_first_touch_enabled = false;
+    }
     pthread_key_t ThreadBase::thread_key;
 
     ThreadPool* ThreadPool::instance_ptr = 0;
@@ -80,7 +88,11 @@ namespace madness {
 #endif
 #ifdef MADNESS_TASK_PROFILING
     Mutex profiling::TaskProfiler::output_mutex_;
+    thread_local profiling::TaskProfiler* profiling::TaskProfiler::current_ = nullptr;
     const char* profiling::TaskProfiler::output_file_name_;
+    bool profiling::TaskProfiler::json_ = false;
+    std::size_t profiling::TaskProfiler::nevent_ = 65536;
+    double profiling::TaskProfiler::epoch_ = 0.0;
 #endif // MADNESS_TASK_PROFILING
 #if defined(HAVE_IBMBGQ) and defined(HPM)
     unsigned int ThreadPool::main_hpmctx;
@@ -154,6 +166,41 @@ namespace madness {
         return 0;
     }
 
+    NumaTopology::NumaTopology() : ndomain(1) {
+#ifndef ON_A_MAC
+        // Each /sys/devices/system/node/nodeN/cpulist holds ranges like "0-7,16-23"
+        // Node numbers may be sparse so stop only after a long gap
+        int nmissing = 0;
+        for (int node=0; nmissing<64; ++node) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!file) {
+                ++nmissing;
+                continue;
+            }
+            nmissing = 0;
+            std::string range;
+            while (std::getline(file, range, ',')) {
+                int lo, hi;
+                const int nread = sscanf(range.c_str(), "%d-%d", &lo, &hi);
+                if (nread < 1) continue;
+                if (nread == 1) hi = lo;
+                if (hi >= int(cpu_domain.size())) cpu_domain.resize(hi+1, 0);
+                for (int cpu=lo; cpu<=hi; ++cpu) cpu_domain[cpu] = node;
+            }
+            ndomain = node + 1;
+        }
+#endif
+    }
+
+    int NumaTopology::current_domain() const {
+        if (ndomain == 1) return 0;
+#ifndef ON_A_MAC
+        return domain_of_cpu(sched_getcpu());
+#else
+        return 0;
+#endif
+    }
+
     // Start the thread running
     void ThreadBase::start() {
         pthread_attr_t attr;
@@ -210,50 +257,111 @@ namespace madness {
 
     namespace profiling {
 
+        /// The per-rank output file: NAME_[rank]x[threads + 1], with a
+        /// \c .json suffix for JSON traces.
+        static std::string output_file() {
+            std::stringstream file_name;
+            file_name << TaskProfiler::output_file_name_ << "_"
+                    << SafeMPI::COMM_WORLD.Get_rank() << "x"
+                    << ThreadPool::size() + 1;
+            if(TaskProfiler::json_) file_name << ".json";
+            return file_name.str();
+        }
+
+        void TaskProfiler::begin() {
+            output_file_name_ = getenv("MAD_TASKPROFILER_NAME");
+            if(! output_file_name_) {
+                if(SafeMPI::COMM_WORLD.Get_rank() == 0)
+                    std::cerr
+                        << "!!! WARNING: MAD_TASKPROFILER_NAME not set.\n"
+                        << "!!! WARNING: There will be no task profile output.\n";
+                return;
+            }
+
+            const char* format = getenv("MAD_TASKPROFILER_FORMAT");
+            json_ = (format && std::string(format) == "json");
+
+            const char* nevent = getenv("MAD_TASKPROFILER_NEVENT");
+            if(nevent) {
+                long n = atol(nevent);
+                if(n > 0) nevent_ = n;
+            }
+
+            // Time of day at which wall_time() is zero
+            struct timeval tv;
+            gettimeofday(&tv,0);
+            epoch_ = (tv.tv_sec + 1e-6*tv.tv_usec - wall_time()) * 1e6;
+
+            // Erase the profiler output file
+            const int rank = SafeMPI::COMM_WORLD.Get_rank();
+            std::ofstream file(output_file().c_str(), std::ios_base::out | std::ios_base::trunc);
+            if(json_) {
+                // Each record ends with a comma and the closing bracket is
+                // omitted, so that threads can append independently.
+                file.precision(3);
+                file << std::fixed << "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << rank
+                     << ",\"args\":{\"name\":\"rank " << rank << "\",\"epoch\":" << epoch_ << "}},\n"
+                     << "{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":" << rank
+                     << ",\"args\":{\"sort_index\":" << rank << "}},\n";
+            }
+            file.close();
+        }
+
         void TaskProfiler::write_to_file() {
-            // Get output filename: NAME_[rank]x[threads + 1]
-            if(output_file_name_ != nullptr) {
-                // Construct the actual output filename
-                std::stringstream file_name;
-                file_name << output_file_name_ << "_"
-                        << SafeMPI::COMM_WORLD.Get_rank() << "x"
-                        << ThreadPool::size() + 1;
-
-                // Lock file for output
-                ScopedMutex<Mutex> locker(TaskProfiler::output_mutex_);
-
-                // Open the file for output
-                std::ofstream file(file_name.str().c_str(), std::ios_base::out | std::ios_base::app);
-                if(! file.fail()) {
-                    // Print the task profile data
-                    // and delete the data since it is not needed anymore
-                    const TaskEventListBase* next = nullptr;
-                    while(head_ != nullptr) {
-                        next = head_->next();
-                        file << *head_;
-                        delete head_;
-                        head_ = const_cast<TaskEventListBase*>(next);
-                    }
-
-                    tail_ = nullptr;
+            if(output_file_name_ == nullptr || (tasks_.size() == 0 && others_.size() == 0)) return;
+
+            // Lock file for output
+            ScopedMutex<Mutex> locker(TaskProfiler::output_mutex_);
+
+            // Open the file for output
+            const std::string file_name = output_file();
+            std::ofstream file(file_name.c_str(), std::ios_base::out | std::ios_base::app);
+            if(! file.fail()) {
+                if(json_) {
+                    const int rank = SafeMPI::COMM_WORLD.Get_rank();
+                    // Symbol lookup is slow, so each name is found only once
+                    std::unordered_map<void*, std::string> names;
+                    auto write_event = [&](const TaskEvent& event) {
+                        if(event.kind() == EventKind::fence) {
+                            event.write_json(file, rank, tid_, "fence");
+                            return;
+                        }
+                        auto it = names.find(event.id().first);
+                        if(it == names.end()) {
+                            std::string name = event.function_name();
+                            if(name == "UNKNOWN" && event.id().second == 1) {
+                                // Not an exported symbol, so use its address
+                                std::ostringstream address;
+                                address << event.id().first;
+                                name = address.str();
+                            }
+                            it = names.emplace(event.id().first, name).first;
+                        }
+                        event.write_json(file, rank, tid_, it->second);
+                    };
+                    std::size_t ndropped = tasks_.drain(write_event);
+                    ndropped += others_.drain(write_event);
+
+                    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << rank
+                         << ",\"tid\":" << tid_ << ",\"args\":{\"name\":\"";
+                    if(tid_ == 0) file << "main";
+                    else if(tid_ > static_cast<int>(ThreadPool::size())) file << "rmi";
+                    else file << "pool " << tid_ - 1;
+                    file << "\",\"dropped\":" << ndropped << "}},\n";
                 } else {
-                    std::cerr << "!!! ERROR: TaskProfiler cannot open file: "
-                            << file_name.str() << "\n";
+                    // Print the task profile data (pool thread index, -1 for main)
+                    const int thread_id = tid_ - 1;
+                    tasks_.drain([&](const TaskEvent& event) {
+                        file << thread_id << "\t" << event << std::endl;
+                    });
                 }
-
-                // close the file
-                file.close();
             } else {
-                // Nothing is written so just cleanup data
-                const TaskEventListBase* next = nullptr;
-                while(head_ != nullptr) {
-                    next = head_->next();
-                    delete head_;
-                    head_ = const_cast<TaskEventListBase*>(next);
-                }
-
-                tail_ = nullptr;
+                std::cerr << "!!! ERROR: TaskProfiler cannot open file: "
+                        << file_name << "\n";
             }
+
+            // close the file
+            file.close();
         }
 
 
@@ -269,10 +377,17 @@ namespace madness {
     ThreadPool::ThreadPool(int nthread)
     : threads(nullptr)
     , main_thread()
+    , local_queues(nullptr)
+    , domain_queues(nullptr)
+    , ndomain(0)
     , nthreads(nthread)
     , finish(false)
+    , scheduler(default_scheduler())
     {
         nfinished = 0;
+        nidle = 0;
+        wake_pending = false;
+        priority_used = false;
         instance_ptr = this;
         if (nthreads < 0) nthreads = default_nthread();
         MADNESS_ASSERT(nthreads >=0);
@@ -304,8 +419,10 @@ namespace madness {
             MADNESS_EXCEPTION("When configured with MADNESS_TASK_BACKEND=Pthreads MAD_NUM_THREADS cannot exceed 64",1);
 
         try {
-            if (nthreads > 0)
+            if (nthreads > 0) {
                 threads = new ThreadPoolThread[nthreads];
+                local_queues = new WorkStealingDeque<PoolTaskInterface*>[nthreads];
+            }
             else
                 threads = 0;
         }
@@ -313,6 +430,12 @@ namespace madness {
             MADNESS_EXCEPTION("memory allocation failed", 0);
         }
 
+        if (default_numa_aware() && nthreads > 0) {
+            ndomain = numa_topology.get_ndomain();
+            domain_queues = new WorkStealingDeque<PoolTaskInterface*>[ndomain];
+            detail::numa_first_touch_enabled = true;
+        }
+
         for (int i=0; i<nthreads; ++i) {
             threads[i].set_pool_thread_index(i);
             threads[i].start(pool_thread_main, (void *)(threads+i));
@@ -346,9 +469,160 @@ namespace madness {
         return nthread;
     }
 
+    // Get NUMA-aware task placement from the environment
+    bool ThreadPool::default_numa_aware() {
+        const char* cnuma = getenv("MAD_TASK_NUMA");
+        if (cnuma) {
+            const std::string value(cnuma);
+            if (value == "on" || value == "ON" || value == "1") return true;
+            if (value != "off" && value != "OFF" && value != "0")
+                MADNESS_EXCEPTION("MAD_TASK_NUMA must be one of on or off", 0);
+        }
+        return false;
+    }
+
+    // Get the scheduling policy from the environment
+    TaskScheduler ThreadPool::default_scheduler() {
+        const char* cscheduler = getenv("MAD_TASK_SCHEDULER");
+        if (cscheduler) {
+            const std::string name(cscheduler);
+            if (name == "steal" || name == "workstealing")
+                return TaskScheduler::WorkStealing;
+            if (name != "queue" && name != "shared")
+                MADNESS_EXCEPTION("MAD_TASK_SCHEDULER must be one of queue or steal", 0);
+        }
+        return TaskScheduler::SharedQueue;
+    }
+
+    void ThreadPool::set_scheduler(TaskScheduler policy) {
+#if !HAVE_INTEL_TBB && !HAVE_PARSEC
+        ThreadPool* const pool = instance();
+        if (pool->scheduler == policy) return;
+        pool->scheduler = policy;
+
+        if (policy == TaskScheduler::SharedQueue) {
+            // Hand any leftover tasks in the local deques to the shared queue
+            PoolTaskInterface* taskbuf[nmax];
+            for (int i=0; i<pool->nthreads; ++i) {
+                while (! pool->local_queues[i].empty()) {
+                    const int ntask = pool->local_queues[i].steal(nmax, taskbuf);
+                    for (int j=0; j<ntask; ++j)
+                        pool->queue.push_back_unbuffered(taskbuf[j]);
+                }
+            }
+        }
+        else {
+            // Threads sleeping in the shared queue are not counted as idle, so
+            // wake them all up to let them start stealing
+            pool->wake_pending = false;
+            for (int i=0; i<pool->nthreads; ++i)
+                pool->queue.push_back_unbuffered(nullptr);
+        }
+#endif
+    }
+
+    int ThreadPool::pop_tasks(PoolTaskInterface** taskbuf, bool wait) {
+        const ThreadBase* const thread = ThreadBase::this_thread();
+        const int id = (thread ? thread->get_pool_thread_index() : -1);
+        const int domain = (! domain_queues) ? 0 :
+                (id >= 0) ? (threads[id].get_numa_domain() % ndomain) :
+                (numa_topology.current_domain() % ndomain);
+
+        // Anyone who takes the wake-up token from the shared queue allows
+        // another one to be sent
+        auto pop_shared = [&](bool wait) {
+            const int ntask = queue.pop_front(nmax, taskbuf, wait);
+            for (int i=0; i<ntask; ++i) {
+                if (! taskbuf[i]) {
+                    wake_pending = false;
+                    break;
+                }
+            }
+            return ntask;
+        };
+
+        while (true) {
+            int ntask = 0;
+
+            // Prioritized tasks first, highest level first. The top level
+            // is taken most recent first like the high-priority tasks pushed
+            // to the front of the shared queue, the others oldest first.
+            if (priority_used.load(std::memory_order_relaxed)) {
+                ntask = priority_queues[TaskAttributes::NPRIORITY-1].pop_back(nmax, taskbuf);
+                if (ntask) return ntask;
+                for (int i=TaskAttributes::NPRIORITY-2; i>0; --i) {
+                    ntask = priority_queues[i].steal(nmax, taskbuf);
+                    if (ntask) return ntask;
+                }
+            }
+
+            // Then the most recent tasks from our own deque
+            if (id >= 0) {
+                ntask = local_queues[id].pop_back(nmax, taskbuf);
+                if (ntask) return ntask;
+            }
+
+            // Then tasks placed in our NUMA domain
+            if (domain_queues) {
+                ntask = domain_queues[domain].steal(nmax, taskbuf);
+                if (ntask) return ntask;
+            }
+
+            // Then tasks injected from outside the pool
+            ntask = pop_shared(false);
+            if (ntask) return ntask;
+
+            // Then the oldest tasks of the other threads, starting with our neighbor
+            bool busy = false;
+            for (int i=1; i<=nthreads; ++i) {
+                const int victim = (id + i) % nthreads;
+                if (victim == id) continue;
+                ntask = local_queues[victim].steal(nmax, taskbuf);
+                if (ntask) return ntask;
+                busy = busy || !local_queues[victim].empty();
+            }
+
+            // Then remote NUMA domains
+            for (int i=1; i<ndomain; ++i) {
+                const int victim = (domain + i) % ndomain;
+                ntask = domain_queues[victim].steal(nmax, taskbuf);
+                if (ntask) return ntask;
+                busy = busy || !domain_queues[victim].empty();
+            }
+            if (domain_queues) busy = busy || !domain_queues[domain].empty();
+            for (int i=1; i<TaskAttributes::NPRIORITY; ++i)
+                busy = busy || !priority_queues[i].empty();
+
+            if (!wait) return 0;
+            if (busy) continue; // Lost a race with the owner or another thief
+
+            // Nothing to do so sleep on the shared queue. We must be counted
+            // as idle before looking at the deques one last time, so that
+            // any thread pushing work after our check will wake us up.
+            nidle++;
+            for (int i=0; i<nthreads && !busy; ++i)
+                busy = !local_queues[i].empty();
+            for (int i=0; i<ndomain && !busy; ++i)
+                busy = !domain_queues[i].empty();
+            for (int i=1; i<TaskAttributes::NPRIORITY && !busy; ++i)
+                busy = !priority_queues[i].empty();
+            if (busy) {
+                nidle--;
+                continue;
+            }
+            ntask = pop_shared(true);
+            nidle--;
+            return ntask;
+        }
+    }
+
     void ThreadPool::thread_main(ThreadPoolThread* const thread) {
         PROFILE_MEMBER_FUNC(ThreadPool);
 	binder.bind();
+        thread->set_numa_domain(numa_topology.current_domain());
+#ifdef MADNESS_TASK_PROFILING
+        thread->profiler().make_current(thread->get_pool_thread_index() + 1);
+#endif // MADNESS_TASK_PROFILING
 
 #if !HAVE_PARSEC
 #define MULTITASK
@@ -404,26 +678,18 @@ namespace madness {
             }
         }
 
-#ifdef MADNESS_TASK_PROFILING
-        // Initialize the output file name for the task profiler.
-        profiling::TaskProfiler::output_file_name_ =
-                getenv("MAD_TASKPROFILER_NAME");
-        if(! profiling::TaskProfiler::output_file_name_) {
-            if(SafeMPI::COMM_WORLD.Get_rank() == 0)
-                std::cerr
-                    << "!!! WARNING: MAD_TASKPROFILER_NAME not set.\n"
-                    << "!!! WARNING: There will be no task profile output.\n";
-        } else {
-            // Construct the actual output filename
-            std::stringstream file_name;
-            file_name << profiling::TaskProfiler::output_file_name_ << "_"
-                    << SafeMPI::COMM_WORLD.Get_rank() << "x"
-                    << ThreadPool::size() + 1;
+        if(instance_ptr->scheduler == TaskScheduler::WorkStealing &&
+                SafeMPI::COMM_WORLD.Get_rank() == 0 && !madness::quiet())
+            std::cout << "MADNESS task scheduler set to work stealing.\n";
+        if(instance_ptr->domain_queues &&
+                SafeMPI::COMM_WORLD.Get_rank() == 0 && !madness::quiet())
+            std::cout << "MADNESS NUMA-aware task placement on with "
+                      << instance_ptr->ndomain << " domain(s).\n";
 
-            // Erase the profiler output file
-            std::ofstream file(file_name.str().c_str(), std::ios_base::out | std::ios_base::trunc);
-            file.close();
-        }
+#ifdef MADNESS_TASK_PROFILING
+        // Read the task profiler settings and truncate its output file.
+        profiling::TaskProfiler::begin();
+        instance_ptr->main_thread.profiler().make_current(0);
 #endif  // MADNESS_TASK_PROFILING
 
 #if defined(HAVE_IBMBGQ) and defined(HPM)
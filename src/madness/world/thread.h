@@ -40,6 +40,8 @@
 
 #include <madness/world/thread_info.h>
 #include <madness/world/dqueue.h>
+#include <madness/world/pool_allocator.h>
+#include <madness/world/runtime_profiler.h>
 #include <madness/world/function_traits.h>
 #include <vector>
 #include <cstddef>
@@ -50,6 +52,7 @@
 #include <type_traits>
 #include <typeinfo>
 #include <new>
+#include <atomic>
 
 //////////// Parsec Related Begin ////////////////////
 #ifdef HAVE_PARSEC
@@ -69,6 +72,7 @@ extern "C" {
 #endif
 #include <sstream> // for std::istringstream
 #include <cstring> // for strchr & strrchr
+#include <algorithm> // for std::min
 #endif // MADNESS_TASK_PROFILING
 
 #ifdef HAVE_INTEL_TBB
@@ -157,6 +161,38 @@ namespace madness {
 
     extern ThreadBinder binder;
 
+    /// NUMA topology of this node.
+
+    /// On Linux the mapping of cpus to NUMA domains is read from
+    /// `/sys/devices/system/node`; elsewhere, or if that fails, there is a
+    /// single domain.
+    class NumaTopology {
+        std::vector<int> cpu_domain; ///< NUMA domain of each cpu
+        int ndomain;                 ///< Number of NUMA domains
+
+    public:
+        NumaTopology();
+
+        /// Number of NUMA domains (at least 1).
+        int get_ndomain() const { return ndomain; }
+
+        /// NUMA domain of a cpu (0 if unknown).
+
+        /// \param[in] cpu The cpu number.
+        /// \return The NUMA domain of \c cpu.
+        int domain_of_cpu(int cpu) const {
+            return (cpu >= 0 && cpu < int(cpu_domain.size())) ? cpu_domain[cpu] : 0;
+        }
+
+        /// NUMA domain of the cpu the calling thread is running on.
+
+        /// Unless the thread is bound (see `MAD_BIND`) this is only a snapshot.
+        /// \return The NUMA domain of the calling thread.
+        int current_domain() const;
+    };
+
+    extern NumaTopology numa_topology;
+
     /// \addtogroup threads
     /// @{
 
@@ -322,10 +358,22 @@ namespace madness {
     ///   migrated to another process for dynamic load balancing. The
     ///   default value is false.
     /// - \c highpriority : indicates a high priority task. The default
-    ///   value is false.
+    ///   value is false. Equivalent to the highest \c priority level.
+    /// - \c priority : one of \c NPRIORITY levels, 0 (the default) being
+    ///   the normal priority. The pool runs ready tasks of higher priority
+    ///   first, e.g. reductions on the critical path ahead of bulk work.
+    ///   Tasks of the top level run most recent first, the others oldest
+    ///   first. Fences talk to the other processes through MPI directly and
+    ///   the broadcasts and reductions of \c WorldGopInterface are already
+    ///   top-level tasks, so no message a remote fence waits on is queued
+    ///   behind bulk work.
     /// - \c nthread : indicates number of threads. 0 threads is interpreted
     ///   as 1 thread for backward compatibility and ease of specifying
     ///   defaults. The default value is 0 (==1).
+    /// - \c numa_domain : hints the NUMA domain whose threads should run
+    ///   the task, e.g. the domain holding the data it touches. Honored only
+    ///   when the pool was started with `MAD_TASK_NUMA=on`. The default
+    ///   value is -1 (no preference).
     class TaskAttributes {
         unsigned long flags; ///< Byte-string storing the specified attributes.
 
@@ -334,6 +382,9 @@ namespace madness {
         static const unsigned long GENERATOR = 1ul<<8; ///< Mask for generator bit.
         static const unsigned long STEALABLE = GENERATOR<<1; ///< Mask for stealable bit.
         static const unsigned long HIGHPRIORITY = GENERATOR<<2; ///< Mask for priority bit.
+        static const unsigned long NUMADOMAIN = 0xfful<<16; ///< Mask for NUMA domain byte (stores domain+1).
+        static const unsigned long PRIORITY = 0x7ul<<24; ///< Mask for priority level.
+        static const int NPRIORITY = 8; ///< Number of priority levels.
 
         /// Sets the attributes to the desired values.
 
@@ -372,6 +423,14 @@ namespace madness {
             return flags&HIGHPRIORITY;
         }
 
+        /// Get the priority level.
+
+        /// \return The priority level (0,...,NPRIORITY-1); high-priority
+        ///    tasks have the highest level.
+        int get_priority() const {
+            return is_high_priority() ? NPRIORITY-1 : int((flags&PRIORITY)>>24);
+        }
+
         /// Sets the generator attribute.
 
         /// \param[in] generator_hint The new value for the generator attribute.
@@ -396,10 +455,17 @@ namespace madness {
 
         /// \param[in] hipri The new value for the high priority attribute.
         TaskAttributes& set_highpriority(bool hipri) {
-            if (hipri)
-                flags |= HIGHPRIORITY;
-            else
-                flags &= ~HIGHPRIORITY;
+            return set_priority(hipri ? NPRIORITY-1 : 0);
+        }
+
+        /// Sets the priority level.
+
+        /// The highest level also sets the high priority attribute.
+        /// \param[in] level The new priority level (0,...,NPRIORITY-1).
+        TaskAttributes& set_priority(int level) {
+            MADNESS_ASSERT(level>=0 && level<NPRIORITY);
+            flags = (flags & ~(PRIORITY | HIGHPRIORITY)) | ((unsigned long)(level) << 24);
+            if (level == NPRIORITY-1) flags |= HIGHPRIORITY;
             return *this;
         }
 
@@ -432,6 +498,22 @@ namespace madness {
         	return n;
         }
 
+        /// Sets the preferred NUMA domain.
+
+        /// \param[in] domain The NUMA domain, or -1 for no preference.
+        TaskAttributes& set_numa_domain(int domain) {
+            MADNESS_ASSERT(domain>=-1 && domain<255);
+            flags = (flags & (~NUMADOMAIN)) | ((unsigned long)(domain+1) << 16);
+            return *this;
+        }
+
+        /// Get the preferred NUMA domain.
+
+        /// \return The NUMA domain, or -1 if there is no preference.
+        int get_numa_domain() const {
+            return int((flags & NUMADOMAIN) >> 16) - 1;
+        }
+
         /// Serializes the attributes for I/O.
 
         /// tparam Archive The archive type.
@@ -466,6 +548,33 @@ namespace madness {
             t.set_nthread(nthread);
             return t;
         }
+
+        /// Attributes with the given priority level.
+
+        /// \param[in] level The priority level (0,...,NPRIORITY-1).
+        /// \return The task attributes.
+        static TaskAttributes priority(int level) {
+            TaskAttributes t;
+            t.set_priority(level);
+            return t;
+        }
+
+        /// Attributes preferring the given NUMA domain.
+
+        /// \param[in] domain The NUMA domain.
+        /// \return The task attributes.
+        static TaskAttributes numa(int domain) {
+            TaskAttributes t;
+            t.set_numa_domain(domain);
+            return t;
+        }
+
+        /// Attributes preferring the NUMA domain of the calling thread.
+
+        /// \return The task attributes.
+        static TaskAttributes numa_local() {
+            return numa(numa_topology.current_domain());
+        }
     };
 
     /// Used to pass information about the thread environment to a user's task.
@@ -532,25 +641,35 @@ namespace madness {
 
     namespace profiling {
 
+        /// Kinds of event recorded by the task profiler.
+        enum class EventKind : unsigned char {
+            task,     ///< A task run by the thread pool
+            rmi_send, ///< An active message sent by RMI
+            rmi_recv, ///< An active message handled by the RMI server thread
+            fence     ///< A global fence
+        };
+
         /// Task event class.
 
         /// This class is used to record the task trace information, including
         /// submit, start, and stop times, as well as identification information.
+        /// Besides tasks it also records RMI sends and receives, and fences.
         class TaskEvent {
         private:
             double times_[3]; ///< Task trace times: { submit, start, stop }.
             std::pair<void*, unsigned short> id_; ///< Task identification information.
             unsigned short threads_; ///< Number of threads used by the task.
+            EventKind kind_; ///< What kind of event this is.
+            int peer_; ///< Source or destination process of an RMI event.
+            std::size_t nbyte_; ///< Size of an RMI message.
 
-            /// Print demangled symbol name.
+            /// Demangle a symbol name.
 
-            /// Add the demangled symbol name to \c os. If demangling fails,
-            /// the unmodified symbol name is used instead. If symbol is NULL,
-            /// "UNKNOWN" is used instead. A tab character is added after the
-            /// symbol name.
-            /// \param[in,out] os The output stream.
-            /// \param[in] symbol The symbol to add to the stream.
-            static void print_demangled(std::ostream& os, const char* symbol) {
+            /// If demangling fails, the unmodified symbol name is returned
+            /// instead. If symbol is NULL, "UNKNOWN" is returned instead.
+            /// \param[in] symbol The symbol to demangle.
+            /// \return The demangled name.
+            static std::string demangle(const char* symbol) {
                 // Get the demagled symbol name
                 if(symbol) {
                     int status = 0;
@@ -559,15 +678,15 @@ namespace madness {
 #else
 		    char* name = cplus_demangle(symbol, DMGL_NO_OPTS);
 #endif
-                    // Append the demangled symbol name to the output stream
-                    if(status == 0) {
-                        os << name << "\t";
+                    if(status == 0 && name) {
+                        std::string result(name);
                         free((void*)name);
+                        return result;
                     } else {
-                        os << symbol << "\t";
+                        return symbol;
                     }
                 } else {
-                    os << "UNKNOWN\t";
+                    return "UNKNOWN";
                 }
             }
 
@@ -599,8 +718,8 @@ namespace madness {
                 if(first) {
                     ++first;
                     const char* last = strrchr(first,'+');
-                    if(last)
-                        mangled_name.assign(first, (last - first) - 1);
+                    if(last && last > first)
+                        mangled_name.assign(first, last - first);
                 }
 #endif // ON_A_MAC
 
@@ -610,29 +729,121 @@ namespace madness {
                 return mangled_name;
             }
 
+            /// Write \c s to \c os as a JSON string.
+            static void write_json_string(std::ostream& os, const std::string& s) {
+                os << '"';
+                for(char c : s) {
+                    if(c == '"' || c == '\\') os << '\\' << c;
+                    else if(static_cast<unsigned char>(c) < 0x20) os << ' ';
+                    else os << c;
+                }
+                os << '"';
+            }
+
         public:
 
             // Only default constructors are needed.
 
-            /// Record the start time of the task and collect task information.
+            /// Record a complete task.
 
-            /// \param[in,out] id The task identifier (a function pointer or const char*)
+            /// \param[in] id The task identifier (a function pointer or const char*)
             ///     and an integer to differentiate the different types.
             /// \param[in] threads The number of threads this task uses.
             /// \param[in] submit_time The time that the task was submitted to the
             ///     task queue.
-            void start(const std::pair<void*, unsigned short>& id,
-                    const unsigned short threads, const double submit_time)
+            /// \param[in] start_time The time the task started.
+            /// \param[in] stop_time The time the task finished.
+            void task(const std::pair<void*, unsigned short>& id,
+                    const unsigned short threads, const double submit_time,
+                    const double start_time, const double stop_time)
             {
                 id_ = id;
                 threads_ = threads;
+                kind_ = EventKind::task;
                 times_[0] = submit_time;
-                times_[1] = wall_time();
+                times_[1] = start_time;
+                times_[2] = stop_time;
             }
 
-            /// Record the stop time of the task.
-            void stop() {
-                times_[2] = wall_time();
+            /// Record a complete non-task event.
+
+            /// \param[in] kind The kind of event.
+            /// \param[in] id Identifies the RMI handler (or is null).
+            /// \param[in] peer The remote process of an RMI event.
+            /// \param[in] nbyte The size of an RMI message.
+            /// \param[in] start_time The time the event started.
+            /// \param[in] stop_time The time the event finished.
+            void record(const EventKind kind, const std::pair<void*, unsigned short>& id,
+                    const int peer, const std::size_t nbyte,
+                    const double start_time, const double stop_time)
+            {
+                id_ = id;
+                threads_ = 1;
+                kind_ = kind;
+                peer_ = peer;
+                nbyte_ = nbyte;
+                times_[0] = times_[1] = start_time;
+                times_[2] = stop_time;
+            }
+
+            /// The kind of this event.
+            EventKind kind() const { return kind_; }
+
+            /// The task or RMI handler identifier.
+            const std::pair<void*, unsigned short>& id() const { return id_; }
+
+            /// The demangled name of the function, member function, or object type.
+            std::string function_name() const {
+                switch(id_.second) {
+                    case 1:
+                        {
+                            const std::string mangled_name = get_name();
+                            if(! mangled_name.empty())
+                                return demangle(mangled_name.c_str());
+                            return "UNKNOWN";
+                        }
+                    case 2:
+                        return demangle(static_cast<const char*>(id_.first));
+                    default:
+                        return "UNKNOWN";
+                }
+            }
+
+            /// Output the event as a Chrome trace "complete" event.
+
+            /// Times are in microseconds since the first call to
+            /// \c wall_time() in this process.
+            /// \param[in,out] os The output stream.
+            /// \param[in] pid The process id of the trace (the MPI rank).
+            /// \param[in] tid The thread id of the trace.
+            /// \param[in] name The name of the event, from \c function_name().
+            void write_json(std::ostream& os, const int pid, const int tid,
+                    const std::string& name) const
+            {
+                static const char* const category[] = { "task", "rmi_send", "rmi_recv", "fence" };
+                os << "{\"name\":";
+                write_json_string(os, name);
+                os << ",\"cat\":\"" << category[static_cast<int>(kind_)]
+                   << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << tid;
+                const std::streamsize precision = os.precision();
+                os.precision(3);
+                os << std::fixed << ",\"ts\":" << times_[1] * 1e6
+                   << ",\"dur\":" << (times_[2] - times_[1]) * 1e6;
+                switch(kind_) {
+                    case EventKind::task:
+                        os << ",\"args\":{\"threads\":" << threads_
+                           << ",\"wait\":" << (times_[1] - times_[0]) * 1e6 << "}";
+                        break;
+                    case EventKind::rmi_send:
+                    case EventKind::rmi_recv:
+                        os << ",\"args\":{\"peer\":" << peer_ << ",\"nbyte\":" << nbyte_ << "}";
+                        break;
+                    default:
+                        break;
+                }
+                os.unsetf(std::ios_base::floatfield);
+                os.precision(precision);
+                os << "},\n";
             }
 
             /// Output the task data using a tab-separated list.
@@ -654,24 +865,7 @@ namespace madness {
                         std::dec << std::noshowbase << "\t";
 
                 // Print the name
-                switch(te.id_.second) {
-                    case 1:
-                        {
-                            const std::string mangled_name = te.get_name();
-
-                            // Print the demangled name
-                            if(! mangled_name.empty())
-                                print_demangled(os, mangled_name.c_str());
-                            else
-                                os << "UNKNOWN\t";
-                        }
-                        break;
-                    case 2:
-                        print_demangled(os, static_cast<const char*>(te.id_.first));
-                        break;
-                    default:
-                        os << "UNKNOWN\t";
-                }
+                os << te.function_name() << "\t";
 
                 // Print:
                 // # of threads, submit time, start time, stop time
@@ -686,118 +880,73 @@ namespace madness {
 
         }; // class TaskEvent
 
-        /// Task event list base class.
-
-        /// This base class allows the data to be stored in a linked list.
-        class TaskEventListBase {
-        private:
-            TaskEventListBase* next_; ///< The next task event in the list.
-
-            TaskEventListBase(const TaskEventListBase&) = delete;
-            TaskEventListBase& operator=(const TaskEventListBase&) = delete;
-
-        public:
-
-            /// Default constructor.
-            TaskEventListBase()
-                : next_(nullptr) { }
-
-            /// Virtual destructor.
-            virtual ~TaskEventListBase() = default;
-
-            /// Get the next event list in the linked list.
-
-            /// \return The next event list.
-            TaskEventListBase* next() const {
-                return next_;
-            }
-
-            /// Insert \c list after this list.
-
-            /// \param[in] list The list to be inserted.
-            void insert(TaskEventListBase* list) {
-                if(next_)
-                    list->next_ = next_;
-                next_ = list;
-            }
-
-            /// Output a task event list to an output stream.
-
-            /// \param[in,out] os The ouptut stream.
-            /// \param[in] tel The task event list to be output.
-            /// \return The modified output stream.
-            friend inline std::ostream& operator<<(std::ostream& os, const TaskEventListBase& tel) {
-                return tel.print_events(os);
-            }
-
-        private:
-
-            /// Print the events.
-            virtual std::ostream& print_events(std::ostream&) const = 0;
-
-        }; // class TaskEventList
-
-        /// A list of task events.
-
-        /// This object is used by the thread pool to record task data.
-        class TaskEventList : public TaskEventListBase {
-        private:
-            unsigned int n_; ///< The number of events recorded.
-            std::unique_ptr<TaskEvent[]> events_; ///< The event array.
-
-            TaskEventList(const TaskEventList&) = delete;
-            TaskEventList& operator=(const TaskEventList&) = delete;
-
-        public:
-
-            /// Default constructor.
-
-            /// \param[in] nmax The maximum number of task events.
-            /// \todo Should nmax be stored? I think it used to be a template
-            ///    parameter (N), which is no longer present.
-            TaskEventList(const unsigned int nmax) :
-                TaskEventListBase(), n_(0ul), events_(new TaskEvent[nmax])
-            { }
-
-            /// Virtual destructor.
-            virtual ~TaskEventList() = default;
-
-            /// Get a new event from this list.
-
-            /// \warning This function can only be called \c nmax times. It is
-            /// the caller's resonsibility to ensure that it is not called too
-            /// many times.
-            /// \return The new event from the list.
-            TaskEvent* event() {
-                return events_.get() + (n_++);
-            }
-
-        private:
-
-            /// Print events recorded in this list.
-
-            /// \param[in,out] os The output stream.
-            /// \return The modified output stream.
-            virtual std::ostream& print_events(std::ostream& os) const {
-                const int thread_id = ThreadBase::this_thread()->get_pool_thread_index();
-                for(std::size_t i = 0; i < n_; ++i)
-                    os << thread_id << "\t" << events_[i] << std::endl;
-                return os;
-            }
-
-        }; // class TaskEventList
-
         /// This class collects and prints task profiling data.
 
+        /// Events are kept in ring buffers of fixed size (set by the
+        /// environment variable `MAD_TASKPROFILER_NEVENT`, default 65536), so
+        /// a long run keeps only its most recent events and the memory and
+        /// time overhead stay bounded. Tasks have one buffer and RMI and fence
+        /// events another, so that frequent messages cannot push out the task
+        /// events; the latter buffer is only used for JSON output. Buffers are
+        /// allocated on first use.
+        ///
+        /// The output format is chosen by `MAD_TASKPROFILER_FORMAT`: the
+        /// default tab-separated text with one task per line, or `json`, which
+        /// writes tasks, RMI sends and receives, and fences in the Chrome
+        /// trace event format (viewable with chrome://tracing or Perfetto).
+        /// The per-rank JSON files are combined with `bin/taskprofile_merge.py`.
+        ///
         /// \note Each thread has its own \c TaskProfiler object, so only one
         /// thread will ever operate on this object at a time and all operations
         /// are inheirently thread safe.
         class TaskProfiler {
         private:
-            TaskEventListBase* head_; ///< The head of the linked list of data.
-            TaskEventListBase* tail_; ///< The tail of the linked list of data.
+            /// A ring buffer of the events of one category.
+            class EventRing {
+            private:
+                std::unique_ptr<TaskEvent[]> events_; ///< The events.
+                std::size_t n_; ///< The number of events recorded since the last write.
+
+            public:
+                EventRing() : events_(), n_(0ul) { }
+
+                /// Get the slot for a new event.
+
+                /// Once the buffer is full the oldest event is overwritten, so an
+                /// event is only written to its slot once it is complete.
+                /// \return The new event.
+                TaskEvent* event() {
+                    if(! events_)
+                        events_.reset(new TaskEvent[nevent_]);
+                    return events_.get() + (n_++ % nevent_);
+                }
+
+                /// The number of events recorded since the last write.
+                std::size_t size() const { return n_; }
+
+                /// Pass the kept events to \c op, oldest first, and forget them.
+
+                /// \param[in] op Called with each event.
+                /// \return The number of events that were overwritten.
+                template <typename opT>
+                std::size_t drain(opT&& op) {
+                    const std::size_t n = n_;
+                    n_ = 0;
+                    // The buffer holds the last nevent_ events, oldest first from first
+                    const std::size_t nkept = std::min(n, nevent_);
+                    const std::size_t first = (n > nevent_ ? n % nevent_ : 0);
+                    for(std::size_t i = 0; i < nkept; ++i)
+                        op(events_[(first + i) % nevent_]);
+                    return n - nkept;
+                }
+            }; // class EventRing
+
+            EventRing tasks_; ///< The task events.
+            EventRing others_; ///< The RMI and fence events.
+            int tid_; ///< The thread id used in the JSON trace.
 
             static Mutex output_mutex_; ///< Mutex used to lock the output file.
+            static thread_local TaskProfiler* current_; ///< The profiler of this thread.
 
             TaskProfiler(const TaskProfiler&) = delete;
             TaskProfiler& operator=(const TaskProfiler&) = delete;
@@ -810,43 +959,72 @@ namespace madness {
             /// `MAD_TASKPROFILER_NAME`.
             static const char* output_file_name_;
 
+            /// True if the output is a JSON trace (`MAD_TASKPROFILER_FORMAT=json`).
+            static bool json_;
+
+            /// The capacity of each ring buffer (`MAD_TASKPROFILER_NEVENT`).
+            static std::size_t nevent_;
+
+            /// The time of day, in microseconds, at which \c wall_time() is zero.
+
+            /// Written to the trace so that ranks can be aligned when merged.
+            static double epoch_;
+
         public:
             /// Default constructor.
             TaskProfiler()
-                : head_(nullptr), tail_(nullptr)
+                : tasks_(), others_(), tid_(0)
             { }
 
-            /// Destructor.
-            ~TaskProfiler() {
-                // Cleanup linked list
-                TaskEventListBase* next = nullptr;
-                while(head_ != nullptr) {
-                    next = head_->next();
-                    delete head_;
-                    head_ = next;
-                }
-            }
+            /// Make this the profiler of the calling thread.
 
-            /// Create a new task event list.
+            /// Non-task events (RMI and fences) are recorded by the profiler of
+            /// the thread they happen in.
+            /// \param[in] tid The thread id used in the JSON trace.
+            void make_current(const int tid) {
+                tid_ = tid;
+                current_ = this;
+            }
 
-            /// \param[in] nmax The maximum number of elements that the list
-            ///     can contain.
-            /// \return A new task event list.
-            TaskEventList* new_list(const std::size_t nmax) {
-                // Create a new event list
-                TaskEventList* list = new TaskEventList(nmax);
+            /// Record a non-task event with the profiler of the calling thread.
+
+            /// Does nothing if the thread has no profiler or the output is not
+            /// JSON, since the text output lists only tasks.
+            /// \param[in] kind The kind of event.
+            /// \param[in] id Identifies the RMI handler (or is null).
+            /// \param[in] peer The remote process of an RMI event.
+            /// \param[in] nbyte The size of an RMI message.
+            /// \param[in] start_time The time the event started.
+            /// \param[in] stop_time The time the event finished.
+            static void record(const EventKind kind, const std::pair<void*, unsigned short>& id,
+                    const int peer, const std::size_t nbyte,
+                    const double start_time, const double stop_time)
+            {
+                if(current_ && output_file_name_ && json_)
+                    current_->others_.event()->record(kind, id, peer, nbyte, start_time, stop_time);
+            }
 
-                // Append the list to the tail of the linked list
-                if(head_ != nullptr) {
-                    tail_->insert(list);
-                    tail_ = list;
-                } else {
-                    head_ = list;
-                    tail_ = list;
-                }
-                return list;
+            /// Record a finished task with the profiler of the calling thread.
+
+            /// Does nothing if the thread has no profiler or there is no output.
+            /// \param[in] id The task identifier.
+            /// \param[in] threads The number of threads the task used.
+            /// \param[in] submit_time The time the task was submitted.
+            /// \param[in] start_time The time the task started.
+            /// \param[in] stop_time The time the task finished.
+            static void record_task(const std::pair<void*, unsigned short>& id,
+                    const unsigned short threads, const double submit_time,
+                    const double start_time, const double stop_time)
+            {
+                if(current_ && output_file_name_)
+                    current_->tasks_.event()->task(id, threads, submit_time, start_time, stop_time);
             }
 
+            /// Read the profiler settings from the environment and truncate the output.
+
+            /// Called by \c ThreadPool::begin.
+            static void begin();
+
             /// Write the profile data to file.
 
             /// The data is cleared after it is written to the file, so this
@@ -876,17 +1054,9 @@ namespace madness {
     private:
 
 #ifdef MADNESS_TASK_PROFILING
-    	profiling::TaskEvent* task_event_; ///< \todo Description needed.
-    	double submit_time_; ///< \todo Description needed.
-        std::pair<void*, unsigned short> id_; ///< \todo Description needed.
-
-        /// \todo Brief description needed.
-
-        /// \todo Descriptions needed.
-        /// \param[in,out] task_event Description needed.
-        void set_event(profiling::TaskEvent* task_event) {
-            task_event_ = task_event;
-        }
+    	double submit_time_; ///< Time the task was submitted to the pool.
+    	double start_time_; ///< Time the task started running.
+        std::pair<void*, unsigned short> id_; ///< Identifies the task function.
 
         /// Collect info on the task and record the submit time.
         void submit() {
@@ -966,11 +1136,12 @@ namespace madness {
             int nthread = get_nthread();
             if (nthread == 1) {
 #ifdef MADNESS_TASK_PROFILING
-                task_event_->start(id_, nthread, submit_time_);
+                start_time_ = wall_time();
 #endif // MADNESS_TASK_PROFILING
                 run(TaskThreadEnv(1,0,0));
 #ifdef MADNESS_TASK_PROFILING
-                task_event_->stop();
+                profiling::TaskProfiler::record_task(id_, nthread, submit_time_,
+                        start_time_, wall_time());
 #endif // MADNESS_TASK_PROFILING
                 return true;
             }
@@ -981,14 +1152,16 @@ namespace madness {
 
 #ifdef MADNESS_TASK_PROFILING
                 if(id == 0)
-                    task_event_->start(id_, nthread, submit_time_);
+                    start_time_ = wall_time();
 #endif // MADNESS_TASK_PROFILING
 
                 run(TaskThreadEnv(nthread, id, barrier));
 
 #ifdef MADNESS_TASK_PROFILING
                 const bool cleanup = barrier->enter(id);
-                if(cleanup) task_event_->stop();
+                if(cleanup)
+                    profiling::TaskProfiler::record_task(id_, nthread, submit_time_,
+                            start_time_, wall_time());
                 return cleanup;
 #else
                 return barrier->enter(id);
@@ -1112,6 +1285,22 @@ namespace madness {
 
         virtual void run(const TaskThreadEnv& info) = 0;
 
+        /// Tasks are allocated from the thread-local pools of \c PoolAllocator
+        static void* operator new(std::size_t size) {
+            return PoolAllocator::allocate(size);
+        }
+
+        /// Placement new is still available for tasks constructed in place
+        static void* operator new(std::size_t, void* p) noexcept { return p; }
+
+        /// Returns the task's block to the pools (\c size is that of the most derived type)
+        static void operator delete(void* p, std::size_t size) {
+            PoolAllocator::deallocate(p, size);
+        }
+
+        /// Matches the placement new
+        static void operator delete(void*, void*) noexcept { }
+
         };
 
     /// A no-operation task used for various purposes.
@@ -1143,11 +1332,26 @@ namespace madness {
 #ifdef MADNESS_TASK_PROFILING
         profiling::TaskProfiler profiler_; ///< \todo Description needed.
 #endif // MADNESS_TASK_PROFILING
+        int numa_domain_; ///< NUMA domain this thread runs in (set when it starts).
 
     public:
-        ThreadPoolThread() : Thread() { }
+        ThreadPoolThread() : Thread(), numa_domain_(0) { }
         virtual ~ThreadPoolThread() = default;
 
+        /// NUMA domain of this thread.
+
+        /// \return The NUMA domain recorded when the thread started.
+        int get_numa_domain() const {
+            return numa_domain_;
+        }
+
+        /// Record the NUMA domain of this thread.
+
+        /// \param[in] domain The NUMA domain.
+        void set_numa_domain(int domain) {
+            numa_domain_ = domain;
+        }
+
 #ifdef MADNESS_TASK_PROFILING
         /// Task profiler accessor.
 
@@ -1159,6 +1363,21 @@ namespace madness {
 #endif // MADNESS_TASK_PROFILING
     };
 
+    /// Scheduling policy of the Pthreads \c ThreadPool.
+
+    /// - \c TaskScheduler::SharedQueue : every task goes through a single
+    ///   shared \c DQueue (the default).
+    /// - \c TaskScheduler::WorkStealing : tasks submitted by a pool thread go
+    ///   to that thread's own \c WorkStealingDeque and idle threads steal from
+    ///   the others. Tasks submitted by other threads (main thread, RMI server),
+    ///   high-priority tasks and multi-threaded tasks still go through the
+    ///   shared queue, which is also where idle threads wait for work.
+    ///
+    /// The default can be selected with the environment variable
+    /// `MAD_TASK_SCHEDULER` (`queue` or `steal`) or changed at runtime with
+    /// \c ThreadPool::set_scheduler().
+    enum class TaskScheduler { SharedQueue, WorkStealing };
+
     /// A singleton pool of threads for dynamic execution of tasks.
 
     /// \attention You must instantiate the pool while running with just one
@@ -1183,9 +1402,17 @@ namespace madness {
         ThreadPoolThread *threads; ///< Array of threads.
         ThreadPoolThread main_thread; ///< Placeholder for main thread tls.
         DQueue<PoolTaskInterface*> queue; ///< Queue of tasks.
+        WorkStealingDeque<PoolTaskInterface*>* local_queues; ///< Per-thread deques used by the work-stealing scheduler.
+        WorkStealingDeque<PoolTaskInterface*>* domain_queues; ///< Per-NUMA-domain queues, null unless `MAD_TASK_NUMA=on`.
+        WorkStealingDeque<PoolTaskInterface*> priority_queues[TaskAttributes::NPRIORITY]; ///< Queues of prioritized tasks (index 0 unused).
+        std::atomic<bool> priority_used; ///< Set once a task with an intermediate priority level was added.
+        int ndomain; ///< Number of entries in \c domain_queues.
         int nthreads; ///< Number of threads.
         volatile bool finish; ///< Set to true when time to stop.
         AtomicInt nfinished; ///< Thread pool exit counter.
+        std::atomic<TaskScheduler> scheduler; ///< Current scheduling policy.
+        AtomicInt nidle; ///< Number of threads sleeping on \c queue (work-stealing only).
+        std::atomic<bool> wake_pending; ///< Set while a wake-up token is in \c queue (work-stealing only).
 
         // Static data
         static ThreadPool* instance_ptr; ///< Singleton pointer.
@@ -1201,6 +1428,73 @@ namespace madness {
         /// \param[in] nthread Description needed.
         ThreadPool(int nthread=-1);
 
+        /// Get the deque of the calling thread, or null if it is not a pool thread.
+
+        /// \return The deque owned by the calling thread.
+        WorkStealingDeque<PoolTaskInterface*>* local_queue() const {
+            const ThreadBase* const thread = ThreadBase::this_thread();
+            const int id = (thread ? thread->get_pool_thread_index() : -1);
+            return (id >= 0 ? local_queues + id : nullptr);
+        }
+
+        /// True if tasks only ever go through the shared queue.
+
+        /// This is the case with the shared queue scheduler, no NUMA-aware
+        /// placement and no task of an intermediate priority level so far;
+        /// the threads then pop straight from \c queue as they always did.
+        bool shared_queue_only() const {
+            return !domain_queues && !priority_used.load(std::memory_order_relaxed) &&
+                    scheduler.load(std::memory_order_relaxed) == TaskScheduler::SharedQueue;
+        }
+
+        /// Start using the priority queues.
+
+        /// Threads sleeping in the shared queue do not look at the priority
+        /// queues, so wake them all up.
+        void enable_priority_queues() {
+            if (! priority_used.exchange(true)) {
+                wake_pending = false;
+                for (int i=0; i<nthreads; ++i)
+                    queue.push_back_unbuffered(nullptr);
+            }
+        }
+
+        /// Wake one sleeping thread, if any, after work was added to a local deque.
+        void wake_idle_thread() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if ((nidle > 0) && !wake_pending.exchange(true))
+                queue.push_back_unbuffered(nullptr); // Null task is the wake-up token
+        }
+
+        /// Get the next batch of tasks.
+
+        /// Looks in order at the priority queues (highest first), the calling
+        /// thread's own deque, the queue of its NUMA domain, the shared queue,
+        /// the deques of the other threads and the queues of the other NUMA
+        /// domains. Not used while \c shared_queue_only() is true.
+        /// \param[out] taskbuf Array of at least \c nmax task pointers.
+        /// \param[in] wait If true sleep on the shared queue until work arrives.
+        /// \return The number of tasks in \c taskbuf (entries may be null).
+        int pop_tasks(PoolTaskInterface** taskbuf, bool wait);
+
+        /// Run a task and delete it once all its threads are done.
+
+        /// Times the task if the runtime profiler is enabled.
+        /// \param[in] task The task.
+        static void run_one(PoolTaskInterface* task) {
+#if !HAVE_INTEL_TBB
+            if (RuntimeProfiler::enabled()) {
+                std::pair<void*,unsigned short> id;
+                task->get_id(id);
+                RuntimeProfileSample sample(RuntimeProfileKind::task, id);
+                if (task->run_multi_threaded()) delete task;
+            }
+            else if (task->run_multi_threaded()) {
+                delete task;
+            }
+#endif
+        }
+
        /// Run the next task.
 
         /// \todo Verify and complete this documentation.
@@ -1214,18 +1508,8 @@ namespace madness {
 
             if (!wait && queue.empty()) return false;
             std::pair<PoolTaskInterface*,bool> t = queue.pop_front(wait);
-#ifdef MADNESS_TASK_PROFILING
-            profiling::TaskEventList* event_list =
-                    this_thread->profiler().new_list(1);
-#endif // MADNESS_TASK_PROFILING
             // Task pointer might be zero due to stealing
-            if (t.second && t.first) {
-#ifdef MADNESS_TASK_PROFILING
-                t.first->set_event(event_list->event());
-#endif // MADNESS_TASK_PROFILING
-                if (t.first->run_multi_threaded())         // What we are here to do
-                    delete t.first;
-            }
+            if (t.second && t.first) run_one(t.first);     // What we are here to do
             return t.second;
 #endif
         }
@@ -1252,19 +1536,12 @@ namespace madness {
 #else
 
             PoolTaskInterface* taskbuf[nmax];
-            int ntask = queue.pop_front(nmax, taskbuf, wait);
-#ifdef MADNESS_TASK_PROFILING
-            profiling::TaskEventList* event_list =
-                    this_thread->profiler().new_list(ntask);
-#endif // MADNESS_TASK_PROFILING
+            int ntask = shared_queue_only() ?
+                    queue.pop_front(nmax, taskbuf, wait) :
+                    pop_tasks(taskbuf, wait);
             for (int i=0; i<ntask; ++i) {
                 if (taskbuf[i]) { // Task pointer might be zero due to stealing
-#ifdef MADNESS_TASK_PROFILING
-                    taskbuf[i]->set_event(event_list->event());
-#endif // MADNESS_TASK_PROFILING
-                    if (taskbuf[i]->run_multi_threaded()) {
-                        delete taskbuf[i];
-                    }
+                    run_one(taskbuf[i]);
                 }
             }
 #if HAVE_PARSEC
@@ -1360,13 +1637,40 @@ namespace madness {
 #else
             if (!task) MADNESS_EXCEPTION("ThreadPool: inserting a NULL task pointer", 1);
             int task_threads = task->get_nthread();
+            ThreadPool* const pool = instance();
+            // Intermediate levels have their own queues; the top level goes
+            // there too once those are in use and otherwise, as it always
+            // did, to the front of the shared queue
+            const int priority = task->get_priority();
+            if ((priority > 0) && (task_threads == 1) &&
+                    (priority < TaskAttributes::NPRIORITY-1 || pool->priority_used.load(std::memory_order_relaxed))) {
+                if (priority < TaskAttributes::NPRIORITY-1) pool->enable_priority_queues();
+                pool->priority_queues[priority].push_back(task);
+                pool->wake_idle_thread();
+                return;
+            }
+            const int domain = task->get_numa_domain();
+            if (pool->domain_queues && (domain >= 0) && (task_threads == 1) && !task->is_high_priority()) {
+                pool->domain_queues[domain % pool->ndomain].push_back(task);
+                pool->wake_idle_thread();
+                return;
+            }
+            if ((pool->scheduler.load(std::memory_order_relaxed) == TaskScheduler::WorkStealing) &&
+                    (task_threads == 1) && !task->is_high_priority()) {
+                WorkStealingDeque<PoolTaskInterface*>* const local = pool->local_queue();
+                if (local) {
+                    local->push_back(task);
+                    pool->wake_idle_thread();
+                    return;
+                }
+            }
             // Currently multithreaded tasks must be shoved on the end of the q
             // to avoid a race condition as multithreaded task is starting up
             if (task->is_high_priority() && (task_threads == 1)) {
-                instance()->queue.push_front(task);
+                pool->queue.push_front(task);
             }
             else {
-                instance()->queue.push_back(task, task_threads);
+                pool->queue.push_back(task, task_threads);
             }
 #endif // HAVE_INTEL_TBB
         }
@@ -1424,9 +1728,47 @@ namespace madness {
 
         /// \return The number of tasks in the queue.
         static std::size_t queue_size() {
-            return instance()->queue.size();
+            const ThreadPool* const pool = instance();
+            std::size_t n = pool->queue.size();
+            if (pool->local_queues) {
+                for (int i=0; i<pool->nthreads; ++i)
+                    n += pool->local_queues[i].size();
+            }
+            if (pool->domain_queues) {
+                for (int i=0; i<pool->ndomain; ++i)
+                    n += pool->domain_queues[i].size();
+            }
+            for (int i=1; i<TaskAttributes::NPRIORITY; ++i)
+                n += pool->priority_queues[i].size();
+            return n;
+        }
+
+        /// Returns the current scheduling policy.
+
+        /// \return The scheduling policy.
+        static TaskScheduler get_scheduler() {
+            return instance()->scheduler;
         }
 
+        /// Change the scheduling policy.
+
+        /// Tasks left in the per-thread deques are moved to the shared queue
+        /// when switching to \c TaskScheduler::SharedQueue. Only call this
+        /// from the main thread while the pool is quiescent (e.g. after a
+        /// fence); it has no effect with the TBB or PaRSEC backends.
+        /// \param[in] policy The new scheduling policy.
+        static void set_scheduler(TaskScheduler policy);
+
+        /// Get NUMA-aware task placement from the environment.
+
+        /// \return True if `MAD_TASK_NUMA` is `on`.
+        static bool default_numa_aware();
+
+        /// Get the scheduling policy from the environment.
+
+        /// \return The scheduling policy given by `MAD_TASK_SCHEDULER`.
+        static TaskScheduler default_scheduler();
+
         /// Returns queue statistics.
 
         /// \return Queue statistics.
@@ -1513,6 +1855,8 @@ namespace madness {
 #elif HAVE_INTEL_TBB
 #else
             delete[] threads;
+            delete[] local_queues;
+            delete[] domain_queues;
 #endif
         }
 
@@ -475,6 +475,11 @@ namespace madness {
     class BaseOutputArchive;
     class BinaryFstreamOutputArchive;
     class BinaryFstreamInputArchive;
+    class MmapInputArchive;
+    class AsyncFstreamOutputArchive;
+    class SharedFileOutputArchive;
+    class SharedFileInputArchive;
+    class SharedFileBlockOutputArchive;
     class BufferOutputArchive;
     class BufferInputArchive;
     class VectorOutputArchive;
@@ -549,6 +554,16 @@ namespace madness {
     template <typename T>
     struct is_default_serializable_helper<archive::BinaryFstreamInputArchive, T, std::enable_if_t<is_trivially_serializable<T>::value>> : std::true_type {};
     template <typename T>
+    struct is_default_serializable_helper<archive::MmapInputArchive, T, std::enable_if_t<is_trivially_serializable<T>::value>> : std::true_type {};
+    template <typename T>
+    struct is_default_serializable_helper<archive::AsyncFstreamOutputArchive, T, std::enable_if_t<is_trivially_serializable<T>::value>> : std::true_type {};
+    template <typename T>
+    struct is_default_serializable_helper<archive::SharedFileOutputArchive, T, std::enable_if_t<is_trivially_serializable<T>::value>> : std::true_type {};
+    template <typename T>
+    struct is_default_serializable_helper<archive::SharedFileInputArchive, T, std::enable_if_t<is_trivially_serializable<T>::value>> : std::true_type {};
+    template <typename T>
+    struct is_default_serializable_helper<archive::SharedFileBlockOutputArchive, T, std::enable_if_t<is_trivially_serializable<T>::value>> : std::true_type {};
+    template <typename T>
     struct is_default_serializable_helper<archive::BufferOutputArchive, T, std::enable_if_t<is_trivially_serializable<T>::value>> : std::true_type {};
     template <typename T>
     struct is_default_serializable_helper<archive::BufferInputArchive, T, std::enable_if_t<is_trivially_serializable<T>::value>> : std::true_type {};
@@ -586,6 +601,16 @@ namespace madness {
     template <>
     struct is_archive<archive::BinaryFstreamInputArchive> : std::true_type {};
     template <>
+    struct is_archive<archive::MmapInputArchive> : std::true_type {};
+    template <>
+    struct is_archive<archive::AsyncFstreamOutputArchive> : std::true_type {};
+    template <>
+    struct is_archive<archive::SharedFileOutputArchive> : std::true_type {};
+    template <>
+    struct is_archive<archive::SharedFileInputArchive> : std::true_type {};
+    template <>
+    struct is_archive<archive::SharedFileBlockOutputArchive> : std::true_type {};
+    template <>
     struct is_archive<archive::BufferOutputArchive> : std::true_type {};
     template <>
     struct is_archive<archive::BufferInputArchive> : std::true_type {};
@@ -617,6 +642,12 @@ namespace madness {
     template <>
     struct is_output_archive<archive::BinaryFstreamOutputArchive> : std::true_type {};
     template <>
+    struct is_output_archive<archive::AsyncFstreamOutputArchive> : std::true_type {};
+    template <>
+    struct is_output_archive<archive::SharedFileOutputArchive> : std::true_type {};
+    template <>
+    struct is_output_archive<archive::SharedFileBlockOutputArchive> : std::true_type {};
+    template <>
     struct is_output_archive<archive::BufferOutputArchive> : std::true_type {};
     template <>
     struct is_output_archive<archive::VectorOutputArchive> : std::true_type {};
@@ -634,6 +665,10 @@ namespace madness {
     template <>
     struct is_input_archive<archive::BinaryFstreamInputArchive> : std::true_type {};
     template <>
+    struct is_input_archive<archive::MmapInputArchive> : std::true_type {};
+    template <>
+    struct is_input_archive<archive::SharedFileInputArchive> : std::true_type {};
+    template <>
     struct is_input_archive<archive::BufferInputArchive> : std::true_type {};
     template <>
     struct is_input_archive<archive::VectorInputArchive> : std::true_type {};
@@ -648,6 +683,22 @@ namespace madness {
     template <class localarchiveT>
     struct is_input_archive<archive::ParallelInputArchive<localarchiveT> > : std::true_type {};
 
+    /// Checks if \c T is an output archive writing (eventually) to a binary file.
+
+    /// Data stored only in files may be encoded differently from data sent
+    /// between processes, e.g. tensors may be compressed.
+    /// \tparam T The type to check.
+    template <typename T>
+    struct is_file_output_archive : std::false_type {};
+    template <>
+    struct is_file_output_archive<archive::BinaryFstreamOutputArchive> : std::true_type {};
+    template <>
+    struct is_file_output_archive<archive::AsyncFstreamOutputArchive> : std::true_type {};
+    template <>
+    struct is_file_output_archive<archive::SharedFileOutputArchive> : std::true_type {};
+    template <>
+    struct is_file_output_archive<archive::SharedFileBlockOutputArchive> : std::true_type {};
+
     /// Evaluates to true if can serialize an object of type `T` to an object of type `Archive` using user-provided methods
     /// \tparam Archive
     /// \tparam T
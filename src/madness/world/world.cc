@@ -41,6 +41,8 @@
 #include <madness/world/worldam.h>
 #include <madness/world/world_task_queue.h>
 #include <madness/world/worldgop.h>
+#include <madness/world/runtime_profiler.h>
+#include <madness/world/memory_accounting.h>
 #include <cstdlib>
 #include <sstream>
 
@@ -213,6 +215,8 @@ namespace madness {
             // this is needed to avoid hangs with some MPIs, e.g. Intel MPI on commodity hardware
             comm.Barrier();
         }
+        RuntimeProfiler::begin();          // Enabled by MAD_RUNTIME_PROFILE
+        MemoryAccounting::begin(comm.Get_rank()); // Timeline enabled by MAD_MEMORY_TIMELINE
 
 #ifdef HAVE_PAPI
         begin_papi_measurement();
@@ -234,6 +238,11 @@ namespace madness {
 
     void finalize() {
         World::default_world->gop.fence();
+        if (RuntimeProfiler::used()) {
+            RuntimeProfiler::disable();
+            RuntimeProfiler::print(*World::default_world);
+        }
+        MemoryAccounting::end(*World::default_world);
         const auto rank = World::default_world->rank();
         const auto world_size = World::default_world->size();
 
@@ -279,33 +288,59 @@ namespace madness {
         double nbyte_sent = rmi.nbyte_sent;
         double nbyte_recv = rmi.nbyte_recv;
         double server_q = rmi.max_serv_send_q;
+        double nrecv_buf = rmi.max_nrecv_posted;
+        double recv_in_use = rmi.max_recv_in_use;
+        double nbatch_sent = rmi.nbatch_sent;
+        double nmsg_batched = rmi.nmsg_batched;
         world.gop.sum(nmsg_sent);
         world.gop.sum(nmsg_recv);
         world.gop.sum(nbyte_sent);
         world.gop.sum(nbyte_recv);
         world.gop.sum(server_q);
+        world.gop.sum(nrecv_buf);
+        world.gop.sum(recv_in_use);
+        world.gop.sum(nbatch_sent);
+        world.gop.sum(nmsg_batched);
 
         double max_nmsg_sent = rmi.nmsg_sent;
         double max_nmsg_recv = rmi.nmsg_recv;
         double max_nbyte_sent = rmi.nbyte_sent;
         double max_nbyte_recv = rmi.nbyte_recv;
         double max_server_q = rmi.max_serv_send_q;
+        double max_nrecv_buf = rmi.max_nrecv_posted;
+        double max_recv_in_use = rmi.max_recv_in_use;
+        double max_nbatch_sent = rmi.nbatch_sent;
+        double max_msg_per_batch = rmi.nbatch_sent ? double(rmi.nmsg_batched)/rmi.nbatch_sent : 0.0;
+        double max_batch_len = rmi.max_msg_per_batch;
         world.gop.max(max_nmsg_sent);
         world.gop.max(max_nmsg_recv);
         world.gop.max(max_nbyte_sent);
         world.gop.max(max_nbyte_recv);
         world.gop.max(max_server_q);
+        world.gop.max(max_nrecv_buf);
+        world.gop.max(max_recv_in_use);
+        world.gop.max(max_nbatch_sent);
+        world.gop.max(max_msg_per_batch);
+        world.gop.max(max_batch_len);
 
         double min_nmsg_sent = rmi.nmsg_sent;
         double min_nmsg_recv = rmi.nmsg_recv;
         double min_nbyte_sent = rmi.nbyte_sent;
         double min_nbyte_recv = rmi.nbyte_recv;
         double min_server_q = rmi.max_serv_send_q;
+        double min_nrecv_buf = rmi.max_nrecv_posted;
+        double min_recv_in_use = rmi.max_recv_in_use;
+        double min_nbatch_sent = rmi.nbatch_sent;
+        double min_msg_per_batch = rmi.nbatch_sent ? double(rmi.nmsg_batched)/rmi.nbatch_sent : 0.0;
         world.gop.min(min_nmsg_sent);
         world.gop.min(min_nmsg_recv);
         world.gop.min(min_nbyte_sent);
         world.gop.min(min_nbyte_recv);
         world.gop.min(min_server_q);
+        world.gop.min(min_nrecv_buf);
+        world.gop.min(min_recv_in_use);
+        world.gop.min(min_nbatch_sent);
+        world.gop.min(min_msg_per_batch);
 
         double npush_back = q.npush_back;
         double npush_front = q.npush_front;
@@ -369,6 +404,10 @@ namespace madness {
             printf("  ----------------------\n");
             printf("   #messages in server q    %.2e / %.2e / %.2e\n",
                    min_server_q, server_q/world.size(), max_server_q);
+            printf("    #max recv buf posted    %.2e / %.2e / %.2e\n",
+                   min_nrecv_buf, nrecv_buf/world.size(), max_nrecv_buf);
+            printf("    #max recv buf in use    %.2e / %.2e / %.2e\n",
+                   min_recv_in_use, recv_in_use/world.size(), max_recv_in_use);
             printf(" #messages sent per node    %.2e / %.2e / %.2e\n",
                    min_nmsg_sent, nmsg_sent/world.size(), max_nmsg_sent);
             printf("    #bytes sent per node    %.2e / %.2e / %.2e\n",
@@ -377,6 +416,11 @@ namespace madness {
                    min_nmsg_recv, nmsg_recv/world.size(), max_nmsg_recv);
             printf("    #bytes recv per node    %.2e / %.2e / %.2e\n",
                    min_nbyte_recv, nbyte_recv/world.size(), max_nbyte_recv);
+            printf("  #batches sent per node    %.2e / %.2e / %.2e\n",
+                   min_nbatch_sent, nbatch_sent/world.size(), max_nbatch_sent);
+            printf("         #msgs per batch    %.2e / %.2e / %.2e\n",
+                   min_msg_per_batch, (nbatch_sent ? nmsg_batched/nbatch_sent : 0.0), max_msg_per_batch);
+            printf("    #max msgs in a batch    %.2e\n", max_batch_len);
             printf("        #msgs systemwide    %.2e\n", nmsg_sent);
             printf("       #bytes systemwide    %.2e\n", nbyte_sent);
             printf("\n");
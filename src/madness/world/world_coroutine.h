@@ -0,0 +1,293 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+/**
+ \file world_coroutine.h
+ \brief Coroutine tasks that suspend on futures instead of blocking a thread.
+ \ingroup taskq
+
+ A function returning \c CoTask<T> is a C++20 coroutine that may
+ \c co_await any \c Future. Submitted with \c WorldTaskQueue::add(CoTask<T>&&)
+ it runs on the thread pool; when it awaits a future that is not yet
+ assigned it gives up its thread and is resumed on the pool once the future
+ is set, so a recursive traversal can wait on remote data without holding a
+ thread or splitting into a chain of tasks.
+ \code
+ CoTask<double> sum_tree(World& world, const dcT& c, const keyT& key) {
+     auto it = co_await c.find(key);             // may be remote
+     double sum = it->second.value();
+     for (const keyT& child : children(key))
+         sum += co_await world.taskq.add(sum_tree(world, c, child));
+     co_return sum;
+ }
+
+ Future<double> total = world.taskq.add(sum_tree(world, c, root));
+ \endcode
+
+ A coroutine counts as one pending task from submission until it returns,
+ so \c fence() waits for it. An exception that escapes a coroutine ends it
+ (its result is never assigned) and is rethrown by the task that was
+ running it, as for any other task. Each suspension costs one small pooled resume
+ record, rather than a \c TaskFn with its futures and dependency counting.
+
+ Only available when compiled as C++20 (or later) with coroutine support,
+ in which case \c MADNESS_HAS_COROUTINES is defined.
+*/
+
+#ifndef MADNESS_WORLD_WORLD_COROUTINE_H__INCLUDED
+#define MADNESS_WORLD_WORLD_COROUTINE_H__INCLUDED
+
+#include <madness/world/world_task_queue.h>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#define MADNESS_HAS_COROUTINES 1
+
+/// \addtogroup taskq
+/// @{
+
+namespace madness {
+
+    namespace detail {
+
+        /// Exception that ended the coroutine last finished by this thread
+        inline thread_local std::exception_ptr coroutine_exception;
+
+        /// Resumes a suspended coroutine on a pool thread
+
+        /// An exception that escapes the coroutine is rethrown once its frame
+        /// is gone, so it is handled as for any other pool task.
+        class CoroutineResume : public PoolTaskInterface {
+            std::coroutine_handle<> h_;
+
+        public:
+            CoroutineResume(std::coroutine_handle<> h, const TaskAttributes& attr)
+                : PoolTaskInterface(attr), h_(h)
+            { }
+
+            void run(const TaskThreadEnv&) override {
+                h_.resume();
+                if (coroutine_exception)
+                    std::rethrow_exception(std::exchange(coroutine_exception, nullptr));
+            }
+        }; // class CoroutineResume
+
+        /// Awaits a future, suspending the coroutine until it is assigned
+        template <typename T>
+        class FutureAwaiter {
+            Future<T> f_;
+            CallbackInterface* resume_;
+
+        public:
+            FutureAwaiter(const Future<T>& f, CallbackInterface* resume)
+                : f_(f), resume_(resume)
+            { }
+
+            bool await_ready() const { return f_.probe(); }
+
+            // The callback may resume and destroy the coroutine (and with it
+            // f_) on another thread while the future is still locked, so
+            // register through a copy that keeps the future alive until
+            // it is unlocked
+            void await_suspend(std::coroutine_handle<>) {
+                Future<T> f = f_;
+                f.register_callback(resume_);
+            }
+
+            T await_resume() { return f_.get(); }
+        }; // class FutureAwaiter
+
+        template <>
+        class FutureAwaiter<void> {
+        public:
+            FutureAwaiter(const Future<void>&, CallbackInterface*) { }
+            bool await_ready() const { return true; }
+            void await_suspend(std::coroutine_handle<>) { }
+            void await_resume() { }
+        }; // class FutureAwaiter<void>
+
+        /// Part of the promise of \c CoTask that does not depend on its result type
+        class CoroutinePromiseBase : public CallbackInterface {
+            friend class madness::WorldTaskQueue;
+
+            WorldTaskQueue* taskq_ = nullptr; ///< Queue the coroutine is registered with
+            TaskAttributes attr_;             ///< Attributes of the resume tasks
+            std::coroutine_handle<> self_;    ///< This coroutine
+            std::exception_ptr exception_;    ///< Exception that ended the coroutine, if any
+
+            /// Destroys the finished coroutine and retires it from its queue
+            struct FinalAwaiter {
+                bool await_ready() const noexcept { return false; }
+
+                template <typename promiseT>
+                void await_suspend(std::coroutine_handle<promiseT> h) const noexcept {
+                    WorldTaskQueue* taskq = h.promise().taskq_;
+                    std::exception_ptr exception = std::move(h.promise().exception_);
+                    h.destroy();
+                    if (taskq) detail::CoroutinePromiseBase::retire(*taskq);
+                    coroutine_exception = std::move(exception);
+                }
+
+                void await_resume() const noexcept { }
+            };
+
+            static void retire(WorldTaskQueue& taskq);
+
+        public:
+            /// Frames come from the same pools as tasks
+            static void* operator new(std::size_t size) { return PoolAllocator::allocate(size); }
+
+            static void operator delete(void* p, std::size_t size) { PoolAllocator::deallocate(p, size); }
+
+            /// Called when an awaited future is assigned
+            void notify() override { ThreadPool::add(new CoroutineResume(self_, attr_)); }
+
+            /// Nothing runs until the coroutine is submitted to a queue
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+
+            FinalAwaiter final_suspend() const noexcept { return {}; }
+
+            /// Kept until the frame is destroyed, then rethrown by the resume task
+            void unhandled_exception() { exception_ = std::current_exception(); }
+
+            template <typename T>
+            FutureAwaiter<T> await_transform(const Future<T>& f) {
+                return FutureAwaiter<T>(f, this);
+            }
+        }; // class CoroutinePromiseBase
+
+        /// Promise of a \c CoTask<T>
+        template <typename T>
+        class CoroutinePromise : public CoroutinePromiseBase {
+            Future<T> result_;
+
+        public:
+            CoTask<T> get_return_object();
+
+            Future<T> result() const { return result_; }
+
+            template <typename U>
+            void return_value(U&& value) { result_.set(std::forward<U>(value)); }
+        }; // class CoroutinePromise
+
+        template <>
+        class CoroutinePromise<void> : public CoroutinePromiseBase {
+        public:
+            CoTask<void> get_return_object();
+
+            Future<void> result() const { return Future<void>(); }
+
+            void return_void() { }
+        }; // class CoroutinePromise<void>
+
+    } // namespace detail
+
+    /// A coroutine task, to be submitted with \c WorldTaskQueue::add
+
+    /// The coroutine does not start until it is submitted. It may \c co_await
+    /// any \c Future (including the result of submitting another \c CoTask)
+    /// and finishes with \c co_return.
+    /// \tparam T The result type of the coroutine
+    template <typename T>
+    class CoTask {
+    public:
+        typedef detail::CoroutinePromise<T> promise_type;
+
+    private:
+        friend class WorldTaskQueue;
+        friend class detail::CoroutinePromise<T>;
+
+        std::coroutine_handle<promise_type> h_;
+
+        explicit CoTask(std::coroutine_handle<promise_type> h) : h_(h) { }
+
+        /// Hands the coroutine over to its caller
+        std::coroutine_handle<promise_type> release() {
+            MADNESS_ASSERT(h_);
+            return std::exchange(h_, {});
+        }
+
+    public:
+        CoTask(const CoTask&) = delete;
+        CoTask& operator=(const CoTask&) = delete;
+
+        CoTask(CoTask&& other) : h_(std::exchange(other.h_, {})) { }
+
+        CoTask& operator=(CoTask&& other) {
+            if (this != &other) {
+                if (h_) h_.destroy();
+                h_ = std::exchange(other.h_, {});
+            }
+            return *this;
+        }
+
+        /// A coroutine that was never submitted is destroyed unrun
+        ~CoTask() { if (h_) h_.destroy(); }
+    }; // class CoTask
+
+    namespace detail {
+
+        template <typename T>
+        inline CoTask<T> CoroutinePromise<T>::get_return_object() {
+            return CoTask<T>(std::coroutine_handle<CoroutinePromise<T> >::from_promise(*this));
+        }
+
+        inline CoTask<void> CoroutinePromise<void>::get_return_object() {
+            return CoTask<void>(std::coroutine_handle<CoroutinePromise<void> >::from_promise(*this));
+        }
+
+        inline void CoroutinePromiseBase::retire(WorldTaskQueue& taskq) { taskq.notify(); }
+
+    } // namespace detail
+
+    template <typename T>
+    Future<T> WorldTaskQueue::add(CoTask<T>&& task, const TaskAttributes& attr) {
+        std::coroutine_handle<detail::CoroutinePromise<T> > h = task.release();
+        detail::CoroutinePromise<T>& promise = h.promise();
+        promise.taskq_ = this;
+        promise.attr_ = attr;
+        promise.self_ = h;
+        Future<T> result = promise.result();
+        nregistered++;
+        ThreadPool::add(new detail::CoroutineResume(h, attr));
+        return result;
+    }
+
+} // namespace madness
+
+/// @}
+
+#endif // coroutines
+
+#endif // MADNESS_WORLD_WORLD_COROUTINE_H__INCLUDED
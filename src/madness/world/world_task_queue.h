@@ -65,6 +65,10 @@ namespace madness {
     class WorldTaskQueue;
     template <typename> struct TaskFunction;
     template <typename> struct TaskMemfun;
+    template <typename T = void> class CoTask;
+    namespace detail {
+        class CoroutinePromiseBase;
+    }
 
     namespace meta {
     template <typename ... argsT>
@@ -318,6 +322,7 @@ namespace madness {
     /// \todo A concise description of the inner workings...
     class WorldTaskQueue : public CallbackInterface, private NO_DEFAULTS {
         friend class TaskInterface;
+        friend class detail::CoroutinePromiseBase;
     private:
         World& world; ///< The communication context.
         const ProcessID me; ///< This process.
@@ -472,6 +477,18 @@ namespace madness {
             t->register_submit_callback();
         }
 
+        /// Add a coroutine task (see world_coroutine.h), taking ownership of it.
+
+        /// The coroutine starts on the thread pool and counts as one pending
+        /// task until it returns, however often it suspends. Only available
+        /// with C++20 coroutine support.
+        /// \tparam T The result type of the coroutine.
+        /// \param[in] task The coroutine.
+        /// \param[in] attr The attributes of the pool tasks that run it.
+        /// \return A future to the result of the coroutine.
+        template <typename T>
+        Future<T> add(CoTask<T>&& task, const TaskAttributes& attr = TaskAttributes());
+
         /// \todo Brief description needed.
 
         /// \todo Descriptions needed.
@@ -1603,6 +1620,13 @@ namespace madness {
 
 #endif // HAVE_INTEL_TBB
 
+        /// Submits the continuation of \c Future::then(World&,fnT&&) as a task
+        template <typename T, typename fnT>
+        Future< continuation_result_t<T, fnT> >
+        continuation_task(World& world, const Future<T>& arg, fnT&& fn) {
+            return world.taskq.add(std::forward<fnT>(fn), arg);
+        }
+
     }  // namespace detail
 
 } // namespace madness
@@ -37,6 +37,8 @@
 
 #include <madness/world/buffer_archive.h>
 #include <madness/world/worldrmi.h>
+#include <madness/world/pool_allocator.h>
+#include <madness/world/runtime_profiler.h>
 #include <madness/world/world.h>
 #include <vector>
 #include <cstddef>
@@ -45,6 +47,10 @@
 
 namespace madness {
 
+    namespace detail {
+        class AsyncFenceTask;
+    }  // namespace detail
+
     /*
       The RMI layer just does transport and does not know about World
       or even necessarily about MPI.  It also has no buffering or
@@ -158,10 +164,17 @@ namespace madness {
     };
 
 
+    /// Returns the number of bytes in the buffer of an AmArg with nbyte of user data
+    inline std::size_t am_arg_buffer_size(std::size_t nbyte) {
+        return sizeof(AmArg)*(1 + (nbyte+sizeof(AmArg)-1)/sizeof(AmArg));
+    }
+
     /// Allocates a new AmArg with nbytes of user data ... delete with free_am_arg
+
+    /// Buffers come from the slab classes of PoolAllocator so those of
+    /// completed sends are recycled by the thread that frees them.
     inline AmArg* alloc_am_arg(std::size_t nbyte) {
-        std::size_t narg = 1 + (nbyte+sizeof(AmArg)-1)/sizeof(AmArg);
-        AmArg *arg = new AmArg[narg];
+        AmArg *arg = new (PoolAllocator::allocate(am_arg_buffer_size(nbyte))) AmArg;
         arg->set_size(nbyte);
         return arg;
     }
@@ -176,7 +189,7 @@ namespace madness {
     /// Frees an AmArg allocated with alloc_am_arg
     inline void free_am_arg(AmArg* arg) {
         //std::cout << " freeing amarg " << (void*)(arg) << " " << pthread_self() << std::endl;
-        delete [] arg;
+        if (arg) PoolAllocator::deallocate(arg, am_arg_buffer_size(arg->size()));
     }
 
     /// Terminate argument serialization
@@ -206,6 +219,7 @@ namespace madness {
     /// Implements AM interface
     class WorldAmInterface : private SCALABLE_MUTEX_TYPE {
         friend class WorldGopInterface;
+        friend class detail::AsyncFenceTask;
         friend class World;
     private:
 
@@ -262,8 +276,12 @@ namespace madness {
             MADNESS_ASSERT(arg->size() + sizeof(AmArg) == nbyte);
             MADNESS_ASSERT(w);
             MADNESS_ASSERT(func);
-            func(*arg);
-            w->am.nrecv++;  // Must be AFTER execution of the function
+            {
+                RuntimeProfileSample sample(RuntimeProfileKind::am,
+                        std::pair<void*,unsigned short>(reinterpret_cast<void*>(func), 1));
+                func(*arg);
+            }
+            w->am.nrecv++;  // Must be AFTER execution of the function (and of its profiling)
         }
 
     public:
@@ -40,9 +40,13 @@
 
 */
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
+#include <map>
 #include <set>
 #include <unordered_set>
+#include <vector>
 
 
 #include <madness/world/parallel_archive.h>
@@ -607,6 +611,39 @@ namespace madness
             //            ref.reset(); // Matching inc() in find() where ref was made
         }
 
+        /// Handles a batch of find requests from one process with a single reply
+        void find_many_handler(ProcessID requestor, const std::vector<keyT> &keys,
+                               const std::vector<RemoteReference<FutureImpl<iterator>>> &refs)
+        {
+            std::vector<RemoteReference<FutureImpl<iterator>>> found_refs, missing_refs;
+            std::vector<std::pair<keyT, valueT>> found;
+            for (std::size_t i = 0; i < keys.size(); ++i)
+            {
+                internal_iteratorT r = local.find(keys[i]);
+                if (r == local.end())
+                {
+                    missing_refs.push_back(refs[i]);
+                }
+                else
+                {
+                    found_refs.push_back(refs[i]);
+                    found.emplace_back(r->first, r->second);
+                }
+            }
+            this->send(requestor, &implT::find_many_reply_handler, found_refs, found, missing_refs);
+        }
+
+        /// Handles the reply to a batch of find requests
+        void find_many_reply_handler(const std::vector<RemoteReference<FutureImpl<iterator>>> &found_refs,
+                                     const std::vector<std::pair<keyT, valueT>> &found,
+                                     const std::vector<RemoteReference<FutureImpl<iterator>>> &missing_refs)
+        {
+            for (std::size_t i = 0; i < found_refs.size(); ++i)
+                found_refs[i].get()->set(iterator(pairT(found[i].first, found[i].second)));
+            for (const auto &ref : missing_refs)
+                ref.get()->set(end());
+        }
+
     public:
         WorldContainerImpl(World &world,
                            const std::shared_ptr<WorldDCPmapInterface<keyT>> &pm,
@@ -844,6 +881,29 @@ namespace madness
             }
         }
 
+        /// Inserts many pairs, with one message per remote owner
+        void insert_many(const std::vector<std::pair<keyT, valueT>> &data)
+        {
+            std::map<ProcessID, std::vector<std::pair<keyT, valueT>>> remote;
+            for (const auto &datum : data)
+            {
+                ProcessID dest = owner(datum.first);
+                if (dest == me)
+                {
+                    accessor acc;
+                    [[maybe_unused]] auto inserted = local.insert(acc, datum.first);
+                    acc->second = datum.second;
+                }
+                else
+                {
+                    remote[dest].push_back(datum);
+                }
+            }
+            // Must be send (not task) for sequential consistency with insert()
+            for (const auto &r : remote)
+                this->send(r.first, &implT::insert_many, r.second);
+        }
+
         bool insert_acc(accessor &acc, const keyT &key)
         {
             MADNESS_ASSERT(owner(key) == me);
@@ -942,6 +1002,39 @@ namespace madness
             }
         }
 
+        std::vector<Future<const_iterator>> find_many(const std::vector<keyT> &keys) const
+        {
+            // Same ugliness as in find() const
+            std::vector<Future<iterator>> r = const_cast<implT *>(this)->find_many(keys);
+            return *(std::vector<Future<const_iterator>> *)(&r);
+        }
+
+        std::vector<Future<iterator>> find_many(const std::vector<keyT> &keys)
+        {
+            typedef std::vector<RemoteReference<FutureImpl<iterator>>> refvecT;
+            std::vector<Future<iterator>> result;
+            result.reserve(keys.size());
+            std::map<ProcessID, std::pair<std::vector<keyT>, refvecT>> remote;
+            for (const keyT &key : keys)
+            {
+                ProcessID dest = owner(key);
+                if (dest == me)
+                {
+                    result.push_back(Future<iterator>(iterator(local.find(key))));
+                }
+                else
+                {
+                    result.push_back(Future<iterator>());
+                    std::pair<std::vector<keyT>, refvecT> &request = remote[dest];
+                    request.first.push_back(key);
+                    request.second.push_back(result.back().remote_ref(this->get_world()));
+                }
+            }
+            for (const auto &r : remote)
+                this->send(r.first, &implT::find_many_handler, me, r.second.first, r.second.second);
+            return result;
+        }
+
         bool find(accessor &acc, const keyT &key)
         {
             if (owner(key) != me)
@@ -1270,6 +1363,16 @@ namespace madness
             replace(pairT(key, value));
         }
 
+        /// Inserts/replaces many key+value pairs (non-blocking communication if keys not local)
+
+        /// The pairs are grouped by owner and each remote owner receives them
+        /// in a single message, instead of one message per pair.
+        void replace_many(const std::vector<std::pair<keyT, valueT>> &data)
+        {
+            check_initialized();
+            p->insert_many(data);
+        }
+
         /// Write access to LOCAL value by key. Returns true if found, false otherwise (always false for remote).
         bool find(accessor &acc, const keyT &key)
         {
@@ -1353,6 +1456,26 @@ namespace madness
             return const_cast<const implT *>(p.get())->find(key);
         }
 
+        /// Returns future iterators for many keys (non-blocking communication if keys not local)
+
+        /// Equivalent to calling find() for each key, but the keys are grouped by
+        /// owner and each remote owner is sent one request and sends one reply.
+        /// Use when_all() on the result to wait for all of them at once.
+        std::vector<Future<iterator>> find_many(const std::vector<keyT> &keys)
+        {
+            check_initialized();
+            return p->find_many(keys);
+        }
+
+        /// Returns future iterators for many keys (non-blocking communication if keys not local)
+
+        /// See the non-const version.
+        std::vector<Future<const_iterator>> find_many(const std::vector<keyT> &keys) const
+        {
+            check_initialized();
+            return const_cast<const implT *>(p.get())->find_many(keys);
+        }
+
         /// Returns an iterator to the beginning of the \em local data (no communication)
         iterator begin()
         {
@@ -2361,6 +2484,167 @@ namespace madness
                     world->gop.fence();
             }
         };
+
+        /// Write container to a single shared file
+
+        /// \ingroup worlddc
+        /// All processes write their values with collective writes into one
+        /// block of the file, followed by an index of (key, offset, size) for
+        /// every value. Process zero first stores a header at the current
+        /// position of the serial data
+        /// \code
+        ///   magic, number of keys, size of the values, size of the index
+        /// \endcode
+        /// The index lets a job with a different number of processes or a
+        /// different process map read only the values it owns.
+        template <class keyT, class valueT>
+        struct ArchiveStoreImpl<ParallelOutputArchive<SharedFileOutputArchive>, WorldContainer<keyT, valueT>>
+        {
+            static void store(const ParallelOutputArchive<SharedFileOutputArchive> &ar, const WorldContainer<keyT, valueT> &t)
+            {
+                const std::int64_t magic = -5881829; // Not the magic of the per-process files
+                typedef WorldContainer<keyT, valueT> dcT;
+                typedef typename dcT::const_iterator const_iterator;
+                World *world = ar.get_world();
+                const ProcessID me = world->rank();
+                const ProcessID nproc = world->size();
+                SharedFileOutputArchive &localar = ar.local_archive();
+                if (ar.dofence())
+                    world->gop.fence();
+
+                // Serialize the local values, remembering where each one starts
+                std::vector<unsigned char> data;
+                std::vector<keyT> keys;
+                std::vector<std::uint64_t> offsets;
+                {
+                    SharedFileBlockOutputArchive dar(data);
+                    for (const_iterator it = t.begin(); it != t.end(); ++it) {
+                        keys.push_back(it->first);
+                        offsets.push_back(data.size());
+                        dar & it->second;
+                    }
+                }
+                offsets.push_back(data.size());
+
+                // Place the values of this process after those of lower ranks
+                std::vector<std::uint64_t> data_sizes(nproc, 0);
+                data_sizes[me] = data.size();
+                world->gop.sum(data_sizes.data(), nproc);
+                std::uint64_t data_offset = 0, data_total = 0;
+                for (ProcessID p = 0; p < nproc; ++p) {
+                    if (p < me) data_offset += data_sizes[p];
+                    data_total += data_sizes[p];
+                }
+
+                // Index entries hold offsets from the start of the values
+                std::vector<unsigned char> index;
+                {
+                    VectorOutputArchive iar(index);
+                    for (std::size_t i = 0; i < keys.size(); ++i) {
+                        std::uint64_t offset = data_offset + offsets[i], nbyte = offsets[i+1] - offsets[i];
+                        iar & keys[i] & offset & nbyte;
+                    }
+                }
+                std::vector<std::uint64_t> index_sizes(nproc, 0);
+                index_sizes[me] = index.size();
+                world->gop.sum(index_sizes.data(), nproc);
+                std::uint64_t index_offset = 0, index_total = 0;
+                for (ProcessID p = 0; p < nproc; ++p) {
+                    if (p < me) index_offset += index_sizes[p];
+                    index_total += index_sizes[p];
+                }
+                std::int64_t nkey = keys.size();
+                world->gop.sum(nkey);
+
+                std::uint64_t base = 0;
+                if (me == 0) {
+                    const std::int64_t header[4] = {magic, nkey, std::int64_t(data_total), std::int64_t(index_total)};
+                    localar.store(header, 4);
+                    localar.flush();
+                    base = localar.position();
+                }
+                world->gop.broadcast(base, 0);
+
+                localar.write_at_all(base + data_offset, data.data(), data.size());
+                localar.write_at_all(base + data_total + index_offset, index.data(), index.size());
+                localar.seek(base + data_total + index_total);
+
+                if (ar.dofence())
+                    world->gop.fence();
+            }
+        };
+
+        /// Read container from a single shared file
+
+        /// \ingroup worlddc
+        /// See the store method above for the layout. Every process reads the
+        /// index, then only the values of the keys it owns under the process
+        /// map of \c t, merging reads of adjacent values.
+        template <class keyT, class valueT>
+        struct ArchiveLoadImpl<ParallelInputArchive<SharedFileInputArchive>, WorldContainer<keyT, valueT>>
+        {
+            static void load(const ParallelInputArchive<SharedFileInputArchive> &ar, WorldContainer<keyT, valueT> &t)
+            {
+                const std::int64_t magic = -5881829;
+                World *world = ar.get_world();
+                const ProcessID me = world->rank();
+                SharedFileInputArchive &localar = ar.local_archive();
+                if (ar.dofence())
+                    world->gop.fence();
+
+                std::int64_t header[5] = {0, 0, 0, 0, 0}; // the fifth is the position of the values
+                if (me == 0) {
+                    localar.load(header, 4);
+                    header[4] = localar.position();
+                }
+                world->gop.broadcast(header, 5, 0);
+                MADNESS_CHECK(header[0] == magic);
+                const std::uint64_t nkey = header[1], data_total = header[2], index_total = header[3], base = header[4];
+
+                std::vector<unsigned char> index(index_total);
+                localar.read_at_all(base + data_total, index.data(), index.size());
+
+                struct entry {
+                    keyT key;
+                    std::uint64_t offset, nbyte;
+                    bool operator<(const entry& other) const { return offset < other.offset; }
+                };
+                std::vector<entry> mine;
+                {
+                    VectorInputArchive iar(index);
+                    for (std::uint64_t i = 0; i < nkey; ++i) {
+                        entry e;
+                        iar & e.key & e.offset & e.nbyte;
+                        if (t.owner(e.key) == me) mine.push_back(e);
+                    }
+                }
+                std::sort(mine.begin(), mine.end());
+
+                // Read runs of adjacent values at once
+                const std::uint64_t maxrun = std::uint64_t(64) << 20;
+                std::vector<unsigned char> buf;
+                for (std::size_t i = 0; i < mine.size(); ) {
+                    std::size_t j = i + 1;
+                    std::uint64_t end = mine[i].offset + mine[i].nbyte;
+                    while (j < mine.size() && mine[j].offset == end && end + mine[j].nbyte - mine[i].offset <= maxrun)
+                        end += mine[j++].nbyte;
+                    buf.resize(end - mine[i].offset);
+                    localar.read_at(base + mine[i].offset, buf.data(), buf.size());
+                    for (std::size_t k = i; k < j; ++k) {
+                        BufferInputArchive bi(buf.data() + (mine[k].offset - mine[i].offset), mine[k].nbyte);
+                        valueT value;
+                        bi & value;
+                        t.replace(mine[k].key, value);
+                    }
+                    i = j;
+                }
+
+                localar.seek(base + data_total + index_total);
+
+                if (ar.dofence())
+                    world->gop.fence();
+            }
+        };
     }
 
 }
@@ -37,10 +37,169 @@
 #endif
 namespace madness {
 
+    namespace detail {
+
+        /// Polling task that advances a split-phase fence
+
+        /// Each run makes as much progress as it can through the fence
+        /// protocol without blocking and, unless the fence is complete,
+        /// resubmits itself so that other tasks get to run in between.
+        /// If no progress was made and the pool has nothing else to do the
+        /// run first sleeps, for twice as long each time up to \c max_backoff_us,
+        /// so the polling does not keep a thread spinning.
+        class AsyncFenceTask : public TaskInterface {
+        public:
+            /// State of the fence shared by successive polling tasks
+            struct State {
+                World& world;
+                std::atomic<bool>& pending;
+                Future<bool> done;
+                ProcessID parent;
+                std::vector<ProcessID> children;
+                std::vector<SafeMPI::Request> reqs;
+                std::vector<uint64_t> sums;
+                SafeMPI::Request req_up, req_down;
+                uint64_t sum[2], bsum[2];
+                uint64_t nsent_prev = 0, nrecv_prev = 1; // invalid initial condition
+                Tag gfence_tag, bcast_tag;
+                int phase = 0;
+                int npass = 0;
+                std::atomic<int> ntask{0}; // Polling tasks alive, each counted by world.taskq.size()
+
+                State(World& world, std::atomic<bool>& pending)
+                    : world(world), pending(pending)
+                {
+                    world.mpi.node_tree_info(0, parent, children);
+                    reqs.resize(children.size());
+                    sums.resize(2*children.size());
+                    gfence_tag = world.mpi.unique_tag();
+                    bcast_tag = world.mpi.unique_tag();
+                }
+            };
+
+        private:
+            std::shared_ptr<State> s;
+
+            static bool test_all(std::vector<SafeMPI::Request>& reqs) {
+                for (auto& req : reqs)
+                    if (! req.Test()) return false;
+                return true;
+            }
+
+            /// True if the polling tasks are all that is left locally and no AM is in flight
+
+            /// The task that spawned this one may not have been retired yet,
+            /// so all polling tasks of the fence are discounted, not just this one.
+            bool quiescent(uint64_t& nsent, uint64_t& nrecv) const {
+                World& world = s->world;
+
+                // Aggregated active messages are counted as sent so must go out now
+                RMI::flush();
+
+                // As in fence_impl the counters are read twice to ensure that they
+                // are consistent
+                const uint64_t nfence1 = s->ntask;
+                const uint64_t ntask1 = world.taskq.size();
+                const uint64_t nsent1 = world.am.nsent;
+                const uint64_t nrecv1 = world.am.nrecv;
+
+                __asm__ __volatile__ (" " : : : "memory");
+
+                const uint64_t ntask2 = world.taskq.size();
+                const uint64_t nfence2 = s->ntask;
+                nsent = world.am.nsent;
+                nrecv = world.am.nrecv;
+
+                __asm__ __volatile__ (" " : : : "memory");
+
+                return (nfence1==nfence2) && (ntask1==nfence1) && (ntask2==nfence2) &&
+                        (nsent1==nsent) && (nrecv1==nrecv);
+            }
+
+            /// Advances the protocol by one step; returns false if it must wait
+            bool step() {
+                World& world = s->world;
+                const int nchild = s->children.size();
+                switch (s->phase) {
+                case 0: // Start a pass by listening for the partial sums of the children
+                    for (int c=0; c<nchild; ++c)
+                        s->reqs[c] = world.mpi.Irecv((void*) &(s->sums[2*c]), 2*sizeof(uint64_t),
+                                MPI_BYTE, s->children[c], s->gfence_tag);
+                    s->phase = 1;
+                    return true;
+
+                case 1: // Wait for the children and local quiescence, then send up the tree
+                    {
+                        uint64_t nsent, nrecv;
+                        if (! test_all(s->reqs) || ! quiescent(nsent, nrecv)) return false;
+                        s->sum[0] = nsent;
+                        s->sum[1] = nrecv;
+                        for (int c=0; c<nchild; ++c) {
+                            s->sum[0] += s->sums[2*c];
+                            s->sum[1] += s->sums[2*c+1];
+                        }
+                        if (s->parent != -1) {
+                            s->req_up = world.mpi.Isend(s->sum, sizeof(s->sum), MPI_BYTE, s->parent, s->gfence_tag);
+                            s->req_down = world.mpi.Irecv(s->bsum, sizeof(s->bsum), MPI_BYTE, s->parent, s->bcast_tag);
+                        }
+                        else {
+                            s->bsum[0] = s->sum[0];
+                            s->bsum[1] = s->sum[1];
+                        }
+                        s->phase = 2;
+                        return true;
+                    }
+
+                case 2: // Wait for the global sums and pass them down the tree
+                    if (s->parent != -1 && ! (s->req_up.Test() && s->req_down.Test())) return false;
+                    for (int c=0; c<nchild; ++c)
+                        s->reqs[c] = world.mpi.Isend(s->bsum, sizeof(s->bsum), MPI_BYTE, s->children[c], s->bcast_tag);
+                    s->phase = 3;
+                    return true;
+
+                case 3: // Finish the pass once the children have their sums
+                    if (! test_all(s->reqs)) return false;
+                    ++(s->npass);
+                    if (s->bsum[0]==s->bsum[1] && s->bsum[0]==s->nsent_prev && s->bsum[1]==s->nrecv_prev) {
+                        s->phase = 4;
+                        return false;
+                    }
+                    s->nsent_prev = s->bsum[0];
+                    s->nrecv_prev = s->bsum[1];
+                    s->phase = 0;
+                    return true;
+
+                default:
+                    return false;
+                }
+            }
+
+        public:
+            AsyncFenceTask(const std::shared_ptr<State>& s) : s(s) { ++(s->ntask); }
+
+            virtual ~AsyncFenceTask() { --(s->ntask); }
+
+            void run(World& world) {
+                while (step()) ;
+
+                if (s->phase == 4) {
+                    s->pending = false;
+                    s->done.set(true);
+                    return;
+                }
+
+                // Poll again once the tasks queued meanwhile had their turn,
+                // rather than holding on to this thread
+                world.taskq.add(new AsyncFenceTask(s));
+            }
+        }; // class AsyncFenceTask
+
+    } // namespace detail
+
 
     /// Synchronizes all processes in communicator AND globally ensures no pending AM or tasks
 
-    /// Runs Dykstra-like termination algorithm on binary tree by
+    /// Runs Dykstra-like termination algorithm on the node-aware tree by
     /// locally ensuring ntask=0 and all am sent and processed,
     /// and then participating in a global sum of nsent and nrecv.
     /// Then globally checks that nsent=nrecv and that both are
@@ -52,35 +211,44 @@ namespace madness {
                                    bool debug) {
         PROFILE_MEMBER_FUNC(WorldGopInterface);
         MADNESS_CHECK(not forbid_fence_);
+        MADNESS_CHECK(not async_fence_pending_);
         unsigned long nsent_prev=0, nrecv_prev=1; // invalid initial condition
-        SafeMPI::Request req0, req1;
-        ProcessID parent, child0, child1;
-        world_.mpi.binary_tree_info(0, parent, child0, child1);
+        SafeMPI::Request req0;
+        ProcessID parent;
+        std::vector<ProcessID> children;
+        world_.mpi.node_tree_info(0, parent, children);
+        const int nchild = children.size();
+        std::vector<SafeMPI::Request> reqs(nchild);
+        std::vector<uint64_t> sums(2*nchild);
         Tag gfence_tag = world_.mpi.unique_tag();
         Tag bcast_tag = world_.mpi.unique_tag();
         int npass = 0;
 
-        //double start = wall_time();
+#ifdef MADNESS_TASK_PROFILING
+        const double start = wall_time();
+#endif // MADNESS_TASK_PROFILING
 
       if (debug)
         madness::print(world_.rank(), ": WORLD.GOP.FENCE: entering fence loop, gfence_tag=", gfence_tag, " bcast_tag=", bcast_tag);
 
       while (1) {
-            uint64_t sum0[2]={0,0}, sum1[2]={0,0}, sum[2];
-            if (child0 != -1) req0 = world_.mpi.Irecv((void*) &sum0, sizeof(sum0), MPI_BYTE, child0, gfence_tag);
-            if (child1 != -1) req1 = world_.mpi.Irecv((void*) &sum1, sizeof(sum1), MPI_BYTE, child1, gfence_tag);
+            uint64_t sum[2];
+            for (int c=0; c<nchild; ++c)
+                reqs[c] = world_.mpi.Irecv((void*) &sums[2*c], 2*sizeof(uint64_t), MPI_BYTE, children[c], gfence_tag);
             world_.taskq.fence();
-            if (child0 != -1) World::await(req0);
-            if (child1 != -1) World::await(req1);
+            for (int c=0; c<nchild; ++c) World::await(reqs[c]);
 
-            if (debug && (child0 != -1 || child1 != -1))
-              madness::print(world_.rank(), ": WORLD.GOP.FENCE: npass=", npass, " received messages from children={", child0, ",", child1, "} gfence_tag=", gfence_tag);
+            if (debug && nchild)
+              madness::print(world_.rank(), ": WORLD.GOP.FENCE: npass=", npass, " received messages from children=", children, " gfence_tag=", gfence_tag);
 
             bool finished;
             uint64_t ntask1, nsent1, nrecv1, ntask2, nsent2, nrecv2;
             do {
                 world_.taskq.fence();
 
+                // Aggregated active messages are counted as sent so must go out now
+                RMI::flush();
+
                 // Since the number of outstanding tasks and number of AM sent/recv
                 // don't share a critical section read each twice and ensure they
                 // are unchanged to ensure that are consistent ... they don't have
@@ -102,8 +270,12 @@ namespace madness {
             }
             while (!finished);
 
-            sum[0] = sum0[0] + sum1[0] + nsent2; // Must use values read above
-            sum[1] = sum0[1] + sum1[1] + nrecv2;
+            sum[0] = nsent2; // Must use values read above
+            sum[1] = nrecv2;
+            for (int c=0; c<nchild; ++c) {
+                sum[0] += sums[2*c];
+                sum[1] += sums[2*c+1];
+            }
 
             if (parent != -1) {
                 req0 = world_.mpi.Isend(&sum, sizeof(sum), MPI_BYTE, parent, gfence_tag);
@@ -154,6 +326,10 @@ namespace madness {
         MallocExtension::instance()->ReleaseFreeMemory();
 //        print("clearing memory");
 #endif
+#ifdef MADNESS_TASK_PROFILING
+        profiling::TaskProfiler::record(profiling::EventKind::fence,
+                std::pair<void*,unsigned short>(nullptr, 0), -1, 0, start, wall_time());
+#endif // MADNESS_TASK_PROFILING
       if (debug)
         madness::print(world_.rank(), ": WORLD.GOP.FENCE: done with fence in ", npass, (npass > 1 ? " loops" : " loop"));
     }
@@ -162,6 +338,16 @@ namespace madness {
       fence_impl([]{}, false, debug);
     }
 
+    Future<bool> WorldGopInterface::fence_async() {
+        MADNESS_CHECK(not forbid_fence_);
+        MADNESS_CHECK(not async_fence_pending_);
+        async_fence_pending_ = true;
+        auto state = std::make_shared<detail::AsyncFenceTask::State>(world_, async_fence_pending_);
+        Future<bool> done = state->done;
+        world_.taskq.add(new detail::AsyncFenceTask(state));
+        return done;
+    }
+
     void WorldGopInterface::serial_invoke(std::function<void()> action) {
       // default implementation requires 2 fences since action may change global state visible to all tasks
       // fence_impl could be used if possible to pause thread pool after the fence
@@ -173,30 +359,26 @@ namespace madness {
     void WorldGopInterface::broadcast(void* buf, size_t nbyte, ProcessID root, bool dowork, Tag bcast_tag) {
       if (bcast_tag < 0)
         bcast_tag = world_.mpi.unique_tag();
-      ProcessID parent, child0, child1;
-      world_.mpi.binary_tree_info(root, parent, child0, child1);
+      ProcessID parent;
+      std::vector<ProcessID> children;
+      world_.mpi.node_tree_info(root, parent, children);
+      const int nchild = children.size();
+      std::vector<SafeMPI::Request> reqs(nchild);
       const size_t max_msg_size =
           static_cast<size_t>(max_reducebcast_msg_size());
 
       auto broadcast_impl = [&, this](void *buf, int nbyte) {
-        SafeMPI::Request req0, req1;
-
         // print("BCAST TAG", bcast_tag);
 
         if (parent != -1) {
-          req0 = world_.mpi.Irecv(buf, nbyte, MPI_BYTE, parent, bcast_tag);
+          SafeMPI::Request req0 = world_.mpi.Irecv(buf, nbyte, MPI_BYTE, parent, bcast_tag);
           World::await(req0, dowork);
         }
 
-        if (child0 != -1)
-          req0 = world_.mpi.Isend(buf, nbyte, MPI_BYTE, child0, bcast_tag);
-        if (child1 != -1)
-          req1 = world_.mpi.Isend(buf, nbyte, MPI_BYTE, child1, bcast_tag);
-
-        if (child0 != -1)
-          World::await(req0, dowork);
-        if (child1 != -1)
-          World::await(req1, dowork);
+        for (int c=0; c<nchild; ++c)
+          reqs[c] = world_.mpi.Isend(buf, nbyte, MPI_BYTE, children[c], bcast_tag);
+        for (int c=0; c<nchild; ++c)
+          World::await(reqs[c], dowork);
       };
 
       while (nbyte) {
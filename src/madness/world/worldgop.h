@@ -38,8 +38,10 @@
 /// If you can recall the Intel hypercubes, their comm lib used GOP as
 /// the abbreviation.
 
+#include <atomic>
 #include <functional>
 #include <type_traits>
+#include <vector>
 #include <madness/world/worldtypes.h>
 #include <madness/world/buffer_archive.h>
 #include <madness/world/world.h>
@@ -151,6 +153,8 @@ namespace madness {
         bool debug_; ///< Debug mode
         bool forbid_fence_=false; ///< forbid calling fence() in case of several active worlds
         int max_reducebcast_msg_size_ = std::numeric_limits<int>::max();  ///< maximum size of messages (in bytes) sent by reduce and broadcast
+        std::atomic<bool> async_fence_pending_{false}; ///< true while a fence_async() is in progress
+        std::size_t nasync_reduce_ = 0; ///< Number of asynchronous reductions started, used as their key
 
         friend class detail::DeferredCleanup;
 
@@ -164,6 +168,8 @@ namespace madness {
         struct GroupReduceTag { };
         struct AllReduceTag { };
         struct GroupAllReduceTag { };
+        struct AsyncReduceTag { };
+        struct AsyncBcastTag { };
 
 
         /// Delayed send callback object
@@ -568,6 +574,39 @@ namespace madness {
             return result.get();
         }
 
+        /// Element-wise reduction of vectors used by reduce_async()
+
+        /// An empty vector is the identity, so \c opT need not have a neutral
+        /// element (\c T() is wrong for max of negative numbers, for instance).
+        /// \tparam T The element type
+        /// \tparam opT The binary operation, as for reduce()
+        template <typename T, typename opT>
+        struct AsyncReduceOp {
+            typedef std::vector<T> result_type;
+            typedef std::vector<T> argument_type;
+
+            opT op;
+
+            AsyncReduceOp(const opT& op) : op(op) { }
+
+            result_type operator()() const { return result_type(); }
+
+            void operator()(result_type& result, const argument_type& arg) const {
+                if (result.empty())
+                    result = arg;
+                else if (! arg.empty()) {
+                    MADNESS_ASSERT(result.size() == arg.size());
+                    for (std::size_t i = 0ul; i < result.size(); ++i)
+                        result[i] = op(result[i], arg[i]);
+                }
+            }
+        }; // struct AsyncReduceOp
+
+        template <typename T>
+        static T async_reduce_front(const std::vector<T>& v) {
+            return v.front();
+        }
+
         /// Distributed reduce
 
         /// \tparam tagT The tag type to be added to the key type
@@ -585,23 +624,36 @@ namespace madness {
         reduce_internal(const ProcessID parent, const ProcessID child0,
                 const ProcessID child1, const ProcessID root, const keyT& key,
                 const valueT& value, const opT& op)
+        {
+            std::vector<ProcessID> children;
+            if(child0 != -1) children.push_back(child0);
+            if(child1 != -1) children.push_back(child1);
+            return reduce_internal<tagT>(parent, children, root, key, value, op);
+        }
+
+        /// Distributed reduce on a tree with any number of children
+
+        /// \see reduce_internal() above; \c children are the children of this
+        /// process in the tree, e.g. from WorldMpiInterface::node_tree_info().
+        template <typename tagT, typename keyT, typename valueT, typename opT>
+        Future<typename detail::result_of<opT>::type>
+        reduce_internal(const ProcessID parent, const std::vector<ProcessID>& children,
+                const ProcessID root, const keyT& key, const valueT& value, const opT& op)
         {
             // Create tagged key
             typedef ProcessKey<keyT, tagT> key_type;
             typedef typename detail::result_of<opT>::type result_type;
             typedef typename remove_future<valueT>::type value_type;
             std::vector<Future<result_type> > results;
-            results.reserve(3);
+            results.reserve(children.size() + 1);
 
             // Add local data to vector of values to reduce
             results.push_back(world_.taskq.add(WorldGopInterface::template reduce_task<value_type, opT>,
                     value, op, TaskAttributes::hipri()));
 
             // Reduce child data
-            if(child0 != -1)
-                results.push_back(recv_internal<result_type>(key_type(key, child0)));
-            if(child1 != -1)
-                results.push_back(recv_internal<result_type>(key_type(key, child1)));
+            for(ProcessID child : children)
+                results.push_back(recv_internal<result_type>(key_type(key, child)));
 
             // Submit the local reduction task
             Future<result_type> local_result =
@@ -618,6 +670,28 @@ namespace madness {
             return Future<result_type>::default_initializer();
         }
 
+        /// Broadcast down a tree with any number of children
+
+        /// Each process passes the value on to its \c children as soon as it
+        /// has it, e.g. down the tree of WorldMpiInterface::node_tree_info().
+        /// \tparam tagT The tag type to be added to the key type
+        /// \param parent The parent of this process, -1 on the root
+        /// \param children The children of this process
+        /// \param key The key associated with this broadcast
+        /// \param value The value to broadcast, used on the root only
+        /// \return A future to the value on all processes
+        template <typename tagT, typename keyT, typename valueT>
+        Future<valueT> tree_bcast_internal(const ProcessID parent, const std::vector<ProcessID>& children,
+                const keyT& key, const Future<valueT>& value) const
+        {
+            typedef ProcessKey<keyT, tagT> key_type;
+            Future<valueT> result = (parent == -1) ? value :
+                    recv_internal<valueT>(key_type(key, parent));
+            for(ProcessID child : children)
+                send_internal(child, key_type(key, world_.rank()), result);
+            return result;
+        }
+
         /// Implementation of fence
 
         /// \param[in] epilogue the action to execute (by the calling thread) immediately after the fence
@@ -718,6 +792,20 @@ namespace madness {
         /// \param[in] debug set to true to print progress statistics using madness::print(); the default is false.
         void fence(bool debug = false);
 
+        /// Starts a fence and returns at once with a future that is assigned when it completes
+
+        /// Runs the same termination algorithm as fence(), but from a polling
+        /// task with nonblocking messages, so the calling thread may carry on
+        /// submitting work or wait on other futures (e.g. from sum_async()) while
+        /// the fence proceeds. A process counts as quiescent when the polling
+        /// tasks of the fence are its only tasks, so the future must not be
+        /// waited on from inside a task. Must be called by all processes in the same order
+        /// from the main thread. Only one may be pending at a time and fence()
+        /// may not be called before it completes. Unlike fence(), deferred
+        /// cleanup is left to the next blocking fence.
+        /// \return A future that is set to true when the fence is complete
+        Future<bool> fence_async();
+
         /// Executes an action on single (this) thread after ensuring all other work is done
 
         /// \param[in] action the action to execute (by the calling thread)
@@ -780,13 +868,18 @@ namespace madness {
 
         /// Inplace global reduction (like MPI all_reduce) while still processing AM & tasks
 
+        /// Reduces up and broadcasts down the node-aware tree of
+        /// WorldMpiInterface::node_tree_info(), so processes on one node
+        /// combine their data before it crosses the network.
         /// Optimizations can be added for long messages and to reduce the memory footprint
         template <typename T, class opT>
             void reduce(T* buf, std::size_t nelem, opT op) {
           static_assert(madness::is_trivially_copyable_v<T>, "T must be trivially copyable");
 
-          ProcessID parent, child0, child1;
-          world_.mpi.binary_tree_info(0, parent, child0, child1);
+          ProcessID parent;
+          std::vector<ProcessID> children;
+          world_.mpi.node_tree_info(0, parent, children);
+          const int nchild = children.size();
           const std::size_t nelem_per_maxmsg =
               max_reducebcast_msg_size() / sizeof(T);
 
@@ -818,41 +911,28 @@ namespace madness {
 #endif
           };
 
-          sptr_t buf0;
-          if (child0 != -1)
-            buf0 = sptr_t(aligned_buf_alloc(),
-                          free_dtor{});
-          sptr_t buf1(nullptr);
-          if (child1 != -1)
-            buf1 = sptr_t(aligned_buf_alloc(),
-                          free_dtor{});
+          std::vector<sptr_t> bufs;
+          for (int c = 0; c < nchild; ++c)
+            bufs.emplace_back(aligned_buf_alloc(), free_dtor{});
+          std::vector<SafeMPI::Request> reqs(nchild);
 
           auto reduce_impl = [&,this](T* buf, size_t nelem) {
             MADNESS_ASSERT(nelem <= nelem_per_maxmsg);
-            SafeMPI::Request req0, req1;
             Tag gsum_tag = world_.mpi.unique_tag();
 
-            if (child0 != -1)
-              req0 = world_.mpi.Irecv(buf0.get(), nelem * sizeof(T), MPI_BYTE,
-                                      child0, gsum_tag);
-            if (child1 != -1)
-              req1 = world_.mpi.Irecv(buf1.get(), nelem * sizeof(T), MPI_BYTE,
-                                      child1, gsum_tag);
+            for (int c = 0; c < nchild; ++c)
+              reqs[c] = world_.mpi.Irecv(bufs[c].get(), nelem * sizeof(T), MPI_BYTE,
+                                         children[c], gsum_tag);
 
-            if (child0 != -1) {
-              World::await(req0);
-              for (long i = 0; i < (long)nelem; ++i)
-                buf[i] = op(buf[i], buf0[i]);
-            }
-            if (child1 != -1) {
-              World::await(req1);
+            for (int c = 0; c < nchild; ++c) {
+              World::await(reqs[c]);
               for (long i = 0; i < (long)nelem; ++i)
-                buf[i] = op(buf[i], buf1[i]);
+                buf[i] = op(buf[i], bufs[c][i]);
             }
 
             if (parent != -1) {
-              req0 = world_.mpi.Isend(buf, nelem * sizeof(T), MPI_BYTE, parent,
-                                      gsum_tag);
+              SafeMPI::Request req0 = world_.mpi.Isend(buf, nelem * sizeof(T), MPI_BYTE, parent,
+                                                       gsum_tag);
               World::await(req0);
             }
 
@@ -946,6 +1026,71 @@ namespace madness {
             min(&a, 1);
         }
 
+        /// Global reduction that returns at once with a future to the result
+
+        /// Unlike reduce() the caller is not blocked: the reduction is carried
+        /// by tasks and active messages up and down the node-aware tree of
+        /// WorldMpiInterface::node_tree_info(), so independent reductions
+        /// (and other work) overlap their communication. The data
+        /// is copied so \c buf may be reused immediately. Must be called by all
+        /// processes in the same order from the main thread.
+        /// \param[in] buf the local data
+        /// \param[in] nelem the number of elements, which must be the same everywhere
+        /// \param[in] op the binary operation, as for reduce()
+        /// \return A future to the element-wise reduction, assigned on all processes
+        template <typename T, class opT>
+        Future<std::vector<T>> reduce_async(const T* buf, size_t nelem, opT op) {
+            typedef AsyncReduceOp<T, opT> reduceT;
+            typedef std::vector<T> resultT;
+            const std::size_t key = nasync_reduce_++;
+
+            // Spread the roots of successive reductions over the processes
+            const ProcessID root = key % world_.size();
+            ProcessID parent = -1;
+            std::vector<ProcessID> children;
+            world_.mpi.node_tree_info(root, parent, children);
+
+            Future<resultT> result =
+                    reduce_internal<AsyncReduceTag>(parent, children, root,
+                            key, resultT(buf, buf + nelem), reduceT(op));
+            return tree_bcast_internal<AsyncBcastTag>(parent, children, key, result);
+        }
+
+        /// Global sum of an array that returns at once with a future to the result
+
+        /// \see reduce_async()
+        template <typename T>
+        Future<std::vector<T>> sum_async(const T* buf, size_t nelem) {
+            return reduce_async(buf, nelem, WorldSumOp<T>());
+        }
+
+        /// Global sum of a scalar that returns at once with a future to the result
+
+        /// \see reduce_async()
+        template <typename T>
+        Future<T> sum_async(const T& a) {
+            return world_.taskq.add(WorldGopInterface::template async_reduce_front<T>,
+                    sum_async(&a, 1), TaskAttributes::hipri());
+        }
+
+        /// Global max of a scalar that returns at once with a future to the result
+
+        /// \see reduce_async()
+        template <typename T>
+        Future<T> max_async(const T& a) {
+            return world_.taskq.add(WorldGopInterface::template async_reduce_front<T>,
+                    reduce_async(&a, 1, WorldMaxOp<T>()), TaskAttributes::hipri());
+        }
+
+        /// Global min of a scalar that returns at once with a future to the result
+
+        /// \see reduce_async()
+        template <typename T>
+        Future<T> min_async(const T& a) {
+            return world_.taskq.add(WorldGopInterface::template async_reduce_front<T>,
+                    reduce_async(&a, 1, WorldMinOp<T>()), TaskAttributes::hipri());
+        }
+
         /// Concatenate an STL vector of serializable stuff onto node 0
 
         /// \param[in] v input vector
@@ -46,7 +46,10 @@
 #include <madness/world/worldmutex.h>
 #include <madness/world/madness_exception.h>
 #include <madness/world/worldhash.h>
+#include <madness/world/memory_accounting.h>
 #include <new>
+#include <atomic>
+#include <algorithm>
 #include <stdio.h>
 #include <map>
 
@@ -62,6 +65,7 @@ namespace madness {
         // A hashtable is an array of nbin bins.
         // Each bin is a linked list of entries protected by a spinlock.
         // Each entry holds a key+value pair, a read-write mutex, and a link to the next entry.
+        // The links are atomic so that an insert-only map can be searched without locks.
 
         template <typename keyT, typename valueT>
         class entry : public madness::MutexReaderWriter {
@@ -69,7 +73,7 @@ namespace madness {
             typedef std::pair<const keyT, valueT> datumT;
             datumT datum;
 
-            class entry<keyT,valueT> * next;
+            std::atomic<entry<keyT,valueT>*> next;
 
             entry(const datumT& datum, entry<keyT,valueT>* next)
                     : datum(datum), next(next) {}
@@ -77,6 +81,7 @@ namespace madness {
 
         template <class keyT, class valueT>
         class bin : private madness::Spinlock {
+            template <class a,class b,class c> friend class madness::ConcurrentHashMap;
         private:
             typedef entry<keyT,valueT> entryT;
             typedef std::pair<const keyT, valueT> datumT;
@@ -84,10 +89,11 @@ namespace madness {
             // perhaps better to just use more bins
         public:
 
-            entryT* p; // was volatile but all uses are protect by mutex with implied barriers and fences
-            int ninbin; // ditto
+            std::atomic<entryT*> p; // modified only with the bin locked, released so it can be read without the lock
+            int ninbin; // was volatile but all uses are protect by mutex with implied barriers and fences
+            bool moved; // True once the entries have been rehashed into a larger table ... ditto
 
-            bin() : p(0),ninbin(0) {}
+            bin() : p(0),ninbin(0),moved(false) {}
 
             ~bin() {
                 clear();
@@ -95,96 +101,74 @@ namespace madness {
 
             void clear() {
                 lock();             // BEGIN CRITICAL SECTION
-                while (p) {
-                    entryT* n=p->next;
-                    delete p;
-                    p=n;
+                while (entryT* t=p.load(std::memory_order_relaxed)) {
+                    p.store(t->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    delete t;
+                    MemoryAccounting::sub(MemoryCategory::hashmap, sizeof(entryT));
                     ninbin--;
                 }
                 MADNESS_ASSERT(ninbin == 0);
                 unlock();           // END CRITICAL SECTION
             }
 
-            entryT* find(const keyT& key, const int lockmode) const {
-                bool gotlock;
-                entryT* result;
-                madness::MutexWaiter waiter;
-                do {
-                    lock();             // BEGIN CRITICAL SECTION
-                    result = match(key);
-                    if (result) {
-                        gotlock = result->try_lock(lockmode);
-                    }
-                    else {
-                        gotlock = true;
-                    }
-                    unlock();           // END CRITICAL SECTION
-                    if (!gotlock) waiter.wait(); //cpu_relax();
-                }
-                while (!gotlock);
-
-                return result;
-            }
-
-            std::pair<entryT*,bool> insert(const datumT& datum, int lockmode) {
-                bool gotlock;
-                entryT* result;
-                bool notfound;
-                madness::MutexWaiter waiter;
-                do {
-                    lock();             // BEGIN CRITICAL SECTION
-                    result = match(datum.first);
-                    notfound = !result;
-                    if (notfound) {
-                        result = p = new entryT(datum,p);
-                        ++ninbin;
-                    }
-                    gotlock = result->try_lock(lockmode);
-                    unlock();           // END CRITICAL SECTION
-                    if (!gotlock) waiter.wait(); //cpu_relax();
-                }
-                while (!gotlock);
+            std::size_t size() const {
+                return ninbin;
+            };
+
+        private:
+            // The following must be called with the bin locked
+
+            entryT* match(const keyT& key) const {
+                entryT* t;
+                for (t=p.load(std::memory_order_relaxed); t; t=t->next.load(std::memory_order_relaxed))
+                    if (t->datum.first == key) break;
+                return t;
+            }
 
+            std::pair<entryT*,bool> insert(const datumT& datum) {
+                entryT* result = match(datum.first);
+                const bool notfound = !result;
+                if (notfound) {
+                    result = new entryT(datum,p.load(std::memory_order_relaxed));
+                    MemoryAccounting::add(MemoryCategory::hashmap, sizeof(entryT));
+                    p.store(result, std::memory_order_release); // Publish the complete entry
+                    ++ninbin;
+                }
                 return std::pair<entryT*,bool>(result,notfound);
             }
 
             bool del(const keyT& key, int lockmode) {
-                bool status = false;
-                lock();             // BEGIN CRITICAL SECTION
-                for (entryT *t=p,*prev=0; t; prev=t,t=t->next) {
+                for (entryT *t=p.load(std::memory_order_relaxed),*prev=0; t; prev=t,t=t->next.load(std::memory_order_relaxed)) {
                     if (t->datum.first == key) {
                         if (prev) {
-                            prev->next = t->next;
+                            prev->next.store(t->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
                         }
                         else {
-                            p = t->next;
+                            p.store(t->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
                         }
                         t->unlock(lockmode);
                         delete t;
+                        MemoryAccounting::sub(MemoryCategory::hashmap, sizeof(entryT));
                         --ninbin;
-                        status = true;
-                        break;
+                        return true;
                     }
                 }
-                unlock();           // END CRITICAL SECTION
-                return status;
-            }
-
-            std::size_t size() const {
-                return ninbin;
-            };
-
-        private:
-            entryT* match(const keyT& key) const {
-                entryT* t;
-                for (t=p; t; t=t->next)
-                    if (t->datum.first == key) break;
-                return t;
+                return false;
             }
 
         };
 
         /// iterator for hash
+
+        /// An iterator made by begin() (and its copies) traverses the table
+        /// of the hash; the hash does not start growing while such an
+        /// iterator exists. An iterator made by find() or insert() points
+        /// into whichever table held the entry. If the hash has grown since,
+        /// incrementing it first completes the rehash and continues from the
+        /// entry's bin in the current table, so it still visits the entries
+        /// that follow (but not necessarily those that preceded it in the
+        /// old table). Incrementing it while other threads insert is
+        /// not thread safe.
         template <class hashT> class HashIterator {
         public:
             typedef typename std::conditional<std::is_const<hashT>::value,
@@ -193,6 +177,7 @@ namespace madness {
             typedef typename std::conditional<std::is_const<hashT>::value,
                     typename std::add_const<typename hashT::datumT>::type,
                     typename hashT::datumT>::type datumT;
+            typedef typename std::remove_const<hashT>::type::tableT tableT;
             typedef std::forward_iterator_tag iterator_category;
             typedef datumT value_type;
             typedef std::ptrdiff_t difference_type;
@@ -201,43 +186,59 @@ namespace madness {
 
         private:
             hashT* h;               // Associated hash table
+            const tableT* t;        // Table holding the current bin
             int bin;                // Current bin
             entryT* entry;          // Current entry in bin ... zero means at end
+            bool traversal;         // True if registered with h as a traversal
+            std::size_t gen;        // Growth count of h for which t is its only table (unless stale)
+
+            static const std::size_t stale = ~std::size_t(0);
 
             template <class otherHashT>
             friend class HashIterator;
+            template <class a,class b,class c> friend class madness::ConcurrentHashMap;
 
             /// If the entry is null (end of current bin) finds next non-empty bin
             void next_non_null_entry() {
                 while (!entry) {
                     ++bin;
-                    if ((unsigned) bin == h->nbins) {
+                    if ((unsigned) bin == t->nbins) {
                         entry = 0;
                         return;
                     }
-                    entry = h->bins[bin].p;
+                    entry = t->bins[bin].p;
                 }
                 return;
             }
 
+            void release() {
+                if (traversal) h->end_traversal();
+                traversal = false;
+            }
+
         public:
 
             /// Makes invalid iterator
-            HashIterator() : h(0), bin(-1), entry(0) {}
+            HashIterator() : h(0), t(0), bin(-1), entry(0), traversal(false), gen(stale) {}
 
             /// Makes begin/end iterator
             HashIterator(hashT* h, bool begin)
-                    : h(h), bin(-1), entry(0) {
-                if (begin) next_non_null_entry();
+                    : h(h), t(0), bin(-1), entry(0), traversal(begin), gen(stale) {
+                if (begin) {
+                    t = h->begin_traversal();
+                    next_non_null_entry();
+                }
             }
 
-            /// Makes iterator to specific entry
-            HashIterator(hashT* h, int bin, entryT* entry)
-                    : h(h), bin(bin), entry(entry) {}
+            /// Makes iterator to specific entry of table t, valid while h has grown gen times
+            HashIterator(hashT* h, const tableT* t, int bin, entryT* entry, std::size_t gen)
+                    : h(h), t(t), bin(bin), entry(entry), traversal(false), gen(gen) {}
 
             /// Copy constructor
             HashIterator(const HashIterator& other)
-                    : h(other.h), bin(other.bin), entry(other.entry) {}
+                    : h(other.h), t(other.t), bin(other.bin), entry(other.entry), traversal(other.traversal), gen(other.gen) {
+                if (traversal) h->copy_traversal();
+            }
 
             /// Implicit conversion of another hash type to this hash type
 
@@ -245,12 +246,35 @@ namespace madness {
             /// types.
             template <class otherHashT>
             HashIterator(const HashIterator<otherHashT>& other)
-                    : h(other.h), bin(other.bin), entry(other.entry) {}
+                    : h(other.h), t(other.t), bin(other.bin), entry(other.entry), traversal(other.traversal), gen(other.gen) {
+                if (traversal) h->copy_traversal();
+            }
+
+            HashIterator& operator=(const HashIterator& other) {
+                if (other.traversal) other.h->copy_traversal();
+                release();
+                h = other.h;
+                t = other.t;
+                bin = other.bin;
+                entry = other.entry;
+                traversal = other.traversal;
+                gen = other.gen;
+                return *this;
+            }
+
+            ~HashIterator() {
+                release();
+            }
 
             HashIterator& operator++() {
                 if (!entry) return *this;
-                entry = entry->next;
-                next_non_null_entry();
+                if (traversal) {
+                    entry = entry->next;
+                    next_non_null_entry();
+                }
+                else {
+                    h->increment(*this);
+                }
                 return *this;
             }
 
@@ -275,6 +299,10 @@ namespace madness {
             void advance(int n) {
                 if (n==0 || !entry) return;
                 MADNESS_ASSERT(n>=0);
+                if (!traversal) {
+                    while (n-- && entry) operator++();
+                    return;
+                }
 
                 // Linear increment up to end of this bin
                 while (n-- && (entry=entry->next)) {}
@@ -286,16 +314,16 @@ namespace madness {
                 // If here, will point to first entry in
                 // a bin ... determine which bin contains
                 // our end point.
-                while (unsigned(n) >= h->bins[bin].size()) {
-                    n -= h->bins[bin].size();
+                while (unsigned(n) >= t->bins[bin].size()) {
+                    n -= t->bins[bin].size();
                     ++bin;
-                    if (unsigned(bin) == h->nbins) {
+                    if (unsigned(bin) == t->nbins) {
                         entry = 0;
                         return; // end
                     }
                 }
 
-                entry = h->bins[bin].p;
+                entry = t->bins[bin].p;
                 MADNESS_ASSERT(entry);
 
                 // Linear increment to target
@@ -304,7 +332,6 @@ namespace madness {
                 return;
             }
 
-
             bool operator==(const HashIterator& a) const {
                 return entry==a.entry;
             }
@@ -392,6 +419,33 @@ namespace madness {
 
     } // End of namespace Hash_private
 
+    /// Load-factor statistics of a ConcurrentHashMap
+    struct ConcurrentHashMapStats {
+        std::size_t nbins;       ///< No. of bins in the current table
+        std::size_t nentries;    ///< No. of entries
+        double load_factor;      ///< Mean no. of entries per bin
+        std::size_t max_chain;   ///< Longest chain of entries in one bin
+        std::size_t nempty;      ///< No. of empty bins
+        std::size_t ngrow;       ///< No. of times the table has grown
+        bool rehashing;          ///< True if entries are still being moved into the current table
+    };
+
+    /// A concurrent hashmap that grows as entries are added
+
+    /// When the load factor exceeds max_load_factor() an insertion starts a
+    /// larger table. The entries are then moved into it bin by bin by the
+    /// threads that insert (a few bins each), so no one waits for the whole
+    /// table to be rehashed. Lookups never take more than the spinlock of
+    /// the bin they search, and an entry stays at the same address when it
+    /// moves, so accessors and iterators to single entries remain valid.
+    /// Growth does not start while an iteration from begin() is live;
+    /// begin() itself completes a rehash in progress. A table that has been
+    /// emptied into its successor is freed as soon as no thread is inside
+    /// an operation on the map that may still be reading it.
+    ///
+    /// A map constructed as insert-only never erases entries, so find(key)
+    /// searches it without taking any lock. This suits write-once caches
+    /// that are read far more often than they are filled.
     template < class keyT, class valueT, class hashfunT = Hash<keyT> >
     class ConcurrentHashMap {
     public:
@@ -408,13 +462,42 @@ namespace madness {
         friend class Hash_private::HashIterator<const hashT>;
 
     protected:
-        const size_t nbins;         // Number of bins
-        binT* bins;                 // Array of bins
+        /// An array of bins; while rehashing the old table points to the new one
+        struct tableT {
+            const size_t nbins;                 // Number of bins
+            binT* const bins;                   // Array of bins
+            tableT* next;                       // Larger table the entries are moving into
+            tableT* retired;                    // Next emptied table waiting to be freed
+            std::atomic<size_t> cursor;         // Next bin to rehash into next
+            std::atomic<size_t> nmoved;         // No. of bins rehashed into next
+
+            tableT(size_t nbins)
+                : nbins(nbins), bins(new binT[nbins]), next(0), retired(0), cursor(0), nmoved(0) {
+                MemoryAccounting::add(MemoryCategory::hashmap, nbins*sizeof(binT));
+            }
+
+            ~tableT() {
+                delete [] bins;
+                MemoryAccounting::sub(MemoryCategory::hashmap, nbins*sizeof(binT));
+            }
+        };
 
     private:
+        std::atomic<tableT*> cur;           // Table that receives new entries
+        mutable std::atomic<tableT*> old;   // Table being rehashed into cur, or null
+        std::atomic<size_t> nentries;       // Number of entries
+        mutable std::atomic<long> ntraversal; // Number of live iterators from begin()
+        mutable std::atomic<long> nreader;  // Number of threads that may be reading a table
+        mutable tableT* retired;            // Emptied tables waiting for nreader to drop to zero
+        mutable std::atomic<size_t> nretired; // Number of tables in retired
+        Spinlock resize_mutex;              // Serializes the start of growth with begin()
+        Spinlock retire_mutex;              // Protects retired
+        float max_load_factor_;             // Grow when nentries > max_load_factor_*nbins (never if zero)
+        std::atomic<size_t> ngrow;          // Number of times the table has grown
+        const bool insert_only_;            // If true entries are never erased and find(key) takes no lock
         hashfunT hashfun;
 
-        //unsigned int hash(const keyT& key) const {return hashfunT::hash(key)%nbins;}
+        static const int nrehash_per_insert = 2; // Bins moved to the new table by each insertion
 
         static int nbins_prime(int n) {
             static const int primes[] = {11, 23, 31, 41, 53, 61, 71, 83, 101,
@@ -432,31 +515,329 @@ namespace madness {
             return primes[nprimes-1];
         }
 
-        unsigned int hash_to_bin(const keyT& key) const {
-            return hashfun(key)%nbins;
+        /// Registers the calling thread as a reader of the tables for its lifetime
+
+        /// A table is retired once the rehash out of it completes, after
+        /// which no new reader can reach it through cur or old. It is freed
+        /// when the number of readers is next seen to be zero.
+        class ReaderGuard : private NO_DEFAULTS {
+            const hashT* h;
+        public:
+            ReaderGuard(const hashT* h) : h(h) {
+                ++(h->nreader);
+            }
+
+            ~ReaderGuard() {
+                if (--(h->nreader) == 0 && h->nretired.load(std::memory_order_relaxed)) h->reclaim();
+            }
+        };
+
+        /// Queues an emptied table to be freed once no reader remains
+        void retire(tableT* t) const {
+            ScopedMutex<Spinlock> guard(retire_mutex);
+            t->retired = retired;
+            retired = t;
+            ++nretired;
+        }
+
+        /// Frees the retired tables if there are no readers
+        void reclaim() const {
+            tableT* t = 0;
+            {
+                ScopedMutex<Spinlock> guard(retire_mutex);
+                // Tables were retired before this, so a reader that starts
+                // after the count is read cannot find them
+                if (nreader == 0) {
+                    t = retired;
+                    retired = 0;
+                }
+            }
+            while (t) {
+                tableT* next = t->retired;
+                delete t;
+                --nretired;
+                t = next;
+            }
+        }
+
+        /// Returns the growth count for an iterator into table t, or stale if t may be superseded
+
+        /// g must have been read before t was looked up
+        size_t iterator_generation(size_t g, const tableT* t) const {
+            if (t == cur.load() && !old.load()) return g;
+            return iterator::stale;
+        }
+
+        /// Advances an iterator made by find() or insert() to the next entry
+        template <typename iteratorT>
+        void increment(iteratorT& it) const {
+            ReaderGuard reader(this);
+            if (it.gen != ngrow || old.load()) {
+                // it.t may have been freed ... resume from the bin now holding the entry
+                finish_rehash();
+                const size_t g = ngrow;
+                it.t = cur.load();
+                it.bin = hashfun(it.entry->datum.first)%it.t->nbins;
+                it.gen = iterator_generation(g, it.t);
+            }
+            it.entry = it.entry->next;
+            it.next_non_null_entry();
+        }
+
+        /// Locks and returns the bin that holds (or will hold) key
+
+        /// While a rehash is in progress this is the bin of the old table,
+        /// unless that has already been moved into the new one.
+        binT* lock_bin(const keyT& key, tableT*& t, int& bin) const {
+            const auto h = hashfun(key);
+            while (true) {
+                // cur is published after old, so load it first
+                tableT* c = cur.load();
+                tableT* o = old.load();
+                if (o && o != c) {
+                    bin = h%o->nbins;
+                    binT* b = o->bins + bin;
+                    b->lock();
+                    if (!b->moved) {
+                        t = o;
+                        return b;
+                    }
+                    b->unlock();
+                }
+                bin = h%c->nbins;
+                binT* b = c->bins + bin;
+                b->lock();
+                if (!b->moved) {
+                    t = c;
+                    return b;
+                }
+                b->unlock(); // c has been superseded meanwhile
+            }
+        }
+
+        /// Moves the entries of bin i of table o into its successor
+        void rehash_bin(tableT* o, size_t i) const {
+            tableT* n = o->next;
+            binT& from = o->bins[i];
+            from.lock();            // BEGIN CRITICAL SECTION
+            // A lock-free reader following e->next may be led into the new
+            // bin and miss the entries left behind ... see find_lockfree
+            while (entryT* e = from.p.load(std::memory_order_relaxed)) {
+                from.p.store(e->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                binT& to = n->bins[hashfun(e->datum.first)%n->nbins];
+                to.lock();
+                e->next.store(to.p.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                to.p.store(e, std::memory_order_release);
+                ++to.ninbin;
+                to.unlock();
+            }
+            from.ninbin = 0;
+            from.moved = true;
+            from.unlock();          // END CRITICAL SECTION
+        }
+
+        /// Moves up to nbin bins of a rehash in progress into the new table
+        void rehash_some(size_t nbin) const {
+            ReaderGuard reader(this);
+            tableT* o = old.load();
+            // Wait until grow() has published the new table, lest o be
+            // retired while a reader may still find it as cur
+            if (!o || cur.load() != o->next) return;
+            while (nbin--) {
+                const size_t i = o->cursor++;
+                if (i >= o->nbins) return;
+                rehash_bin(o, i);
+                if (++(o->nmoved) == o->nbins) {
+                    old.store(0);
+                    retire(o);
+                    return;
+                }
+            }
+        }
+
+        /// Completes a rehash in progress
+        void finish_rehash() const {
+            ReaderGuard reader(this);
+            MutexWaiter waiter;
+            while (tableT* o = old.load()) {
+                rehash_some(o->nbins);
+                if (old.load() == o) waiter.wait(); // Others are moving the last bins
+            }
+        }
+
+        /// Starts rehashing into a table about twice as large if the load factor is exceeded
+        void grow() {
+            ScopedMutex<Spinlock> guard(resize_mutex);
+            tableT* c = cur.load(std::memory_order_relaxed);
+            if (old.load(std::memory_order_relaxed) || ntraversal || max_load_factor_ <= 0 ||
+                nentries <= max_load_factor_*c->nbins) return;
+            const size_t n = nbins_prime(2*c->nbins);
+            if (n <= c->nbins) return; // Already as large as it gets
+            c->next = new tableT(n);
+            ++ngrow; // Before publishing, so that an iterator into c cannot claim the new count
+            old.store(c);
+            cur.store(c->next);
+        }
+
+        /// Called after inserting an entry
+        void inserted() {
+            const size_t n = ++nentries;
+            if (old.load(std::memory_order_relaxed))
+                rehash_some(nrehash_per_insert);
+            else if (n > max_load_factor_*cur.load(std::memory_order_relaxed)->nbins && max_load_factor_ > 0)
+                grow();
+        }
+
+        /// Registers an iteration from begin() and returns the (stable) table it traverses
+        const tableT* begin_traversal() const {
+            {
+                ScopedMutex<Spinlock> guard(resize_mutex);
+                ++ntraversal;
+            }
+            finish_rehash();
+            return cur.load(); // Cannot be superseded (and freed) while the traversal lives
+        }
+
+        void copy_traversal() const {
+            ++ntraversal;
+        }
+
+        void end_traversal() const {
+            --ntraversal;
+        }
+
+        std::pair<entryT*,bool> insert_entry(const datumT& datum, int lockmode, tableT*& t, int& bin) {
+            ReaderGuard reader(this);
+            std::pair<entryT*,bool> result;
+            bool gotlock;
+            madness::MutexWaiter waiter;
+            do {
+                binT* b = lock_bin(datum.first, t, bin);    // BEGIN CRITICAL SECTION
+                result = b->insert(datum);
+                gotlock = result.first->try_lock(lockmode);
+                b->unlock();                                // END CRITICAL SECTION
+                if (!gotlock) waiter.wait(); //cpu_relax();
+            }
+            while (!gotlock);
+
+            if (result.second) inserted();
+            return result;
+        }
+
+        entryT* find_entry(const keyT& key, int lockmode, tableT*& t, int& bin) const {
+            ReaderGuard reader(this);
+            bool gotlock;
+            entryT* result;
+            madness::MutexWaiter waiter;
+            do {
+                binT* b = lock_bin(key, t, bin);    // BEGIN CRITICAL SECTION
+                result = b->match(key);
+                if (result) {
+                    gotlock = result->try_lock(lockmode);
+                }
+                else {
+                    gotlock = true;
+                }
+                b->unlock();                        // END CRITICAL SECTION
+                if (!gotlock) waiter.wait(); //cpu_relax();
+            }
+            while (!gotlock);
+
+            return result;
+        }
+
+        /// Searches the bin of key in table t without taking any lock
+        static entryT* search_lockfree(const tableT* t, std::size_t h, const keyT& key, int& bin) {
+            bin = h%t->nbins;
+            for (entryT* e=t->bins[bin].p.load(std::memory_order_acquire); e; e=e->next.load(std::memory_order_acquire))
+                if (e->datum.first == key) return e;
+            return 0;
+        }
+
+        /// Searches an insert-only map for key without taking any lock
+
+        /// Entries are never freed while the map exists, so any chain can be
+        /// followed safely. A miss is not conclusive, since the entry may
+        /// just be moving to a larger table, and must be confirmed by
+        /// find_entry.
+        entryT* find_lockfree(const keyT& key, tableT*& t, int& bin) const {
+            ReaderGuard reader(this);
+            const std::size_t h = hashfun(key);
+            tableT* c = cur.load();
+            tableT* o = old.load();
+            if (entryT* e = search_lockfree(c, h, key, bin)) {
+                t = c;
+                return e;
+            }
+            if (o && o != c) {
+                if (entryT* e = search_lockfree(o, h, key, bin)) {
+                    t = o;
+                    return e;
+                }
+            }
+            return 0;
+        }
+
+        bool erase_entry(const keyT& key, int lockmode) {
+            if (insert_only_) MADNESS_EXCEPTION("ConcurrentHashMap: cannot erase from an insert-only map", 0);
+            ReaderGuard reader(this);
+            tableT* t;
+            int bin;
+            binT* b = lock_bin(key, t, bin);    // BEGIN CRITICAL SECTION
+            const bool status = b->del(key, lockmode);
+            b->unlock();                        // END CRITICAL SECTION
+            if (status) --nentries;
+            return status;
         }
 
     public:
-        ConcurrentHashMap(int n=1021, const hashfunT& hf = hashfunT())
-                : nbins(hashT::nbins_prime(n))
-                , bins(new binT[nbins])
+        /// Makes an empty map with about n bins
+
+        /// If insert_only is true entries can never be erased (except by
+        /// clear()) and find(key) takes no lock.
+        ConcurrentHashMap(int n=1021, const hashfunT& hf = hashfunT(), bool insert_only = false)
+                : cur(new tableT(hashT::nbins_prime(n)))
+                , old(0)
+                , nentries(0)
+                , ntraversal(0)
+                , nreader(0)
+                , retired(0)
+                , nretired(0)
+                , max_load_factor_(1.0)
+                , ngrow(0)
+                , insert_only_(insert_only)
                 , hashfun(hf) {}
 
         ConcurrentHashMap(const  hashT& h)
-                : nbins(h.nbins)
-                , bins(new binT[nbins])
+                : cur(new tableT(h.bucket_count()))
+                , old(0)
+                , nentries(0)
+                , ntraversal(0)
+                , nreader(0)
+                , retired(0)
+                , nretired(0)
+                , max_load_factor_(h.max_load_factor_)
+                , ngrow(0)
+                , insert_only_(h.insert_only_)
                 , hashfun(h.hashfun) {
             *this = h;
         }
 
         virtual ~ConcurrentHashMap() {
-            delete [] bins;
+            while (tableT* t = retired) {
+                retired = t->retired;
+                delete t;
+            }
+            tableT* o = old.load();
+            if (o && o != cur.load()) delete o;
+            delete cur.load();
         }
 
         hashT& operator=(const  hashT& h) {
             if (this != &h) {
                 this->clear();
                 hashfun = h.hashfun;
+                max_load_factor_ = h.max_load_factor_;
                 for (const_iterator p=h.begin(); p!=h.end(); ++p) {
                     [[maybe_unused]] auto&& [it, inserted] = insert(*p);
                     MADNESS_ASSERT(inserted);
@@ -466,16 +847,19 @@ namespace madness {
         }
 
         [[nodiscard]] std::pair<iterator,bool> insert(const datumT& datum) {
-            int bin = hash_to_bin(datum.first);
-            std::pair<entryT*,bool> result = bins[bin].insert(datum,entryT::NOLOCK);
-            return std::pair<iterator,bool>(iterator(this,bin,result.first),result.second);
+            const size_t g = ngrow;
+            tableT* t;
+            int bin;
+            std::pair<entryT*,bool> result = insert_entry(datum,entryT::NOLOCK,t,bin);
+            return std::pair<iterator,bool>(iterator(this,t,bin,result.first,iterator_generation(g,t)),result.second);
         }
 
         /// Returns true if new pair was inserted; false if key is already in the map and the datum was not inserted
         [[nodiscard]] bool insert(accessor& result, const datumT& datum) {
             result.release();
-            int bin = hash_to_bin(datum.first);
-            std::pair<entryT*,bool> r = bins[bin].insert(datum,entryT::WRITELOCK);
+            tableT* t;
+            int bin;
+            std::pair<entryT*,bool> r = insert_entry(datum,entryT::WRITELOCK,t,bin);
             result.set(r.first);
             return r.second;
         }
@@ -483,8 +867,9 @@ namespace madness {
         /// Returns true if new pair was inserted; false if key is already in the map and the datum was not inserted
         [[nodiscard]] bool insert(const_accessor& result, const datumT& datum) {
             result.release();
-            int bin = hash_to_bin(datum.first);
-            std::pair<entryT*,bool> r = bins[bin].insert(datum,entryT::READLOCK);
+            tableT* t;
+            int bin;
+            std::pair<entryT*,bool> r = insert_entry(datum,entryT::READLOCK,t,bin);
             result.set(r.first);
             return r.second;
         }
@@ -500,7 +885,7 @@ namespace madness {
         }
 
         [[nodiscard]] bool try_erase(const keyT& key) {
-            if (bins[hash_to_bin(key)].del(key,entryT::NOLOCK)) return true;
+            if (erase_entry(key,entryT::NOLOCK)) return true;
             else return false;
         }
 
@@ -511,34 +896,41 @@ namespace madness {
         }
 
         void erase(accessor& item) {
-            bins[hash_to_bin(item->first)].del(item->first,entryT::WRITELOCK);
+            erase_entry(item->first,entryT::WRITELOCK);
             item.unset();
         }
 
         void erase(const_accessor& item) {
             item.convert_read_lock_to_write_lock();
-            bins[hash_to_bin(item->first)].del(item->first,entryT::WRITELOCK);
+            erase_entry(item->first,entryT::WRITELOCK);
             item.unset();
         }
 
         [[nodiscard]] iterator find(const keyT& key) {
-            int bin = hash_to_bin(key);
-            entryT* entry = bins[bin].find(key,entryT::NOLOCK);
+            const size_t g = ngrow;
+            tableT* t;
+            int bin;
+            entryT* entry = insert_only_ ? find_lockfree(key,t,bin) : 0;
+            if (!entry) entry = find_entry(key,entryT::NOLOCK,t,bin);
             if (!entry) return end();
-            else return iterator(this,bin,entry);
+            else return iterator(this,t,bin,entry,iterator_generation(g,t));
         }
 
         [[nodiscard]] const_iterator find(const keyT& key) const {
-            int bin = hash_to_bin(key);
-            const entryT* entry = bins[bin].find(key,entryT::NOLOCK);
+            const size_t g = ngrow;
+            tableT* t;
+            int bin;
+            const entryT* entry = insert_only_ ? find_lockfree(key,t,bin) : 0;
+            if (!entry) entry = find_entry(key,entryT::NOLOCK,t,bin);
             if (!entry) return end();
-            else return const_iterator(this,bin,entry);
+            else return const_iterator(this,t,bin,entry,iterator_generation(g,t));
         }
 
         [[nodiscard]] bool find(accessor& result, const keyT& key) {
             result.release();
-            int bin = hash_to_bin(key);
-            entryT* entry = bins[bin].find(key,entryT::WRITELOCK);
+            tableT* t;
+            int bin;
+            entryT* entry = find_entry(key,entryT::WRITELOCK,t,bin);
             bool foundit = entry;
             if (foundit) result.set(entry);
             return foundit;
@@ -546,21 +938,30 @@ namespace madness {
 
         [[nodiscard]] bool find(const_accessor& result, const keyT& key) const {
             result.release();
-            int bin = hash_to_bin(key);
-            entryT* entry = bins[bin].find(key,entryT::READLOCK);
+            tableT* t;
+            int bin;
+            entryT* entry = find_entry(key,entryT::READLOCK,t,bin);
             bool foundit = entry;
             if (foundit) result.set(entry);
             return foundit;
         }
 
+        /// Erases all entries
+
+        /// For an insert-only map this must not overlap with any other use of the map
         void clear() {
-            for (unsigned int i=0; i<nbins; ++i) bins[i].clear();
+            ReaderGuard reader(this);
+            finish_rehash();
+            tableT* t = cur.load();
+            for (unsigned int i=0; i<t->nbins; ++i) {
+                const size_t n = t->bins[i].size();
+                t->bins[i].clear();
+                nentries -= n;
+            }
         }
 
         [[nodiscard]] size_t size() const {
-            size_t sum = 0;
-            for (size_t i=0; i<nbins; ++i) sum += bins[i].size();
-            return sum;
+            return nentries;
         }
 
         [[nodiscard]] valueT& operator[](const keyT& key) {
@@ -594,12 +995,69 @@ namespace madness {
 
         const hashfunT& get_hash() const { return hashfun; }
 
+        /// Returns true if entries are never erased and find(key) takes no lock
+        [[nodiscard]] bool is_insert_only() const {
+            return insert_only_;
+        }
+
+        /// Returns the number of bins of the current table
+        [[nodiscard]] size_t bucket_count() const {
+            ReaderGuard reader(this);
+            return cur.load()->nbins;
+        }
+
+        /// Returns the mean number of entries per bin
+        [[nodiscard]] float load_factor() const {
+            return float(size())/bucket_count();
+        }
+
+        /// Returns the load factor above which the table grows
+        [[nodiscard]] float max_load_factor() const {
+            return max_load_factor_;
+        }
+
+        /// Sets the load factor above which the table grows (zero disables growth)
+        void max_load_factor(float f) {
+            max_load_factor_ = std::max(f, 0.0f);
+        }
+
+        /// Returns the load-factor statistics
+
+        /// Not thread safe with respect to concurrent modification
+        ConcurrentHashMapStats get_stats() const {
+            ReaderGuard reader(this);
+            ConcurrentHashMapStats stats;
+            const tableT* c = cur.load();
+            const tableT* o = old.load();
+            stats.nbins = c->nbins;
+            stats.nentries = size();
+            stats.load_factor = double(stats.nentries)/stats.nbins;
+            stats.max_chain = stats.nempty = 0;
+            for (size_t i=0; i<c->nbins; ++i) {
+                const size_t n = c->bins[i].size();
+                stats.max_chain = std::max(stats.max_chain, n);
+                if (n == 0) ++stats.nempty;
+            }
+            if (o && o != c)
+                for (size_t i=0; i<o->nbins; ++i)
+                    stats.max_chain = std::max(stats.max_chain, o->bins[i].size());
+            stats.ngrow = ngrow;
+            stats.rehashing = (o != 0);
+            return stats;
+        }
+
         void print_stats() const {
-            for (unsigned int i=0; i<nbins; ++i) {
+            ReaderGuard reader(this);
+            finish_rehash();
+            const tableT* t = cur.load();
+            for (unsigned int i=0; i<t->nbins; ++i) {
                 if (i && (i%10)==0) printf("\n");
-                printf("%8d", int(bins[i].size()));
+                printf("%8d", int(t->bins[i].size()));
             }
             printf("\n");
+            const ConcurrentHashMapStats stats = get_stats();
+            printf("nbins=%zu nentries=%zu load_factor=%.2f max_chain=%zu nempty=%zu ngrow=%zu\n",
+                   stats.nbins, stats.nentries, stats.load_factor, stats.max_chain, stats.nempty, stats.ngrow);
         }
     };
 }
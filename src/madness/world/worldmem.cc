@@ -100,6 +100,22 @@ namespace madness {
             << cur_num_frags << " " << std::setw(12) << max_num_frags << "\n";
         std::cout << "  cur and max bytes allocated " << std::setw(12)
             << cur_num_bytes << " " << std::setw(12) << max_num_bytes << "\n";
+
+        const PoolAllocatorStats pool = pool_stats();
+        std::cout << " pool allocs, frees and large " << std::setw(12)
+            << pool.nalloc << " " << std::setw(12) << pool.nfree << " "
+            << std::setw(12) << pool.nlarge << "\n";
+        std::cout << "      pool batches get and put " << std::setw(12)
+            << pool.nbatch_get << " " << std::setw(12) << pool.nbatch_put << "\n";
+        std::cout << "           pool bytes reserved " << std::setw(12)
+            << pool.nbytes << "\n";
+
+        for (std::size_t i=0; i<=std::size_t(MemoryCategory::ncategory); ++i) {
+            const MemoryCategory c = MemoryCategory(i);
+            const MemoryAccountingStats acc = MemoryAccounting::get_stats(c);
+            std::cout << std::setw(11) << MemoryAccounting::name(c) << " cur and max bytes "
+                << std::setw(12) << acc.current << " " << std::setw(12) << acc.high_water << "\n";
+        }
     }
 
     void WorldMemInfo::reset() {
@@ -36,6 +36,8 @@
 */
 
 #include <madness/madness_config.h>
+#include <madness/world/pool_allocator.h>
+#include <madness/world/memory_accounting.h>
 #include <string>
 #ifdef WORLD_GATHER_MEM_STATS
 #include <new>
@@ -95,6 +97,22 @@ namespace madness {
         /// Prints memory use statistics to std::cout
         void print() const;
 
+        /// Statistics of the pools that hold tasks and futures (see \c PoolAllocator)
+
+        /// Unlike the counters above these are gathered whether or not
+        /// WORLD_GATHER_MEM_STATS is enabled.
+        PoolAllocatorStats pool_stats() const {
+            return PoolAllocator::get_stats();
+        }
+
+        /// Memory held by one subsystem (see \c MemoryAccounting)
+
+        /// Like the pool statistics these are gathered whether or not
+        /// WORLD_GATHER_MEM_STATS is enabled.
+        MemoryAccountingStats accounting_stats(MemoryCategory c) const {
+            return MemoryAccounting::get_stats(c);
+        }
+
         /// Resets all counters to zero
         void reset();
 
@@ -35,6 +35,7 @@
 */
 
 #include <madness/world/worldmpi.h>
+#include <algorithm>
 
 namespace madness {
     namespace detail {
@@ -57,4 +58,75 @@ namespace madness {
         /// @}
 
     } // namespace detail
+
+    void WorldMpiInterface::init_nodes() {
+        const int np = size();
+        const int me = rank();
+
+        // Lowest rank on the node of each process
+        std::vector<int> leaders(np, 0);
+        if (np > 1) {
+            int leader = me;
+            const char* mad_ranks_per_node = std::getenv("MAD_RANKS_PER_NODE");
+            if (mad_ranks_per_node) {
+                const int n = std::max(std::atoi(mad_ranks_per_node), 1);
+                leader = (me/n)*n;
+            }
+            else {
+                SafeMPI::Intracomm node = Split_type(SafeMPI::Intracomm::SHARED_SPLIT_TYPE, me);
+                node.Allreduce(&me, &leader, 1, MPI_INT, MPI_MIN);
+            }
+            std::fill(leaders.begin(), leaders.end(), -1);
+            leaders[me] = leader;
+            Allreduce(MPI_IN_PLACE, leaders.data(), np, MPI_INT, MPI_MAX);
+        }
+
+        // Number the nodes in the order of their leaders
+        node_of_rank_.resize(np);
+        node_ranks_.clear();
+        std::vector<int> node_of_leader(np, -1);
+        for (int p=0; p<np; ++p) {
+            int& node = node_of_leader[leaders[p]];
+            if (node < 0) {
+                node = node_ranks_.size();
+                node_ranks_.emplace_back();
+            }
+            node_of_rank_[p] = node;
+            if (p == me) node_index_ = node_ranks_[node].size();
+            node_ranks_[node].push_back(p);
+        }
+    }
+
+    void WorldMpiInterface::node_tree_info(ProcessID root, ProcessID& parent, std::vector<ProcessID>& children) const {
+        const int nnode = node_ranks_.size();
+        const int rootnode = node_of_rank_[root];
+        const int mynode = node_of_rank_[rank()];
+        const std::vector<int>& ranks = node_ranks_[mynode];
+        const int n = ranks.size();
+
+        // Renumber the processes of this node so that its leader is 0
+        const int iroot = (mynode == rootnode) ?
+            std::lower_bound(ranks.begin(), ranks.end(), root) - ranks.begin() : 0;
+        auto pos = [iroot](int i) { return (i == iroot) ? 0 : ((i < iroot) ? i + 1 : i); };
+        auto process = [&](int p) { return ranks[(p == 0) ? iroot : ((p <= iroot) ? p - 1 : p)]; };
+        const int me = pos(node_index_);
+
+        parent = -1;
+        children.clear();
+        if (me == 0) {
+            // Binary tree of node leaders with the node of root renumbered to 0
+            auto leader = [&](int q) {
+                const int node = (q + rootnode) % nnode;
+                return (node == rootnode) ? root : node_ranks_[node].front();
+            };
+            const int q = (mynode - rootnode + nnode) % nnode;
+            if (q > 0) parent = leader((q - 1) >> 1);
+            for (int c = 2*q + 1; c <= 2*q + 2 && c < nnode; ++c) children.push_back(leader(c));
+        }
+        else {
+            parent = process((me - 1) >> 1);
+        }
+        for (int c = 2*me + 1; c <= 2*me + 2 && c < n; ++c) children.push_back(process(c));
+    }
+
 } // namespace madness
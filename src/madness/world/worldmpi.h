@@ -52,6 +52,7 @@
 */
 
 #include <type_traits>
+#include <vector>
 #include <madness/world/safempi.h>
 #include <madness/world/worldtypes.h>
 #include <cstdlib>
@@ -269,14 +270,27 @@ namespace madness {
         WorldMpiInterface(const WorldMpiInterface&) = delete;
         WorldMpiInterface& operator=(const WorldMpiInterface&) = delete;
 
+        std::vector<int> node_of_rank_; ///< Node of each process
+        std::vector< std::vector<int> > node_ranks_; ///< Sorted processes of each node
+        int node_index_; ///< Index of this process in its node
+
+        /// Finds the processes that share a node (collective).
+
+        /// Nodes are the shared-memory domains of MPI, or blocks of
+        /// consecutive ranks of size given by the environment variable
+        /// MAD_RANKS_PER_NODE.
+        void init_nodes();
+
     public:
         /// Constructs an interface in the specified \c SafeMPI communicator.
 
-        /// \todo Verify this documentation.
+        /// This is collective over the communicator.
         /// \param[in] comm The communicator.
         WorldMpiInterface(const SafeMPI::Intracomm& comm) :
-            detail::WorldMpiRuntime(), SafeMPI::Intracomm(comm)
-        { }
+            detail::WorldMpiRuntime(), SafeMPI::Intracomm(comm), node_index_(0)
+        {
+            init_nodes();
+        }
 
         ~WorldMpiInterface() = default;
 
@@ -447,6 +461,31 @@ namespace madness {
 
         /// \return The number of processes.
         int size() const { return SafeMPI::Intracomm::Get_size(); }
+
+        /// Access the number of nodes.
+
+        /// \return The number of nodes spanned by the processes.
+        int nnode() const { return node_ranks_.size(); }
+
+        /// Access the node of a process.
+
+        /// \param[in] p The process.
+        /// \return The index of the node of process \c p.
+        int node_of(ProcessID p) const { return node_of_rank_[p]; }
+
+        /// Construct info about a node-aware tree with given root.
+
+        /// The processes of each node form a binary tree under a node leader
+        /// (\c root on its own node, elsewhere the lowest rank), and the node
+        /// leaders form a binary tree with the node of \c root at its top.
+        /// Only one message per node thus crosses the network on the way up
+        /// or down, instead of about one per process with the flat tree of
+        /// binary_tree_info(). A leader has up to two children on other
+        /// nodes, listed first, and up to two on its own node.
+        /// \param[in] root The root of the tree.
+        /// \param[out] parent The parent of this process, -1 if none.
+        /// \param[out] children The children of this process.
+        void node_tree_info(ProcessID root, ProcessID& parent, std::vector<ProcessID>& children) const;
     }; // class WorldMpiInterface
 
 }
@@ -37,6 +37,7 @@
 #include <madness/world/worldrmi.h>
 #include <madness/world/worldtypes.h>
 #include <madness/world/worldmutex.h>
+#include <madness/world/runtime_profiler.h>
 #include <string>
 #include <vector>
 
@@ -187,8 +188,9 @@ namespace madness {
     };
 }
 
+#define PROFILE_STRINGIFY(s) #s
+
 #ifdef WORLD_PROFILE_ENABLE
-#  define PROFILE_STRINGIFY(s) #s
 
 #  define PROFILE_BLOCK(name)                                             \
     static const int __name##_id=madness::WorldProfile::register_id(PROFILE_STRINGIFY(name)); \
@@ -205,9 +207,16 @@ namespace madness {
 
 #else
 
-#  define PROFILE_BLOCK(name)
-#  define PROFILE_FUNC
-#  define PROFILE_MEMBER_FUNC(classname)
+// Without WorldProfile the regions are timed by RuntimeProfiler when it is enabled
+
+#  define PROFILE_BLOCK(name)                                             \
+    madness::RuntimeProfileRegion name("", PROFILE_STRINGIFY(name))
+
+#  define PROFILE_FUNC                                                    \
+    madness::RuntimeProfileRegion __profile_obj("", __FUNCTION__)
+
+#  define PROFILE_MEMBER_FUNC(classname)                                  \
+    madness::RuntimeProfileRegion __profile_obj(PROFILE_STRINGIFY(classname), __FUNCTION__)
 
 #endif
 
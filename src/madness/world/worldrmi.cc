@@ -33,9 +33,14 @@
 
 #include <madness/world/worldrmi.h>
 #include <madness/world/posixmem.h>
+#include <madness/world/pool_allocator.h>
+#include <madness/world/runtime_profiler.h>
+#include <madness/world/memory_accounting.h>
 #include <madness/world/timers.h>
 #include <madness/world/units.h>
 #include <iostream>
+#include <cstring>
+#include <string>
 #include <algorithm>
 #include <utility>
 #include <sstream>
@@ -52,11 +57,26 @@ namespace madness {
     bool RMI::debugging = false;
     std::list< std::unique_ptr<RMISendReq> > RMI::send_req;
 
+    // Interval (s) over which the use of the recv buffers is judged before shrinking the pool
+    static const double recv_window = 1.0;
+
     bool& RMI::is_server_thread_accessor() {
       static thread_local bool is_server_thread = false;
       return is_server_thread;
     }
 
+    /// Identifies handler \c func to the profilers (as a function pointer)
+    static std::pair<void*,unsigned short> profile_id(rmi_handlerT func) {
+        return std::pair<void*,unsigned short>(reinterpret_cast<void*>(func), 1);
+    }
+
+#ifdef MADNESS_TASK_PROFILING
+    /// Record an RMI send or receive of a message for handler \c func
+    static void profile_rmi(profiling::EventKind kind, rmi_handlerT func,
+                            int peer, std::size_t nbyte, double start) {
+        profiling::TaskProfiler::record(kind, profile_id(func), peer, nbyte, start, wall_time());
+    }
+#endif // MADNESS_TASK_PROFILING
 
     void RMI::RmiTask::process_some() {
 
@@ -78,21 +98,42 @@ namespace madness {
           if (narrived) break;
           ++iterations;
           clear_send_req();
+          if (nbatch_open) flush(true);
+          clear_batch_req();
+          if (npending) progress_pending();
           myusleep(RMI::testsome_backoff_us);
         }
 
+        // Under steady incoming traffic the loop above exits at once, so
+        // also send the expired batches and pending messages on every pass
+        if (narrived && nbatch_open) flush(true);
+        if (narrived && npending) progress_pending();
+
 #ifndef HAVE_CRAYXT
         waiter.reset();
 #endif
 
+        // Recv buffers holding unprocessed messages
+        std::size_t inuse = std::max(narrived, 0) + n_in_q;
+
         if (print_debug_info && narrived > 0)
             print_error(rank, ":RMI: ", narrived, " messages just arrived\n");
 
         if (narrived) {
             for (int m=0; m<narrived; ++m) {
+                const int i = ind[m];
+                if (recv_cancelled[i]) {
+                    recv_cancelled[i] = false;
+                    if (status[m].Is_cancelled()) {
+                        // A surplus buffer released when the pool shrank
+                        --inuse;
+                        post_recv_buf(i);
+                        continue;
+                    }
+                }
+
                 const int src = status[m].Get_source();
                 const size_t len = status[m].Get_count(MPI_BYTE);
-                const int i = ind[m];
 
                 ++(RMI::stats.nmsg_recv);
                 RMI::stats.nbyte_recv += len;
@@ -111,7 +152,16 @@ namespace madness {
                                   " count=", count, "\n");
 
                     if (is_ordered(attr)) ++(recv_counters[src]);
-                    func(recv_buf[i], len);
+                    {
+                        RuntimeProfileSample sample(RuntimeProfileKind::rmi, profile_id(func));
+#ifdef MADNESS_TASK_PROFILING
+                        const double start = wall_time();
+                        func(recv_buf[i], len);
+                        profile_rmi(profiling::EventKind::rmi_recv, func, src, len, start);
+#else
+                        func(recv_buf[i], len);
+#endif // MADNESS_TASK_PROFILING
+                    }
                     post_recv_buf(i);
                 }
                 else {
@@ -150,7 +200,16 @@ namespace madness {
                                 " count=", q[m].count, "\n");
 
                   ++(recv_counters[src]);
-                  q[m].func(recv_buf[q[m].i], q[m].len);
+                  {
+                      RuntimeProfileSample sample(RuntimeProfileKind::rmi, profile_id(q[m].func));
+#ifdef MADNESS_TASK_PROFILING
+                      const double start = wall_time();
+                      q[m].func(recv_buf[q[m].i], q[m].len);
+                      profile_rmi(profiling::EventKind::rmi_recv, q[m].func, src, q[m].len, start);
+#else
+                      q[m].func(recv_buf[q[m].i], q[m].len);
+#endif // MADNESS_TASK_PROFILING
+                  }
                   post_recv_buf(q[m].i);
                 }
                 else {
@@ -174,20 +233,114 @@ namespace madness {
             ThreadPool::instance()->flush_prebuf();
 #endif
             clear_send_req();
+            clear_batch_req();
+        }
+
+        adapt_recv_bufs(inuse);
+    }
+
+    void RMI::RmiTask::batch_handler(void *buf, size_t nbyte) {
+        char* p = static_cast<char*>(buf) + HEADER_LEN;
+        const char* end = static_cast<char*>(buf) + nbyte;
+        uint64_t nmsg = 0;
+        while (p < end) {
+            const size_t len = *reinterpret_cast<const size_t*>(p);
+            void* msg = p + HEADER_LEN;
+            const header* h = static_cast<const header*>(msg);
+            rmi_handlerT func = archive::to_abs_fn_ptr<rmi_handlerT>(h->func);
+            RuntimeProfileSample sample(RuntimeProfileKind::rmi, profile_id(func));
+            func(msg, len);
+            p += HEADER_LEN + ((len + ALIGNMENT - 1)/ALIGNMENT)*ALIGNMENT;
+            ++nmsg;
+        }
+        ++(RMI::stats.nbatch_recv);
+        RMI::stats.nmsg_batched_recv += nmsg;
+    }
+
+    void RMI::RmiTask::aggregate(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr) {
+        const size_t reclen = HEADER_LEN + ((nbyte + ALIGNMENT - 1)/ALIGNMENT)*ALIGNMENT;
+        Batch& b = batches[dest];
+        ScopedMutex<Spinlock> guard(b);
+        if (b.buf && b.nbyte + reclen > aggregate_len_)
+            send_batch(b, dest);
+        if (!b.buf) {
+            b.buf = static_cast<char*>(PoolAllocator::allocate(aggregate_len_));
+            b.nbyte = HEADER_LEN;
+            b.nmsg = 0;
+            b.start = wall_time();
+            ++nbatch_open;
+        }
+
+        char* rec = b.buf + b.nbyte;
+        *reinterpret_cast<size_t*>(rec) = nbyte;
+        header* h = reinterpret_cast<header*>(rec + HEADER_LEN);
+        memcpy(h, buf, nbyte);
+        h->func = archive::to_rel_fn_ptr(func);
+        h->attr = attr;
+        b.nbyte += reclen;
+        ++b.nmsg;
+    }
+
+    void RMI::RmiTask::send_batch(Batch& b, ProcessID dest) {
+        if (!b.buf) return;
+        Request req = send_now(b.buf, b.nbyte, dest, batch_handler, ATTR_ORDERED, b.nmsg);
+        {
+            ScopedMutex<Spinlock> guard(batch_req_mutex);
+            batch_req.emplace_back(b.buf, req);
         }
+        b.buf = nullptr;
+        --nbatch_open;
+    }
+
+    void RMI::RmiTask::flush(bool expired_only) {
+        if (!nbatch_open) return;
+        const double now = expired_only ? wall_time() : 0.0;
+        for (ProcessID dest=0; dest<nproc; ++dest) {
+            Batch& b = batches[dest];
+            if (expired_only) {
+                // The server must not wait on a sender that is filling the batch
+                if (!b.try_lock()) continue;
+                if (b.buf && (now - b.start) >= aggregate_timeout_)
+                    send_batch(b, dest);
+                b.unlock();
+            }
+            else {
+                ScopedMutex<Spinlock> guard(b);
+                send_batch(b, dest);
+            }
+        }
+    }
+
+    void RMI::RmiTask::clear_batch_req() {
+        if (!batch_req_mutex.try_lock()) return;
+        auto it = batch_req.begin();
+        while (it != batch_req.end()) {
+            if (it->second.Test()) {
+                PoolAllocator::deallocate(it->first, aggregate_len_);
+                it = batch_req.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        batch_req_mutex.unlock();
     }
 
     void RMI::RmiTask::post_pending_huge_msg() {
-        if (recv_buf[nrecv_]) return;      // Message already pending
-        if (!hugeq.empty()) {
+        // Post a receive for each waiting huge message that finds a free slot
+        for (std::size_t i = nrecv_max_; i < maxq_ && !hugeq.empty(); ++i) {
+            if (recv_buf[i]) continue;      // Message already pending in this slot
             const auto& hugemsg = hugeq.front();
             const int src = std::get<0>(hugemsg);
             const size_t nbyte = std::get<1>(hugemsg);
             const int tag = std::get<2>(hugemsg);
             hugeq.pop_front();
-            if (posix_memalign(&recv_buf[nrecv_], ALIGNMENT, nbyte))
+            if (posix_memalign(&recv_buf[i], ALIGNMENT, nbyte))
                 MADNESS_EXCEPTION("RMI: failed allocating huge message", 1);
-            recv_req[nrecv_] = comm.Irecv(recv_buf[nrecv_], nbyte, MPI_BYTE, src, tag);
+            recv_len[i] = nbyte;
+            MemoryAccounting::add(MemoryCategory::rmi, nbyte);
+            recv_req[i] = comm.Irecv(recv_buf[i], nbyte, MPI_BYTE, src, tag);
+            ++(RMI::stats.nrendezvous_recv);
             int nada=0;
             // make unique tags to ensure that ack msgs do not collide with normal recv msgs
 #ifdef MADNESS_USE_BSEND_ACKS
@@ -202,8 +355,16 @@ namespace madness {
         if (i < (int)nrecv_) {
             recv_req[i] = comm.Irecv(recv_buf[i], max_msg_len_, MPI_BYTE, MPI_ANY_SOURCE, SafeMPI::RMI_TAG);
         }
-        else if (i == (int)nrecv_) {
+        else if (i < (int)nrecv_max_) {
+            // The pool has shrunk below this slot ... retire it
+            free(recv_buf[i]);
+            MemoryAccounting::sub(MemoryCategory::rmi, recv_len[i]);
+            recv_buf[i] = 0;
+            --(RMI::stats.nrecv_posted);
+        }
+        else if (i < (int)maxq_) {
             free(recv_buf[i]);
+            MemoryAccounting::sub(MemoryCategory::rmi, recv_len[i]);
             recv_buf[i] = 0;
             post_pending_huge_msg();
         }
@@ -212,6 +373,62 @@ namespace madness {
         }
     }
 
+    void RMI::RmiTask::adapt_recv_bufs(std::size_t inuse) {
+        RMI::stats.max_recv_in_use = std::max(RMI::stats.max_recv_in_use, uint64_t(inuse));
+        RMI::stats.max_q = std::max(RMI::stats.max_q, uint64_t(n_in_q));
+        nrecv_hwm_ = std::max(nrecv_hwm_, inuse);
+
+        // Grow at once if a burst of messages occupied most of the buffers
+        if (4*inuse >= 3*nrecv_ && nrecv_ < nrecv_max_) {
+            resize_recv_bufs(2*nrecv_);
+            return;
+        }
+
+        // Shrink if fewer than a quarter of the buffers were in use for a whole window
+        const double now = wall_time();
+        if (now - nrecv_window_start_ >= recv_window) {
+            if (4*nrecv_hwm_ < nrecv_ && nrecv_ > nrecv_min_)
+                resize_recv_bufs(std::max(nrecv_/2, 2*nrecv_hwm_));
+            nrecv_hwm_ = 0;
+            nrecv_window_start_ = now;
+        }
+    }
+
+    void RMI::RmiTask::resize_recv_bufs(std::size_t n) {
+        n = std::min(std::max(n, nrecv_min_), nrecv_max_);
+        if (n == nrecv_) return;
+        if (RMI::debugging)
+            print_error(rank, ":RMI: resizing recv buffer pool from ", nrecv_, " to ", n, "\n");
+
+        if (n > nrecv_) {
+            for (std::size_t i = nrecv_; i < n; ++i) {
+                if (recv_buf[i]) continue; // Not retired yet ... is reposted once processed or cancelled
+                if (posix_memalign(&recv_buf[i], ALIGNMENT, max_msg_len_))
+                    MADNESS_EXCEPTION("RMI: failed allocating aligned recv buffer", 1);
+                recv_len[i] = max_msg_len_;
+                MemoryAccounting::add(MemoryCategory::rmi, max_msg_len_);
+                ++(RMI::stats.nrecv_posted);
+                recv_req[i] = comm.Irecv(recv_buf[i], max_msg_len_, MPI_BYTE, MPI_ANY_SOURCE, SafeMPI::RMI_TAG);
+            }
+            ++(RMI::stats.nrecv_grow);
+        }
+        else {
+            // Cancel the receives of the buffers beyond n that wait for a
+            // message; each is freed by post_recv_buf once its cancellation
+            // completes (or its message, if one arrived first, is handled).
+            // The buffers holding queued messages are retired the same way.
+            for (std::size_t i = n; i < nrecv_; ++i) {
+                if (recv_buf[i] && !recv_cancelled[i] && MPI_Request(recv_req[i]) != MPI_REQUEST_NULL) {
+                    recv_req[i].Cancel();
+                    recv_cancelled[i] = true;
+                }
+            }
+            ++(RMI::stats.nrecv_shrink);
+        }
+        nrecv_ = n;
+        RMI::stats.max_nrecv_posted = std::max(RMI::stats.max_nrecv_posted, RMI::stats.nrecv_posted);
+    }
+
     RMI::RmiTask::~RmiTask() {
         //         if (!SafeMPI::Is_finalized()) {
         //             for (int i=0; i<nrecv_; ++i) {
@@ -233,13 +450,26 @@ namespace madness {
             , recv_counters(new counterT[nproc])
             , max_msg_len_(DEFAULT_MAX_MSG_LEN)
             , nrecv_(DEFAULT_NRECV)
-            , maxq_(DEFAULT_NRECV + 1)
+            , nrecv_min_(32)
+            , nrecv_max_(2*DEFAULT_NRECV)
+            , nrecv_hwm_(0)
+            , nrecv_window_start_(wall_time())
+            , nrendezvous_(DEFAULT_NRENDEZVOUS)
+            , rendezvous_threshold_(DEFAULT_MAX_MSG_LEN)
+            , maxq_(2*DEFAULT_NRECV + DEFAULT_NRENDEZVOUS)
             , recv_buf()
             , recv_req()
             , status()
             , ind()
             , q()
             , n_in_q(0)
+            , aggregate_(false)
+            , aggregate_len_(64*1024)
+            , aggregate_timeout_(100e-6)
+            , batches(new Batch[nproc])
+            , nbatch_open(0)
+            , pending(new std::list<Pending>[nproc])
+            , npending(0)
     {
         // Get the maximum buffer size from the MAD_BUFFER_SIZE environment
         // variable.
@@ -277,7 +507,43 @@ namespace madness {
                     "!!! WARNING: Increasing MAD_RECV_BUFFERS to ", nrecv_,
                     ".\n");
             }
-            maxq_ = nrecv_ + 1;
+        }
+
+        // Get the number of concurrent rendezvous receives from the
+        // MAD_RENDEZVOUS_BUFFERS environment variable.
+        const char* mad_rendezvous_buffs = getenv("MAD_RENDEZVOUS_BUFFERS");
+        if(mad_rendezvous_buffs) {
+            std::stringstream ss(mad_rendezvous_buffs);
+            ss >> nrendezvous_;
+            if(nrendezvous_ < 1) nrendezvous_ = 1;
+        }
+
+        // Get the bounds on the number of receive buffers from the
+        // MAD_RECV_BUFFERS_MIN and MAD_RECV_BUFFERS_MAX environment variables;
+        // the pool adapts to the traffic between them.
+        nrecv_max_ = 2*nrecv_;
+        const char* mad_recv_buffs_min = getenv("MAD_RECV_BUFFERS_MIN");
+        if(mad_recv_buffs_min) {
+            std::stringstream ss(mad_recv_buffs_min);
+            ss >> nrecv_min_;
+            nrecv_min_ = std::max(nrecv_min_, std::size_t(32));
+        }
+        const char* mad_recv_buffs_max = getenv("MAD_RECV_BUFFERS_MAX");
+        if(mad_recv_buffs_max) {
+            std::stringstream ss(mad_recv_buffs_max);
+            ss >> nrecv_max_;
+        }
+        nrecv_max_ = std::min(std::max(nrecv_max_, nrecv_min_), (std::size_t(1)<<14) - nrendezvous_);
+        nrecv_ = std::min(std::max(nrecv_, nrecv_min_), nrecv_max_);
+        maxq_ = nrecv_max_ + nrendezvous_;
+
+        // Get the rendezvous threshold from the MAD_RENDEZVOUS_THRESHOLD
+        // environment variable; it cannot exceed the size of the recv buffers.
+        rendezvous_threshold_ = max_msg_len_;
+        const char* mad_rendezvous_threshold = getenv("MAD_RENDEZVOUS_THRESHOLD");
+        if(mad_rendezvous_threshold) {
+            rendezvous_threshold_ = std::max(std::min(cstr_to_memory_size(mad_rendezvous_threshold),
+                                                      max_msg_len_), std::size_t(1024));
         }
 
         // Get environment variable controlling use of synchronous send (MAD_NSSEND)
@@ -294,9 +560,38 @@ namespace madness {
             }
         }
 
+        // Get the aggregation of small messages from the MAD_RMI_AGGREGATE
+        // (on/off or batch size) and MAD_RMI_AGGREGATE_US (timeout) environment variables
+        const char* mad_rmi_aggregate = getenv("MAD_RMI_AGGREGATE");
+        if (mad_rmi_aggregate) {
+            const std::string value(mad_rmi_aggregate);
+            if (value == "on" || value == "ON" || value == "1") {
+                aggregate_ = true;
+            }
+            else if (!(value == "off" || value == "OFF" || value == "0")) {
+                aggregate_len_ = cstr_to_memory_size(mad_rmi_aggregate);
+                aggregate_ = true;
+            }
+        }
+        // A batch must never take the rendezvous path, which holds it back
+        // until the destination acknowledges
+        aggregate_len_ = std::max(std::min(aggregate_len_, rendezvous_threshold_), std::size_t(1024));
+        aggregate_len_ -= aggregate_len_ % ALIGNMENT;
+        aggregate_max_msg_ = std::min(aggregate_len_/16, rendezvous_threshold_);
+        const char* mad_rmi_aggregate_us = getenv("MAD_RMI_AGGREGATE_US");
+        if (mad_rmi_aggregate_us) {
+            std::stringstream ss(mad_rmi_aggregate_us);
+            double us;
+            ss >> us;
+            aggregate_timeout_ = std::max(us, 0.0)*1e-6;
+        }
+
         // Allocate memory for receive buffer and requests
         recv_buf.reset(new void*[maxq_]);
-        recv_req.reset(new Request[maxq_]);
+        recv_len.reset(new std::size_t[maxq_]);
+        recv_req.reset(new SafeMPI::Request[maxq_]);
+        recv_cancelled.reset(new bool[maxq_]);
+        std::fill_n(recv_cancelled.get(), maxq_, false);
 
         // Initialize the send/recv counts
         std::fill_n(send_counters.get(), nproc, 0);
@@ -315,9 +610,13 @@ namespace madness {
             for(int i = 0; i < (int)nrecv_; ++i) {
                 if(posix_memalign(&recv_buf[i], ALIGNMENT, max_msg_len_))
                     MADNESS_EXCEPTION("RMI:initialize:failed allocating aligned recv buffer", 1);
+                recv_len[i] = max_msg_len_;
+                MemoryAccounting::add(MemoryCategory::rmi, max_msg_len_);
                 post_recv_buf(i);
             }
-            recv_buf[nrecv_] = 0;
+            RMI::stats.nrecv_posted = RMI::stats.max_nrecv_posted = nrecv_;
+            for(std::size_t i = nrecv_; i < maxq_; ++i)
+                recv_buf[i] = 0;
         }
     }
 
@@ -413,87 +712,140 @@ namespace madness {
     }
 
     RMI::Request
-    RMI::RmiTask::RmiTask::isend(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr) {
-
-        MADNESS_ASSERT(nbyte <= std::numeric_limits<int>::max());
+    RMI::RmiTask::isend(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr) {
+#ifdef MADNESS_TASK_PROFILING
+        const double start = wall_time();
+        struct Profile {
+            rmi_handlerT func; ProcessID dest; size_t nbyte; double start;
+            ~Profile() { profile_rmi(profiling::EventKind::rmi_send, func, dest, nbyte, start); }
+        } profile{func, dest, nbyte, start};
+#endif // MADNESS_TASK_PROFILING
+        if (aggregate_) {
+            if (nbyte >= HEADER_LEN && nbyte <= aggregate_max_msg_) {
+                // The message was copied so the caller may reuse buf at once
+                aggregate(buf, nbyte, dest, func, attr);
+                return Request();
+            }
 
-        int tag = SafeMPI::RMI_TAG;
-        static std::size_t numsent = 0; // for tracking synchronous sends
+            // Preserve order with messages already waiting in the batch
+            ScopedMutex<Spinlock> guard(batches[dest]);
+            send_batch(batches[dest], dest);
+        }
+        return send_now(buf, nbyte, dest, func, attr);
+    }
 
-        if (nbyte > max_msg_len_) {
-            // Huge message protocol ... send message to dest indicating size and origin of huge message.
-            // Remote end posts a buffer then acks the request.  This end can then send.
-            const int nword = HEADER_LEN/sizeof(size_t);
-            size_t info[nword+3];
-            info[nword  ] = rank;
-            info[nword+1] = nbyte;
-            tag = unique_tag();
-            info[nword+2] = tag;
-
-            int ack;
-            // make unique tags to ensure that ack msgs do not collide with normal recv msgs
-            Request req_ack = comm.Irecv(&ack, sizeof(ack), MPI_BYTE, dest, tag + unique_tag_period());
-            Request req_send = isend(info, sizeof(info), dest, RMI::RmiTask::huge_msg_handler, ATTR_UNORDERED);
+    RMI::Request
+    RMI::RmiTask::send_now(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr, int nbatched) {
 
-            MutexWaiter waiter;
-            while (!req_send.Test()) waiter.wait();
-            waiter.reset();
-            while (!req_ack.Test()) waiter.wait();
-        }
-        else if (nbyte < HEADER_LEN) {
+        MADNESS_ASSERT(nbyte <= std::numeric_limits<int>::max());
+        if (nbyte < HEADER_LEN)
             MADNESS_EXCEPTION("RMI::isend --- your buffer is too small to hold the header", static_cast<int>(nbyte));
+
+        header* h = (header*)(buf);
+        h->func = archive::to_rel_fn_ptr(func);
+
+        // Since most uses are ordered and we need the mutex to accumulate stats
+        // we presently always get the lock
+        ScopedMutex<Mutex> guard(this);
+
+        // Huge message (rendezvous) protocol ... the message waits until dest
+        // has posted a buffer for it, and ordered messages sent after it to
+        // dest wait behind it so that they do not overtake it.  The server
+        // thread sends them (see progress_pending) so that no thread, in
+        // particular the server itself, blocks on the destination.
+        const bool huge = (nbyte > rendezvous_threshold_);
+        std::list<Pending>& waiting = pending[dest];
+        if (huge || (is_ordered(attr) && !waiting.empty())) {
+            waiting.emplace_back(buf, nbyte, attr, nbatched, huge);
+            ++npending;
+            if (huge && waiting.size() == 1) announce(dest, waiting.front());
+            return Request(waiting.back().state);
         }
 
+        return post(buf, nbyte, dest, attr, nbatched, SafeMPI::RMI_TAG);
+    }
+
+    SafeMPI::Request
+    RMI::RmiTask::post(const void* buf, size_t nbyte, ProcessID dest, attrT attr, int nbatched, int tag) {
+        static std::size_t numsent = 0; // for tracking synchronous sends
+
         if (RMI::debugging)
           print_error(rank, ":RMI: sending buf=", buf, " nbyte=", nbyte,
-                      " dest=", dest, " func=", func,
+                      " dest=", dest,
                       " ordered=", is_ordered(attr),
                       " count=", int(send_counters[dest]), "\n");
 
-        // Since most uses are ordered and we need the mutex to accumulate stats
-        // we presently always get the lock
-        lock();
-
         // If ordering need the mutex to enclose sending the message
         // otherwise there is a livelock scenario due to a starved thread
         // holding an early counter.
         if (is_ordered(attr)) {
-            //lock();
             attr |= ((send_counters[dest]++)<<16);
         }
 
         header* h = (header*)(buf);
-        h->func = archive::to_rel_fn_ptr(func);
         h->attr = attr;
 
         ++(RMI::stats.nmsg_sent);
         RMI::stats.nbyte_sent += nbyte;
-
+        if (nbatched) {
+            ++(RMI::stats.nbatch_sent);
+            RMI::stats.nmsg_batched += nbatched;
+            RMI::stats.max_msg_per_batch = std::max(RMI::stats.max_msg_per_batch, uint64_t(nbatched));
+        }
 
         numsent++;
-        Request result;
         if (nssend_ && numsent==std::size_t(nssend_)) {
-            result = comm.Issend(buf, nbyte, MPI_BYTE, dest, tag);
             numsent %= nssend_;
+            return comm.Issend(buf, nbyte, MPI_BYTE, dest, tag);
         }
-        else {
-            result = comm.Isend(buf, nbyte, MPI_BYTE, dest, tag);
-        }
+        return comm.Isend(buf, nbyte, MPI_BYTE, dest, tag);
+    }
 
-        unlock();
+    void RMI::RmiTask::announce(ProcessID dest, Pending& p) {
+        // Send message to dest indicating size and origin of huge message.
+        // Remote end posts a buffer then acks the request.  This end can then send
+        // directly from buf into the remote buffer.
+        const int nword = HEADER_LEN/sizeof(size_t);
+        p.tag = unique_tag();
+        p.info[nword  ] = rank;
+        p.info[nword+1] = p.nbyte;
+        p.info[nword+2] = p.tag;
+
+        // make unique tags to ensure that ack msgs do not collide with normal recv msgs
+        p.req_ack = comm.Irecv(&p.ack, sizeof(p.ack), MPI_BYTE, dest, p.tag + unique_tag_period());
+        header* h = (header*)(p.info);
+        h->func = archive::to_rel_fn_ptr(&RMI::RmiTask::huge_msg_handler);
+        p.req_info = post(p.info, sizeof(p.info), dest, ATTR_UNORDERED, 0, SafeMPI::RMI_TAG);
+        p.announced = true;
+    }
 
-        return result;
+    void RMI::RmiTask::progress_pending() {
+        ScopedMutex<Mutex> guard(this);
+        for (ProcessID dest=0; dest<nproc && npending; ++dest) {
+            std::list<Pending>& waiting = pending[dest];
+            while (!waiting.empty()) {
+                Pending& p = waiting.front();
+                if (p.huge) {
+                    if (!p.announced) announce(dest, p);
+                    if (!(p.req_info.Test() && p.req_ack.Test())) break;
+                    p.state->req = post(p.buf, p.nbyte, dest, p.attr, p.nbatched, p.tag);
+                    ++(RMI::stats.nrendezvous_sent);
+                }
+                else {
+                    p.state->req = post(p.buf, p.nbyte, dest, p.attr, p.nbatched, SafeMPI::RMI_TAG);
+                }
+                p.state->started.store(true, std::memory_order_release);
+                waiting.pop_front();
+                --npending;
+            }
+        }
     }
 
     int RMI::RmiTask::unique_tag() const {
         constexpr int first_tag = 4096;
         static int tag = first_tag;
-        /// should be able to do this with atomics
-        lock();
         tag = (tag == first_tag+unique_tag_period()-1) ? first_tag : tag + 1;
-        const int result = tag;
-        unlock();
-        return result;
+        return tag;
     }
 
   int RMI::testsome_backoff_us = 2;
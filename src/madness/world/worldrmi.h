@@ -41,6 +41,7 @@
 #include <list>
 #include <memory>
 #include <tuple>
+#include <atomic>
 #include <pthread.h>
 #include <madness/world/print.h>
 
@@ -75,8 +76,9 @@
   RMI::Request RMI::isend(const void* buf, size_t nbyte, int dest,
                           rmi_handlerT func, unsigned int attr=0)
   - to send an asynchronous message
-  - RMI::Request has the same interface as SafeMPI::Request
-  (right now it is a SafeMPI::Request but this is not guaranteed)
+  - RMI::Request::Test() returns true once buf may be reused; a
+  message may wait behind a rendezvous to the same destination before
+  it is handed to MPI, so this is not always a SafeMPI::Request
 
   void RMI::begin()
   - to start the server thread
@@ -150,9 +152,25 @@ namespace madness {
         uint64_t nmsg_recv;
         uint64_t nbyte_recv;
         uint64_t max_serv_send_q;
+        uint64_t nbatch_sent;       // No. of aggregated batches sent (each also counts once in nmsg_sent)
+        uint64_t nmsg_batched;      // No. of messages sent inside batches
+        uint64_t max_msg_per_batch; // Largest no. of messages in one batch
+        uint64_t nbatch_recv;       // No. of aggregated batches received
+        uint64_t nmsg_batched_recv; // No. of messages received inside batches
+        uint64_t nrendezvous_sent;  // No. of messages sent with the rendezvous protocol
+        uint64_t nrendezvous_recv;  // No. of messages received with the rendezvous protocol
+        uint64_t nrecv_posted;      // No. of recv buffers currently allocated
+        uint64_t max_nrecv_posted;  // High-water mark of nrecv_posted
+        uint64_t max_recv_in_use;   // Most recv buffers holding unprocessed messages at once
+        uint64_t max_q;             // Longest out-of-order message q
+        uint64_t nrecv_grow;        // No. of times the recv buffer pool grew
+        uint64_t nrecv_shrink;      // No. of times the recv buffer pool shrank
 
         RMIStats()
-            : nmsg_sent(0), nbyte_sent(0), nmsg_recv(0), nbyte_recv(0), max_serv_send_q(0) {}
+            : nmsg_sent(0), nbyte_sent(0), nmsg_recv(0), nbyte_recv(0), max_serv_send_q(0)
+            , nbatch_sent(0), nmsg_batched(0), max_msg_per_batch(0), nbatch_recv(0), nmsg_batched_recv(0)
+            , nrendezvous_sent(0), nrendezvous_recv(0), nrecv_posted(0), max_nrecv_posted(0)
+            , max_recv_in_use(0), max_q(0), nrecv_grow(0), nrecv_shrink(0) {}
     };
 
     /// This for RMI server thread to manage lifetime of WorldAM messages that it is sending
@@ -171,7 +189,39 @@ namespace madness {
 
     public:
 
-        typedef SafeMPI::Request Request;
+        /// Status of a message sent by isend()
+
+        /// A message that waits for a rendezvous to the same destination
+        /// is only handed to MPI by the server thread once that completes;
+        /// until then Test() returns false.
+        class Request {
+        public:
+            /// Filled in by the server thread when a waiting message is sent
+            struct Deferred {
+                std::atomic<bool> started{false};
+                SafeMPI::Request req;
+            };
+
+            Request() = default;
+
+            Request(const SafeMPI::Request& req) : req_(req) {}
+
+            explicit Request(const std::shared_ptr<Deferred>& deferred) : deferred_(deferred) {}
+
+            /// @return true if the message has been sent and its buffer may be reused
+            bool Test() {
+                if (deferred_) {
+                    if (!deferred_->started.load(std::memory_order_acquire)) return false;
+                    req_ = deferred_->req;
+                    deferred_.reset();
+                }
+                return req_.Test();
+            }
+
+        private:
+            SafeMPI::Request req_;
+            std::shared_ptr<Deferred> deferred_;
+        }; // class Request
 
         // Choose header length to hold at least sizeof(header) and
         // also to ensure good alignment of the user payload.
@@ -216,7 +266,44 @@ namespace madness {
                 attrT attr;
             }; // struct header
 
-            /// q of huge messages, each msg = {source,nbytes,tag}
+            /// Small messages to one destination waiting to be sent as one MPI message
+
+            /// The buffer holds a header (for batch_handler) followed by one
+            /// record per message: HEADER_LEN bytes holding the message length,
+            /// then the message itself padded to ALIGNMENT.
+            struct Batch : public Spinlock {
+                char* buf = nullptr;    // Pooled buffer of aggregate_len_ bytes, null if the batch is empty
+                std::size_t nbyte = 0;  // Bytes used, including the header
+                int nmsg = 0;           // No. of messages in the batch
+                double start = 0.0;     // Time at which the first message was added
+            }; // struct Batch
+
+            /// A message to one destination waiting for a rendezvous to complete
+
+            /// Huge messages and the ordered messages sent after them to the
+            /// same destination wait in a list, so that the server thread
+            /// never blocks on a rendezvous and each message still gets its
+            /// order counter when it goes on the wire. Only the huge message
+            /// at the front of a list is announced to the destination.
+            struct Pending {
+                const void* buf;
+                std::size_t nbyte;
+                attrT attr;
+                int nbatched;
+                bool huge;
+                std::shared_ptr<Request::Deferred> state = std::make_shared<Request::Deferred>();
+                // Rendezvous of a huge message, set once announced
+                bool announced = false;
+                int tag = 0;
+                int ack = 0;
+                SafeMPI::Request req_ack, req_info;
+                std::size_t info[HEADER_LEN/sizeof(std::size_t)+3];
+
+                Pending(const void* buf, std::size_t nbyte, attrT attr, int nbatched, bool huge)
+                    : buf(buf), nbyte(nbyte), attr(attr), nbatched(nbatched), huge(huge) {}
+            }; // struct Pending
+
+            /// q of huge (rendezvous) messages waiting for a slot, each msg = {source,nbytes,tag}
             std::list< std::tuple<int,size_t,int> > hugeq;
 
             SafeMPI::Intracomm comm;
@@ -226,17 +313,39 @@ namespace madness {
             std::unique_ptr<counterT[]> send_counters; // used to be volatile but no need
             std::unique_ptr<counterT[]> recv_counters;
             std::size_t max_msg_len_;
-            std::size_t nrecv_;
+            std::size_t nrecv_;         // No. of recv buffers to keep posted, adapts within [nrecv_min_,nrecv_max_]
+            std::size_t nrecv_min_;
+            std::size_t nrecv_max_;     // Recv buffers use slots [0,nrecv_max_), huge messages the ones after
+            std::size_t nrecv_hwm_;     // Most recv buffers in use at once in the current window
+            double nrecv_window_start_; // Start time of the current window
+            std::size_t nrendezvous_;   // No. of huge messages that can be received concurrently
+            std::size_t rendezvous_threshold_; // Messages larger than this use the rendezvous protocol
             long nssend_;
             std::size_t maxq_;
-            std::unique_ptr<void*[]> recv_buf; // Will be at least ALIGNMENT aligned ... +1 for huge messages
+            std::unique_ptr<void*[]> recv_buf; // Will be at least ALIGNMENT aligned ... +nrendezvous_ for huge messages, 0 if retired
+            std::unique_ptr<std::size_t[]> recv_len; // Size of each allocated recv buffer (for MemoryAccounting)
             std::unique_ptr<SafeMPI::Request[]> recv_req;
+            std::unique_ptr<bool[]> recv_cancelled; // True while the receive of a surplus buffer is being cancelled
 
             std::unique_ptr<SafeMPI::Status[]> status;
             std::unique_ptr<int[]> ind;
             std::unique_ptr<qmsg[]> q;
             int n_in_q;
 
+            std::atomic<bool> aggregate_;      // True if small messages are aggregated
+            std::size_t aggregate_len_;        // Size of batch buffers, in bytes
+            std::size_t aggregate_max_msg_;    // Largest message that is aggregated, in bytes
+            double aggregate_timeout_;         // A batch is flushed this long (s) after its first message
+            std::unique_ptr<Batch[]> batches;  // One per destination
+            std::atomic<int> nbatch_open;      // No. of non-empty batches
+            Spinlock batch_req_mutex;          // Protects batch_req
+            std::list< std::pair<void*,Request> > batch_req; // Batches being sent
+            std::unique_ptr<std::list<Pending>[]> pending; // One per destination, protected by the RmiTask mutex
+            std::atomic<int> npending;         // No. of messages waiting in pending
+#ifdef MADNESS_TASK_PROFILING
+            profiling::TaskProfiler profiler;  // Records messages handled by the server thread
+#endif // MADNESS_TASK_PROFILING
+
             static inline bool is_ordered(attrT attr) { return attr & ATTR_ORDERED; }
 
             void process_some();
@@ -251,9 +360,15 @@ namespace madness {
   	        ::madness::binder.bind();
                 set_rmi_task_is_running(true);
                 RMI::set_this_thread_is_server(true);
+#ifdef MADNESS_TASK_PROFILING
+                profiler.make_current(ThreadPool::size() + 1);
+#endif // MADNESS_TASK_PROFILING
 
                 while (! finished) process_some();
 
+#ifdef MADNESS_TASK_PROFILING
+                profiler.write_to_file();
+#endif // MADNESS_TASK_PROFILING
                 RMI::set_this_thread_is_server(false);
                 set_rmi_task_is_running(false);
 
@@ -264,8 +379,14 @@ namespace madness {
             void run() {
   	        ::madness::binder.bind();
                 RMI::set_this_thread_is_server(true);
+#ifdef MADNESS_TASK_PROFILING
+                profiler.make_current(ThreadPool::size() + 1);
+#endif // MADNESS_TASK_PROFILING
                 try {
                     while (! finished) process_some();
+#ifdef MADNESS_TASK_PROFILING
+                    profiler.write_to_file();
+#endif // MADNESS_TASK_PROFILING
                     finished = false;
                 } catch(...) {
                     delete this;
@@ -280,6 +401,17 @@ namespace madness {
                 if (debugging)
                   print_error(rank, ":RMI: sending exit request to server thread\n");
 
+                // Send any aggregated messages and let the server complete them
+                // and the rendezvous still waiting
+                flush(false);
+                while (true) {
+                    if (!npending) {
+                        ScopedMutex<Spinlock> guard(batch_req_mutex);
+                        if (batch_req.empty()) break;
+                    }
+                    myusleep(1000);
+                }
+
                 // Set finished flag
                 finished = true;
                 while(finished)
@@ -288,15 +420,60 @@ namespace madness {
 
             static void huge_msg_handler(void *buf, size_t nbytein);
 
+            /// Invokes the handlers of all messages in an aggregated batch
+            static void batch_handler(void *buf, size_t nbyte);
+
             Request isend(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr);
 
+            /// Sends a message as its own MPI message (\c nbatched>0 if it is a batch)
+
+            /// Huge messages, and ordered messages that follow one to \c dest,
+            /// are queued for the server thread instead (see Pending).
+            Request send_now(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr,
+                             int nbatched = 0);
+
+            /// Assigns the order counter and hands a message to MPI (mutex must be held)
+            SafeMPI::Request post(const void* buf, size_t nbyte, ProcessID dest, attrT attr, int nbatched, int tag);
+
+            /// Announces a huge message to \c dest (mutex must be held)
+            void announce(ProcessID dest, Pending& p);
+
+            /// Sends the pending messages whose rendezvous has been acknowledged
+            void progress_pending();
+
+            /// Copies a small message into the batch for \c dest
+            void aggregate(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr);
+
+            /// Sends the batch for \c dest, if any, and empties it (batch must be locked)
+
+            /// The batch gets its order counter as it is put on the wire, which
+            /// must happen under the lock so that a later batch to \c dest
+            /// cannot overtake it. Batches are never larger than the rendezvous
+            /// threshold, so they only wait behind one already under way.
+            void send_batch(Batch& b, ProcessID dest);
+
+            /// Sends all non-empty batches, or only those older than the timeout
+            void flush(bool expired_only);
+
+            /// Frees the buffers of batches whose send has completed
+            void clear_batch_req();
+
             void post_pending_huge_msg();
 
             void post_recv_buf(int i);
 
+            /// Grows or shrinks the recv buffer pool from its use since the last call
+            void adapt_recv_bufs(std::size_t inuse);
+
+            /// Sets the number of recv buffers to keep posted (clamped to the bounds)
+
+            /// New buffers are posted at once; the receives of surplus ones are
+            /// cancelled and the buffers freed as that completes
+            void resize_recv_bufs(std::size_t n);
+
         private:
 
-            /// thread-safely round-robins through tags in [first_tag, first_tag+period) range
+            /// round-robins through tags in [first_tag, first_tag+period) range (mutex must be held)
             /// @returns new tag to be used in messaging
             int unique_tag() const;
             /// the period of tags returned by unique_tag()
@@ -312,6 +489,7 @@ namespace madness {
 
         static const size_t DEFAULT_MAX_MSG_LEN = 3*512*1024;  //!< the default size of recv buffers, in bytes; the actual size can be configured by the user via envvar MAD_BUFFER_SIZE
         static const int DEFAULT_NRECV = 128;  //!< the default # of recv buffers; the actual number can be configured by the user via envvar MAD_RECV_BUFFERS
+        static const int DEFAULT_NRENDEZVOUS = 8;  //!< the default # of concurrent rendezvous receives; the actual number can be configured by the user via envvar MAD_RENDEZVOUS_BUFFERS
 
         // Not allowed
         RMI(const RMI&);
@@ -335,14 +513,48 @@ namespace madness {
 
         /// Returns the number of recv buffers
 
-        /// @return The number of recv buffers
-        /// @note The default value is given by RMI::DEFAULT_NRECV, can be overridden at runtime by the user via environment variable MAD_RECV_BUFFERS
+        /// The server thread grows the pool when a burst of messages occupies
+        /// most of the buffers, and shrinks it when use stays low, within
+        /// [nrecv_min(),nrecv_max()]. The high-water marks are in RMIStats.
+        /// @return The number of recv buffers currently kept posted
+        /// @note The initial value is given by RMI::DEFAULT_NRECV, can be overridden at runtime by the user via environment variable MAD_RECV_BUFFERS
         /// @warning Cannot be smaller than 32.
         static std::size_t nrecv() {
             MADNESS_ASSERT(task_ptr);
             return task_ptr->nrecv_;
         }
 
+        /// Returns the least number of recv buffers
+
+        /// @note The default value is 32, can be overridden at runtime by the user via environment variable MAD_RECV_BUFFERS_MIN
+        static std::size_t nrecv_min() {
+            MADNESS_ASSERT(task_ptr);
+            return task_ptr->nrecv_min_;
+        }
+
+        /// Returns the largest number of recv buffers
+
+        /// @note The default value is twice the initial number, can be overridden at runtime by the user via environment variable MAD_RECV_BUFFERS_MAX
+        static std::size_t nrecv_max() {
+            MADNESS_ASSERT(task_ptr);
+            return task_ptr->nrecv_max_;
+        }
+
+        /// Returns the size above which messages are sent with the rendezvous protocol
+
+        /// Such a message is announced to the receiver, which posts a receive
+        /// directly into a buffer of the exact message size (handed to the
+        /// message handler without further copies) and acknowledges; the
+        /// sender then transfers the payload from the caller's buffer. Hence
+        /// the recv buffers need only hold messages up to this size.
+        /// @return The rendezvous threshold, in bytes
+        /// @note The default value is max_msg_len(), can be lowered at runtime by the user via environment variable MAD_RENDEZVOUS_THRESHOLD.
+        /// Up to RMI::DEFAULT_NRENDEZVOUS such messages are received concurrently (envvar MAD_RENDEZVOUS_BUFFERS).
+        static std::size_t rendezvous_threshold() {
+            MADNESS_ASSERT(task_ptr);
+            return task_ptr->rendezvous_threshold_;
+        }
+
         /// Send a remote method invocation (again you should probably be looking at worldam.h instead)
 
         /// @param[in] buf Pointer to the data buffer (do not modify until send is completed)
@@ -350,7 +562,7 @@ namespace madness {
         /// @param[in] dest Process to receive the message
         /// @param[in] func The function to handle the message on the remote end
         /// @param[in] attr Attributes of the message (ATTR_UNORDERED or ATTR_ORDERED)
-        /// @return The status as an RMI::Request that presently is a SafeMPI::Request
+        /// @return The status as an RMI::Request
         static Request
         isend(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, unsigned int attr=ATTR_UNORDERED) {
             if(!task_ptr) {
@@ -377,6 +589,35 @@ namespace madness {
             }
         }
 
+        /// Enables or disables aggregation of small messages
+
+        /// When enabled, messages of up to 1/16 of the batch size that are sent
+        /// to the same process are packed into one MPI message. A batch is sent
+        /// when it is full, when a larger message is sent to the same process,
+        /// shortly (\c MAD_RMI_AGGREGATE_US microseconds, default 100) after
+        /// its first message was added, or by \c flush() (which is called by
+        /// every fence). Ordering of messages from one thread is preserved.
+        /// Aggregation is off unless the \c MAD_RMI_AGGREGATE environment
+        /// variable is set to \c on or to the batch size (e.g. 64KB, the default).
+        /// The batch size is capped at the rendezvous threshold.
+        /// \note Disabling aggregation flushes all batches.
+        /// \note A no-op if the RMI server is not running (e.g. with one process).
+        static void set_aggregation(bool enable) {
+            if (!task_ptr) return;
+            task_ptr->aggregate_ = enable;
+            if (!enable) task_ptr->flush(false);
+        }
+
+        /// @return true if small messages are being aggregated
+        static bool get_aggregation() {
+            return task_ptr && task_ptr->aggregate_;
+        }
+
+        /// Sends all aggregated messages now
+        static void flush() {
+            if (task_ptr) task_ptr->flush(false);
+        }
+
         static void set_debug(bool status) { debugging = status; }
 
         static bool get_debug() { return debugging; }